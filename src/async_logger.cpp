@@ -0,0 +1,190 @@
+#include "async_logger.h"
+#include <algorithm>
+
+namespace {
+
+const char *kLevelNames[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+const int64_t kSecondNs = 1000000000LL;
+
+}  // namespace
+
+AsyncLogger &AsyncLogger::Instance() {
+  static AsyncLogger logger;
+  return logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : min_level_(LOG_INFO), rate_limit_(10), dropped_(0), suppressed_(0),
+      sink_(stderr), stop_(false) {
+  drainer_ = std::thread(&AsyncLogger::DrainLoop, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+  stop_ = true;
+  drainer_.join();
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Drain();
+  for (const auto &limit : limits_) {
+    if (limit.second.suppressed > 0) {
+      WriteSuppressed(limit.first, limit.second.suppressed);
+    }
+  }
+  fflush(sink_);
+}
+
+void AsyncLogger::StoreText(Record &record, Arg &arg, const char *value, size_t length) {
+  arg.type = Arg::TEXT;
+  arg.text_offset = record.text_used;
+  size_t room = kTextBytes - record.text_used;
+  if (room == 0) {
+    // no room left, the argument prints empty
+    arg.text_offset = kTextBytes - 1;
+    return;
+  }
+  length = std::min(length, room - 1);
+  memcpy(record.text + record.text_used, value, length);
+  record.text[record.text_used + length] = '\0';
+  record.text_used += length + 1;
+}
+
+AsyncLogger::Ring &AsyncLogger::ThreadRing() {
+  // the logger keeps the ring alive after its thread exits until drained,
+  // then Drain removes it
+  thread_local RingOwner owner;
+  if (!owner.ring) {
+    owner.ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.push_back(owner.ring);
+  }
+  return *owner.ring;
+}
+
+void AsyncLogger::Push(const Record &record) {
+  Ring &ring = ThreadRing();
+  size_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) >= kRingSize) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Record &slot = ring.records[head & (kRingSize - 1)];
+  // copy only the used part of the text
+  slot.format = record.format;
+  slot.time_ns = record.time_ns;
+  slot.level = record.level;
+  slot.num_args = record.num_args;
+  slot.text_used = record.text_used;
+  memcpy(slot.args, record.args, record.num_args * sizeof(Arg));
+  memcpy(slot.text, record.text, record.text_used);
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void AsyncLogger::DrainLoop() {
+  while (!stop_) {
+    size_t written;
+    {
+      std::lock_guard<std::mutex> lock(sink_mutex_);
+      written = Drain();
+      if (written > 0) {
+        fflush(sink_);
+      }
+    }
+    if (written == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+size_t AsyncLogger::Drain() {
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    drain_rings_ = rings_;
+  }
+  size_t written = 0;
+  bool released = false;
+  for (const std::shared_ptr<Ring> &ring : drain_rings_) {
+    // read before head, an orphaned ring gets no records after the flag
+    bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t head = ring->head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      Write(ring->records[tail & (kRingSize - 1)]);
+      ++written;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    released = released || orphaned;
+  }
+  if (released) {
+    // drop the drained rings of exited threads, their memory is freed with
+    // the last snapshot holding them
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                [](const std::shared_ptr<Ring> &ring) {
+                                  return ring->orphaned.load(std::memory_order_acquire) &&
+                                         ring->tail.load(std::memory_order_relaxed) ==
+                                             ring->head.load(std::memory_order_acquire);
+                                }),
+                 rings_.end());
+  }
+  return written;
+}
+
+void AsyncLogger::Write(const Record &record) {
+  Limit &limit = limits_[record.format];
+  if (limit.count == 0 || record.time_ns - limit.window_ns >= kSecondNs) {
+    if (limit.suppressed > 0) {
+      WriteSuppressed(record.format, limit.suppressed);
+    }
+    limit.window_ns = record.time_ns;
+    limit.count = 0;
+    limit.suppressed = 0;
+  }
+  if (++limit.count > rate_limit_) {
+    ++limit.suppressed;
+    ++suppressed_;
+    return;
+  }
+
+  char number[32];
+  snprintf(number, sizeof(number), "%.6f", record.time_ns / 1e9);
+  line_.assign(number);
+  line_ += " ";
+  line_ += kLevelNames[record.level];
+  line_ += " ";
+  int next = 0;
+  for (const char *c = record.format; *c != '\0'; ++c) {
+    if (c[0] == '{' && c[1] == '}' && next < record.num_args) {
+      const Arg &arg = record.args[next++];
+      if (arg.type == Arg::INTEGER) {
+        snprintf(number, sizeof(number), "%lld", arg.integer);
+        line_ += number;
+      } else if (arg.type == Arg::REAL) {
+        snprintf(number, sizeof(number), "%g", arg.real);
+        line_ += number;
+      } else {
+        line_ += record.text + arg.text_offset;
+      }
+      ++c;
+    } else {
+      line_ += *c;
+    }
+  }
+  line_ += '\n';
+  fputs(line_.c_str(), sink_);
+}
+
+void AsyncLogger::WriteSuppressed(const char *format, long long count) {
+  fprintf(sink_, "%lld messages like \"%s\" suppressed\n", count, format);
+}
+
+void AsyncLogger::Flush() {
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Drain();
+  fflush(sink_);
+}
+
+void AsyncLogger::SetSink(FILE *sink) {
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Drain();
+  fflush(sink_);
+  sink_ = sink;
+}
@@ -0,0 +1,215 @@
+#ifndef ASYNC_LOGGER_H_
+#define ASYNC_LOGGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum LogLevel {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARNING,
+  LOG_ERROR
+};
+
+/**
+ * AsyncLogger keeps formatting and I/O off the threads that log.
+ *
+ * Log copies the format pointer, a timestamp and the raw arguments into a
+ * fixed-size record in a ring buffer owned by the calling thread. Each ring
+ * has one producer and one consumer, so a push is two atomic operations and
+ * no lock. A background thread drains all rings every millisecond, replaces
+ * the "{}" placeholders of the format with the arguments and writes the
+ * lines to the sink. Messages from the same format beyond rate_limit_ per
+ * second are suppressed and counted in one summary line. A full ring drops
+ * the record rather than block the producer.
+ *
+ * Formats must be string literals, they are only read when drained.
+ * Arguments may be integers, floating point numbers and strings; strings
+ * are copied, up to kTextBytes in total per record.
+ */
+class AsyncLogger {
+ public:
+  static const int kMaxArgs = 6;
+  static const int kTextBytes = 96;
+  // records per thread ring, a power of two
+  static const size_t kRingSize = 4096;
+
+  /**
+   * Instance the process-wide logger, started on first use
+   */
+  static AsyncLogger &Instance();
+
+  virtual ~AsyncLogger();
+
+  /**
+   * Log queues a message
+   * @param level Severity, messages below min_level_ are discarded
+   * @param format String literal with one "{}" per argument
+   * @param args Arguments
+   */
+  template <typename... Args>
+  void Log(LogLevel level, const char *format, const Args &... args) {
+    if (level < min_level_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    Record record;
+    record.format = format;
+    record.level = level;
+    record.time_ns = NowNs();
+    record.num_args = 0;
+    record.text_used = 0;
+    Pack(record, args...);
+    Push(record);
+  }
+
+  /**
+   * Flush blocks until every record logged before the call is written
+   */
+  void Flush();
+
+  /**
+   * SetSink redirects the output, stderr by default
+   */
+  void SetSink(FILE *sink);
+
+  // lowest level written
+  std::atomic<int> min_level_;
+
+  // messages per format and second before the rest are suppressed
+  int rate_limit_;
+
+  // records dropped because a ring was full, and suppressed by the limit
+  std::atomic<long long> dropped_;
+  long long suppressed_;
+
+ private:
+  struct Arg {
+    enum Type { INTEGER, REAL, TEXT } type;
+    union {
+      long long integer;
+      double real;
+      int text_offset;
+    };
+  };
+
+  struct Record {
+    const char *format;
+    int64_t time_ns;
+    int level;
+    int num_args;
+    int text_used;
+    Arg args[kMaxArgs];
+    char text[kTextBytes];
+  };
+
+  // single producer, single consumer ring of records
+  struct Ring {
+    Record records[kRingSize];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    // set once the owning thread has exited, after its last record
+    std::atomic<bool> orphaned;
+    Ring() : head(0), tail(0), orphaned(false) {}
+  };
+
+  // thread local handle of a ring, marks it orphaned when the thread exits
+  struct RingOwner {
+    std::shared_ptr<Ring> ring;
+    ~RingOwner() {
+      if (ring) {
+        ring->orphaned.store(true, std::memory_order_release);
+      }
+    }
+  };
+
+  // suppression state of one format
+  struct Limit {
+    int64_t window_ns;
+    int count;
+    long long suppressed;
+  };
+
+  AsyncLogger();
+
+  // monotonic time; the coarse clock has millisecond resolution, enough for
+  // log lines, at a fraction of the cost of steady_clock
+  static int64_t NowNs() {
+#ifdef CLOCK_MONOTONIC_COARSE
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  void Pack(Record &) {}
+
+  template <typename T, typename... Rest>
+  void Pack(Record &record, const T &value, const Rest &... rest) {
+    if (record.num_args < kMaxArgs) {
+      Store(record, record.args[record.num_args++], value);
+    }
+    Pack(record, rest...);
+  }
+
+  template <typename T>
+  static void Store(Record &, Arg &arg, const T &value) {
+    StoreNumber(arg, value, std::is_floating_point<T>());
+  }
+  template <typename T>
+  static void StoreNumber(Arg &arg, const T &value, std::true_type) {
+    arg.type = Arg::REAL;
+    arg.real = value;
+  }
+  template <typename T>
+  static void StoreNumber(Arg &arg, const T &value, std::false_type) {
+    arg.type = Arg::INTEGER;
+    arg.integer = static_cast<long long>(value);
+  }
+  static void Store(Record &record, Arg &arg, const char *value) {
+    StoreText(record, arg, value, strlen(value));
+  }
+  static void Store(Record &record, Arg &arg, const std::string &value) {
+    StoreText(record, arg, value.data(), value.size());
+  }
+  static void StoreText(Record &record, Arg &arg, const char *value, size_t length);
+
+  void Push(const Record &record);
+  Ring &ThreadRing();
+  void DrainLoop();
+  // drains all rings, returns the number of records written
+  size_t Drain();
+  void Write(const Record &record);
+  void WriteSuppressed(const char *format, long long count);
+
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring> > rings_;
+
+  // state below is only touched by the drain thread, and by Flush and
+  // SetSink under sink_mutex_
+  std::mutex sink_mutex_;
+  FILE *sink_;
+  std::map<const char*, Limit> limits_;
+  std::string line_;
+  // snapshot of rings_ reused by every drain, so an idle drain allocates
+  // nothing
+  std::vector<std::shared_ptr<Ring> > drain_rings_;
+
+  std::atomic<bool> stop_;
+  std::thread drainer_;
+};
+
+#endif  // ASYNC_LOGGER_H_
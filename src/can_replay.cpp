@@ -0,0 +1,407 @@
+#include "can_replay.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fast_math.h"
+
+namespace {
+
+const uint32_t kIdMask = 0x1FFFFFFF;
+
+// value of a hex digit, -1 for other characters
+int HexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+}  // namespace
+
+bool CanDatabase::Parse(const std::string &text) {
+  std::istringstream lines(text);
+  std::string line;
+  CanMessage *message = nullptr;
+  while (std::getline(lines, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos) {
+      continue;
+    }
+    if (line.compare(start, 4, "BO_ ") == 0) {
+      unsigned long id;
+      char name[256];
+      int dlc;
+      if (sscanf(line.c_str() + start, "BO_ %lu %255[^: ] : %d", &id, name, &dlc) != 3) {
+        return false;
+      }
+      CanMessage parsed;
+      parsed.id = id & kIdMask;
+      parsed.name = name;
+      parsed.dlc = dlc;
+      messages_.push_back(parsed);
+      message = &messages_.back();
+    } else if (line.compare(start, 4, "SG_ ") == 0) {
+      size_t colon = line.find(':', start);
+      char name[256];
+      if (message == nullptr || colon == std::string::npos
+          || sscanf(line.c_str() + start, "SG_ %255s", name) != 1) {
+        return false;
+      }
+      CanSignal signal;
+      char order;
+      char sign;
+      signal.name = name;
+      // multiplexer indicators between the name and the colon are skipped
+      if (sscanf(line.c_str() + colon + 1, " %d|%d@%c%c (%lf,%lf)", &signal.start_bit,
+                 &signal.length, &order, &sign, &signal.factor, &signal.offset) != 6
+          || (order != '0' && order != '1') || (sign != '+' && sign != '-')) {
+        return false;
+      }
+      signal.big_endian = order == '0';
+      signal.is_signed = sign == '-';
+      message->signals.push_back(signal);
+    } else {
+      // a signal belongs to the BO_ line right above it
+      message = nullptr;
+    }
+  }
+  return true;
+}
+
+bool CanDatabase::Load(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  return Parse(text.str());
+}
+
+const CanMessage *CanDatabase::Find(uint32_t id) const {
+  for (const CanMessage &message : messages_) {
+    if (message.id == id) {
+      return &message;
+    }
+  }
+  return nullptr;
+}
+
+const CanSignal *CanDatabase::FindSignal(uint32_t id, const std::string &name) const {
+  const CanMessage *message = Find(id);
+  if (message == nullptr) {
+    return nullptr;
+  }
+  for (const CanSignal &signal : message->signals) {
+    if (signal.name == name) {
+      return &signal;
+    }
+  }
+  return nullptr;
+}
+
+CandumpReader::CandumpReader() : skipped_(0), data_(nullptr), size_(0), offset_(0) {}
+
+CandumpReader::~CandumpReader() {
+  Close();
+}
+
+void CandumpReader::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  offset_ = 0;
+}
+
+bool CandumpReader::Open(const std::string &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = info.st_size;
+  if (size_ > 0) {
+    void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    data_ = static_cast<const char*>(mapped);
+    madvise(mapped, size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  skipped_ = 0;
+  return true;
+}
+
+int CandumpReader::Channel(const char *name, size_t length) {
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    if (channels_[i].size() == length && memcmp(channels_[i].data(), name, length) == 0) {
+      return i;
+    }
+  }
+  channels_.push_back(std::string(name, length));
+  return channels_.size() - 1;
+}
+
+bool CandumpReader::Next(CanFrame *frame) {
+  while (offset_ < size_) {
+    const char *p = data_ + offset_;
+    const char *end = static_cast<const char*>(memchr(p, '\n', size_ - offset_));
+    if (end == nullptr) {
+      end = data_ + size_;
+    }
+    offset_ = end - data_ + 1;
+
+    // (seconds.fraction)
+    while (p < end && (*p == ' ' || *p == '\t')) {
+      ++p;
+    }
+    if (p == end) {
+      continue;
+    }
+    if (*p++ != '(') {
+      ++skipped_;
+      continue;
+    }
+    long long seconds = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      seconds = seconds * 10 + (*p++ - '0');
+    }
+    long long micros = 0;
+    int digits = 0;
+    if (p < end && *p == '.') {
+      for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+        if (digits < 6) {
+          micros = micros * 10 + (*p - '0');
+          ++digits;
+        }
+      }
+    }
+    for (; digits < 6; ++digits) {
+      micros *= 10;
+    }
+    if (p >= end || *p++ != ')') {
+      ++skipped_;
+      continue;
+    }
+
+    // interface
+    while (p < end && *p == ' ') {
+      ++p;
+    }
+    const char *name = p;
+    while (p < end && *p != ' ') {
+      ++p;
+    }
+    size_t name_length = p - name;
+    while (p < end && *p == ' ') {
+      ++p;
+    }
+
+    // id#data
+    uint32_t id = 0;
+    int id_digits = 0;
+    int digit;
+    while (p < end && (digit = HexDigit(*p)) >= 0) {
+      id = (id << 4) | digit;
+      ++id_digits;
+      ++p;
+    }
+    if (name_length == 0 || id_digits == 0 || id_digits > 8 || p >= end || *p++ != '#'
+        || (p < end && (*p == '#' || *p == 'R'))) {
+      ++skipped_;
+      continue;
+    }
+    int dlc = 0;
+    uint64_t zero = 0;
+    memcpy(frame->data, &zero, sizeof(frame->data));
+    bool valid = true;
+    while (p + 1 < end && HexDigit(p[0]) >= 0) {
+      int high = HexDigit(p[0]);
+      int low = HexDigit(p[1]);
+      if (low < 0 || dlc == 8) {
+        valid = false;
+        break;
+      }
+      frame->data[dlc++] = (high << 4) | low;
+      p += 2;
+    }
+    if (!valid || (p < end && HexDigit(*p) >= 0)) {
+      ++skipped_;
+      continue;
+    }
+
+    frame->timestamp_us = seconds * 1000000 + micros;
+    frame->channel = Channel(name, name_length);
+    frame->id = id & kIdMask;
+    frame->dlc = dlc;
+    return true;
+  }
+  return false;
+}
+
+double RadarObjectDecoder::SignalPlan::Decode(uint64_t little, uint64_t big) const {
+  uint64_t raw = ((big_endian ? big : little) >> shift) & mask;
+  if (is_signed && (raw & sign_bit) != 0) {
+    raw |= ~mask;
+  }
+  double value = is_signed ? static_cast<double>(static_cast<int64_t>(raw))
+                           : static_cast<double>(raw);
+  return value * factor + offset;
+}
+
+RadarObjectDecoder::RadarObjectDecoder()
+    : frames_(0), batches_(0), incomplete_(0), compiled_(false), header_id_(0), object_id_(0) {}
+
+bool RadarObjectDecoder::CompileSignal(const CanSignal *signal, SignalPlan *plan) {
+  if (signal == nullptr || signal->length < 1 || signal->length > 64) {
+    return false;
+  }
+  if (signal->big_endian) {
+    // the start bit is the most significant one, bit 7 of byte 0 is bit 63
+    // of the byte swapped word
+    int byte = signal->start_bit / 8;
+    int msb = (7 - byte) * 8 + signal->start_bit % 8;
+    plan->shift = msb - signal->length + 1;
+    if (byte > 7 || plan->shift < 0) {
+      return false;
+    }
+  } else {
+    plan->shift = signal->start_bit;
+    if (signal->start_bit < 0 || signal->start_bit + signal->length > 64) {
+      return false;
+    }
+  }
+  plan->big_endian = signal->big_endian;
+  plan->is_signed = signal->is_signed;
+  plan->mask = signal->length == 64 ? ~0ULL : (1ULL << signal->length) - 1;
+  plan->sign_bit = 1ULL << (signal->length - 1);
+  plan->factor = signal->factor;
+  plan->offset = signal->offset;
+  return true;
+}
+
+bool RadarObjectDecoder::Compile(const CanDatabase &database, const RadarObjectLayout &layout) {
+  header_id_ = layout.header_id;
+  object_id_ = layout.object_id;
+  compiled_ = CompileSignal(database.FindSignal(layout.header_id, layout.count_signal), &count_)
+      && CompileSignal(database.FindSignal(layout.object_id, layout.id_signal), &id_)
+      && CompileSignal(database.FindSignal(layout.object_id, layout.x_signal), &x_)
+      && CompileSignal(database.FindSignal(layout.object_id, layout.y_signal), &y_)
+      && CompileSignal(database.FindSignal(layout.object_id, layout.vx_signal), &vx_)
+      && CompileSignal(database.FindSignal(layout.object_id, layout.vy_signal), &vy_);
+  return compiled_;
+}
+
+int RadarObjectDecoder::AddRadar(int channel, uint32_t id_offset) {
+  int radar = radars_.size();
+  RadarState state;
+  state.batch.radar = radar;
+  state.batch.timestamp_us = 0;
+  state.batch.size = 0;
+  state.expected = 0;
+  state.open = false;
+  radars_.push_back(state);
+  MessagePlan header = {radar, true};
+  MessagePlan object = {radar, false};
+  plans_[Key(channel, (header_id_ + id_offset) & kIdMask)] = header;
+  plans_[Key(channel, (object_id_ + id_offset) & kIdMask)] = object;
+  return radar;
+}
+
+void RadarObjectDecoder::Emit(RadarState &state) {
+  state.open = false;
+  ++batches_;
+  if (sink_) {
+    sink_(state.batch);
+  }
+}
+
+bool RadarObjectDecoder::Feed(const CanFrame &frame) {
+  if (!compiled_) {
+    return false;
+  }
+  std::unordered_map<uint64_t, MessagePlan>::const_iterator plan =
+      plans_.find(Key(frame.channel, frame.id));
+  if (plan == plans_.end()) {
+    return false;
+  }
+  ++frames_;
+  uint64_t little;
+  memcpy(&little, frame.data, sizeof(little));
+  uint64_t big = __builtin_bswap64(little);
+  RadarState &state = radars_[plan->second.radar];
+  RadarBatch &batch = state.batch;
+
+  if (plan->second.header) {
+    if (state.open) {
+      ++incomplete_;
+      Emit(state);
+    }
+    double count = count_.Decode(little, big);
+    state.expected = count > 0 ? static_cast<size_t>(count) : 0;
+    batch.timestamp_us = frame.timestamp_us;
+    batch.size = 0;
+    state.open = true;
+    if (state.expected == 0) {
+      Emit(state);
+    }
+    return true;
+  }
+  // objects of a cycle whose header was lost
+  if (!state.open) {
+    return true;
+  }
+
+  double x = x_.Decode(little, big);
+  double y = y_.Decode(little, big);
+  double vx = vx_.Decode(little, big);
+  double vy = vy_.Decode(little, big);
+  double rho = sqrt(x * x + y * y);
+  if (batch.size == batch.detections.size()) {
+    batch.detections.push_back(MeasurementPackage());
+    batch.detections.back().sensor_type_ = MeasurementPackage::RADAR;
+    batch.detections.back().raw_measurements_ = Eigen::VectorXd(3);
+    batch.object_ids.push_back(0);
+  }
+  MeasurementPackage &detection = batch.detections[batch.size];
+  detection.timestamp_ = batch.timestamp_us;
+  detection.raw_measurements_ << rho, FastAtan2(y, x), rho > 1e-6 ? (x * vx + y * vy) / rho : 0.0;
+  batch.object_ids[batch.size] = static_cast<int>(id_.Decode(little, big));
+  if (++batch.size == state.expected) {
+    Emit(state);
+  }
+  return true;
+}
+
+void RadarObjectDecoder::Flush() {
+  for (RadarState &state : radars_) {
+    if (state.open) {
+      if (state.batch.size < state.expected) {
+        ++incomplete_;
+      }
+      Emit(state);
+    }
+  }
+}
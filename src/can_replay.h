@@ -0,0 +1,235 @@
+#ifndef CAN_REPLAY_H_
+#define CAN_REPLAY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "measurement_package.h"
+
+// a signal of a message as a DBC file defines it
+struct CanSignal {
+  std::string name;
+  // DBC bit numbering: the least significant bit of Intel signals, the most
+  // significant bit of Motorola ones
+  int start_bit;
+  int length;
+  bool big_endian;
+  bool is_signed;
+  double factor;
+  double offset;
+};
+
+struct CanMessage {
+  uint32_t id;
+  std::string name;
+  int dlc;
+  std::vector<CanSignal> signals;
+};
+
+/**
+ * CanDatabase is the signal table of a bus, read from the BO_ and SG_ lines
+ * of a DBC file. Multiplexed signals, value tables and attributes are not
+ * needed for object lists and are ignored.
+ */
+class CanDatabase {
+ public:
+  /**
+   * Parse adds the messages of DBC text
+   * @return false if a BO_ or SG_ line is malformed
+   */
+  bool Parse(const std::string &text);
+
+  bool Load(const std::string &path);
+
+  void Add(const CanMessage &message) { messages_.push_back(message); }
+
+  // the message of an id, nullptr if there is none
+  const CanMessage *Find(uint32_t id) const;
+
+  // the signal of a message, nullptr if there is none
+  const CanSignal *FindSignal(uint32_t id, const std::string &name) const;
+
+  const std::vector<CanMessage> &messages() const { return messages_; }
+
+ private:
+  std::vector<CanMessage> messages_;
+};
+
+// one classic CAN frame, data zero padded to 8 bytes
+struct CanFrame {
+  long long timestamp_us;
+  // index of the interface name in CandumpReader::channels()
+  int channel;
+  uint32_t id;
+  int dlc;
+  uint8_t data[8];
+};
+
+/**
+ * CandumpReader maps a candump log, the "(seconds) interface id#data" lines
+ * candump -l writes, and parses it frame by frame in place. Remote frames,
+ * CAN FD frames and malformed lines are skipped and counted.
+ */
+class CandumpReader {
+ public:
+  CandumpReader();
+
+  /**
+   * Destructor unmaps the file
+   */
+  virtual ~CandumpReader();
+
+  /**
+   * Open maps a log
+   * @return false if it cannot be mapped
+   */
+  bool Open(const std::string &path);
+
+  /**
+   * Next parses the next frame
+   * @return false at the end of the log
+   */
+  bool Next(CanFrame *frame);
+
+  // interface names in order of first appearance
+  const std::vector<std::string> &channels() const { return channels_; }
+
+  // index of an interface name, added if it is new
+  int Channel(const char *name, size_t length);
+
+  // lines skipped so far
+  long long skipped_;
+
+ private:
+  void Close();
+
+  const char *data_;
+  size_t size_;
+  size_t offset_;
+  std::vector<std::string> channels_;
+};
+
+// signals of an object list and how they map to radar measurements
+struct RadarObjectLayout {
+  // message opening every cycle with the number of objects that follow,
+  // and the message carrying one object
+  uint32_t header_id = 0x60A;
+  std::string count_signal = "Obj_NofObjects";
+  uint32_t object_id = 0x60B;
+  std::string id_signal = "Obj_ID";
+  // Cartesian position and velocity in the sensor frame, x ahead
+  std::string x_signal = "Obj_DistLong";
+  std::string y_signal = "Obj_DistLat";
+  std::string vx_signal = "Obj_VrelLong";
+  std::string vy_signal = "Obj_VrelLat";
+};
+
+// the objects of one radar cycle as radar measurements
+struct RadarBatch {
+  int radar;
+  long long timestamp_us;
+  // detections[0, size) are valid, the rest are kept for reuse
+  size_t size;
+  std::vector<MeasurementPackage> detections;
+  std::vector<int> object_ids;
+};
+
+/**
+ * RadarObjectDecoder turns the object list frames of several radars into
+ * one batch of radar measurements per radar and cycle.
+ *
+ * The signals are compiled once per radar and message id into plans of a
+ * shift, a mask and a scale. A frame is a hash lookup on channel and id,
+ * one 64 bit load in each byte order and a shift and mask per signal; the
+ * batches and their measurement vectors are reused, so decoding allocates
+ * nothing once every radar has seen its largest cycle.
+ *
+ * Objects are converted to range, bearing and range rate, the measurement
+ * UKF::UpdateRadar expects. A batch is complete when the announced number
+ * of objects has arrived, or, if frames were lost, when the next cycle
+ * starts, and goes to the sink right away.
+ */
+class RadarObjectDecoder {
+ public:
+  typedef std::function<void(const RadarBatch &batch)> BatchSink;
+
+  RadarObjectDecoder();
+
+  /**
+   * Compile looks up the layout signals in a database
+   * @return false if a message or signal is missing or does not fit in
+   *   8 bytes
+   */
+  bool Compile(const CanDatabase &database, const RadarObjectLayout &layout);
+
+  /**
+   * AddRadar adds a radar whose messages arrive on a channel with ids
+   * shifted by id_offset, as radars sharing a bus configure them
+   * @return Index of the radar in its batches
+   */
+  int AddRadar(int channel, uint32_t id_offset = 0);
+
+  /**
+   * Feed decodes a frame, other frames are ignored
+   * @return true if the frame belonged to a radar
+   */
+  bool Feed(const CanFrame &frame);
+
+  // sends the incomplete batches of every radar, at the end of a log
+  void Flush();
+
+  BatchSink sink_;
+
+  long long frames_;
+  long long batches_;
+  // cycles that ended with objects missing
+  long long incomplete_;
+
+ private:
+  struct SignalPlan {
+    int shift;
+    bool big_endian;
+    bool is_signed;
+    uint64_t mask;
+    uint64_t sign_bit;
+    double factor;
+    double offset;
+
+    double Decode(uint64_t little, uint64_t big) const;
+  };
+
+  struct MessagePlan {
+    int radar;
+    bool header;
+  };
+
+  struct RadarState {
+    RadarBatch batch;
+    size_t expected;
+    bool open;
+  };
+
+  static bool CompileSignal(const CanSignal *signal, SignalPlan *plan);
+  void Emit(RadarState &state);
+
+  static uint64_t Key(int channel, uint32_t id) {
+    return (static_cast<uint64_t>(channel) << 32) | id;
+  }
+
+  bool compiled_;
+  uint32_t header_id_;
+  uint32_t object_id_;
+  SignalPlan count_;
+  SignalPlan id_;
+  SignalPlan x_;
+  SignalPlan y_;
+  SignalPlan vx_;
+  SignalPlan vy_;
+  std::unordered_map<uint64_t, MessagePlan> plans_;
+  std::vector<RadarState> radars_;
+};
+
+#endif  // CAN_REPLAY_H_
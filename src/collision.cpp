@@ -0,0 +1,177 @@
+#include "collision.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "fast_math.h"
+
+namespace {
+
+// probability that a normal variable with mean mu and standard deviation
+// sigma lies in (-h, h)
+double IntervalProbability(double mu, double sigma, double h) {
+  if (sigma < 1e-9) {
+    return std::fabs(mu) < h ? 1.0 : 0.0;
+  }
+  double scale = 1.0 / (sigma * std::sqrt(2.0));
+  return 0.5 * (std::erf((h - mu) * scale) - std::erf((-h - mu) * scale));
+}
+
+}  // namespace
+
+CollisionPredictor::CollisionPredictor(int num_threads)
+    : horizon_s_(3), step_s_(0.1), std_a_(2), sigma_margin_(3.5),
+      min_probability_(1e-3), broad_phase_(true), candidate_pairs_(0),
+      pool_(num_threads) {}
+
+CollisionPredictor::~CollisionPredictor() {}
+
+std::vector<CollisionRisk> CollisionPredictor::Evaluate(const std::vector<TrackBox> &tracks) {
+  const int n = tracks.size();
+  const int steps = static_cast<int>(std::ceil(horizon_s_ / step_s_ - 1e-9)) + 1;
+
+  // predicted center, half extent of the footprint and position standard
+  // deviation per track and step, track-major
+  std::vector<double> cx(n * steps), cy(n * steps), hx(n * steps), hy(n * steps);
+  std::vector<double> sx(n * steps), sy(n * steps);
+
+  pool_.ParallelFor(n, [&](int i) {
+    const TrackBox &track = tracks[i];
+    const Eigen::VectorXd &x = track.x;
+    const Eigen::MatrixXd &P = track.P;
+    double v = x(2);
+    double yaw = x(3);
+    double yawd = x(4);
+    double s0, c0;
+    FastSinCos(yaw, &s0, &c0);
+
+    // Jacobian of the velocity vector with respect to (v, yaw)
+    Eigen::Matrix2d J;
+    J << c0, -v * s0,
+         s0, v * c0;
+    Eigen::Matrix2d Ppos = P.block<2, 2>(0, 0);
+    Eigen::Matrix2d Pcross = P.block<2, 2>(0, 2) * J.transpose();
+    Eigen::Matrix2d Pvel = J * P.block<2, 2>(2, 2) * J.transpose();
+    double var_a = std_a_ * std_a_;
+
+    for (int k = 0; k < steps; ++k) {
+      double t = k * step_s_;
+      double yaw_t = yaw + yawd * t;
+      double s, c;
+      FastSinCos(yaw_t, &s, &c);
+      int idx = i * steps + k;
+      if (std::fabs(yawd) > 0.001) {
+        cx[idx] = x(0) + v / yawd * (s - s0);
+        cy[idx] = x(1) + v / yawd * (c0 - c);
+      } else {
+        cx[idx] = x(0) + v * c0 * t;
+        cy[idx] = x(1) + v * s0 * t;
+      }
+      hx[idx] = 0.5 * (track.length * std::fabs(c) + track.width * std::fabs(s));
+      hy[idx] = 0.5 * (track.length * std::fabs(s) + track.width * std::fabs(c));
+
+      Eigen::Matrix2d Pt = Ppos + t * (Pcross + Pcross.transpose()) + t * t * Pvel;
+      double accel = 0.25 * t * t * t * t * var_a;
+      sx[idx] = std::sqrt(std::max(Pt(0, 0) + accel, 0.0));
+      sy[idx] = std::sqrt(std::max(Pt(1, 1) + accel, 0.0));
+    }
+  });
+
+  // candidate partners j > i of every track i, only kept with the broad
+  // phase; without it every later track is a partner
+  std::vector<std::vector<int> > partners(n);
+  if (broad_phase_) {
+    // boxes swept over the horizon, padded by the position uncertainty
+    std::vector<double> min_x(n), max_x(n), min_y(n), max_y(n);
+    for (int i = 0; i < n; ++i) {
+      min_x[i] = min_y[i] = std::numeric_limits<double>::infinity();
+      max_x[i] = max_y[i] = -std::numeric_limits<double>::infinity();
+      for (int k = 0; k < steps; ++k) {
+        int idx = i * steps + k;
+        double px = hx[idx] + sigma_margin_ * sx[idx];
+        double py = hy[idx] + sigma_margin_ * sy[idx];
+        min_x[i] = std::min(min_x[i], cx[idx] - px);
+        max_x[i] = std::max(max_x[i], cx[idx] + px);
+        min_y[i] = std::min(min_y[i], cy[idx] - py);
+        max_y[i] = std::max(max_y[i], cy[idx] + py);
+      }
+    }
+
+    // sweep along x, a box stays active until the sweep passes its end
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return min_x[a] < min_x[b]; });
+    std::vector<int> active;
+    candidate_pairs_ = 0;
+    for (int i : order) {
+      int kept = 0;
+      for (int j : active) {
+        if (max_x[j] < min_x[i]) {
+          continue;
+        }
+        active[kept++] = j;
+        if (min_y[i] <= max_y[j] && min_y[j] <= max_y[i]) {
+          partners[std::min(i, j)].push_back(std::max(i, j));
+          ++candidate_pairs_;
+        }
+      }
+      active.resize(kept);
+      active.push_back(i);
+    }
+  } else {
+    candidate_pairs_ = (long long)n * (n - 1) / 2;
+  }
+
+  // narrow phase, every step of the candidate pairs of one track at a time
+  std::vector<std::vector<CollisionRisk> > rows(n);
+  pool_.ParallelFor(n, [&](int a) {
+    std::vector<int> &row = partners[a];
+    if (broad_phase_) {
+      std::sort(row.begin(), row.end());
+    }
+    int count = broad_phase_ ? row.size() : n - a - 1;
+    const double *ax = &cx[a * steps], *ay = &cy[a * steps];
+    const double *ahx = &hx[a * steps], *ahy = &hy[a * steps];
+    const double *asx = &sx[a * steps], *asy = &sy[a * steps];
+    for (int p = 0; p < count; ++p) {
+      int b = broad_phase_ ? row[p] : a + 1 + p;
+      const double *bx = &cx[b * steps], *by = &cy[b * steps];
+      const double *bhx = &hx[b * steps], *bhy = &hy[b * steps];
+      const double *bsx = &sx[b * steps], *bsy = &sy[b * steps];
+
+      double probability = 0;
+      double ttc = std::numeric_limits<double>::infinity();
+      for (int k = 0; k < steps; ++k) {
+        // the footprints overlap when the difference of the centers lies
+        // within the summed half extents on both axes
+        double dx = ax[k] - bx[k];
+        double dy = ay[k] - by[k];
+        double wx = ahx[k] + bhx[k];
+        double wy = ahy[k] + bhy[k];
+        double px = IntervalProbability(dx, std::sqrt(asx[k] * asx[k] + bsx[k] * bsx[k]), wx);
+        double py = IntervalProbability(dy, std::sqrt(asy[k] * asy[k] + bsy[k] * bsy[k]), wy);
+        probability = std::max(probability, px * py);
+        if (ttc == std::numeric_limits<double>::infinity()
+            && std::fabs(dx) < wx && std::fabs(dy) < wy) {
+          ttc = k * step_s_;
+        }
+      }
+      if (probability >= min_probability_ || ttc != std::numeric_limits<double>::infinity()) {
+        CollisionRisk risk;
+        risk.a = tracks[a].id;
+        risk.b = tracks[b].id;
+        risk.probability = probability;
+        risk.ttc = ttc;
+        rows[a].push_back(risk);
+      }
+    }
+  });
+
+  std::vector<CollisionRisk> risks;
+  for (const std::vector<CollisionRisk> &row : rows) {
+    risks.insert(risks.end(), row.begin(), row.end());
+  }
+  return risks;
+}
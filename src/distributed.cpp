@@ -0,0 +1,485 @@
+#include "distributed.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "async_logger.h"
+
+namespace {
+
+// message types exchanged between coordinator and workers
+enum MessageType : uint8_t {
+  kTick = 1,   // coordinator -> worker: dt, timestamp, incoming cars
+  kDone = 2,   // worker -> coordinator: outgoing cars
+  kStop = 3,   // coordinator -> worker: finish the run
+  kReport = 4  // worker -> coordinator: WorkerReport
+};
+
+template <typename T>
+void Put(std::string &buf, const T &value) {
+  buf.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Get(const char *&p, const char *end, T &value) {
+  if (end - p < (long)sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+void PutMatrix(std::string &buf, const Eigen::MatrixXd &m) {
+  Put(buf, (int32_t)m.rows());
+  Put(buf, (int32_t)m.cols());
+  buf.append(reinterpret_cast<const char *>(m.data()), sizeof(double) * m.size());
+}
+
+bool GetMatrix(const char *&p, const char *end, Eigen::MatrixXd &m) {
+  int32_t rows, cols;
+  if (!Get(p, end, rows) || !Get(p, end, cols) || rows < 0 || cols < 0) {
+    return false;
+  }
+  size_t bytes = sizeof(double) * rows * cols;
+  if ((size_t)(end - p) < bytes) {
+    return false;
+  }
+  m.resize(rows, cols);
+  std::memcpy(m.data(), p, bytes);
+  p += bytes;
+  return true;
+}
+
+// the filter state and configuration; the dimensions and sigma point weights
+// are fixed by the constructor and not sent
+void WriteUKF(std::string &buf, const UKF &ukf) {
+  Put(buf, (uint8_t)ukf.is_initialized_);
+  Put(buf, (uint8_t)ukf.use_laser_);
+  Put(buf, (uint8_t)ukf.use_radar_);
+  PutMatrix(buf, ukf.x_);
+  PutMatrix(buf, ukf.P_);
+  PutMatrix(buf, ukf.Xsig_pred_);
+  Put(buf, ukf.time_us_);
+  Put(buf, ukf.std_a_);
+  Put(buf, ukf.std_yawdd_);
+  Put(buf, ukf.std_laspx_);
+  Put(buf, ukf.std_laspy_);
+  PutMatrix(buf, ukf.Lidar_H_);
+  PutMatrix(buf, ukf.Lidar_R_);
+  Put(buf, ukf.std_radr_);
+  Put(buf, ukf.std_radphi_);
+  Put(buf, ukf.std_radrd_);
+  PutMatrix(buf, ukf.Radar_R_);
+  Put(buf, (int32_t)ukf.radar_update_);
+  Put(buf, ukf.adaptive_spread_);
+  Put(buf, ukf.adaptive_min_range_);
+  Put(buf, ukf.radar_update_count_);
+  Put(buf, (uint8_t)ukf.event_trigger_);
+  Put(buf, ukf.trigger_nis_);
+  Put(buf, ukf.trigger_gain_);
+  Put(buf, ukf.nis_);
+  Put(buf, ukf.updates_run_);
+  Put(buf, ukf.updates_skipped_);
+  Put(buf, ukf.skipped_nis_sum_);
+  Put(buf, ukf.init_window_us_);
+  Put(buf, (int32_t)ukf.init_window_.size());
+  for (const MeasurementPackage &meas : ukf.init_window_) {
+    Put(buf, (int64_t)meas.timestamp_);
+    Put(buf, (int32_t)meas.sensor_type_);
+    Put(buf, (int32_t)meas.samples_);
+    PutMatrix(buf, meas.raw_measurements_);
+  }
+}
+
+bool ReadUKF(const char *&p, const char *end, UKF &ukf) {
+  uint8_t initialized, use_laser, use_radar, event_trigger;
+  int32_t radar_update, window_size;
+  Eigen::MatrixXd x;
+  if (!Get(p, end, initialized) || !Get(p, end, use_laser) || !Get(p, end, use_radar) ||
+      !GetMatrix(p, end, x) || x.cols() != 1 || !GetMatrix(p, end, ukf.P_) ||
+      !GetMatrix(p, end, ukf.Xsig_pred_) || !Get(p, end, ukf.time_us_) ||
+      !Get(p, end, ukf.std_a_) || !Get(p, end, ukf.std_yawdd_) ||
+      !Get(p, end, ukf.std_laspx_) || !Get(p, end, ukf.std_laspy_) ||
+      !GetMatrix(p, end, ukf.Lidar_H_) || !GetMatrix(p, end, ukf.Lidar_R_) ||
+      !Get(p, end, ukf.std_radr_) || !Get(p, end, ukf.std_radphi_) ||
+      !Get(p, end, ukf.std_radrd_) || !GetMatrix(p, end, ukf.Radar_R_) ||
+      !Get(p, end, radar_update) || radar_update < UKF::UNSCENTED || radar_update > UKF::ADAPTIVE ||
+      !Get(p, end, ukf.adaptive_spread_) || !Get(p, end, ukf.adaptive_min_range_) ||
+      !Get(p, end, ukf.radar_update_count_) || !Get(p, end, event_trigger) ||
+      !Get(p, end, ukf.trigger_nis_) || !Get(p, end, ukf.trigger_gain_) ||
+      !Get(p, end, ukf.nis_) || !Get(p, end, ukf.updates_run_) ||
+      !Get(p, end, ukf.updates_skipped_) || !Get(p, end, ukf.skipped_nis_sum_) ||
+      !Get(p, end, ukf.init_window_us_) || !Get(p, end, window_size) || window_size < 0) {
+    return false;
+  }
+  ukf.is_initialized_ = initialized;
+  ukf.use_laser_ = use_laser;
+  ukf.use_radar_ = use_radar;
+  ukf.x_ = x.col(0);
+  ukf.radar_update_ = static_cast<UKF::UpdateMethod>(radar_update);
+  ukf.event_trigger_ = event_trigger;
+
+  ukf.init_window_.clear();
+  for (int i = 0; i < window_size; ++i) {
+    MeasurementPackage meas;
+    int64_t timestamp;
+    int32_t sensor_type, samples;
+    Eigen::MatrixXd z;
+    if (!Get(p, end, timestamp) || !Get(p, end, sensor_type) || !Get(p, end, samples) ||
+        !GetMatrix(p, end, z) ||
+        z.cols() != 1) {
+      return false;
+    }
+    meas.timestamp_ = timestamp;
+    meas.sensor_type_ = static_cast<MeasurementPackage::SensorType>(sensor_type);
+    meas.samples_ = samples;
+    meas.raw_measurements_ = z.col(0);
+    ukf.init_window_.push_back(meas);
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    // a worker that died must surface as an error, not as SIGPIPE
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// frames are a 4 byte length, a type byte and the payload
+bool SendMessage(int fd, MessageType type, const std::string &payload) {
+  std::string frame;
+  Put(frame, (uint32_t)(payload.size() + 1));
+  Put(frame, (uint8_t)type);
+  frame += payload;
+  return WriteAll(fd, frame.data(), frame.size());
+}
+
+bool ReceiveMessage(int fd, MessageType &type, std::string &payload) {
+  uint32_t length;
+  uint8_t raw_type;
+  if (!ReadAll(fd, reinterpret_cast<char *>(&length), sizeof(length)) || length == 0) {
+    return false;
+  }
+  if (!ReadAll(fd, reinterpret_cast<char *>(&raw_type), sizeof(raw_type))) {
+    return false;
+  }
+  payload.resize(length - 1);
+  if (length > 1 && !ReadAll(fd, &payload[0], length - 1)) {
+    return false;
+  }
+  type = static_cast<MessageType>(raw_type);
+  return true;
+}
+
+// threads of the calling process, -1 where /proc does not tell
+int ThreadCount() {
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  int count = -1;
+  while (status >> key) {
+    if (key == "Threads:") {
+      status >> count;
+      break;
+    }
+  }
+  return count;
+}
+
+// body of a worker process, owns one shard until told to stop
+int WorkerMain(int fd, double x_min, double x_max) {
+  HighwayShard shard(0, x_min, x_max);
+  Car ego(Vect3(0, 0, 0), Vect3(4, 2, 2), Color(0, 1, 0), 0, 0, 2, "egoCar");
+  double step_seconds = 0;
+
+  MessageType type;
+  std::string payload;
+  while (ReceiveMessage(fd, type, payload)) {
+    const char *p = payload.data();
+    const char *end = p + payload.size();
+
+    if (type == kStop) {
+      WorkerReport report;
+      std::memset(&report, 0, sizeof(report));
+      report.cars = shard.traffic_.size();
+      report.handoffs_in = shard.handoffs_in_;
+      report.handoffs_out = shard.handoffs_out_;
+      report.samples = shard.tools_.estimations.size();
+      report.step_seconds = step_seconds;
+      for (size_t i = 0; i < shard.tools_.estimations.size(); ++i) {
+        VectorXd residual = shard.tools_.estimations[i] - shard.tools_.ground_truth[i];
+        for (int k = 0; k < 4; ++k) {
+          report.residual[k] += residual(k) * residual(k);
+        }
+      }
+      std::string reply;
+      Put(reply, report);
+      return SendMessage(fd, kReport, reply) ? 0 : 1;
+    }
+    if (type != kTick) {
+      return 1;
+    }
+
+    double dt;
+    long long timestamp;
+    int32_t count;
+    if (!Get(p, end, dt) || !Get(p, end, timestamp) || !Get(p, end, count)) {
+      return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+      Car car;
+      if (!ReadCar(p, end, car)) {
+        return 1;
+      }
+      shard.handoff_in_.push_back(car);
+    }
+    shard.Absorb();
+
+    auto start = std::chrono::steady_clock::now();
+    shard.Step(ego, dt, timestamp);
+    step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string reply;
+    Put(reply, (int32_t)shard.handoff_out_.size());
+    for (const Car &car : shard.handoff_out_) {
+      WriteCar(reply, car);
+    }
+    if (!SendMessage(fd, kDone, reply)) {
+      return 1;
+    }
+  }
+  return 1;
+}
+
+}  // namespace
+
+void WriteCar(std::string &buf, const Car &car) {
+  Put(buf, car.position);
+  Put(buf, car.dimensions);
+  Put(buf, car.color);
+  Put(buf, car.velocity);
+  Put(buf, car.angle);
+  Put(buf, car.acceleration);
+  Put(buf, car.steering);
+  Put(buf, car.Lf);
+  Put(buf, (int32_t)car.accuateIndex);
+  Put(buf, (int32_t)car.name.size());
+  buf += car.name;
+  Put(buf, (int32_t)car.instructions.size());
+  for (const accuation &a : car.instructions) {
+    Put(buf, a);
+  }
+
+  WriteUKF(buf, car.ukf);
+}
+
+bool ReadCar(const char *&p, const char *end, Car &car) {
+  Vect3 position(0, 0, 0), dimensions(0, 0, 0);
+  Color color(0, 0, 0);
+  float velocity, angle, acceleration, steering, Lf;
+  int32_t index, name_size, num_instructions;
+  if (!Get(p, end, position) || !Get(p, end, dimensions) || !Get(p, end, color) ||
+      !Get(p, end, velocity) || !Get(p, end, angle) || !Get(p, end, acceleration) ||
+      !Get(p, end, steering) || !Get(p, end, Lf) || !Get(p, end, index) ||
+      !Get(p, end, name_size) || name_size < 0 || end - p < name_size) {
+    return false;
+  }
+  std::string name(p, name_size);
+  p += name_size;
+
+  car = Car(position, dimensions, color, velocity, angle, Lf, name);
+  car.acceleration = acceleration;
+  car.steering = steering;
+  car.accuateIndex = index;
+
+  if (!Get(p, end, num_instructions) || num_instructions < 0) {
+    return false;
+  }
+  for (int i = 0; i < num_instructions; ++i) {
+    accuation a(0, 0, 0);
+    if (!Get(p, end, a)) {
+      return false;
+    }
+    car.instructions.push_back(a);
+  }
+
+  return ReadUKF(p, end, car.ukf);
+}
+
+DistributedHighway::DistributedHighway(double road_min, double road_max, int num_workers)
+    : road_min_(road_min), road_max_(road_max), num_workers_(num_workers), handoffs_(0), exits_(0),
+      outbox_(num_workers), outbox_count_(num_workers, 0) {}
+
+DistributedHighway::~DistributedHighway() {
+  Stop();
+}
+
+int DistributedHighway::ShardIndex(double x) const {
+  return SegmentIndex(x, road_min_, road_max_, num_workers_);
+}
+
+void DistributedHighway::AddCar(const Car &car) {
+  int index = ShardIndex(car.position.x);
+  if (index < 0) {
+    return;
+  }
+  WriteCar(outbox_[index], car);
+  ++outbox_count_[index];
+}
+
+bool DistributedHighway::Start() {
+  // a forked child gets only the forking thread; locks other threads held,
+  // in the logger, the metrics registry or the allocator, stay held forever
+  int threads = ThreadCount();
+  if (threads > 1) {
+    AsyncLogger::Instance().Log(LOG_ERROR, "DistributedHighway::Start forks, but {} threads already run",
+                                threads);
+    return false;
+  }
+  for (int i = 0; i < num_workers_; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+    if (pid == 0) {
+      // the child only keeps its own end of its own socket pair
+      close(fds[0]);
+      for (int fd : sockets_) {
+        close(fd);
+      }
+      double x_min, x_max;
+      SegmentBounds(i, road_min_, road_max_, num_workers_, x_min, x_max);
+      int status = WorkerMain(fds[1], x_min, x_max);
+      // _exit skips the destructors that would drain the worker's log
+      AsyncLogger::Instance().Flush();
+      _exit(status);
+    }
+
+    close(fds[1]);
+    sockets_.push_back(fds[0]);
+    pids_.push_back(pid);
+  }
+  return true;
+}
+
+bool DistributedHighway::Step(double dt, long long timestamp) {
+  // send every worker its tick together with the cars handed over to it
+  for (int i = 0; i < num_workers_; ++i) {
+    std::string payload;
+    Put(payload, dt);
+    Put(payload, timestamp);
+    Put(payload, (int32_t)outbox_count_[i]);
+    payload += outbox_[i];
+    outbox_[i].clear();
+    outbox_count_[i] = 0;
+    if (!SendMessage(sockets_[i], kTick, payload)) {
+      return false;
+    }
+  }
+
+  // barrier: wait for every worker and route the cars leaving its segment
+  for (int i = 0; i < num_workers_; ++i) {
+    MessageType type;
+    std::string payload;
+    if (!ReceiveMessage(sockets_[i], type, payload) || type != kDone) {
+      return false;
+    }
+    const char *p = payload.data();
+    const char *end = p + payload.size();
+    int32_t count;
+    if (!Get(p, end, count)) {
+      return false;
+    }
+    for (int k = 0; k < count; ++k) {
+      Car car;
+      if (!ReadCar(p, end, car)) {
+        return false;
+      }
+      int index = ShardIndex(car.position.x);
+      if (index < 0) {
+        ++exits_;
+        continue;
+      }
+      ++handoffs_;
+      WriteCar(outbox_[index], car);
+      ++outbox_count_[index];
+    }
+  }
+  return true;
+}
+
+bool DistributedHighway::Finish() {
+  bool ok = true;
+  reports_.clear();
+  for (int i = 0; i < num_workers_; ++i) {
+    MessageType type;
+    std::string payload;
+    WorkerReport report;
+    if (!SendMessage(sockets_[i], kStop, std::string()) ||
+        !ReceiveMessage(sockets_[i], type, payload) || type != kReport ||
+        payload.size() != sizeof(report)) {
+      ok = false;
+      continue;
+    }
+    std::memcpy(&report, payload.data(), sizeof(report));
+    reports_.push_back(report);
+  }
+  Stop();
+  return ok;
+}
+
+void DistributedHighway::Stop() {
+  for (int fd : sockets_) {
+    close(fd);
+  }
+  for (pid_t pid : pids_) {
+    int status;
+    waitpid(pid, &status, 0);
+  }
+  sockets_.clear();
+  pids_.clear();
+}
+
+VectorXd DistributedHighway::CalculateRMSE() const {
+  VectorXd rmse(4);
+  rmse << 0, 0, 0, 0;
+  long long samples = 0;
+  for (const WorkerReport &report : reports_) {
+    for (int k = 0; k < 4; ++k) {
+      rmse(k) += report.residual[k];
+    }
+    samples += report.samples;
+  }
+  if (samples == 0) {
+    return rmse;
+  }
+  rmse = rmse / samples;
+  return rmse.array().sqrt();
+}
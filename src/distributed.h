@@ -0,0 +1,110 @@
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "shard.h"
+
+/**
+ * WriteCar appends the full state of a car, including its UKF, to buf
+ */
+void WriteCar(std::string &buf, const Car &car);
+
+/**
+ * ReadCar decodes a car written by WriteCar
+ * @param p Read position, advanced past the car
+ * @param end End of the buffer
+ * @param car Decoded car
+ * @return false if the buffer is truncated
+ */
+bool ReadCar(const char *&p, const char *end, Car &car);
+
+// per-worker results collected when the run is finished
+struct WorkerReport {
+  int cars;
+  long long handoffs_in;
+  long long handoffs_out;
+  long long samples;
+  double step_seconds;
+  // sum of squared residuals for px, py, vx, vy
+  double residual[4];
+};
+
+/**
+ * DistributedHighway runs the highway as a coordinator plus one worker
+ * process per shard. Workers are forked and talk to the coordinator over
+ * Unix socket pairs. Every tick the coordinator sends each worker the cars
+ * handed over to it and waits for all of them to reply with the cars that
+ * left their segment, so ticks proceed in lockstep and the result does not
+ * depend on process scheduling.
+ */
+class DistributedHighway {
+ public:
+  /**
+   * Constructor
+   * @param road_min Rear end of the simulated road in m
+   * @param road_max Front end of the simulated road in m
+   * @param num_workers Number of worker processes, one shard each
+   */
+  DistributedHighway(double road_min, double road_max, int num_workers);
+
+  virtual ~DistributedHighway();
+
+  /**
+   * AddCar queues a car for the worker owning its position, must be called
+   * before the first Step
+   */
+  void AddCar(const Car &car);
+
+  /**
+   * Start forks the worker processes. The workers do not exec, so Start
+   * has to run before the process starts any thread, including the drain
+   * thread of AsyncLogger (the first log call) and MetricsServer: a thread
+   * holding a lock at the fork would leave it locked in every worker.
+   * @return false if threads already run, or if a socket pair or process
+   *   could not be created
+   */
+  bool Start();
+
+  /**
+   * Step runs one lockstep tick on every worker
+   * @param dt Time step in s
+   * @param timestamp Simulation time in us
+   * @return false if a worker failed
+   */
+  bool Step(double dt, long long timestamp);
+
+  /**
+   * Finish stops the workers and collects their reports
+   * @return false if a worker failed
+   */
+  bool Finish();
+
+  // index of the worker owning x, -1 if x is off the simulated road
+  int ShardIndex(double x) const;
+
+  // RMSE over every estimate recorded by all workers, valid after Finish
+  VectorXd CalculateRMSE() const;
+
+  std::vector<WorkerReport> reports_;
+  double road_min_;
+  double road_max_;
+  int num_workers_;
+
+  // cars that crossed into the segment of another worker
+  long long handoffs_;
+
+  // cars that drove off either end of the simulated road
+  long long exits_;
+
+ private:
+  void Stop();
+
+  std::vector<int> sockets_;
+  std::vector<pid_t> pids_;
+  std::vector<std::string> outbox_;
+  std::vector<int> outbox_count_;
+};
+
+#endif  // DISTRIBUTED_H_
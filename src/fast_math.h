@@ -0,0 +1,112 @@
+#ifndef FAST_MATH_H_
+#define FAST_MATH_H_
+
+#include <cmath>
+
+/**
+ * Polynomial sin, cos and atan2 for the filter and simulation hot paths.
+ * They use only multiplies, adds and selects, with no table lookups and no
+ * calls; the kernels of simd_kernels.h evaluate the same polynomials on
+ * whole vectors.
+ *
+ * Maximum absolute error against libm:
+ *   PolySin, PolyCos, PolySinCos  2e-11 for |x| < 1e5 rad
+ *   PolyAtan2                     2e-11 rad for all finite arguments
+ * Both are far below the radar bearing noise of 0.03 rad.
+ *
+ * The Fast* functions are what the hot paths call. They map to the
+ * polynomials when UKF_FAST_MATH is defined (cmake -DUKF_FAST_MATH=ON) and
+ * to libm otherwise, so every use site switches together. sqrt is left to
+ * std::sqrt, which compiles to a single instruction.
+ */
+
+inline void PolySinCos(double x, double *s, double *c) {
+  // reduce to |r| <= pi/4, pi/2 split in two parts so k * pi/2 stays exact
+  const double kTwoOverPi = 6.36619772367581382433e-01;
+  const double kPiOver2Hi = 1.57079632673412561417e+00;
+  const double kPiOver2Lo = 6.07710050650619224932e-11;
+  double k = std::nearbyint(x * kTwoOverPi);
+  double r = (x - k * kPiOver2Hi) - k * kPiOver2Lo;
+  double r2 = r * r;
+
+  // Taylor polynomials, truncation error below r^13/13! and r^14/14!
+  double sr = r + r * r2 * (-1.0/6 + r2 * (1.0/120 + r2 * (-1.0/5040
+            + r2 * (1.0/362880 + r2 * (-1.0/39916800)))));
+  double cr = 1.0 + r2 * (-0.5 + r2 * (1.0/24 + r2 * (-1.0/720 + r2 * (1.0/40320
+            + r2 * (-1.0/3628800 + r2 * (1.0/479001600))))));
+
+  // rotate by the quadrant
+  int quadrant = (int)((long long)k & 3);
+  double sq = (quadrant & 1) ? cr : sr;
+  double cq = (quadrant & 1) ? sr : cr;
+  *s = (quadrant & 2) ? -sq : sq;
+  *c = ((quadrant + 1) & 2) ? -cq : cq;
+}
+
+inline double PolySin(double x) {
+  double s, c;
+  PolySinCos(x, &s, &c);
+  return s;
+}
+
+inline double PolyCos(double x) {
+  double s, c;
+  PolySinCos(x, &s, &c);
+  return c;
+}
+
+inline double PolyAtan2(double y, double x) {
+  const double kTanPiOver8 = 4.14213562373095048802e-01;
+  double ax = std::fabs(x);
+  double ay = std::fabs(y);
+
+  // atan of t in [0, 1], shifted by pi/4 above tan(pi/8) so |u| <= tan(pi/8)
+  bool swap = ay > ax;
+  double num = swap ? ax : ay;
+  double den = swap ? ay : ax;
+  double t = den > 0 ? num / den : 0.0;
+  bool shift = t > kTanPiOver8;
+  double u = shift ? (t - 1.0) / (t + 1.0) : t;
+  double u2 = u * u;
+
+  // Taylor series to u^23, truncation error below tan(pi/8)^25 / 25
+  double p = 1.0/23;
+  p = -1.0/21 + u2 * p;
+  p = 1.0/19 + u2 * p;
+  p = -1.0/17 + u2 * p;
+  p = 1.0/15 + u2 * p;
+  p = -1.0/13 + u2 * p;
+  p = 1.0/11 + u2 * p;
+  p = -1.0/9 + u2 * p;
+  p = 1.0/7 + u2 * p;
+  p = -1.0/5 + u2 * p;
+  p = 1.0/3 + u2 * p;
+  double a = u - u * u2 * p;
+  a = shift ? a + M_PI / 4 : a;
+
+  // back to the full circle
+  a = swap ? M_PI / 2 - a : a;
+  a = x < 0 ? M_PI - a : a;
+  return std::signbit(y) ? -a : a;
+}
+
+#ifdef UKF_FAST_MATH
+
+inline void FastSinCos(double x, double *s, double *c) { PolySinCos(x, s, c); }
+inline double FastSin(double x) { return PolySin(x); }
+inline double FastCos(double x) { return PolyCos(x); }
+inline double FastAtan2(double y, double x) { return PolyAtan2(y, x); }
+
+#else
+
+inline void FastSinCos(double x, double *s, double *c) {
+  *s = std::sin(x);
+  *c = std::cos(x);
+}
+inline double FastSin(double x) { return std::sin(x); }
+inline double FastCos(double x) { return std::cos(x); }
+inline double FastAtan2(double y, double x) { return std::atan2(y, x); }
+
+#endif  // UKF_FAST_MATH
+
+#endif  // FAST_MATH_H_
@@ -0,0 +1,2342 @@
+// Headless entry point for running highway scenarios without a viewer,
+// used for scaling experiments and batch evaluation
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include "async_logger.h"
+#include "can_replay.h"
+#include "collision.h"
+#include "distributed.h"
+#include "fast_math.h"
+#include "lidar_replay.h"
+#include "metrics.h"
+#include "mot_evaluator.h"
+#include "particle_filter.h"
+#include "shard.h"
+#include "simd_kernels.h"
+#include "simulation_fork.h"
+#include "time_synchronizer.h"
+#include "track_log.h"
+#include "tuner.h"
+#include "ukf_smoother.h"
+#include "highway.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+void usage()
+{
+	std::cerr << "usage: ukf_headless <command> [options]\n"
+	          << "  shards [--cars N] [--shards K] [--threads T] [--seconds S] [--seed X]\n"
+	          << "      run the sharded highway with 1..T threads and report scaling\n"
+	          << "  distributed [--cars N] [--workers W] [--seconds S] [--seed X]\n"
+	          << "      run the highway on 1 and on W worker processes and report scaling\n"
+	          << "  tune [--method grid|random|bayes] [--evals N] [--seeds S] [--threads T]\n"
+	          << "      search std_a_ and std_yawdd_ over seeded runs and print a ranked report\n"
+	          << "  smooth [--seconds S] [--segments K] [--overlap M] [--threads T]\n"
+	          << "      record the highway logs and compare filtered, smoothed and parallel-in-time smoothed RMSE\n"
+	          << "  accuracy [--seeds S] [--threads T]\n"
+	          << "      check the fast math error bounds and the RMSE thresholds over seeded runs\n"
+	          << "  events [--seeds S] [--nis X] [--gain G]\n"
+	          << "      compare event-triggered updates against updating on every measurement\n"
+	          << "  radar [--seeds S] [--method unscented|ekf|converted|adaptive]\n"
+	          << "      run the seeded highway with each radar update method, or only the given one, against the RMSE thresholds\n"
+	          << "  init [--seeds S] [--window W] [--yaw Y]\n"
+	          << "      compare the error after track birth for single-measurement and windowed initialization\n"
+	          << "  particles [--particles N] [--threads T] [--seconds S]\n"
+	          << "      track the recorded highway logs with the UKF and the particle filter, report RMSE and particles/s\n"
+	          << "  collisions [--tracks N] [--threads T] [--seed X]\n"
+	          << "      predict collisions between the ego car and N generated tracks, naive against sweep and prune\n"
+	          << "  mot [--runs R] [--objects N] [--frames F] [--threads T]\n"
+	          << "      score synthetic Monte Carlo runs and the highway tracks with MOTA, MOTP, ID switches and GOSPA\n"
+	          << "  columnar [--samples N] [--out FILE]\n"
+	          << "      write N samples and a highway run to columnar track logs and scan them back through mmap\n"
+	          << "  logging [--messages N] [--threads T]\n"
+	          << "      compare the per-call cost of the asynchronous logger with synchronous iostream writes\n"
+	          << "  forks [--forks F] [--cars N] [--seconds S] [--threads T] [--seed X]\n"
+	          << "      roll out F ego behaviours on copy-on-write forks and on deep copies of the traffic\n"
+	          << "  isa [--sets N] [--scans K] [--particles P] [--seconds S]\n"
+	          << "      check every instruction set build of the kernels against the scalar one and time them\n"
+	          << "  regress [--baseline FILE] [--write FILE] [--rmse-tolerance R] [--seeds S] [--latency [--tolerance T] [--repeats N]]\n"
+	          << "      run the scenario suite, check rmseThreshold on every seed and compare accuracy, and with --latency latency, against a baseline\n"
+	          << "  metrics [--port P] [--seconds S] [--interval MS] [--budget B]\n"
+	          << "      run the highway scheduled with budget B with the metrics endpoint up, scrape it every MS ms and print the last scrape\n"
+	          << "  pcap [--out FILE] [--rotations N] [--rate R] [--consumer-ms MS] [--queue Q]\n"
+	          << "      capture the highway with a simulated VLP-16, replay the pcap unthrottled and at R times the recorded rate into a consumer taking MS ms per rotation\n"
+	          << "  can [--radars R] [--objects N] [--seconds S] [--out FILE]\n"
+	          << "      replay the highway radar through a candump object list log, then decode R radars at 20 Hz with N objects each\n"
+	          << "  sync [--lidar-latency US] [--radar-latency US] [--streams K] [--seconds S]\n"
+	          << "      run the highway with late sensors unsynchronized and through the time synchronizer, then merge K streams\n"
+	          << "  rig [--repeats N]\n"
+	          << "      track the highway with the stock sensors and with a corner radar rig, updating per detection and stacked\n";
+}
+
+// value of --name in argv, or fallback when it is not given
+double option(int argc, char** argv, const char* name, double fallback)
+{
+	for (int i = 2; i < argc-1; i++)
+	{
+		if (std::strcmp(argv[i], name) == 0)
+			return std::atof(argv[i+1]);
+	}
+	return fallback;
+}
+
+int runShards(int argc, char** argv)
+{
+	int cars = option(argc, argv, "--cars", 200);
+	int shards = option(argc, argv, "--shards", 8);
+	int threads = option(argc, argv, "--threads", std::thread::hardware_concurrency());
+	double seconds = option(argc, argv, "--seconds", 10);
+	unsigned int seed = option(argc, argv, "--seed", 1);
+	int frame_per_sec = 30;
+	double roadLength = 50.0 * cars;
+
+	double baseline = 0;
+	// every thread count has to reproduce the single thread run
+	bool agree = true;
+	VectorXd firstRmse;
+	long long firstHandoffs = 0;
+	int firstCars = 0;
+	for (int t = 1; t <= threads; t *= 2)
+	{
+		ShardedHighway highway(-roadLength/2, roadLength/2, shards, t);
+		highway.Populate(cars, seed);
+
+		auto startTime = std::chrono::steady_clock::now();
+		int frames = frame_per_sec*seconds;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			long long time_us = 1000000LL*frame/frame_per_sec;
+			highway.Step((double)1/frame_per_sec, time_us);
+		}
+		auto endTime = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(endTime - startTime).count();
+		if (t == 1)
+			baseline = elapsed;
+
+		long long handoffs = 0;
+		for (const HighwayShard* shard : highway.shards_)
+			handoffs += shard->handoffs_in_;
+
+		VectorXd rmse = highway.CalculateRMSE();
+		std::cout << "threads " << t
+		          << " time " << elapsed << " s"
+		          << " speedup " << baseline/elapsed
+		          << " efficiency " << baseline/(elapsed*t)
+		          << " cars " << highway.NumCars()
+		          << " handoffs " << handoffs
+		          << " exits " << highway.exits_
+		          << " rmse " << rmse.transpose() << std::endl;
+		if (t == 1)
+		{
+			firstRmse = rmse;
+			firstHandoffs = handoffs;
+			firstCars = highway.NumCars();
+		}
+		agree = agree && rmse == firstRmse && handoffs == firstHandoffs && highway.NumCars() == firstCars
+		        && highway.NumCars() + highway.exits_ == cars;
+	}
+	if (!agree)
+		std::cout << "FAIL: the thread counts disagree, or cars were lost" << std::endl;
+	return agree ? 0 : 1;
+}
+
+int runDistributed(int argc, char** argv)
+{
+	int cars = option(argc, argv, "--cars", 200);
+	int workers = option(argc, argv, "--workers", std::thread::hardware_concurrency());
+	double seconds = option(argc, argv, "--seconds", 10);
+	unsigned int seed = option(argc, argv, "--seed", 1);
+	int frame_per_sec = 30;
+	double roadLength = 50.0 * cars;
+
+	std::vector<int> runs = {1};
+	if (workers > 1)
+		runs.push_back(workers);
+
+	double baseline = 0;
+	for (int w : runs)
+	{
+		DistributedHighway highway(-roadLength/2, roadLength/2, w);
+		for (const Car& car : GenerateTraffic(cars, -roadLength/2, roadLength/2, seed))
+			highway.AddCar(car);
+		if (!highway.Start())
+		{
+			std::cerr << "could not start " << w << " workers" << std::endl;
+			return 1;
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+		int frames = frame_per_sec*seconds;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			long long time_us = 1000000LL*frame/frame_per_sec;
+			if (!highway.Step((double)1/frame_per_sec, time_us))
+			{
+				std::cerr << "worker failed at frame " << frame << std::endl;
+				return 1;
+			}
+		}
+		auto endTime = std::chrono::steady_clock::now();
+		if (!highway.Finish())
+		{
+			std::cerr << "worker failed while reporting" << std::endl;
+			return 1;
+		}
+		double elapsed = std::chrono::duration<double>(endTime - startTime).count();
+		if (w == 1)
+			baseline = elapsed;
+
+		int remaining = 0;
+		double busiest = 0;
+		for (const WorkerReport& report : highway.reports_)
+		{
+			remaining += report.cars;
+			busiest = std::max(busiest, report.step_seconds);
+		}
+
+		std::cout << "workers " << w
+		          << " time " << elapsed << " s"
+		          << " busiest " << busiest << " s"
+		          << " speedup " << baseline/elapsed
+		          << " efficiency " << baseline/(elapsed*w)
+		          << " cars " << remaining
+		          << " handoffs " << highway.handoffs_
+		          << " exits " << highway.exits_
+		          << " rmse " << highway.CalculateRMSE().transpose() << std::endl;
+	}
+	return 0;
+}
+
+// value of --name in argv, or fallback when it is not given
+std::string stringOption(int argc, char** argv, const char* name, const std::string& fallback)
+{
+	for (int i = 2; i < argc-1; i++)
+	{
+		if (std::strcmp(argv[i], name) == 0)
+			return argv[i+1];
+	}
+	return fallback;
+}
+
+// whether the flag --name is given
+bool flagOption(int argc, char** argv, const char* name)
+{
+	for (int i = 2; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int runTune(int argc, char** argv)
+{
+	std::string method = stringOption(argc, argv, "--method", "bayes");
+	int evals = option(argc, argv, "--evals", 32);
+	int numSeeds = option(argc, argv, "--seeds", 8);
+	int threads = option(argc, argv, "--threads", 0);
+	unsigned int seed = option(argc, argv, "--seed", 1);
+
+	// seed 0 is the default scenario shown by ukf_highway
+	std::vector<long long> seeds;
+	for (int i = 0; i < numSeeds; i++)
+		seeds.push_back(i);
+
+	NoiseTuner tuner(seeds, threads);
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<TunerResult> results;
+	if (method == "grid")
+		results = tuner.GridSearch(std::max(1, (int)std::sqrt((double)evals)));
+	else if (method == "random")
+		results = tuner.RandomSearch(evals, seed);
+	else if (method == "bayes")
+		results = tuner.BayesianSearch(evals, seed);
+	else
+	{
+		usage();
+		return 1;
+	}
+	auto endTime = std::chrono::steady_clock::now();
+
+	std::cout << method << " search: " << results.size() << " configurations x " << seeds.size()
+	          << " seeds in " << std::chrono::duration<double>(endTime - startTime).count() << " s" << std::endl;
+	NoiseTuner::Report(results, std::cout);
+	return 0;
+}
+
+// RMSE of px, py, vx, vy against ground truth looked up by timestamp
+VectorXd stateRMSE(const std::vector<SmoothedState>& states, const std::map<long long, VectorXd>& truth)
+{
+	Tools tools;
+	for (const SmoothedState& state : states)
+	{
+		VectorXd estimate(4);
+		estimate << state.x(0), state.x(1), state.x(2)*cos(state.x(3)), state.x(2)*sin(state.x(3));
+		tools.estimations.push_back(estimate);
+		tools.ground_truth.push_back(truth.at(state.timestamp));
+	}
+	return tools.CalculateRMSE(tools.estimations, tools.ground_truth);
+}
+
+// record every measurement and the ground truth of the tracked cars,
+// returns the car names
+std::vector<std::string> recordHighway(double seconds, std::vector<std::vector<MeasurementPackage> >& logs,
+                                       std::vector<std::map<long long, VectorXd> >& truth)
+{
+	int frame_per_sec = 30;
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	logs.assign(highway.traffic.size(), std::vector<MeasurementPackage>());
+	truth.assign(highway.traffic.size(), std::map<long long, VectorXd>());
+	highway.tools.measurementSink = [&](Car& car, const MeasurementPackage& meas_package)
+	{
+		logs[&car - &highway.traffic[0]].push_back(meas_package);
+		car.ukf.ProcessMeasurement(meas_package);
+	};
+	for (int frame = 0; frame < frame_per_sec*seconds; frame++)
+	{
+		long long time_us = 1000000LL*frame/frame_per_sec;
+		highway.stepHighway(25, time_us, frame_per_sec, viewer);
+		for (size_t i = 0; i < highway.traffic.size(); i++)
+		{
+			const Car& car = highway.traffic[i];
+			VectorXd gt(4);
+			gt << car.position.x, car.position.y, car.velocity*cos(car.angle), car.velocity*sin(car.angle);
+			truth[i][time_us] = gt;
+		}
+	}
+
+	std::vector<std::string> names;
+	for (const Car& car : highway.traffic)
+		names.push_back(car.name);
+	return names;
+}
+
+int runSmooth(int argc, char** argv)
+{
+	double seconds = option(argc, argv, "--seconds", 10);
+	int threads = option(argc, argv, "--threads", 0);
+	int overlap = option(argc, argv, "--overlap", 60);
+
+	std::vector<std::vector<MeasurementPackage> > logs;
+	std::vector<std::map<long long, VectorXd> > truth;
+	std::vector<std::string> names = recordHighway(seconds, logs, truth);
+
+	WorkerPool pool(threads);
+	int segments = option(argc, argv, "--segments", pool.Size());
+	UKFSmoother smoother;
+	for (size_t i = 0; i < logs.size(); i++)
+	{
+		std::vector<SmoothedState> filtered;
+		auto startTime = std::chrono::steady_clock::now();
+		std::vector<SmoothedState> smoothed = smoother.Smooth(logs[i], &filtered);
+		auto midTime = std::chrono::steady_clock::now();
+		std::vector<SmoothedState> parallel = smoother.SmoothParallel(logs[i], segments, overlap, pool);
+		auto endTime = std::chrono::steady_clock::now();
+
+		std::cout << names[i] << ": " << logs[i].size() << " measurements" << std::endl
+		          << "  filtered rmse " << stateRMSE(filtered, truth[i]).transpose() << std::endl
+		          << "  smoothed rmse " << stateRMSE(smoothed, truth[i]).transpose()
+		          << " in " << std::chrono::duration<double>(midTime - startTime).count() << " s" << std::endl
+		          << "  parallel rmse " << stateRMSE(parallel, truth[i]).transpose()
+		          << " in " << std::chrono::duration<double>(endTime - midTime).count() << " s"
+		          << " (" << segments << " segments, overlap " << overlap << ")" << std::endl;
+	}
+	return 0;
+}
+
+int runAccuracy(int argc, char** argv)
+{
+	int numSeeds = option(argc, argv, "--seeds", 16);
+	int threads = option(argc, argv, "--threads", 0);
+	// documented in fast_math.h
+	const double bound = 2e-11;
+	bool ok = true;
+
+#ifdef UKF_FAST_MATH
+	std::cout << "math: polynomial (UKF_FAST_MATH)" << std::endl;
+#else
+	std::cout << "math: libm" << std::endl;
+#endif
+
+	// sin and cos over the documented range, denser near zero where the filter lives
+	double sinCosError = 0;
+	for (int i = -1000000; i <= 1000000; i++)
+	{
+		double x = i < -500000 || i > 500000 ? i*0.1 : i*1e-5;
+		double s, c;
+		PolySinCos(x, &s, &c);
+		sinCosError = std::max(sinCosError, std::max(std::fabs(s - std::sin(x)), std::fabs(c - std::cos(x))));
+	}
+
+	// atan2 around the full circle at ranges from 1 mm to 10 km
+	double atan2Error = 0;
+	for (int i = 0; i < 200000; i++)
+	{
+		double angle = -M_PI + 2*M_PI*i/200000;
+		for (double range = 1e-3; range < 1e4; range *= 10)
+		{
+			double y = range*std::sin(angle);
+			double x = range*std::cos(angle);
+			atan2Error = std::max(atan2Error, std::fabs(PolyAtan2(y, x) - std::atan2(y, x)));
+		}
+	}
+	std::cout << "sincos max error " << sinCosError << " atan2 max error " << atan2Error
+	          << " bound " << bound << std::endl;
+	if (sinCosError > bound || atan2Error > bound)
+		ok = false;
+
+	// some seeds miss rmseThreshold with either math, so the per-seed results
+	// are the reference: diff this output between a libm and a UKF_FAST_MATH build
+	std::vector<RunResult> runs(numSeeds);
+	WorkerPool pool(threads);
+	NoiseConfig config = {2.0, 2.0};
+	pool.ParallelFor(numSeeds, [&](int i)
+	{
+		runs[i] = RunHighway(config, i, nullptr, false);
+	});
+	int passed = 0;
+	for (int i = 0; i < numSeeds; i++)
+	{
+		std::cout << "seed " << i << (runs[i].pass ? " pass" : " fail")
+		          << " worst ratio " << runs[i].worst_ratio
+		          << " rmse " << runs[i].rmse.transpose() << std::endl;
+		if (runs[i].pass)
+			passed++;
+	}
+	std::cout << passed << " of " << numSeeds << " seeds within rmseThreshold" << std::endl;
+	std::cout << (ok ? "accuracy ok" : "accuracy FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+int runEvents(int argc, char** argv)
+{
+	int numSeeds = option(argc, argv, "--seeds", 8);
+	UKF defaults;
+	double nis = option(argc, argv, "--nis", defaults.trigger_nis_);
+	double gain = option(argc, argv, "--gain", defaults.trigger_gain_);
+	int frame_per_sec = 30;
+
+	for (int triggered = 0; triggered < 2; triggered++)
+	{
+		int passed = 0;
+		long long run = 0, skipped = 0;
+		double skippedNis = 0;
+		VectorXd rmse = VectorXd::Zero(4);
+		auto startTime = std::chrono::steady_clock::now();
+		for (int seed = 0; seed < numSeeds; seed++)
+		{
+			pcl::visualization::PCLVisualizer::Ptr viewer;
+			Highway highway(viewer);
+			highway.tools.seed = seed;
+			highway.event_triggered_updates = triggered;
+			for (Car& car : highway.traffic)
+			{
+				car.ukf.trigger_nis_ = nis;
+				car.ukf.trigger_gain_ = gain;
+			}
+			for (int frame = 0; frame < frame_per_sec*10; frame++)
+				highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+
+			rmse += highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+			if (highway.pass)
+				passed++;
+			for (const Car& car : highway.traffic)
+			{
+				run += car.ukf.updates_run_;
+				skipped += car.ukf.updates_skipped_;
+				skippedNis += car.ukf.skipped_nis_sum_;
+			}
+		}
+		auto endTime = std::chrono::steady_clock::now();
+
+		std::cout << (triggered ? "event-triggered" : "every measurement")
+		          << " time " << std::chrono::duration<double>(endTime - startTime).count() << " s"
+		          << " pass " << passed << "/" << numSeeds
+		          << " rmse " << (rmse/numSeeds).transpose();
+		if (triggered)
+			std::cout << " skipped " << skipped << "/" << run + skipped
+			          << " mean skipped nis " << (skipped > 0 ? skippedNis/skipped : 0);
+		std::cout << std::endl;
+	}
+	return 0;
+}
+
+int runRadar(int argc, char** argv)
+{
+	int numSeeds = option(argc, argv, "--seeds", 16);
+	std::string only = stringOption(argc, argv, "--method", "");
+	int frame_per_sec = 30;
+
+	std::vector<UKF::UpdateMethod> methods;
+	for (int m = UKF::UNSCENTED; m <= UKF::ADAPTIVE; m++)
+		methods.push_back((UKF::UpdateMethod)m);
+	if (!only.empty())
+	{
+		UKF::UpdateMethod method;
+		if (!UKF::ParseUpdateMethod(only, method))
+		{
+			std::cerr << "unknown radar update method " << only << std::endl;
+			return 1;
+		}
+		methods.assign(1, method);
+	}
+
+	bool pass = true;
+	for (UKF::UpdateMethod method : methods)
+	{
+		int passed = 0;
+		std::string failed;
+		long long counts[3] = {0, 0, 0};
+		VectorXd rmse = VectorXd::Zero(4);
+		auto startTime = std::chrono::steady_clock::now();
+		for (int seed = 0; seed < numSeeds; seed++)
+		{
+			pcl::visualization::PCLVisualizer::Ptr viewer;
+			Highway highway(viewer);
+			highway.tools.seed = seed;
+			highway.radar_update = method;
+			for (int frame = 0; frame < frame_per_sec*10; frame++)
+				highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+
+			rmse += highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+			if (highway.pass)
+				passed++;
+			else
+				failed += " " + std::to_string(seed);
+			for (const Car& car : highway.traffic)
+				for (int k = 0; k < 3; k++)
+					counts[k] += car.ukf.radar_update_count_[k];
+		}
+		auto endTime = std::chrono::steady_clock::now();
+
+		std::cout << UKF::UpdateMethodName(method)
+		          << " time " << std::chrono::duration<double>(endTime - startTime).count() << " s"
+		          << " pass " << passed << "/" << numSeeds
+		          << " rmse " << (rmse/numSeeds).transpose()
+		          << " updates unscented " << counts[UKF::UNSCENTED] << " ekf " << counts[UKF::EKF]
+		          << " converted " << counts[UKF::CONVERTED];
+		if (!failed.empty())
+			std::cout << " failed seeds" << failed;
+		std::cout << std::endl;
+		pass = pass && passed == numSeeds;
+	}
+	return pass ? 0 : 1;
+}
+
+int runInit(int argc, char** argv)
+{
+	int numSeeds = option(argc, argv, "--seeds", 16);
+	long long window = option(argc, argv, "--window", 200000);
+	// turns every car away from the lane so the heading is not known upfront
+	double yaw = option(argc, argv, "--yaw", 0.3);
+	int frame_per_sec = 30;
+	const int bins = 10;
+
+	for (int windowed = 0; windowed < 2; windowed++)
+	{
+		std::vector<double> position(bins, 0.0), velocity(bins, 0.0);
+		std::vector<int> count(bins, 0);
+		int passed = 0;
+		VectorXd rmse = VectorXd::Zero(4);
+		for (int seed = 0; seed < numSeeds; seed++)
+		{
+			pcl::visualization::PCLVisualizer::Ptr viewer;
+			Highway highway(viewer);
+			highway.tools.seed = seed;
+			highway.init_window = windowed ? window : 0;
+			for (Car& car : highway.traffic)
+				car.angle += yaw;
+			for (int frame = 0; frame < frame_per_sec*10; frame++)
+			{
+				highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+				int bin = frame * bins / frame_per_sec;
+				if (bin >= bins)
+					continue;
+				// the estimates of this frame are the last ones pushed
+				size_t tracked = highway.traffic.size();
+				for (size_t i = highway.tools.estimations.size() - tracked; i < highway.tools.estimations.size(); i++)
+				{
+					VectorXd error = highway.tools.estimations[i] - highway.tools.ground_truth[i];
+					position[bin] += error.head(2).squaredNorm();
+					velocity[bin] += error.tail(2).squaredNorm();
+					count[bin]++;
+				}
+			}
+			rmse += highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+			if (highway.pass)
+				passed++;
+		}
+
+		std::cout << (windowed ? "window " + std::to_string(window/1000) + " ms" : "single measurement") << std::endl
+		          << "  first second, position/velocity rms per " << 1000/bins << " ms:";
+		for (int bin = 0; bin < bins; bin++)
+			std::cout << " " << std::sqrt(position[bin]/count[bin]) << "/" << std::sqrt(velocity[bin]/count[bin]);
+		std::cout << std::endl
+		          << "  rmse " << (rmse/numSeeds).transpose() << " pass " << passed << "/" << numSeeds << std::endl;
+	}
+	return 0;
+}
+
+// filter a measurement log, keeping the estimate after every measurement
+std::vector<SmoothedState> runTracker(Tracker& tracker, const std::vector<MeasurementPackage>& log)
+{
+	std::vector<SmoothedState> states;
+	for (const MeasurementPackage& meas_package : log)
+	{
+		tracker.ProcessMeasurement(meas_package);
+		SmoothedState state;
+		state.timestamp = meas_package.timestamp_;
+		state.x = tracker.State();
+		state.P = tracker.Covariance();
+		states.push_back(state);
+	}
+	return states;
+}
+
+int runParticles(int argc, char** argv)
+{
+	int particles = option(argc, argv, "--particles", 100000);
+	int threads = option(argc, argv, "--threads", 0);
+	double seconds = option(argc, argv, "--seconds", 10);
+
+	std::vector<std::vector<MeasurementPackage> > logs;
+	std::vector<std::map<long long, VectorXd> > truth;
+	std::vector<std::string> names = recordHighway(seconds, logs, truth);
+
+	WorkerPool pool(threads);
+	for (size_t i = 0; i < logs.size(); i++)
+	{
+		UKF ukf;
+		auto startTime = std::chrono::steady_clock::now();
+		std::vector<SmoothedState> ukfStates = runTracker(ukf, logs[i]);
+		auto midTime = std::chrono::steady_clock::now();
+		ParticleFilter pf(particles, &pool, i + 1);
+		std::vector<SmoothedState> pfStates = runTracker(pf, logs[i]);
+		auto endTime = std::chrono::steady_clock::now();
+
+		double pfSeconds = std::chrono::duration<double>(endTime - midTime).count();
+		std::cout << names[i] << ": " << logs[i].size() << " measurements" << std::endl
+		          << "  ukf rmse " << stateRMSE(ukfStates, truth[i]).transpose()
+		          << " in " << std::chrono::duration<double>(midTime - startTime).count() << " s" << std::endl
+		          << "  pf  rmse " << stateRMSE(pfStates, truth[i]).transpose()
+		          << " in " << pfSeconds << " s, " << particles << " particles on " << pool.Size() << " threads, "
+		          << particles*(double)logs[i].size()/pfSeconds << " particles/s, "
+		          << pf.resamples_ << " resamples" << std::endl;
+	}
+	return 0;
+}
+
+int runCollisions(int argc, char** argv)
+{
+	int numTracks = option(argc, argv, "--tracks", 2000);
+	int threads = option(argc, argv, "--threads", 0);
+	unsigned int seed = option(argc, argv, "--seed", 1);
+	double roadLength = 10.0 * numTracks;
+
+	// the ego car sits at the origin of its own frame, the traffic around it
+	// is tracked with a settled covariance
+	std::vector<TrackBox> tracks;
+	TrackBox ego;
+	ego.id = -1;
+	ego.x = VectorXd::Zero(5);
+	ego.P = MatrixXd::Zero(5, 5);
+	ego.length = 4;
+	ego.width = 2;
+	tracks.push_back(ego);
+	std::vector<Car> traffic = GenerateTraffic(numTracks, -roadLength/2, roadLength/2, seed);
+	for (size_t i = 0; i < traffic.size(); i++)
+	{
+		TrackBox track;
+		track.id = i;
+		track.x = VectorXd(5);
+		track.x << traffic[i].position.x, traffic[i].position.y, traffic[i].velocity, traffic[i].angle, 0;
+		track.P = MatrixXd::Zero(5, 5);
+		track.P.diagonal() << 0.01, 0.01, 0.1, 0.001, 0.01;
+		track.length = traffic[i].dimensions.x;
+		track.width = traffic[i].dimensions.y;
+		tracks.push_back(track);
+	}
+
+	CollisionPredictor predictor(threads);
+	std::vector<std::vector<CollisionRisk> > results;
+	std::vector<double> seconds;
+	for (int broadPhase = 0; broadPhase < 2; broadPhase++)
+	{
+		predictor.broad_phase_ = broadPhase;
+		auto startTime = std::chrono::steady_clock::now();
+		results.push_back(predictor.Evaluate(tracks));
+		auto endTime = std::chrono::steady_clock::now();
+		seconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+		std::cout << (broadPhase ? "sweep and prune" : "naive") << ": " << predictor.candidate_pairs_ << " pairs checked, "
+		          << results.back().size() << " risks in " << seconds.back() << " s" << std::endl;
+	}
+
+	bool match = results[0].size() == results[1].size();
+	for (size_t i = 0; match && i < results[0].size(); i++)
+	{
+		const CollisionRisk& naive = results[0][i];
+		const CollisionRisk& pruned = results[1][i];
+		match = naive.a == pruned.a && naive.b == pruned.b
+		     && naive.probability == pruned.probability && naive.ttc == pruned.ttc;
+	}
+
+	int egoRisks = 0;
+	double minTtc = INFINITY;
+	for (const CollisionRisk& risk : results[1])
+	{
+		if (risk.a == -1)
+		{
+			egoRisks++;
+			minTtc = std::min(minTtc, risk.ttc);
+		}
+	}
+	std::cout << "speedup " << seconds[0]/seconds[1] << ", ego risks " << egoRisks
+	          << ", smallest ego ttc " << minTtc << " s, results " << (match ? "match" : "differ") << std::endl;
+	return match ? 0 : 1;
+}
+
+// ego behaviour of rollout i: acceleration, steering, and whether the car
+// ahead brakes
+void forkBehaviour(int i, float& acceleration, float& steering, bool& brake)
+{
+	acceleration = -3.0 + (i % 7);
+	steering = 0.02 * ((i / 7) % 3 - 1);
+	brake = i % 2;
+}
+
+// index of the nearest car ahead of the ego car in its lane, -1 if none
+int carAhead(const std::vector<Vect3>& positions)
+{
+	int ahead = -1;
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		if (positions[i].x > 0 && std::fabs(positions[i].y) < 2 && (ahead < 0 || positions[i].x < positions[ahead].x))
+			ahead = i;
+	}
+	return ahead;
+}
+
+// whether the ego box overlaps the box of a car in the same orientation
+bool touches(const Vect3& ego, const Vect3& car)
+{
+	return std::fabs(ego.x - car.x) < 4 && std::fabs(ego.y - car.y) < 2;
+}
+
+int runForks(int argc, char** argv)
+{
+	int numForks = option(argc, argv, "--forks", 48);
+	int numCars = option(argc, argv, "--cars", 2000);
+	double seconds = option(argc, argv, "--seconds", 3);
+	int threads = option(argc, argv, "--threads", 0);
+	unsigned int seed = option(argc, argv, "--seed", 1);
+	int frame_per_sec = 30;
+	int steps = seconds * frame_per_sec;
+	float dt = 1.0 / frame_per_sec;
+	long long timestamp = 2000000;
+	double roadLength = 10.0 * numCars;
+
+	std::vector<Car> traffic = GenerateTraffic(numCars, -roadLength/2, roadLength/2, seed);
+	Car egoCar(Vect3(0, 0, 0), Vect3(4, 2, 2), Color(0, 1, 0), 0, 0, 2, "egoCar");
+	// keep the lane in front of the ego car clear for a while
+	for (Car& car : traffic)
+	{
+		if (std::fabs(car.position.y) < 2 && std::fabs(car.position.x) < 8)
+			car.position.y = 4;
+	}
+	std::vector<Vect3> positions;
+	for (const Car& car : traffic)
+		positions.push_back(car.position);
+	int ahead = carAhead(positions);
+
+	WorkerPool pool(threads);
+
+	// deep copies, the whole traffic per rollout
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<double> copied(numForks);
+	std::vector<size_t> copiedBytes(numForks);
+	pool.ParallelFor(numForks, [&](int i)
+	{
+		std::vector<Car> cars = traffic;
+		Car ego = egoCar;
+		bool brake;
+		forkBehaviour(i, ego.acceleration, ego.steering, brake);
+		if (brake && ahead >= 0)
+		{
+			cars[ahead].instructions.clear();
+			cars[ahead].instructions.push_back(accuation(timestamp, -3.0, 0.0));
+			cars[ahead].accuateIndex = -1;
+		}
+		copiedBytes[i] = cars.size() * (sizeof(Car) + sizeof(double) * (cars[0].ukf.x_.size() + cars[0].ukf.P_.size()
+		                 + cars[0].ukf.Xsig_pred_.size() + cars[0].ukf.weights_.size()));
+		copied[i] = seconds;
+		long long time_us = timestamp;
+		for (int step = 0; step < steps && copied[i] == seconds; step++)
+		{
+			for (Car& car : cars)
+				car.move(dt, time_us);
+			ego.move(dt, time_us);
+			time_us += dt * 1e6;
+			for (const Car& car : cars)
+			{
+				if (touches(ego.position, car.position))
+					copied[i] = (step + 1) * dt;
+			}
+		}
+	});
+	auto midTime = std::chrono::steady_clock::now();
+
+	// copy-on-write forks of one snapshot
+	SimulationFork root = SimulationFork::Snapshot(traffic, egoCar, timestamp);
+	std::vector<size_t> forkBytes(numForks);
+	std::vector<double> forked = RunRollouts(root, numForks, [&](int i, SimulationFork& fork)
+	{
+		bool brake;
+		forkBehaviour(i, fork.ego().acceleration, fork.ego().steering, brake);
+		if (brake && ahead >= 0)
+		{
+			Car& car = fork.MutableCar(ahead);
+			car.instructions.clear();
+			car.instructions.push_back(accuation(timestamp, -3.0, 0.0));
+			fork.MutablePose(ahead).accuateIndex = -1;
+		}
+		double collision = seconds;
+		for (int step = 0; step < steps && collision == seconds; step++)
+		{
+			fork.Step(dt);
+			for (int j = 0; j < fork.size(); j++)
+			{
+				if (touches(fork.ego().position, fork.pose(j).position))
+					collision = (step + 1) * dt;
+			}
+		}
+		forkBytes[i] = fork.OwnedBytes();
+		return collision;
+	}, pool);
+	auto endTime = std::chrono::steady_clock::now();
+
+	int collisions = 0;
+	size_t copiedTotal = 0, forkTotal = 0;
+	for (int i = 0; i < numForks; i++)
+	{
+		if (forked[i] < seconds)
+			collisions++;
+		copiedTotal += copiedBytes[i];
+		forkTotal += forkBytes[i];
+	}
+	bool match = copied == forked;
+	double copySeconds = std::chrono::duration<double>(midTime - startTime).count();
+	double forkSeconds = std::chrono::duration<double>(endTime - midTime).count();
+	std::cout << numForks << " rollouts of " << seconds << " s over " << numCars << " cars on " << pool.Size() << " threads, "
+	          << collisions << " collide" << std::endl
+	          << "  deep copies " << copySeconds << " s, " << copiedTotal/numForks << " bytes per rollout" << std::endl
+	          << "  forks       " << forkSeconds << " s, " << forkTotal/numForks << " bytes per rollout" << std::endl
+	          << "speedup " << copySeconds/forkSeconds << ", results " << (match ? "match" : "differ") << std::endl;
+	return match ? 0 : 1;
+}
+
+// total cost of an assignment in the form MotEvaluator::Assign minimizes
+double assignmentCost(const std::vector<ObjectState>& a, const std::vector<ObjectState>& b,
+                      const std::vector<std::pair<int, int> >& matches, double gate)
+{
+	double cost = 0;
+	for (const std::pair<int, int>& match : matches)
+		cost += std::hypot(a[match.first].x - b[match.second].x, a[match.first].y - b[match.second].y) - gate;
+	return cost;
+}
+
+// objects drive on three lanes; tracks are noisy, sometimes missing,
+// sometimes restarted under a new id, and mixed with clutter
+std::vector<MotFrame> generateMotRun(int numObjects, int numFrames, unsigned int seed)
+{
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::normal_distribution<double> noise(0.0, 0.3);
+	double roadLength = 10.0 * numObjects;
+	double dt = 0.1;
+
+	std::vector<ObjectState> objects(numObjects);
+	std::vector<double> speed(numObjects);
+	std::vector<int> trackId(numObjects);
+	int nextTrackId = 0;
+	for (int i = 0; i < numObjects; i++)
+	{
+		objects[i].id = i;
+		objects[i].x = roadLength * uniform(gen);
+		objects[i].y = 4.0 * (int)(3 * uniform(gen)) - 4.0;
+		speed[i] = 16.0 * uniform(gen) - 8.0;
+		trackId[i] = nextTrackId++;
+	}
+
+	std::vector<MotFrame> frames(numFrames);
+	for (int f = 0; f < numFrames; f++)
+	{
+		MotFrame& frame = frames[f];
+		for (int i = 0; i < numObjects; i++)
+		{
+			objects[i].x += speed[i] * dt;
+			frame.truth.push_back(objects[i]);
+			if (uniform(gen) < 0.002)
+				trackId[i] = nextTrackId++;
+			if (uniform(gen) < 0.05)
+				continue;
+			ObjectState track;
+			track.id = trackId[i];
+			track.x = objects[i].x + noise(gen);
+			track.y = objects[i].y + noise(gen);
+			frame.tracks.push_back(track);
+		}
+		for (int c = 0; c < numObjects / 50; c++)
+		{
+			ObjectState clutter;
+			clutter.id = nextTrackId++;
+			clutter.x = roadLength * uniform(gen);
+			clutter.y = 12.0 * uniform(gen) - 6.0;
+			frame.tracks.push_back(clutter);
+		}
+	}
+	return frames;
+}
+
+void printMot(const std::string& name, const MotMetrics& metrics)
+{
+	std::cout << name << ": MOTA " << metrics.Mota() << " MOTP " << metrics.Motp() << " m"
+	          << " ID switches " << metrics.id_switches << " misses " << metrics.misses
+	          << " false positives " << metrics.false_positives << " GOSPA " << metrics.Gospa() << std::endl;
+}
+
+int runMot(int argc, char** argv)
+{
+	int numRuns = option(argc, argv, "--runs", 200);
+	int numObjects = option(argc, argv, "--objects", 100);
+	int numFrames = option(argc, argv, "--frames", 100);
+	int threads = option(argc, argv, "--threads", 0);
+	int frame_per_sec = 30;
+
+	std::vector<std::vector<MotFrame> > runs(numRuns);
+	for (int r = 0; r < numRuns; r++)
+		runs[r] = generateMotRun(numObjects, numFrames, r + 1);
+
+	// the sparse solver has to find the same optimum as the full matrix
+	MotEvaluator evaluator;
+	bool match = true;
+	auto startTime = std::chrono::steady_clock::now();
+	for (const MotFrame& frame : runs[0])
+	{
+		double sparse = assignmentCost(frame.truth, frame.tracks,
+		                               MotEvaluator::Assign(frame.truth, frame.tracks, evaluator.gate_, 1.0), evaluator.gate_);
+		double dense = assignmentCost(frame.truth, frame.tracks,
+		                              MotEvaluator::Assign(frame.truth, frame.tracks, evaluator.gate_, 1.0, false), evaluator.gate_);
+		match = match && std::fabs(sparse - dense) < 1e-6;
+	}
+	auto midTime = std::chrono::steady_clock::now();
+	for (const MotFrame& frame : runs[0])
+		MotEvaluator::Assign(frame.truth, frame.tracks, evaluator.gate_, 1.0);
+	auto endTime = std::chrono::steady_clock::now();
+	double checkSeconds = std::chrono::duration<double>(midTime - startTime).count();
+	double sparseSeconds = std::chrono::duration<double>(endTime - midTime).count();
+	std::cout << "sparse against full assignment over " << numFrames << " frames: "
+	          << (match ? "same cost" : "different cost") << ", sparse "
+	          << sparseSeconds << " s, both " << checkSeconds << " s" << std::endl;
+
+	WorkerPool pool(threads);
+	startTime = std::chrono::steady_clock::now();
+	MotMetrics metrics = evaluator.EvaluateRuns(runs, pool);
+	endTime = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+	printMot(std::to_string(numRuns) + " runs of " + std::to_string(numObjects) + " objects", metrics);
+	std::cout << "  " << metrics.frames/seconds << " frames/s on " << pool.Size() << " threads" << std::endl;
+
+	// the highway scenario, tracks carry the index of the car they follow
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	for (int frame = 0; frame < frame_per_sec*10; frame++)
+		highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+	MotEvaluator highwayEvaluator;
+	size_t tracked = highway.traffic.size();
+	for (size_t first = 0; first + tracked <= highway.tools.estimations.size(); first += tracked)
+	{
+		MotFrame frame;
+		for (size_t i = 0; i < tracked; i++)
+		{
+			const VectorXd& estimate = highway.tools.estimations[first + i];
+			const VectorXd& truth = highway.tools.ground_truth[first + i];
+			frame.truth.push_back(ObjectState{(int)i, truth(0), truth(1)});
+			frame.tracks.push_back(ObjectState{(int)i, estimate(0), estimate(1)});
+		}
+		highwayEvaluator.AddFrame(frame);
+	}
+	printMot("highway", highwayEvaluator.metrics());
+	return match ? 0 : 1;
+}
+
+int runColumnar(int argc, char** argv)
+{
+	long long numSamples = option(argc, argv, "--samples", 10000000);
+	std::string out = stringOption(argc, argv, "--out", "tracks.ukfc");
+	std::string highwayOut = out + ".highway";
+	int frame_per_sec = 30;
+
+	TrackLogWriter writer;
+	if (!writer.Open(out))
+	{
+		std::cerr << "cannot write " << out << std::endl;
+		return 1;
+	}
+	auto startTime = std::chrono::steady_clock::now();
+	for (long long i = 0; i < numSamples; i++)
+	{
+		TrackSample sample;
+		sample.timestamp = i / 100 * 33333;
+		sample.track_id = i % 100;
+		sample.px = 0.5 * (i % 977);
+		sample.py = 4.0 * (i % 3) - 4.0;
+		sample.vx = 0.01 * (i % 1013);
+		sample.vy = 0;
+		for (int k = 0; k < 5; k++)
+			sample.p_diag[k] = 0.01 * (k + 1);
+		sample.nis = 0.001 * (i % 5003);
+		writer.Append(sample);
+	}
+	auto appendTime = std::chrono::steady_clock::now();
+	if (!writer.Close())
+	{
+		std::cerr << "writing " << out << " failed" << std::endl;
+		return 1;
+	}
+	auto endTime = std::chrono::steady_clock::now();
+	double appendSeconds = std::chrono::duration<double>(appendTime - startTime).count();
+	double writeSeconds = std::chrono::duration<double>(endTime - startTime).count();
+	std::cout << "wrote " << numSamples << " samples in " << writeSeconds << " s, "
+	          << numSamples/writeSeconds << " samples/s, " << appendSeconds << " s of it on the appending thread" << std::endl;
+
+	TrackLogReader reader;
+	startTime = std::chrono::steady_clock::now();
+	if (!reader.Open(out))
+	{
+		std::cerr << "cannot read " << out << std::endl;
+		return 1;
+	}
+	double nisSum = 0;
+	double pxSum = 0;
+	for (int c = 0; c < reader.chunks(); c++)
+	{
+		const TrackLogChunk& chunk = reader.chunk(c);
+		for (size_t i = 0; i < chunk.rows; i++)
+		{
+			nisSum += chunk.nis[i];
+			pxSum += chunk.px[i];
+		}
+	}
+	endTime = std::chrono::steady_clock::now();
+	double readSeconds = std::chrono::duration<double>(endTime - startTime).count();
+	std::cout << "mapped " << reader.rows() << " samples in " << reader.chunks() << " chunks and scanned two columns in "
+	          << readSeconds << " s, " << reader.rows()/readSeconds << " samples/s, mean nis " << nisSum/reader.rows()
+	          << " mean px " << pxSum/reader.rows() << std::endl;
+	bool complete = reader.rows() == numSamples;
+
+	{
+		pcl::visualization::PCLVisualizer::Ptr viewer;
+		Highway highway(viewer);
+		highway.track_log_path = highwayOut;
+		for (int frame = 0; frame < frame_per_sec*10; frame++)
+			highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+	}
+	TrackLogReader highwayReader;
+	if (!highwayReader.Open(highwayOut))
+	{
+		std::cerr << "cannot read " << highwayOut << std::endl;
+		return 1;
+	}
+	// the last update of every frame is the radar one, after the first second
+	// its NIS averages about 3 for a consistent filter
+	std::map<int, std::pair<double, int> > trackNis;
+	for (int c = 0; c < highwayReader.chunks(); c++)
+	{
+		const TrackLogChunk& chunk = highwayReader.chunk(c);
+		for (size_t i = 0; i < chunk.rows; i++)
+		{
+			if (chunk.timestamp[i] <= 1000000)
+				continue;
+			trackNis[chunk.track_id[i]].first += chunk.nis[i];
+			trackNis[chunk.track_id[i]].second++;
+		}
+	}
+	std::cout << "highway: " << highwayReader.rows() << " samples, mean nis per track";
+	for (const auto& track : trackNis)
+		std::cout << " " << track.first << ":" << track.second.first/track.second.second;
+	std::cout << std::endl;
+	return complete ? 0 : 1;
+}
+
+int runLogging(int argc, char** argv)
+{
+	int numMessages = option(argc, argv, "--messages", 1000000);
+	int threads = option(argc, argv, "--threads", 4);
+	AsyncLogger& logger = AsyncLogger::Instance();
+	FILE* devNull = fopen("/dev/null", "w");
+	std::ofstream devNullStream("/dev/null");
+	if (!devNull || !devNullStream)
+	{
+		std::cerr << "cannot open /dev/null" << std::endl;
+		return 1;
+	}
+	logger.SetSink(devNull);
+	std::mutex streamMutex;
+
+	for (int asynchronous = 1; asynchronous >= 0; asynchronous--)
+	{
+		std::vector<double> worst(threads, 0.0);
+		std::vector<std::thread> producers;
+		auto startTime = std::chrono::steady_clock::now();
+		for (int t = 0; t < threads; t++)
+		{
+			producers.push_back(std::thread([&, t]()
+			{
+				// the per-call time includes the two clock reads of this loop
+				for (int i = 0; i < numMessages; i++)
+				{
+					auto callStart = std::chrono::steady_clock::now();
+					if (asynchronous)
+					{
+						logger.Log(LOG_INFO, "track {} at {} m, nis {}", i, 0.5*i, 2.5);
+					}
+					else
+					{
+						std::lock_guard<std::mutex> lock(streamMutex);
+						devNullStream << "track " << i << " at " << 0.5*i << " m, nis " << 2.5 << std::endl;
+					}
+					auto callEnd = std::chrono::steady_clock::now();
+					worst[t] = std::max(worst[t], std::chrono::duration<double, std::micro>(callEnd - callStart).count());
+				}
+			}));
+		}
+		for (std::thread& producer : producers)
+			producer.join();
+		auto endTime = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(endTime - startTime).count();
+		std::cout << (asynchronous ? "asynchronous" : "iostream    ") << ": "
+		          << 1e9*seconds/numMessages << " ns per call per thread, worst call "
+		          << *std::max_element(worst.begin(), worst.end()) << " us";
+		if (asynchronous)
+		{
+			logger.Flush();
+			std::cout << ", " << logger.suppressed_ << " suppressed by the rate limit, "
+			          << logger.dropped_ << " dropped on full rings";
+		}
+		std::cout << std::endl;
+	}
+	logger.SetSink(stderr);
+	fclose(devNull);
+	return 0;
+}
+
+int runIsa(int argc, char** argv)
+{
+	int numSets = option(argc, argv, "--sets", 100000);
+	int numScans = option(argc, argv, "--scans", 3);
+	int numParticles = option(argc, argv, "--particles", 1000003);
+	double seconds = option(argc, argv, "--seconds", 10);
+	const SimdKernels* scalar = KernelsFor(ISA_SCALAR);
+	std::cout << "selected " << Kernels().name << std::endl;
+
+	// random sigma point sets in the ranges the highway produces
+	const int n = 15;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+	std::vector<double> aug(numSets*7*kSigmaStride, 0.0);
+	for (int s = 0; s < numSets; s++)
+		for (int i = 0; i < n; i++)
+		{
+			double* set = &aug[s*7*kSigmaStride];
+			set[0*kSigmaStride+i] = 40*uniform(rng);
+			set[1*kSigmaStride+i] = 8*uniform(rng);
+			set[2*kSigmaStride+i] = 5 + 5*uniform(rng);
+			set[3*kSigmaStride+i] = 4*uniform(rng);
+			set[4*kSigmaStride+i] = i % 5 == 0 ? 1e-4*uniform(rng) : uniform(rng);
+			set[5*kSigmaStride+i] = 3*uniform(rng);
+			set[6*kSigmaStride+i] = uniform(rng);
+		}
+	double weights[n];
+	weights[0] = -4.0/3;
+	for (int i = 1; i < n; i++)
+		weights[i] = 1.0/6;
+
+	// every kernel over every set, returns all outputs and the seconds per set
+	auto runKernels = [&](const SimdKernels& kernels, std::vector<double>& out)
+	{
+		out.assign(numSets*(5+3+5+25+9+15), 0.0);
+		alignas(64) double pred[5*kSigmaStride];
+		alignas(64) double z[3*kSigmaStride];
+		auto startTime = std::chrono::steady_clock::now();
+		for (int s = 0; s < numSets; s++)
+		{
+			double* o = &out[s*(5+3+5+25+9+15)];
+			kernels.predict_sigma_points(&aug[s*7*kSigmaStride], pred, n, 0.1);
+			kernels.radar_transform(pred, z, n);
+			kernels.ut_mean(pred, 5, n, weights, o);
+			kernels.ut_mean(z, 3, n, weights, o+5);
+			kernels.ut_covariance(pred, o, 5, 3, pred, o, 5, 3, n, weights, o+8+5);
+			kernels.ut_covariance(z, o+5, 3, 1, z, o+5, 3, 1, n, weights, o+8+5+25);
+			kernels.ut_covariance(pred, o, 5, 3, z, o+5, 3, 1, n, weights, o+8+5+25+9);
+			std::copy(pred, pred+5, o+8);
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() / numSets;
+	};
+
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	Lidar& lidar = *highway.lidar;
+	lidar.updateCars(highway.traffic);
+	std::vector<RayTarget> targets;
+	for (const Car& car : highway.traffic)
+		targets.push_back({car.position.x, car.position.y, car.position.z, car.cosNegTheta, car.sinNegTheta, car.dimensions.x, car.dimensions.y, car.dimensions.z});
+	RayScan rayScan = {lidar.position.x, lidar.position.y, lidar.position.z, lidar.resoultion, lidar.maxDistance, tan(lidar.groundSlope), targets.data(), (int)targets.size()};
+	size_t numRays = lidar.rays.size();
+	auto castRays = [&](const SimdKernels& kernels, std::vector<double>& hits)
+	{
+		hits.assign(4*numRays, 0.0);
+		auto startTime = std::chrono::steady_clock::now();
+		for (int k = 0; k < numScans; k++)
+			kernels.cast_rays(rayScan, lidar.rayDirX.data(), lidar.rayDirY.data(), lidar.rayDirZ.data(), numRays,
+			                  &hits[0], &hits[numRays], &hits[2*numRays], &hits[3*numRays]);
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() / numScans;
+	};
+
+	// random particles in the same ranges, the state rows then the noise rows
+	std::vector<float> particles(7*numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		particles[0*numParticles+i] = 40*uniform(rng);
+		particles[1*numParticles+i] = 8*uniform(rng);
+		particles[2*numParticles+i] = 5 + 5*uniform(rng);
+		particles[3*numParticles+i] = 4*uniform(rng);
+		particles[4*numParticles+i] = i % 5 == 0 ? 1e-4*uniform(rng) : uniform(rng);
+		particles[5*numParticles+i] = 2*uniform(rng);
+		particles[6*numParticles+i] = 2*uniform(rng);
+	}
+	// one prediction and a lidar and a radar likelihood, returns the state,
+	// both likelihoods and their maxima, and the seconds per particle
+	auto runParticles = [&](const SimdKernels& kernels, std::vector<float>& out)
+	{
+		out = particles;
+		out.resize(9*numParticles+2);
+		float* p = out.data();
+		const double zLidar[2] = {10, 2};
+		const double invLidar[2] = {1/(0.15*0.15), 1/(0.15*0.15)};
+		const double zRadar[3] = {10, 0.2, 5};
+		const double invRadar[3] = {1/(0.3*0.3), 1/(0.03*0.03), 1/(0.3*0.3)};
+		const int n = numParticles;
+		auto startTime = std::chrono::steady_clock::now();
+		kernels.predict_particles(p, p+n, p+2*n, p+3*n, p+4*n, p+5*n, p+6*n, n, 2.0, 2.0, 0.1);
+		p[9*n] = kernels.lidar_log_likelihood(p, p+n, n, zLidar, invLidar, p+7*n);
+		p[9*n+1] = kernels.radar_log_likelihood(p, p+n, p+2*n, p+3*n, n, zRadar, invRadar, p+8*n);
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() / n;
+	};
+
+	std::vector<double> reference, referenceHits;
+	std::vector<float> referenceParticles;
+	runKernels(*scalar, reference);
+	castRays(*scalar, referenceHits);
+	runParticles(*scalar, referenceParticles);
+	bool agree = true;
+	for (int isa = ISA_SCALAR; isa <= ISA_AVX512; isa++)
+	{
+		const SimdKernels* kernels = KernelsFor(static_cast<SimdIsa>(isa));
+		if (!kernels)
+		{
+			std::cout << IsaName(static_cast<SimdIsa>(isa)) << ": not supported here" << std::endl;
+			continue;
+		}
+		std::vector<double> out, hits;
+		double setSeconds = runKernels(*kernels, out);
+		double scanSeconds = castRays(*kernels, hits);
+		double worst = 0;
+		for (size_t i = 0; i < out.size(); i++)
+			worst = std::max(worst, std::fabs(out[i] - reference[i]) / std::max(1.0, std::fabs(reference[i])));
+		bool sameHits = hits == referenceHits;
+		std::vector<float> particleOut;
+		double particleSeconds = runParticles(*kernels, particleOut);
+		// float results, a rounding apart at most
+		double worstParticle = 0;
+		for (size_t i = 0; i < particleOut.size(); i++)
+			worstParticle = std::max(worstParticle, std::fabs((double)particleOut[i] - referenceParticles[i])
+			                                        / std::max(1.0, std::fabs((double)referenceParticles[i])));
+		agree = agree && worst < 1e-9 && sameHits && worstParticle < 1e-6;
+		std::cout << kernels->name << ": " << 1e9*setSeconds << " ns per sigma point set, "
+		          << 1e3*scanSeconds << " ms per lidar scan of " << numRays << " rays, worst error " << worst
+		          << (sameHits ? ", same ray hits" : ", RAY HITS DIFFER") << ", "
+		          << 1e9*particleSeconds << " ns per particle, worst particle error " << worstParticle << std::endl;
+	}
+
+	// the ray casting kernels against Ray::rayCast, with the same noise draws
+	srand(1);
+	pcl::PointCloud<pcl::PointXYZ>::Ptr referenceCloud(new pcl::PointCloud<pcl::PointXYZ>());
+	auto startTime = std::chrono::steady_clock::now();
+	for (Ray ray : lidar.rays)
+		ray.rayCast(lidar.cars, lidar.minDistance, lidar.maxDistance, referenceCloud, lidar.groundSlope, lidar.sderr);
+	double rayCastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	srand(1);
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = lidar.scan();
+	bool sameCloud = cloud->points.size() == referenceCloud->points.size();
+	for (size_t i = 0; sameCloud && i < cloud->points.size(); i++)
+		sameCloud = cloud->points[i].x == referenceCloud->points[i].x && cloud->points[i].y == referenceCloud->points[i].y
+		            && cloud->points[i].z == referenceCloud->points[i].z;
+	agree = agree && sameCloud;
+	std::cout << "Ray::rayCast: " << 1e3*rayCastSeconds << " ms per scan, " << referenceCloud->points.size() << " points, "
+	          << (sameCloud ? "same cloud as Lidar::scan" : "CLOUD DIFFERS FROM Lidar::scan") << std::endl;
+
+	// the filter end to end with the selected kernels
+	std::vector<std::vector<MeasurementPackage> > logs;
+	std::vector<std::map<long long, VectorXd> > truth;
+	recordHighway(seconds, logs, truth);
+	size_t measurements = 0;
+	double filterSeconds = 0;
+	VectorXd rmse = VectorXd::Zero(4);
+	for (size_t i = 0; i < logs.size(); i++)
+	{
+		UKF ukf;
+		ukf.radar_update_ = UKF::UNSCENTED;
+		startTime = std::chrono::steady_clock::now();
+		std::vector<SmoothedState> states = runTracker(ukf, logs[i]);
+		filterSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		measurements += logs[i].size();
+		rmse += stateRMSE(states, truth[i]) / logs.size();
+	}
+	std::cout << "filter with " << Kernels().name << ": " << 1e6*filterSeconds/measurements
+	          << " us per measurement, mean rmse " << rmse.transpose() << std::endl;
+	return agree ? 0 : 1;
+}
+
+// p-th percentile, 0..1, of the samples
+double percentile(std::vector<double> samples, double p)
+{
+	if (samples.empty())
+		return 0;
+	size_t k = std::min(samples.size()-1, (size_t)(p*samples.size()));
+	std::nth_element(samples.begin(), samples.begin()+k, samples.end());
+	return samples[k];
+}
+
+// one scenario of the regression suite on one seed
+struct RegressRun
+{
+	VectorXd rmse;
+	bool pass;
+	std::vector<double> updateSeconds;
+	std::vector<double> frameSeconds;
+};
+
+RegressRun regressHighway(const std::string& scenario, long long seed)
+{
+	// the high rate scenario senses every car 150 times a second
+	int frame_per_sec = scenario == "rate" ? 150 : 30;
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	highway.tools.seed = seed;
+	RegressRun run;
+	if (scenario == "crowded")
+	{
+		// 97 more tracked cars around the ego car, 100 filters per frame
+		for (const Car& car : GenerateTraffic(97, -150, 150, seed))
+		{
+			highway.traffic.push_back(car);
+			highway.trackCars.push_back(true);
+		}
+	}
+	if (scenario == "scheduled")
+	{
+		// a budget below the measurements per frame, so load is shed
+		highway.schedule_measurements = true;
+		highway.scheduler.budget_ = 4;
+	}
+	else if (scenario == "fused")
+	{
+		highway.fuse_sensors = true;
+	}
+	else
+	{
+		highway.event_triggered_updates = scenario == "events";
+		highway.tools.measurementSink = [&](Car& car, const MeasurementPackage& meas_package)
+		{
+			auto updateStart = std::chrono::steady_clock::now();
+			car.ukf.ProcessMeasurement(meas_package);
+			run.updateSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - updateStart).count());
+		};
+	}
+	for (int frame = 0; frame < frame_per_sec*10; frame++)
+	{
+		auto frameStart = std::chrono::steady_clock::now();
+		highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+		run.frameSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+	}
+	run.rmse = highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+	run.pass = highway.pass;
+	return run;
+}
+
+int runRegress(int argc, char** argv)
+{
+	std::string baselinePath = stringOption(argc, argv, "--baseline", "regress_baseline.txt");
+	std::string writePath = stringOption(argc, argv, "--write", "");
+	double tolerance = option(argc, argv, "--tolerance", 0.5);
+	double rmseTolerance = option(argc, argv, "--rmse-tolerance", 0.02);
+	// latencies depend on the machine and its load, so they are only
+	// measured and compared on request, against a baseline of the same machine
+	bool latency = flagOption(argc, argv, "--latency");
+	int repeats = latency ? option(argc, argv, "--repeats", 3) : 1;
+	int numSeeds = option(argc, argv, "--seeds", 16);
+	std::vector<long long> seeds;
+	for (long long seed = 0; seed < numSeeds; seed++)
+		seeds.push_back(seed);
+	// the stock scenario, event-triggered updates, the load shedding
+	// scheduler, fused sensors and two load scenarios: 100 tracked cars, and
+	// 150 Hz lidar and radar. Every seed of every scenario has to meet
+	// rmseThreshold
+	const std::vector<std::string> scenarios = {"highway", "events", "scheduled", "fused", "crowded", "rate"};
+	bool ok = true;
+
+	// lower is better for every value; latencies in us are compared with
+	// tolerance, the RMSE with rmseTolerance
+	std::map<std::string, double> values;
+	std::map<std::string, bool> isLatency;
+	for (const std::string& scenario : scenarios)
+	{
+		VectorXd rmse = VectorXd::Zero(4);
+		std::vector<long long> failedSeeds;
+		double updateP99 = 0, frameP99 = 0;
+		for (int repeat = 0; repeat < repeats; repeat++)
+		{
+			std::vector<double> updateSeconds, frameSeconds;
+			for (long long seed : seeds)
+			{
+				RegressRun run = regressHighway(scenario, seed);
+				updateSeconds.insert(updateSeconds.end(), run.updateSeconds.begin(), run.updateSeconds.end());
+				frameSeconds.insert(frameSeconds.end(), run.frameSeconds.begin(), run.frameSeconds.end());
+				if (repeat == 0)
+				{
+					rmse += run.rmse / seeds.size();
+					if (!run.pass)
+						failedSeeds.push_back(seed);
+				}
+			}
+			// the best repeat, the others saw more interference
+			double update = 1e6*percentile(updateSeconds, 0.99);
+			double frame = 1e6*percentile(frameSeconds, 0.99);
+			updateP99 = repeat == 0 ? update : std::min(updateP99, update);
+			frameP99 = repeat == 0 ? frame : std::min(frameP99, frame);
+		}
+
+		const char* components[4] = {"x", "y", "vx", "vy"};
+		for (int k = 0; k < 4; k++)
+			values[scenario + ".rmse_" + components[k]] = rmse(k);
+		if (latency)
+		{
+			if (scenario != "scheduled" && scenario != "fused")
+			{
+				values[scenario + ".update_p99_us"] = updateP99;
+				isLatency[scenario + ".update_p99_us"] = true;
+			}
+			values[scenario + ".frame_p99_us"] = frameP99;
+			isLatency[scenario + ".frame_p99_us"] = true;
+		}
+
+		std::cout << scenario << ": " << failedSeeds.size() << " of " << seeds.size() << " seeds miss rmseThreshold" << std::endl;
+		for (long long seed : failedSeeds)
+			std::cout << "FAIL " << scenario << ": seed " << seed << " misses rmseThreshold" << std::endl;
+		if (!failedSeeds.empty())
+			ok = false;
+	}
+
+	if (!writePath.empty())
+	{
+		// record only, comparing against the file just written proves nothing
+		std::ofstream out(writePath);
+		out << "# ukf_headless regress baseline, name value\n";
+		out.precision(10);
+		for (const auto& value : values)
+			out << value.first << " " << value.second << "\n";
+		if (!out)
+		{
+			std::cerr << "cannot write " << writePath << std::endl;
+			return 1;
+		}
+		for (const auto& value : values)
+			std::cout << value.first << " " << value.second << std::endl;
+		std::cout << "baseline written to " << writePath << std::endl;
+		return ok ? 0 : 1;
+	}
+
+	std::map<std::string, double> baseline;
+	std::ifstream in(baselinePath);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string name;
+		double value;
+		if (line.empty() || line[0] == '#' || !(fields >> name >> value))
+			continue;
+		baseline[name] = value;
+	}
+	if (baseline.empty())
+	{
+		std::cout << "FAIL no baseline in " << baselinePath << ", record one with --write " << baselinePath << std::endl;
+		ok = false;
+	}
+
+	for (const auto& value : values)
+	{
+		std::cout << value.first << " " << value.second;
+		std::map<std::string, double>::const_iterator base = baseline.find(value.first);
+		if (base == baseline.end())
+		{
+			std::cout << " FAIL, not in the baseline";
+			ok = false;
+		}
+		else
+		{
+			double allowed = base->second * (1 + (isLatency.count(value.first) ? tolerance : rmseTolerance)) + 1e-9;
+			std::cout << " baseline " << base->second;
+			if (value.second > allowed)
+			{
+				std::cout << " FAIL, above " << allowed;
+				ok = false;
+			}
+		}
+		std::cout << std::endl;
+	}
+	std::cout << (ok ? "regress ok" : "regress FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+// a number of heap allocations for reports, or why there is none
+std::string allocationCount(double allocations)
+{
+	if (!MetricsRegistry::CountsAllocations())
+		return "allocations not counted (UKF_COUNT_ALLOCATIONS is off)";
+	std::ostringstream out;
+	out << allocations << " allocations";
+	return out.str();
+}
+
+// body of an HTTP GET of the metrics endpoint, empty on failure
+std::string scrapeMetrics(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return "";
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	std::string response;
+	const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0
+	    && write(fd, request, sizeof(request)-1) == (ssize_t)sizeof(request)-1)
+	{
+		char buffer[4096];
+		ssize_t n;
+		while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+			response.append(buffer, n);
+	}
+	close(fd);
+	size_t body = response.find("\r\n\r\n");
+	return body == std::string::npos ? "" : response.substr(body+4);
+}
+
+int runMetrics(int argc, char** argv)
+{
+	int port = option(argc, argv, "--port", 0);
+	double seconds = option(argc, argv, "--seconds", 10);
+	int interval = option(argc, argv, "--interval", 10);
+	int frame_per_sec = 30;
+
+	MetricsServer server;
+	if (!server.Start(port))
+	{
+		std::cerr << "cannot listen on port " << port << std::endl;
+		return 1;
+	}
+	std::cout << "serving metrics on 127.0.0.1:" << server.port() << std::endl;
+
+	// a scraper polls while the highway runs, the filters never wait for it
+	std::atomic<bool> done(false);
+	long long scrapes = 0;
+	double scrapeSeconds = 0;
+	std::string last;
+	std::thread scraper([&]()
+	{
+		while (!done)
+		{
+			auto scrapeStart = std::chrono::steady_clock::now();
+			std::string body = scrapeMetrics(server.port());
+			scrapeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - scrapeStart).count();
+			if (!body.empty())
+				scrapes++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+		}
+	});
+
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	// the scheduler under a tight budget, so the queue and shed metrics move
+	highway.schedule_measurements = true;
+	highway.scheduler.budget_ = option(argc, argv, "--budget", 4);
+	Histogram& frameSeconds = MetricsRegistry::Instance().GetHistogram("render_frame_seconds", "Duration of one simulated and rendered frame", MetricsRegistry::LatencyBounds());
+	auto startTime = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frame_per_sec*seconds; frame++)
+	{
+		auto frameStart = std::chrono::steady_clock::now();
+		highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+		frameSeconds.Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+	}
+	double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	done = true;
+	scraper.join();
+	last = scrapeMetrics(server.port());
+	server.Stop();
+
+	std::cout << last;
+	std::cout << frame_per_sec*seconds << " frames in " << runSeconds << " s, " << scrapes << " scrapes, "
+	          << (scrapes > 0 ? 1e3*scrapeSeconds/scrapes : 0.0) << " ms per scrape" << std::endl;
+	return scrapes > 0 && !last.empty() ? 0 : 1;
+}
+
+// appends a little endian value of size bytes
+void putLittle(std::string& out, unsigned long long value, int size)
+{
+	for (int i = 0; i < size; i++)
+		out.push_back((char)((value >> (8*i)) & 0xFF));
+}
+
+void putBig16(std::string& out, unsigned int value)
+{
+	out.push_back((char)((value >> 8) & 0xFF));
+	out.push_back((char)(value & 0xFF));
+}
+
+// one pcap record of an Ethernet, IPv4 and UDP frame around payload
+void putUdpRecord(std::string& out, long long timeUs, int port, const std::string& payload)
+{
+	std::string frame(12, (char)0xFF);
+	putBig16(frame, 0x0800);
+	size_t ip = frame.size();
+	frame.push_back(0x45);
+	frame.push_back(0);
+	putBig16(frame, 20+8+payload.size());
+	putBig16(frame, 0);
+	putBig16(frame, 0x4000);
+	frame.push_back(64);
+	frame.push_back(17);
+	putBig16(frame, 0);
+	const unsigned char addresses[8] = {192, 168, 1, 201, 255, 255, 255, 255};
+	frame.append((const char*)addresses, 8);
+	unsigned int checksum = 0;
+	for (size_t i = ip; i < ip+20; i += 2)
+		checksum += ((unsigned char)frame[i] << 8) | (unsigned char)frame[i+1];
+	while (checksum >> 16)
+		checksum = (checksum & 0xFFFF) + (checksum >> 16);
+	frame[ip+10] = (char)((~checksum >> 8) & 0xFF);
+	frame[ip+11] = (char)(~checksum & 0xFF);
+	putBig16(frame, port);
+	putBig16(frame, port);
+	putBig16(frame, 8+payload.size());
+	putBig16(frame, 0);
+	frame += payload;
+
+	putLittle(out, timeUs / 1000000, 4);
+	putLittle(out, timeUs % 1000000, 4);
+	putLittle(out, frame.size(), 4);
+	putLittle(out, frame.size(), 4);
+	out += frame;
+}
+
+int runPcap(int argc, char** argv)
+{
+	std::string out = stringOption(argc, argv, "--out", "highway_vlp16.pcap");
+	int numRotations = option(argc, argv, "--rotations", 50);
+	double rate = option(argc, argv, "--rate", 1);
+	int consumerMs = option(argc, argv, "--consumer-ms", 150);
+	int queueFrames = option(argc, argv, "--queue", 2);
+
+	// a VLP-16 on the ego roof at 10 Hz and 0.2 deg, 1800 firings a rotation
+	const int columns = 1800;
+	const int lasers = 16;
+	const int elevations[lasers] = {-15, 1, -13, 3, -11, 5, -9, 7, -7, 9, -5, 11, -3, 13, -1, 15};
+	const double sequenceUs = 55.296;
+	pcl::visualization::PCLVisualizer::Ptr viewer;
+	Highway highway(viewer);
+	Lidar& lidar = *highway.lidar;
+	lidar.updateCars(highway.traffic);
+	std::vector<RayTarget> targets;
+	for (const Car& car : highway.traffic)
+		targets.push_back({car.position.x, car.position.y, car.position.z, car.cosNegTheta, car.sinNegTheta, car.dimensions.x, car.dimensions.y, car.dimensions.z});
+	RayScan rayScan = {lidar.position.x, lidar.position.y, lidar.position.z, lidar.resoultion, lidar.maxDistance, tan(lidar.groundSlope), targets.data(), (int)targets.size()};
+	// ray of column c and laser l at l*columns+c, azimuth clockwise from +y as the sensor counts it
+	std::vector<double> dirX(columns*lasers), dirY(columns*lasers), dirZ(columns*lasers);
+	for (int l = 0; l < lasers; l++)
+		for (int c = 0; c < columns; c++)
+		{
+			double alpha = c*0.2*M_PI/180;
+			double omega = elevations[l]*M_PI/180;
+			dirX[l*columns+c] = lidar.resoultion*cos(omega)*sin(alpha);
+			dirY[l*columns+c] = lidar.resoultion*cos(omega)*cos(alpha);
+			dirZ[l*columns+c] = lidar.resoultion*sin(omega);
+		}
+	size_t numRays = dirX.size();
+	std::vector<double> hits(4*numRays);
+	Kernels().cast_rays(rayScan, dirX.data(), dirY.data(), dirZ.data(), numRays, &hits[0], &hits[numRays], &hits[2*numRays], &hits[3*numRays]);
+	// 2 mm units, 0 where the ray left the sensor range
+	std::vector<unsigned int> raw(numRays);
+	for (size_t i = 0; i < numRays; i++)
+		raw[i] = hits[3*numRays+i] < std::min(lidar.maxDistance, 100.0) ? (unsigned int)std::lround(hits[3*numRays+i]/0.002) : 0;
+
+	// the capture starts half a packet into a rotation so that rotations end
+	// mid-packet, with a position packet on port 8308 every rotation
+	std::string capture;
+	putLittle(capture, 0xa1b2c3d4, 4);
+	putLittle(capture, 2, 2);
+	putLittle(capture, 4, 2);
+	putLittle(capture, 0, 8);
+	putLittle(capture, 65535, 4);
+	putLittle(capture, 1, 4);
+	const long long startUs = 1700000000LL*1000000;
+	const int firstColumn = 12;
+	long long numPackets = 0;
+	for (long long column = firstColumn; column < (long long)numRotations*columns; column += 24, numPackets++)
+	{
+		long long timeUs = startUs + (long long)std::llround((column-firstColumn)*sequenceUs);
+		std::string packet;
+		for (int block = 0; block < 12; block++)
+		{
+			putLittle(packet, 0xEEFF, 2);
+			putLittle(packet, ((column + 2*block) % columns)*20, 2);
+			for (int sequence = 0; sequence < 2; sequence++)
+			{
+				int c = (column + 2*block + sequence) % columns;
+				for (int l = 0; l < lasers; l++)
+				{
+					putLittle(packet, raw[l*columns+c], 2);
+					packet.push_back((char)(raw[l*columns+c] ? 40 + l : 0));
+				}
+			}
+		}
+		putLittle(packet, (timeUs - startUs) % 3600000000LL, 4);
+		packet.push_back(0x37);
+		packet.push_back(0x22);
+		putUdpRecord(capture, timeUs, kVelodyneDataPort, packet);
+		if (column % columns < 24)
+			putUdpRecord(capture, timeUs, 8308, std::string(512, '\0'));
+	}
+	{
+		std::ofstream file(out, std::ios::binary);
+		file.write(capture.data(), capture.size());
+		if (!file)
+		{
+			std::cerr << "cannot write " << out << std::endl;
+			return 1;
+		}
+	}
+	double recordedSeconds = numPackets*24*sequenceUs*1e-6;
+	std::cout << "wrote " << numPackets << " packets, " << numRotations << " rotations, " << recordedSeconds
+	          << " s of VLP-16 data to " << out << std::endl;
+
+	// unthrottled into a consumer that checks every point against the rays
+	bool pass = true;
+	{
+		LidarReplay replay(queueFrames);
+		double maxError = 0;
+		long long points = 0;
+		long long frames = 0;
+		long long columnsSeen = 0;
+		double allocations = 0;
+		auto startTime = std::chrono::steady_clock::now();
+		if (!replay.Start(out, 0))
+		{
+			std::cerr << "cannot replay " << out << std::endl;
+			return 1;
+		}
+		while (LidarFrame* frame = replay.Next(1000))
+		{
+			if (frames++ == 0)
+				allocations = MetricsRegistry::Allocations();
+			for (int col = 0; col < frame->columns; col++)
+			{
+				int c = (int)std::lround(frame->azimuth[col]*180/M_PI/0.2) % columns;
+				for (int l = 0; l < lasers; l++)
+				{
+					int row = (elevations[l]+15)/2;
+					int index = frame->index(row, col);
+					bool hit = raw[l*columns+c] != 0;
+					if (hit != !std::isnan(frame->x[index]))
+					{
+						maxError = INFINITY;
+						continue;
+					}
+					if (!hit)
+						continue;
+					size_t ray = l*columns+c;
+					maxError = std::max(maxError, std::fabs(frame->x[index] - (hits[ray]-rayScan.origin_x)));
+					maxError = std::max(maxError, std::fabs(frame->y[index] - (hits[numRays+ray]-rayScan.origin_y)));
+					maxError = std::max(maxError, std::fabs(frame->z[index] - (hits[2*numRays+ray]-rayScan.origin_z)));
+					points++;
+				}
+			}
+			columnsSeen += frame->columns;
+			replay.Release(frame);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		allocations = MetricsRegistry::Allocations() - allocations;
+		replay.Stop();
+		std::cout << "unthrottled: " << replay.packets_ << " packets, " << frames << " rotations, " << points
+		          << " points in " << seconds << " s, " << replay.packets_/seconds << " packets/s, "
+		          << recordedSeconds/seconds << "x real time, max error " << maxError << " m, "
+		          << allocationCount(allocations) << " after the first rotation" << std::endl;
+		pass = pass && maxError <= 0.002 && columnsSeen == (long long)numPackets*24 && frames == numRotations+1
+		       && replay.dropped_ == 0;
+	}
+
+	// at the recorded rate into a consumer too slow to keep up
+	{
+		LidarReplay replay(queueFrames);
+		std::vector<double> latencies;
+		long long lastSequence = -1;
+		bool ordered = true;
+		auto startTime = std::chrono::steady_clock::now();
+		replay.Start(out, rate);
+		while (LidarFrame* frame = replay.Next(1000))
+		{
+			long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+			latencies.push_back(1e-6*(now - frame->ready_ns));
+			ordered = ordered && frame->sequence > lastSequence;
+			lastSequence = frame->sequence;
+			std::this_thread::sleep_for(std::chrono::milliseconds(consumerMs));
+			replay.Release(frame);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		replay.Stop();
+		double bound = (queueFrames+1)*std::max(100.0/(rate > 0 ? rate : 1), (double)consumerMs);
+		std::cout << "rate " << rate << ", consumer " << consumerMs << " ms: " << latencies.size() << " of "
+		          << replay.frames_ << " rotations consumed, " << replay.dropped_ << " dropped, handoff latency p50 "
+		          << percentile(latencies, 0.5) << " ms p99 " << percentile(latencies, 0.99) << " ms max "
+		          << percentile(latencies, 1) << " ms (bound " << bound << " ms) in " << seconds << " s" << std::endl;
+		pass = pass && ordered && (long long)latencies.size() + replay.dropped_ == replay.frames_
+		       && percentile(latencies, 1) <= bound;
+	}
+
+	// stopped, and destroyed, while the consumer holds frames and the
+	// unthrottled replay waits for one to come back
+	{
+		bool held = true;
+		{
+			LidarReplay replay(1);
+			replay.Start(out, 0);
+			LidarFrame* first = replay.Next(1000);
+			LidarFrame* second = replay.Next(1000);
+			held = first != nullptr && second != nullptr;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			replay.Stop();
+			replay.Release(first);
+			replay.Release(second);
+		}
+		{
+			LidarReplay replay(1);
+			replay.Start(out, 0);
+			held = held && replay.Next(1000) != nullptr && replay.Next(1000) != nullptr;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+		std::cout << "stop and destroy with held frames: " << (held ? "ok" : "FAILED, no frames to hold") << std::endl;
+		pass = pass && held;
+	}
+	return pass ? 0 : 1;
+}
+
+// object list of the can command, Motorola objects and an Intel header
+const char* kRadarDbc =
+	"VERSION \"\"\n"
+	"\n"
+	"BO_ 1546 Obj_0_Status: 8 RADAR\n"
+	" SG_ Obj_NofObjects : 0|8@1+ (1,0) [0|255] \"\" Vector__XXX\n"
+	" SG_ Obj_MeasCounter : 8|16@1+ (1,0) [0|65535] \"\" Vector__XXX\n"
+	"\n"
+	"BO_ 1547 Obj_1_General: 8 RADAR\n"
+	" SG_ Obj_ID : 7|8@0+ (1,0) [0|255] \"\" Vector__XXX\n"
+	" SG_ Obj_DistLong : 15|16@0+ (0.02,-500) [-500|810.7] \"m\" Vector__XXX\n"
+	" SG_ Obj_DistLat : 31|14@0+ (0.02,-163.84) [-163.84|163.82] \"m\" Vector__XXX\n"
+	" SG_ Obj_VrelLong : 33|13@0- (0.02,0) [-81.92|81.9] \"m/s\" Vector__XXX\n"
+	" SG_ Obj_VrelLat : 52|13@0- (0.02,0) [-81.92|81.9] \"m/s\" Vector__XXX\n";
+
+// writes value into a signal of frame data, the inverse of the decoder
+void putSignal(uint8_t* data, const CanSignal& signal, double value)
+{
+	unsigned long long mask = signal.length == 64 ? ~0ULL : (1ULL << signal.length) - 1;
+	unsigned long long raw = (unsigned long long)std::llround((value - signal.offset)/signal.factor) & mask;
+	unsigned long long word = 0;
+	for (int i = 0; i < 8; i++)
+		word |= (unsigned long long)data[i] << (signal.big_endian ? 8*(7-i) : 8*i);
+	int shift = signal.big_endian ? (7 - signal.start_bit/8)*8 + signal.start_bit%8 - signal.length + 1 : signal.start_bit;
+	word |= raw << shift;
+	for (int i = 0; i < 8; i++)
+		data[i] = (uint8_t)(word >> (signal.big_endian ? 8*(7-i) : 8*i));
+}
+
+// one candump -l line
+void putCanLine(std::string& out, long long timeUs, int channel, unsigned int id, const uint8_t* data)
+{
+	char line[64];
+	int n = snprintf(line, sizeof(line), "(%lld.%06lld) can%d %03X#", timeUs/1000000, timeUs%1000000, channel, id);
+	out.append(line, n);
+	for (int i = 0; i < 8; i++)
+	{
+		n = snprintf(line, sizeof(line), "%02X", data[i]);
+		out.append(line, n);
+	}
+	out.push_back('\n');
+}
+
+// a header and one frame per object of one radar cycle
+void putRadarCycle(std::string& out, const CanDatabase& database, long long timeUs, int channel, unsigned int idOffset,
+                   int cycle, const std::vector<std::vector<double> >& objects)
+{
+	uint8_t data[8] = {0};
+	putSignal(data, *database.FindSignal(0x60A, "Obj_NofObjects"), objects.size());
+	putSignal(data, *database.FindSignal(0x60A, "Obj_MeasCounter"), cycle % 65536);
+	putCanLine(out, timeUs, channel, 0x60A + idOffset, data);
+	const char* names[5] = {"Obj_ID", "Obj_DistLong", "Obj_DistLat", "Obj_VrelLong", "Obj_VrelLat"};
+	for (const std::vector<double>& object : objects)
+	{
+		std::fill(data, data+8, 0);
+		for (int s = 0; s < 5; s++)
+			putSignal(data, *database.FindSignal(0x60B, names[s]), object[s]);
+		putCanLine(out, timeUs, channel, 0x60B + idOffset, data);
+	}
+}
+
+int runCan(int argc, char** argv)
+{
+	int numRadars = option(argc, argv, "--radars", 32);
+	int numObjects = option(argc, argv, "--objects", 40);
+	double seconds = option(argc, argv, "--seconds", 60);
+	std::string out = stringOption(argc, argv, "--out", "radar_objects.log");
+
+	CanDatabase database;
+	RadarObjectLayout layout;
+	RadarObjectDecoder decoder;
+	if (!database.Parse(kRadarDbc) || !decoder.Compile(database, layout))
+	{
+		std::cerr << "cannot compile the object list layout" << std::endl;
+		return 1;
+	}
+	bool pass = true;
+
+	// the highway radar measurements through an object list log and back
+	{
+		std::vector<std::vector<MeasurementPackage> > logs;
+		std::vector<std::map<long long, VectorXd> > truth;
+		std::vector<std::string> names = recordHighway(10, logs, truth);
+		std::map<long long, std::vector<std::vector<double> > > cycles;
+		for (size_t i = 0; i < logs.size(); i++)
+			for (const MeasurementPackage& meas : logs[i])
+				if (meas.sensor_type_ == MeasurementPackage::RADAR)
+				{
+					double rho = meas.raw_measurements_(0), phi = meas.raw_measurements_(1), rhoDot = meas.raw_measurements_(2);
+					cycles[meas.timestamp_].push_back({(double)i, rho*cos(phi), rho*sin(phi), rhoDot*cos(phi), rhoDot*sin(phi)});
+				}
+		std::string log;
+		int cycle = 0;
+		for (const auto& objects : cycles)
+			putRadarCycle(log, database, objects.first, 0, 0, cycle++, objects.second);
+		std::string highwayOut = out + ".highway";
+		std::ofstream(highwayOut, std::ios::binary).write(log.data(), log.size());
+
+		CandumpReader reader;
+		if (!reader.Open(highwayOut))
+		{
+			std::cerr << "cannot read " << highwayOut << std::endl;
+			return 1;
+		}
+		RadarObjectDecoder highwayDecoder;
+		highwayDecoder.Compile(database, layout);
+		highwayDecoder.AddRadar(reader.Channel("can0", 4));
+		std::vector<std::map<long long, VectorXd> > decoded(logs.size());
+		highwayDecoder.sink_ = [&](const RadarBatch& batch)
+		{
+			for (size_t k = 0; k < batch.size; k++)
+				decoded[batch.object_ids[k]][batch.timestamp_us] = batch.detections[k].raw_measurements_;
+		};
+		CanFrame frame;
+		while (reader.Next(&frame))
+			highwayDecoder.Feed(frame);
+		highwayDecoder.Flush();
+
+		VectorXd maxError = VectorXd::Zero(3);
+		for (size_t i = 0; i < logs.size(); i++)
+		{
+			std::vector<MeasurementPackage> replayed = logs[i];
+			for (MeasurementPackage& meas : replayed)
+				if (meas.sensor_type_ == MeasurementPackage::RADAR)
+				{
+					VectorXd z = decoded[i].at(meas.timestamp_);
+					VectorXd error = (z - meas.raw_measurements_).cwiseAbs();
+					error(1) = std::min(error(1), 2*M_PI - error(1));
+					maxError = maxError.cwiseMax(error);
+					meas.raw_measurements_ = z;
+				}
+			UKF original, replay;
+			std::cout << names[i] << ": rmse recorded " << stateRMSE(runTracker(original, logs[i]), truth[i]).transpose()
+			          << ", replayed " << stateRMSE(runTracker(replay, replayed), truth[i]).transpose() << std::endl;
+		}
+		std::cout << cycle << " cycles, " << highwayDecoder.frames_ << " frames, max error rho " << maxError(0)
+		          << " phi " << maxError(1) << " rho_dot " << maxError(2) << std::endl;
+		pass = pass && highwayDecoder.batches_ == cycle && highwayDecoder.incomplete_ == 0 && reader.skipped_ == 0
+		       && maxError(0) < 0.02 && maxError(2) < 0.02;
+		std::remove(highwayOut.c_str());
+	}
+
+	// radars at 20 Hz, 8 per bus with ids shifted by 0x10, and 100 Hz
+	// vehicle frames the decoder ignores
+	auto object = [](int radar, int cycle, int k)
+	{
+		double x = 2 + (radar*37 + cycle*3 + k*101) % 15000 * 0.05;
+		double y = -60 + (radar*11 + cycle + k*53) % 6000 * 0.02;
+		double vx = -40 + (radar + cycle*7 + k*13) % 4000 * 0.02;
+		double vy = -20 + (radar*3 + cycle + k*29) % 2000 * 0.02;
+		return std::vector<double>{(double)k, x, y, vx, vy};
+	};
+	int numCycles = seconds*20;
+	{
+		std::string log;
+		std::vector<std::vector<double> > objects(numObjects);
+		const long long startUs = 1700000000LL*1000000;
+		for (int c = 0; c < numCycles; c++)
+		{
+			for (int r = 0; r < numRadars; r++)
+			{
+				for (int k = 0; k < numObjects; k++)
+					objects[k] = object(r, c, k);
+				putRadarCycle(log, database, startUs + c*50000LL + r*1000, r % 4, 0x10*(r/4), c, objects);
+			}
+			uint8_t speed[8] = {0x12, 0x34, 0, 0, 0, 0, 0, 0};
+			for (int t = 0; t < 5; t++)
+				putCanLine(log, startUs + c*50000LL + t*10000, 0, 0x300, speed);
+		}
+		std::ofstream file(out, std::ios::binary);
+		file.write(log.data(), log.size());
+		if (!file)
+		{
+			std::cerr << "cannot write " << out << std::endl;
+			return 1;
+		}
+		std::cout << "wrote " << numRadars << " radars, " << numCycles << " cycles, " << log.size()/1e6 << " MB to " << out << std::endl;
+	}
+
+	CandumpReader reader;
+	for (int r = 0; r < 4 && r < numRadars; r++)
+		reader.Channel(("can" + std::to_string(r)).c_str(), 4);
+	for (int r = 0; r < numRadars; r++)
+		decoder.AddRadar(r % 4, 0x10*(r/4));
+	long long detections = 0;
+	double rhoSum = 0;
+	decoder.sink_ = [&](const RadarBatch& batch)
+	{
+		detections += batch.size;
+		for (size_t k = 0; k < batch.size; k++)
+			rhoSum += batch.detections[k].raw_measurements_(0);
+	};
+	if (!reader.Open(out))
+	{
+		std::cerr << "cannot read " << out << std::endl;
+		return 1;
+	}
+	long long numFrames = 0;
+	double allocations = MetricsRegistry::Allocations();
+	auto startTime = std::chrono::steady_clock::now();
+	CanFrame frame;
+	while (reader.Next(&frame))
+	{
+		decoder.Feed(frame);
+		numFrames++;
+	}
+	decoder.Flush();
+	double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	allocations = MetricsRegistry::Allocations() - allocations;
+	std::cout << numFrames << " frames, " << decoder.batches_ << " batches, " << detections << " detections in "
+	          << decodeSeconds << " s, " << numFrames/decodeSeconds << " frames/s, " << seconds/decodeSeconds
+	          << "x real time, " << allocationCount(allocations) << ", mean range " << rhoSum/detections << " m" << std::endl;
+	pass = pass && decoder.batches_ == (long long)numRadars*numCycles && decoder.incomplete_ == 0
+	       && detections == (long long)numRadars*numCycles*numObjects && reader.skipped_ == 0;
+
+	// every detection against the objects that were written
+	CandumpReader checkReader;
+	checkReader.Channel("can0", 4);
+	checkReader.Channel("can1", 4);
+	checkReader.Channel("can2", 4);
+	checkReader.Channel("can3", 4);
+	checkReader.Open(out);
+	double maxError = 0;
+	int cycleOf = 0;
+	std::vector<int> cycles(numRadars, 0);
+	decoder.sink_ = [&](const RadarBatch& batch)
+	{
+		cycleOf = cycles[batch.radar]++;
+		for (size_t k = 0; k < batch.size; k++)
+		{
+			std::vector<double> o = object(batch.radar, cycleOf, batch.object_ids[k]);
+			double rho = sqrt(o[1]*o[1] + o[2]*o[2]);
+			const VectorXd& z = batch.detections[k].raw_measurements_;
+			maxError = std::max(maxError, std::fabs(z(0) - rho));
+			maxError = std::max(maxError, std::fabs(z(2) - (o[1]*o[3] + o[2]*o[4])/rho));
+			maxError = std::max(maxError, rho*std::fabs(z(1) - atan2(o[2], o[1])));
+		}
+	};
+	while (checkReader.Next(&frame))
+		decoder.Feed(frame);
+	std::cout << "max error " << maxError << " m" << std::endl;
+	pass = pass && maxError < 0.05;
+	return pass ? 0 : 1;
+}
+
+int runSync(int argc, char** argv)
+{
+	long long lidarLatency = option(argc, argv, "--lidar-latency", 80000);
+	long long radarLatency = option(argc, argv, "--radar-latency", 30000);
+	int numStreams = option(argc, argv, "--streams", 16);
+	double seconds = option(argc, argv, "--seconds", 60);
+	int frame_per_sec = 30;
+	bool pass = true;
+
+	// the highway with prompt sensors, late ones filtered in arrival order and
+	// late ones through the synchronizer
+	for (int run = 0; run < 3; run++)
+	{
+		pcl::visualization::PCLVisualizer::Ptr viewer;
+		Highway highway(viewer);
+		if (run > 0)
+		{
+			highway.lidar_latency = lidarLatency;
+			highway.radar_latency = radarLatency;
+			highway.synchronize_sensors = run == 2;
+		}
+		for (int frame = 0; frame < frame_per_sec*10; frame++)
+			highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+		// late sensors start the tracks a few frames late, score from the second second
+		Tools& tools = highway.tools;
+		size_t skip = frame_per_sec*tools.estimations.size()/(frame_per_sec*10);
+		std::vector<VectorXd> estimations(tools.estimations.begin()+skip, tools.estimations.end());
+		std::vector<VectorXd> groundTruth(tools.ground_truth.begin()+skip, tools.ground_truth.end());
+		VectorXd rmse = tools.CalculateRMSE(estimations, groundTruth);
+		const char* names[3] = {"prompt", "late, arrival order", "late, synchronized"};
+		std::cout << names[run] << ": rmse after 1 s " << rmse.transpose();
+		if (run == 2)
+		{
+			const SynchronizerStats& stats = highway.synchronizer->stats_;
+			std::cout << ", " << stats.released << " released, " << stats.late << " late, mean wait "
+			          << 1e-3*stats.total_wait_us/std::max(1LL, stats.released) << " ms max " << 1e-3*stats.max_wait_us << " ms";
+			pass = pass && stats.late == 0 && stats.max_wait_us <= std::max(lidarLatency, radarLatency);
+		}
+		std::cout << std::endl;
+	}
+
+	// streams of 10 to 100 Hz with latencies of 5 to 100 ms, each in order
+	std::mt19937 rng(1);
+	std::vector<SyncedMeasurement> arrivals;
+	std::vector<long long> latencies(numStreams);
+	TimeSynchronizer synchronizer;
+	for (int k = 0; k < numStreams; k++)
+	{
+		latencies[k] = 5000 + (k*13 % 20)*5000;
+		synchronizer.AddStream("s" + std::to_string(k), latencies[k]);
+		long long period = 1000000 / (10 + (k*37) % 91);
+		long long lastArrival = 0;
+		for (long long t = (k*7919) % period; t < seconds*1e6; t += period)
+		{
+			MeasurementPackage meas;
+			meas.sensor_type_ = MeasurementPackage::LASER;
+			meas.timestamp_ = t;
+			meas.raw_measurements_ = VectorXd::Zero(2);
+			lastArrival = std::max(lastArrival, t + std::uniform_int_distribution<long long>(0, latencies[k])(rng));
+			arrivals.push_back({k, k, meas, lastArrival});
+		}
+	}
+	std::stable_sort(arrivals.begin(), arrivals.end(), [](const SyncedMeasurement& a, const SyncedMeasurement& b)
+	{
+		return a.arrival_us < b.arrival_us;
+	});
+	long long maxLatency = *std::max_element(latencies.begin(), latencies.end());
+
+	long long lastTimestamp = LLONG_MIN;
+	long long released = 0;
+	bool ordered = true;
+	TimeSynchronizer::Sink sink = [&](const SyncedMeasurement& synced)
+	{
+		ordered = ordered && synced.meas.timestamp_ >= lastTimestamp;
+		lastTimestamp = synced.meas.timestamp_;
+		released++;
+	};
+	auto startTime = std::chrono::steady_clock::now();
+	for (const SyncedMeasurement& synced : arrivals)
+	{
+		for (long long due = synchronizer.NextReleaseTime(); due <= synced.arrival_us; due = synchronizer.NextReleaseTime())
+			synchronizer.Release(due, sink);
+		synchronizer.Push(synced.stream, synced.track_id, synced.meas, synced.arrival_us);
+		synchronizer.Release(synced.arrival_us, sink);
+	}
+	synchronizer.Drain(sink);
+	double mergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	// holding every measurement for the largest latency orders them as well
+	double fixedWait = 0;
+	for (const SyncedMeasurement& synced : arrivals)
+		fixedWait += synced.meas.timestamp_ + maxLatency - synced.arrival_us;
+	const SynchronizerStats& stats = synchronizer.stats_;
+	std::cout << numStreams << " streams: " << released << " measurements merged in " << mergeSeconds << " s, "
+	          << released/mergeSeconds << " measurements/s, " << (ordered ? "in order" : "OUT OF ORDER") << ", mean wait "
+	          << 1e-3*stats.total_wait_us/released << " ms max " << 1e-3*stats.max_wait_us << " ms, holding for the largest latency "
+	          << 1e-3*fixedWait/arrivals.size() << " ms" << std::endl;
+	pass = pass && ordered && released == (long long)arrivals.size() && stats.late == 0
+	       && stats.max_wait_us <= maxLatency && stats.total_wait_us <= fixedWait;
+	return pass ? 0 : 1;
+}
+
+int runRig(int argc, char** argv)
+{
+	int repeats = option(argc, argv, "--repeats", 20);
+	int frame_per_sec = 30;
+	int frames = frame_per_sec*10;
+	bool pass = true;
+
+	// detections per tracked car and frame it is detected in
+	{
+		pcl::visualization::PCLVisualizer::Ptr viewer;
+		Highway highway(viewer);
+		std::vector<SensorMount> rig = CornerRadarRig();
+		long long detections = 0, detected = 0, radarFrames = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			long long timestamp = 1000000LL*frame/frame_per_sec;
+			for (Car& car : highway.traffic)
+			{
+				car.move((double)1/frame_per_sec, timestamp);
+				std::vector<MountedMeasurement> seen = highway.tools.rigSense(car, rig, timestamp, frame_per_sec);
+				detections += seen.size();
+				detected += !seen.empty();
+			}
+			radarFrames += rig[1].Fires(timestamp, 1000000/frame_per_sec);
+		}
+		std::cout << "corner rig: " << rig.size() << " sensors, " << (double)detections/detected
+		          << " observations per target and cycle, " << radarFrames << " radar cycles in " << frames << " frames" << std::endl;
+	}
+
+	// the stock sensors, then the stock and the corner rig per detection and stacked
+	const char* names[5] = {"stock sensors", "stock rig, per detection", "stock rig, stacked",
+	                        "corner rig, per detection", "corner rig, stacked"};
+	for (int run = 0; run < 5; run++)
+	{
+		VectorXd rmse;
+		bool below = true;
+		double seconds = 0;
+		for (int repeat = 0; repeat < repeats; repeat++)
+		{
+			pcl::visualization::PCLVisualizer::Ptr viewer;
+			Highway highway(viewer);
+			if (run > 0)
+			{
+				highway.rig = run < 3 ? StockRig() : CornerRadarRig();
+				highway.stacked_updates = run % 2 == 0;
+			}
+			auto startTime = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				highway.stepHighway(25, 1000000LL*frame/frame_per_sec, frame_per_sec, viewer);
+				if (frame > frame_per_sec)
+				{
+					// the highway's own check, from the second second on
+					VectorXd frameRmse = highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+					for (int k = 0; k < 4; k++)
+						below = below && frameRmse(k) <= highway.rmseThreshold[k];
+				}
+			}
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			rmse = highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+		}
+		std::cout << names[run] << ": rmse " << rmse.transpose() << ", " << (below ? "below" : "ABOVE")
+		          << " the thresholds, " << 1e6*seconds/(repeats*frames) << " us per frame" << std::endl;
+		pass = pass && below;
+	}
+	return pass ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		usage();
+		return 1;
+	}
+
+	std::string command = argv[1];
+	if (command == "shards")
+		return runShards(argc, argv);
+	if (command == "distributed")
+		return runDistributed(argc, argv);
+	if (command == "tune")
+		return runTune(argc, argv);
+	if (command == "smooth")
+		return runSmooth(argc, argv);
+	if (command == "accuracy")
+		return runAccuracy(argc, argv);
+	if (command == "events")
+		return runEvents(argc, argv);
+	if (command == "radar")
+		return runRadar(argc, argv);
+	if (command == "init")
+		return runInit(argc, argv);
+	if (command == "particles")
+		return runParticles(argc, argv);
+	if (command == "collisions")
+		return runCollisions(argc, argv);
+	if (command == "forks")
+		return runForks(argc, argv);
+	if (command == "mot")
+		return runMot(argc, argv);
+	if (command == "columnar")
+		return runColumnar(argc, argv);
+	if (command == "logging")
+		return runLogging(argc, argv);
+	if (command == "isa")
+		return runIsa(argc, argv);
+	if (command == "regress")
+		return runRegress(argc, argv);
+	if (command == "metrics")
+		return runMetrics(argc, argv);
+	if (command == "pcap")
+		return runPcap(argc, argv);
+	if (command == "can")
+		return runCan(argc, argv);
+	if (command == "sync")
+		return runSync(argc, argv);
+	if (command == "rig")
+		return runRig(argc, argv);
+
+	usage();
+	return 1;
+}
@@ -1,9 +1,24 @@
 /* \author Aaron Brown */
 // Handle logic for creating traffic on highway and animating it
 
+#ifndef HIGHWAY_H
+#define HIGHWAY_H
+
 #include "render/render.h"
 #include "sensors/lidar.h"
 #include "tools.h"
+#include "measurement_scheduler.h"
+#include "track_scheduler.h"
+#include "track_fusion.h"
+#include "speculative_predictor.h"
+#include "collision.h"
+#include "simulation_fork.h"
+#include "track_log.h"
+#include "time_synchronizer.h"
+#include "async_logger.h"
+#include "metrics.h"
+#include <memory>
+#include <random>
 
 class Highway
 {
@@ -28,8 +43,54 @@ public:
 	// Predict path in the future using UKF
 	double projectedTime = 0;
 	int projectedSteps = 0;
+	// Queue measurements and filter them through the deadline-aware scheduler
+	bool schedule_measurements = false;
+	// Give far and receding tracks reduced update rates
+	bool schedule_tracks = false;
+	// Filter lidar and radar in separate threads and fuse the local tracks
+	bool fuse_sensors = false;
+	// Predict tracks between frames so measurements only run the update
+	bool speculate_predictions = false;
+	// Radar update method of every filter, see UKF::UpdateMethod
+	UKF::UpdateMethod radar_update = UKF::UNSCENTED;
+	// Skip updates whose innovation carries little information
+	bool event_triggered_updates = false;
+	// Fit new tracks to their measurements of this many us, 0 starts them from one
+	long long init_window = 0;
+	// Export every estimate to this columnar track log, empty for none
+	std::string track_log_path = "";
+	// Predict collision probability and time to collision with the ego car
+	bool predict_collisions = false;
+	// Deliver lidar and radar measurements up to this many us late, in order
+	// per sensor, as processing and buses do
+	long long lidar_latency = 0;
+	long long radar_latency = 0;
+	// Merge late measurements back into timestamp order before the filters
+	bool synchronize_sensors = true;
+	// Sense with these mounted sensors instead of the stock lidar and radar,
+	// e.g. CornerRadarRig(). The rig feeds the filters directly, bypassing
+	// the latency, scheduling, fusion and speculation stages above
+	std::vector<SensorMount> rig;
+	// Apply all rig detections of a track in a frame as one stacked update
+	bool stacked_updates = true;
 	// --------------------------------
 
+	MeasurementScheduler scheduler;
+	TrackScheduler trackScheduler;
+	std::unique_ptr<TrackFusion> fusion;
+	std::unique_ptr<SpeculativePredictor> speculator;
+	std::unique_ptr<CollisionPredictor> collisions;
+	std::vector<CollisionRisk> risks;
+	std::unique_ptr<TrackLogWriter> trackLog;
+	std::unique_ptr<TimeSynchronizer> synchronizer;
+	// delayed measurements not yet arrived, arrival_us is when they will
+	std::vector<SyncedMeasurement> inFlight;
+	long long lastArrival[2] = {0, 0};
+	std::mt19937 latencyRng;
+	// true once tools.measurementSink feeds routeMeasurement
+	bool routed = false;
+
+	// viewer may be null to run the scenario headless
 	Highway(pcl::visualization::PCLVisualizer::Ptr& viewer)
 	{
 
@@ -98,17 +159,102 @@ public:
 		lidar = new Lidar(traffic,0);
 	
 		// render environment
-		renderHighway(0,viewer);
-		egoCar.render(viewer);
-		car1.render(viewer);
-		car2.render(viewer);
-		car3.render(viewer);
+		if(viewer)
+		{
+			renderHighway(0,viewer);
+			egoCar.render(viewer);
+			car1.render(viewer);
+			car2.render(viewer);
+			car3.render(viewer);
+		}
+	}
+
+	~Highway()
+	{
+		delete lidar;
+	}
+
+	// Sensed measurements pass the enabled stages in this order: sensor
+	// latency and synchronization, the scheduler, then the filters
+	void routeMeasurement(int id, const MeasurementPackage& meas_package)
+	{
+		if(!synchronizer)
+		{
+			scheduleMeasurement(id, meas_package);
+			return;
+		}
+		int stream = meas_package.sensor_type_ == MeasurementPackage::LASER ? 0 : 1;
+		long long latency = stream == 0 ? lidar_latency : radar_latency;
+		long long delay = std::uniform_int_distribution<long long>(0, latency)(latencyRng);
+		lastArrival[stream] = std::max(lastArrival[stream], meas_package.timestamp_ + delay);
+		inFlight.push_back({stream, id, meas_package, lastArrival[stream]});
+	}
+
+	void scheduleMeasurement(int id, const MeasurementPackage& meas_package)
+	{
+		if(schedule_measurements)
+			scheduler.Enqueue(id, meas_package);
+		else
+			filterMeasurement(id, meas_package);
+	}
+
+	void filterMeasurement(int id, const MeasurementPackage& meas_package)
+	{
+		if(fusion)
+			fusion->Submit(id, meas_package);
+		else if(speculator)
+			speculator->ProcessMeasurement(id, traffic[id].ukf, meas_package);
+		else
+			traffic[id].ukf.ProcessMeasurement(meas_package);
+	}
+
+	// branch the current state off for what-if rollouts
+	SimulationFork fork(long long timestamp)
+	{
+		return SimulationFork::Snapshot(traffic, egoCar, timestamp);
 	}
 	
 	void stepHighway(double egoVelocity, long long timestamp, int frame_per_sec, pcl::visualization::PCLVisualizer::Ptr& viewer)
 	{
+		bool render = (bool)viewer;
+
+		if(fuse_sensors && speculate_predictions)
+		{
+			// fusion filters in its own sensor-local tracks, the speculated car filters would never see a measurement
+			AsyncLogger::Instance().Log(LOG_ERROR, "speculate_predictions does not work with fuse_sensors, speculation is off");
+			speculate_predictions = false;
+		}
+		if(fuse_sensors && !fusion)
+			fusion.reset(new TrackFusion());
+		if(!track_log_path.empty() && !trackLog)
+		{
+			trackLog.reset(new TrackLogWriter());
+			if(!trackLog->Open(track_log_path))
+			{
+				AsyncLogger::Instance().Log(LOG_ERROR, "Cannot write track log {}", track_log_path);
+				trackLog.reset();
+				track_log_path.clear();
+			}
+		}
+		if(speculate_predictions && !speculator)
+			speculator.reset(new SpeculativePredictor());
+		if((lidar_latency > 0 || radar_latency > 0) && !synchronizer)
+		{
+			synchronizer.reset(new TimeSynchronizer());
+			synchronizer->AddStream("lidar", lidar_latency);
+			synchronizer->AddStream("radar", radar_latency);
+		}
+		if((schedule_measurements || fusion || speculator || synchronizer) && !routed)
+		{
+			// sensed cars are references into traffic, their index is the track id
+			tools.measurementSink = [this](Car& car, const MeasurementPackage& meas_package)
+			{
+				routeMeasurement(&car - &traffic[0], meas_package);
+			};
+			routed = true;
+		}
 
-		if(visualize_pcd)
+		if(visualize_pcd && render)
 		{
 			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
 			renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
@@ -116,13 +262,16 @@ public:
 		
 
 		// render highway environment with poles
-		renderHighway(egoVelocity*timestamp/1e6, viewer);
-		egoCar.render(viewer);
+		if(render)
+		{
+			renderHighway(egoVelocity*timestamp/1e6, viewer);
+			egoCar.render(viewer);
+		}
 		
 		for (int i = 0; i < traffic.size(); i++)
 		{
 			traffic[i].move((double)1/frame_per_sec, timestamp);
-			if(!visualize_pcd)
+			if(!visualize_pcd && render)
 				traffic[i].render(viewer);
 			// Sense surrounding cars with lidar and radar
 			if(trackCars[i])
@@ -130,25 +279,197 @@ public:
 				VectorXd gt(4);
 				gt << traffic[i].position.x, traffic[i].position.y, traffic[i].velocity*cos(traffic[i].angle), traffic[i].velocity*sin(traffic[i].angle);
 				tools.ground_truth.push_back(gt);
-				tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar);
-				tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar);
-				tools.ukfResults(traffic[i],viewer, projectedTime, projectedSteps);
+				traffic[i].ukf.radar_update_ = radar_update;
+				if(event_triggered_updates)
+					traffic[i].ukf.event_trigger_ = true;
+				if(init_window > 0)
+					traffic[i].ukf.init_window_us_ = init_window;
+				if(schedule_tracks && !trackScheduler.ShouldUpdate(i, traffic[i].ukf, egoCar, timestamp))
+					continue;
+				if(!rig.empty())
+				{
+					std::vector<MountedMeasurement> detections = tools.rigSense(traffic[i], rig, timestamp, frame_per_sec);
+					if(stacked_updates)
+						traffic[i].ukf.ProcessStacked(detections);
+					else
+						for (const MountedMeasurement& detection : detections)
+							traffic[i].ukf.ProcessStacked(std::vector<MountedMeasurement>(1, detection));
+					continue;
+				}
+				tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar && render);
+				tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar && render);
+			}
+		}
+
+		if(synchronizer)
+		{
+			// hand over what arrived by now in arrival order, releasing as soon
+			// as the order is settled
+			std::stable_sort(inFlight.begin(), inFlight.end(), [](const SyncedMeasurement& a, const SyncedMeasurement& b)
+			{
+				return a.arrival_us < b.arrival_us;
+			});
+			auto process = [this](const SyncedMeasurement& synced)
+			{
+				scheduleMeasurement(synced.track_id, synced.meas);
+			};
+			size_t arrived = 0;
+			for (; arrived < inFlight.size() && inFlight[arrived].arrival_us <= timestamp; arrived++)
+			{
+				const SyncedMeasurement& synced = inFlight[arrived];
+				if(!synchronize_sensors)
+				{
+					process(synced);
+					continue;
+				}
+				for (long long due = synchronizer->NextReleaseTime(); due <= synced.arrival_us; due = synchronizer->NextReleaseTime())
+					synchronizer->Release(due, process);
+				synchronizer->Push(synced.stream, synced.track_id, synced.meas, synced.arrival_us);
+				synchronizer->Release(synced.arrival_us, process);
+			}
+			inFlight.erase(inFlight.begin(), inFlight.begin()+arrived);
+			for (long long due = synchronizer->NextReleaseTime(); synchronize_sensors && due <= timestamp; due = synchronizer->NextReleaseTime())
+				synchronizer->Release(due, process);
+		}
+
+		if(schedule_measurements)
+		{
+			auto distance = [this](int id)
+			{
+				// tracks without an estimate yet are served first
+				const UKF& ukf = traffic[id].ukf;
+				if(!ukf.is_initialized_)
+					return 0.0;
+				return sqrt((ukf.x_[0]-egoCar.position.x)*(ukf.x_[0]-egoCar.position.x)+(ukf.x_[1]-egoCar.position.y)*(ukf.x_[1]-egoCar.position.y));
+			};
+			auto process = [this](int id, const MeasurementPackage& meas_package)
+			{
+				filterMeasurement(id, meas_package);
+			};
+			scheduler.Dispatch(timestamp, distance, process);
+			if(render)
+				viewer->addText("Shed stale: "+std::to_string(scheduler.stats_.shed_stale)+" coalesced: "+std::to_string(scheduler.stats_.coalesced), 30, 325, 20, 1, 1, 1, "scheduler");
+		}
+
+		if(fusion)
+		{
+			// wait for the sensor threads so runs stay reproducible
+			fusion->Sync();
+			for (size_t i = 0; i < traffic.size(); i++)
+			{
+				VectorXd x;
+				MatrixXd P;
+				if(trackCars[i] && fusion->Fuse(i, timestamp, x, P))
+				{
+					traffic[i].ukf.x_ = x;
+					traffic[i].ukf.P_ = P;
+					traffic[i].ukf.time_us_ = timestamp;
+					traffic[i].ukf.is_initialized_ = true;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < traffic.size(); i++)
+		{
+			if(trackCars[i])
+			{
+				if(render)
+					tools.ukfResults(traffic[i],viewer, projectedTime, projectedSteps);
+				// coasting tracks report a mean-only prediction to the current time
+				VectorXd x = traffic[i].ukf.x_;
+				if(traffic[i].ukf.time_us_ < timestamp)
+					x = traffic[i].ukf.PredictMean((timestamp - traffic[i].ukf.time_us_) / 1e6);
 				VectorXd estimate(4);
-				double v  = traffic[i].ukf.x_(2);
-    			double yaw = traffic[i].ukf.x_(3);
+				double v  = x(2);
+    			double yaw = x(3);
     			double v1 = cos(yaw)*v;
     			double v2 = sin(yaw)*v;
-				estimate << traffic[i].ukf.x_[0], traffic[i].ukf.x_[1], v1, v2;
+				estimate << x[0], x[1], v1, v2;
 				tools.estimations.push_back(estimate);
-	
+				if(trackLog)
+				{
+					TrackSample sample;
+					sample.timestamp = timestamp;
+					sample.track_id = i;
+					sample.px = x[0];
+					sample.py = x[1];
+					sample.vx = v1;
+					sample.vy = v2;
+					for (int k = 0; k < 5; k++)
+						sample.p_diag[k] = traffic[i].ukf.P_(k, k);
+					sample.nis = traffic[i].ukf.nis_;
+					trackLog->Append(sample);
+				}
+			}
+		}
+
+		if(predict_collisions)
+		{
+			if(!collisions)
+				collisions.reset(new CollisionPredictor());
+			std::vector<TrackBox> tracks;
+			TrackBox ego;
+			ego.id = -1;
+			ego.x = VectorXd::Zero(5);
+			ego.x << egoCar.position.x, egoCar.position.y, egoCar.velocity, egoCar.angle, 0;
+			ego.P = MatrixXd::Zero(5, 5);
+			ego.length = egoCar.dimensions.x;
+			ego.width = egoCar.dimensions.y;
+			tracks.push_back(ego);
+			for (size_t i = 0; i < traffic.size(); i++)
+			{
+				if(!trackCars[i] || !traffic[i].ukf.is_initialized_)
+					continue;
+				TrackBox track;
+				track.id = i;
+				track.x = traffic[i].ukf.x_;
+				track.P = traffic[i].ukf.P_;
+				track.length = traffic[i].dimensions.x;
+				track.width = traffic[i].dimensions.y;
+				tracks.push_back(track);
+			}
+			risks = collisions->Evaluate(tracks);
+			if(render)
+			{
+				double probability = 0;
+				double ttc = INFINITY;
+				for (const CollisionRisk& risk : risks)
+				{
+					if(risk.a != -1)
+						continue;
+					probability = std::max(probability, risk.probability);
+					ttc = std::min(ttc, risk.ttc);
+				}
+				viewer->addText("Collision risk: "+std::to_string(probability)+" TTC: "+(std::isinf(ttc) ? std::string("none") : std::to_string(ttc)+" s"), 30, 350, 20, 1, 1, 1, "collision");
 			}
 		}
-		viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
+
+		if(speculator)
+		{
+			// the time until the next frame is idle, predict every track ahead
+			std::vector<const UKF*> filters;
+			for (size_t i = 0; i < traffic.size(); i++)
+				filters.push_back(trackCars[i] ? &traffic[i].ukf : nullptr);
+			speculator->Speculate(filters);
+		}
 		VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
-		viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
-		viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
-		viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
-		viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
+		static Gauge* rmseGauges[4] = {
+			&MetricsRegistry::Instance().GetGauge("ukf_rmse", "Running RMSE of the tracked cars", "component=\"x\""),
+			&MetricsRegistry::Instance().GetGauge("ukf_rmse", "Running RMSE of the tracked cars", "component=\"y\""),
+			&MetricsRegistry::Instance().GetGauge("ukf_rmse", "Running RMSE of the tracked cars", "component=\"vx\""),
+			&MetricsRegistry::Instance().GetGauge("ukf_rmse", "Running RMSE of the tracked cars", "component=\"vy\"")};
+		static Gauge& rmseSamples = MetricsRegistry::Instance().GetGauge("ukf_rmse_samples", "Estimates in the running RMSE");
+		for (int i = 0; i < 4; i++)
+			rmseGauges[i]->Set(rmse[i]);
+		rmseSamples.Set(tools.estimations.size());
+		if(render)
+		{
+			viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
+			viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
+			viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
+			viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
+			viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
+		}
 
 		if(timestamp > 1.0e6)
 		{
@@ -174,7 +495,7 @@ public:
 				pass = false;
 			}
 		}
-		if(!pass)
+		if(!pass && render)
 		{
 			viewer->addText("RMSE Failed Threshold", 30, 150, 20, 1, 0, 0, "rmse_fail");
 			if(rmseFailLog[0] > 0)
@@ -189,4 +510,6 @@ public:
 		
 	}
 	
-};
\ No newline at end of file
+};
+
+#endif
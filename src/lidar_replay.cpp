@@ -0,0 +1,460 @@
+#include "lidar_replay.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fast_math.h"
+#include "metrics.h"
+
+namespace {
+
+const uint32_t kPcapMagic = 0xa1b2c3d4;
+const uint32_t kPcapMagicNs = 0xa1b23c4d;
+const size_t kPcapHeaderBytes = 24;
+const size_t kRecordHeaderBytes = 16;
+
+const uint32_t kLinkNull = 0;
+const uint32_t kLinkEthernet = 1;
+const uint32_t kLinkRaw = 101;
+const uint32_t kLinkLinuxCooked = 113;
+
+const int kBlocks = 12;
+const int kBlockBytes = 100;
+const int kLasers = 16;
+// firing sequences take 55.296 us, a block two of them
+const double kSequenceUs = 55.296;
+const double kDistanceUnit = 0.002;
+const uint8_t kDualReturn = 0x39;
+// elevation of each laser in deg, in firing order
+const int kElevation[kLasers] = {-15, 1, -13, 3, -11, 5, -9, 7, -7, 9, -5, 11, -3, 13, -1, 15};
+
+uint16_t Little16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+uint32_t Little32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint16_t Big16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+long long SteadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Counter &Packets() {
+  static Counter &counter = MetricsRegistry::Instance().GetCounter(
+      "lidar_replay_packets_total", "Lidar data packets decoded from captures");
+  return counter;
+}
+
+Counter &Frames(const char *outcome) {
+  return MetricsRegistry::Instance().GetCounter(
+      "lidar_replay_frames_total", "Lidar rotations by what became of them",
+      std::string("outcome=\"") + outcome + "\"");
+}
+
+Histogram &HandoffLatency() {
+  static Histogram &histogram = MetricsRegistry::Instance().GetHistogram(
+      "lidar_replay_handoff_seconds", "Time from a finished rotation to its consumer",
+      MetricsRegistry::LatencyBounds());
+  return histogram;
+}
+
+}  // namespace
+
+LidarFrame::LidarFrame(int capacity)
+    : capacity(capacity), columns(0), timestamp_us(0), sequence(0), overflow(0), ready_ns(0),
+      x(kRows * capacity), y(kRows * capacity), z(kRows * capacity),
+      intensity(kRows * capacity), azimuth(capacity), column_time_us(capacity) {}
+
+void LidarFrame::Clear() {
+  columns = 0;
+  timestamp_us = 0;
+  overflow = 0;
+}
+
+PcapReader::PcapReader()
+    : data_(nullptr), size_(0), offset_(0), swapped_(false), nanoseconds_(false),
+      link_type_(kLinkEthernet) {}
+
+PcapReader::~PcapReader() {
+  Close();
+}
+
+void PcapReader::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  offset_ = 0;
+}
+
+uint32_t PcapReader::Read32(const uint8_t *p) const {
+  uint32_t value = Little32(p);
+  return swapped_ ? __builtin_bswap32(value) : value;
+}
+
+bool PcapReader::Open(const std::string &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < kPcapHeaderBytes) {
+    close(fd);
+    return false;
+  }
+  size_ = info.st_size;
+  void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(mapped);
+  // the packets are read once front to back
+  madvise(mapped, size_, MADV_SEQUENTIAL);
+
+  uint32_t magic = Little32(data_);
+  swapped_ = magic == __builtin_bswap32(kPcapMagic) || magic == __builtin_bswap32(kPcapMagicNs);
+  magic = Read32(data_);
+  if (magic != kPcapMagic && magic != kPcapMagicNs) {
+    Close();
+    return false;
+  }
+  nanoseconds_ = magic == kPcapMagicNs;
+  link_type_ = Read32(data_ + 20) & 0xFFFF;
+  offset_ = kPcapHeaderBytes;
+  return true;
+}
+
+void PcapReader::Rewind() {
+  if (data_ != nullptr) {
+    offset_ = kPcapHeaderBytes;
+  }
+}
+
+bool PcapReader::Next(const uint8_t **payload, size_t *size, long long *timestamp_us, int *port) {
+  while (data_ != nullptr && size_ - offset_ >= kRecordHeaderBytes) {
+    const uint8_t *record = data_ + offset_;
+    size_t captured = Read32(record + 8);
+    if (captured > size_ - offset_ - kRecordHeaderBytes) {
+      // truncated capture
+      offset_ = size_;
+      return false;
+    }
+    offset_ += kRecordHeaderBytes + captured;
+    const uint8_t *packet = record + kRecordHeaderBytes;
+    const uint8_t *end = packet + captured;
+
+    // link layer down to the IPv4 header
+    const uint8_t *ip = packet;
+    if (link_type_ == kLinkEthernet) {
+      if (captured < 14) {
+        continue;
+      }
+      size_t header = 14;
+      uint16_t ether_type = Big16(packet + 12);
+      while (ether_type == 0x8100 && captured >= header + 4) {
+        ether_type = Big16(packet + header + 2);
+        header += 4;
+      }
+      if (ether_type != 0x0800) {
+        continue;
+      }
+      ip = packet + header;
+    } else if (link_type_ == kLinkLinuxCooked) {
+      if (captured < 16 || Big16(packet + 14) != 0x0800) {
+        continue;
+      }
+      ip = packet + 16;
+    } else if (link_type_ == kLinkNull) {
+      ip = packet + 4;
+    } else if (link_type_ != kLinkRaw) {
+      continue;
+    }
+
+    if (end - ip < 20 || (ip[0] >> 4) != 4 || ip[9] != 17) {
+      continue;
+    }
+    size_t ip_header = (ip[0] & 0x0F) * 4;
+    // more fragments or a fragment offset
+    if ((Big16(ip + 6) & 0x3FFF) != 0 || end - ip < static_cast<long>(ip_header + 8)) {
+      continue;
+    }
+    const uint8_t *udp = ip + ip_header;
+    size_t length = Big16(udp + 4);
+    if (length < 8 || udp + length > end) {
+      continue;
+    }
+
+    *payload = udp + 8;
+    *size = length - 8;
+    *port = Big16(udp + 2);
+    long long seconds = Read32(record);
+    long long fraction = Read32(record + 4);
+    *timestamp_us = seconds * 1000000 + (nanoseconds_ ? fraction / 1000 : fraction);
+    return true;
+  }
+  return false;
+}
+
+VelodyneDecoder::VelodyneDecoder() : rotations_(0), last_azimuth_(0) {
+  for (int laser = 0; laser < kLasers; ++laser) {
+    double elevation = kElevation[laser] * M_PI / 180;
+    cos_elevation_[laser] = cos(elevation);
+    sin_elevation_[laser] = sin(elevation);
+    row_of_laser_[laser] = (kElevation[laser] + 15) / 2;
+  }
+}
+
+int VelodyneDecoder::Decode(const uint8_t *payload, size_t size, LidarFrame *frame, int first) {
+  if (size != kVelodynePacketBytes) {
+    return -1;
+  }
+  const int step = payload[1204] == kDualReturn ? 2 : 1;
+  const uint32_t packet_us = Little32(payload + 1200);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  for (int firing = first; firing < kFirings; ++firing) {
+    int block = firing / 2;
+    int sequence = firing % 2;
+    if (block % step != 0) {
+      continue;
+    }
+    const uint8_t *data = payload + block * kBlockBytes;
+    if (data[0] != 0xFF || data[1] != 0xEE) {
+      return -1;
+    }
+
+    // the second sequence fires halfway to the next block
+    double azimuth = Little16(data + 2);
+    if (sequence == 1) {
+      int next = block + step < kBlocks ? block + step : block - step;
+      double other = Little16(payload + next * kBlockBytes + 2);
+      double gap = next > block ? other - azimuth : azimuth - other;
+      if (gap < 0) {
+        gap += 36000;
+      }
+      azimuth += gap / 2;
+      if (azimuth >= 36000) {
+        azimuth -= 36000;
+      }
+    }
+
+    if (frame->columns + frame->overflow > 0 && azimuth < last_azimuth_) {
+      return firing;
+    }
+    if (frame->columns + frame->overflow == 0) {
+      ++rotations_;
+    }
+    last_azimuth_ = azimuth;
+    if (frame->columns == frame->capacity) {
+      ++frame->overflow;
+      continue;
+    }
+
+    int column = frame->columns++;
+    double alpha = azimuth * M_PI / 18000;
+    double sin_alpha, cos_alpha;
+    FastSinCos(alpha, &sin_alpha, &cos_alpha);
+    long long time_us = packet_us + llround(((block / step) * 2 + sequence) * kSequenceUs);
+    frame->azimuth[column] = alpha;
+    frame->column_time_us[column] = time_us;
+    if (column == 0) {
+      frame->timestamp_us = time_us;
+    }
+
+    const uint8_t *channel = data + 4 + sequence * kLasers * 3;
+    for (int laser = 0; laser < kLasers; ++laser, channel += 3) {
+      int index = frame->index(row_of_laser_[laser], column);
+      uint16_t raw = Little16(channel);
+      if (raw == 0) {
+        frame->x[index] = nan;
+        frame->y[index] = nan;
+        frame->z[index] = nan;
+        frame->intensity[index] = nan;
+        continue;
+      }
+      double range = raw * kDistanceUnit;
+      double planar = range * cos_elevation_[laser];
+      frame->x[index] = planar * sin_alpha;
+      frame->y[index] = planar * cos_alpha;
+      frame->z[index] = range * sin_elevation_[laser];
+      frame->intensity[index] = channel[2];
+    }
+  }
+  return kFirings;
+}
+
+LidarReplay::LidarReplay(int queue_frames, int capacity)
+    : packets_(0), frames_(0), dropped_(0), queue_frames_(queue_frames < 1 ? 1 : queue_frames),
+      ready_head_(0), ready_count_(0), filling_(nullptr), lossless_(false), stop_(false),
+      finished_(true) {
+  // one frame filling, one held by the consumer, the rest queued
+  for (size_t i = 0; i < queue_frames_ + 2; ++i) {
+    pool_.emplace_back(new LidarFrame(capacity));
+  }
+  ready_.resize(pool_.size());
+  free_.reserve(pool_.size());
+}
+
+LidarReplay::~LidarReplay() {
+  Stop();
+}
+
+bool LidarReplay::Start(const std::string &path, double rate) {
+  Stop();
+  if (!reader_.Open(path)) {
+    return false;
+  }
+  decoder_ = VelodyneDecoder();
+  free_.clear();
+  ready_head_ = 0;
+  ready_count_ = 0;
+  for (size_t i = 1; i < pool_.size(); ++i) {
+    free_.push_back(pool_[i].get());
+  }
+  filling_ = pool_[0].get();
+  filling_->Clear();
+  filling_->sequence = 0;
+  packets_ = 0;
+  frames_ = 0;
+  dropped_ = 0;
+  lossless_ = rate <= 0;
+  stop_ = false;
+  finished_ = false;
+  replayer_ = std::thread(&LidarReplay::ReplayLoop, this, rate);
+  return true;
+}
+
+void LidarReplay::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (replayer_.joinable()) {
+    replayer_.join();
+  }
+  finished_ = true;
+}
+
+void LidarReplay::ReplayLoop(double rate) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  long long first_us = -1;
+  const uint8_t *payload;
+  size_t size;
+  long long timestamp_us;
+  int port;
+  // set when Stop interrupts a hand off, filling_ is then null
+  bool stopped = false;
+  while (!stopped && reader_.Next(&payload, &size, &timestamp_us, &port)) {
+    if (port != kVelodyneDataPort || size != kVelodynePacketBytes) {
+      continue;
+    }
+    if (rate > 0) {
+      if (first_us < 0) {
+        first_us = timestamp_us;
+      }
+      std::chrono::steady_clock::time_point due =
+          start + std::chrono::microseconds(llround((timestamp_us - first_us) / rate));
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (cv_.wait_until(lock, due, [this] { return stop_; })) {
+        break;
+      }
+    } else if (stop_) {
+      break;
+    }
+
+    ++packets_;
+    Packets().Increment();
+    int firing = 0;
+    while ((firing = decoder_.Decode(payload, size, filling_, firing)) < VelodyneDecoder::kFirings) {
+      if (firing < 0) {
+        break;
+      }
+      if (!HandOff()) {
+        stopped = true;
+        break;
+      }
+    }
+  }
+  // the last rotation is partial but still a frame
+  if (!stopped && filling_->columns > 0) {
+    HandOff();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+  }
+  cv_.notify_all();
+}
+
+bool LidarReplay::HandOff() {
+  static Counter &delivered = Frames("queued");
+  static Counter &dropped = Frames("dropped");
+  std::unique_lock<std::mutex> lock(mutex_);
+  filling_->ready_ns = SteadyNs();
+  ready_[(ready_head_ + ready_count_++) % ready_.size()] = filling_;
+  delivered.Increment();
+  long long sequence = ++frames_;
+  filling_ = nullptr;
+  while (filling_ == nullptr) {
+    if (stop_) {
+      return false;
+    }
+    if (!free_.empty() && ready_count_ <= queue_frames_) {
+      filling_ = free_.back();
+      free_.pop_back();
+    } else if (ready_count_ > 0 && !lossless_) {
+      // the consumer fell behind, recycle its oldest rotation
+      filling_ = ready_[ready_head_];
+      ready_head_ = (ready_head_ + 1) % ready_.size();
+      --ready_count_;
+      ++dropped_;
+      dropped.Increment();
+    } else {
+      cv_.wait(lock);
+    }
+  }
+  lock.unlock();
+  cv_.notify_all();
+  filling_->Clear();
+  filling_->sequence = sequence;
+  return true;
+}
+
+LidarFrame *LidarReplay::Next(int timeout_ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+               [this] { return ready_count_ > 0 || finished_ || stop_; });
+  if (ready_count_ == 0) {
+    return nullptr;
+  }
+  LidarFrame *frame = ready_[ready_head_];
+  ready_head_ = (ready_head_ + 1) % ready_.size();
+  --ready_count_;
+  HandoffLatency().Observe((SteadyNs() - frame->ready_ns) * 1e-9);
+  return frame;
+}
+
+void LidarReplay::Release(LidarFrame *frame) {
+  if (frame == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(frame);
+  }
+  cv_.notify_all();
+}
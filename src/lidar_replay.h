@@ -0,0 +1,223 @@
+#ifndef LIDAR_REPLAY_H_
+#define LIDAR_REPLAY_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// UDP port of Velodyne firing data packets
+const int kVelodyneDataPort = 2368;
+// size of the UDP payload of a VLP-16 data packet
+const size_t kVelodynePacketBytes = 1206;
+
+/**
+ * LidarFrame is one rotation of a 16 laser spinning lidar as an organized
+ * point buffer: row r holds laser r in order of elevation, bottom first,
+ * and column c the firing at azimuth azimuth[c]. Point (r, c) is at index
+ * r * capacity + c of each coordinate array. Lasers without a return are
+ * NaN. The arrays are allocated once and reused for every rotation.
+ */
+struct LidarFrame {
+  static const int kRows = 16;
+
+  explicit LidarFrame(int capacity);
+
+  // drops all columns, keeps the memory
+  void Clear();
+
+  int index(int row, int column) const { return row * capacity + column; }
+
+  int capacity;
+  int columns;
+  // time of the first firing, us since the top of the hour as the sensor
+  // counts it, and the sequence number of the rotation
+  long long timestamp_us;
+  long long sequence;
+  // columns that did not fit and were dropped
+  int overflow;
+  // steady clock time the frame was queued for the consumer, in ns
+  long long ready_ns;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> intensity;
+  // azimuth in rad and firing time in us, one per column
+  std::vector<float> azimuth;
+  std::vector<long long> column_time_us;
+};
+
+/**
+ * PcapReader maps a pcap capture and walks its UDP datagrams without
+ * copying them. Ethernet, VLAN tagged Ethernet, Linux cooked and raw IP
+ * captures in either byte order and with us or ns timestamps are read;
+ * other packets and fragmented datagrams are skipped.
+ */
+class PcapReader {
+ public:
+  PcapReader();
+
+  /**
+   * Destructor unmaps the file
+   */
+  virtual ~PcapReader();
+
+  /**
+   * Open maps a capture
+   * @return false if the file cannot be mapped or is not a pcap file
+   */
+  bool Open(const std::string &path);
+
+  /**
+   * Next finds the next UDP datagram
+   * @param payload Set to the datagram payload inside the mapping
+   * @param size Payload bytes
+   * @param timestamp_us Capture time
+   * @param port Destination port
+   * @return false at the end of the capture
+   */
+  bool Next(const uint8_t **payload, size_t *size, long long *timestamp_us, int *port);
+
+  // back to the first packet
+  void Rewind();
+
+ private:
+  void Close();
+  uint32_t Read32(const uint8_t *p) const;
+
+  const uint8_t *data_;
+  size_t size_;
+  size_t offset_;
+  bool swapped_;
+  bool nanoseconds_;
+  uint32_t link_type_;
+};
+
+/**
+ * VelodyneDecoder parses VLP-16 data packets straight into organized
+ * frames.
+ *
+ * A packet holds 12 blocks of two firing sequences of the 16 lasers. The
+ * azimuth of the second sequence is interpolated halfway to the next block.
+ * Each column computes the sine and cosine of its azimuth once, each laser
+ * the ones of its elevation in the constructor, so a point costs a few
+ * multiplies and no allocation. In dual return mode the first return of
+ * every block pair is kept.
+ */
+class VelodyneDecoder {
+ public:
+  // firing sequences of one packet
+  static const int kFirings = 24;
+
+  VelodyneDecoder();
+
+  /**
+   * Decode adds the firings of a packet to a frame, from firing first on,
+   * and stops where a new rotation begins
+   * @param payload Data packet, kVelodynePacketBytes long
+   * @param frame Frame being filled
+   * @param first Firing to start at
+   * @return kFirings when the packet is done, otherwise the firing that
+   *   starts the next rotation: hand off the frame and continue from there
+   *   with an empty one; -1 if the packet is malformed
+   */
+  int Decode(const uint8_t *payload, size_t size, LidarFrame *frame, int first = 0);
+
+  // frames started so far
+  long long rotations_;
+
+ private:
+  double cos_elevation_[16];
+  double sin_elevation_[16];
+  // laser of each row
+  int row_of_laser_[16];
+  // azimuth of the last column in hundredths of a degree
+  double last_azimuth_;
+};
+
+/**
+ * LidarReplay reads a capture on its own thread, at the recorded rate or a
+ * multiple of it, and hands complete rotations to the consumer.
+ *
+ * Frames come from a fixed pool. At most queue_frames finished rotations
+ * wait for the consumer; when the queue is full during a paced replay the
+ * oldest one is recycled, as a live sensor would not wait either, so a slow
+ * consumer always gets recent data and the latency from the last firing to
+ * Next stays bounded by the queue length, never by the backlog. Unthrottled
+ * replays wait for the consumer instead and deliver every rotation.
+ */
+class LidarReplay {
+ public:
+  /**
+   * Constructor
+   * @param queue_frames Finished rotations that may wait for the consumer
+   * @param capacity Columns per frame, 0.1 deg resolution needs 3600
+   */
+  explicit LidarReplay(int queue_frames = 2, int capacity = 4096);
+
+  /**
+   * Destructor stops the replay
+   */
+  virtual ~LidarReplay();
+
+  /**
+   * Start opens a capture and starts replaying it
+   * @param path pcap file
+   * @param rate 1 replays at the recorded rate, 10 ten times faster, 0 as
+   *   fast as the consumer takes the frames
+   * @return false if the capture cannot be opened; frames of an earlier
+   *   replay must be released before
+   */
+  bool Start(const std::string &path, double rate = 1.0);
+
+  /**
+   * Next waits for the next finished rotation
+   * @param timeout_ms Longest wait
+   * @return The frame, to be given back with Release, or nullptr on timeout
+   *   and once the capture is replayed and the queue is empty
+   */
+  LidarFrame *Next(int timeout_ms);
+
+  void Release(LidarFrame *frame);
+
+  void Stop();
+
+  // true once the whole capture is decoded
+  bool finished() const { return finished_; }
+
+  std::atomic<long long> packets_;
+  std::atomic<long long> frames_;
+  // rotations recycled unread because the consumer fell behind
+  std::atomic<long long> dropped_;
+
+ private:
+  void ReplayLoop(double rate);
+  // queues the frame being filled and takes a new one; false on stop, which
+  // leaves filling_ null
+  bool HandOff();
+
+  PcapReader reader_;
+  VelodyneDecoder decoder_;
+  size_t queue_frames_;
+  std::vector<std::unique_ptr<LidarFrame> > pool_;
+  std::vector<LidarFrame*> free_;
+  // ring of finished frames, oldest at ready_head_
+  std::vector<LidarFrame*> ready_;
+  size_t ready_head_;
+  size_t ready_count_;
+  LidarFrame *filling_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // unthrottled replays wait for the consumer instead of recycling
+  bool lossless_;
+  bool stop_;
+  std::atomic<bool> finished_;
+  std::thread replayer_;
+};
+
+#endif  // LIDAR_REPLAY_H_
@@ -4,6 +4,9 @@
 
 //#include "render/render.h"
 #include "highway.h"
+#include "metrics.h"
+#include <chrono>
+#include <cstdlib>
 
 int main(int argc, char** argv)
 {
@@ -17,6 +20,15 @@ int main(int argc, char** argv)
 	viewer->setCameraPosition ( x_pos-26, 0, 15.0, x_pos+25, 0, 0, 0, 0, 1);
 
 	Highway highway(viewer);
+	// unscented, ekf, converted or adaptive
+	if (getenv("UKF_RADAR_UPDATE") != nullptr && !UKF::ParseUpdateMethod(getenv("UKF_RADAR_UPDATE"), highway.radar_update))
+		AsyncLogger::Instance().Log(LOG_ERROR, "unknown radar update method {}", std::string(getenv("UKF_RADAR_UPDATE")));
+
+	// scrape with curl localhost:$UKF_METRICS_PORT
+	MetricsServer metrics;
+	if (getenv("UKF_METRICS_PORT") != nullptr && !metrics.Start(atoi(getenv("UKF_METRICS_PORT"))))
+		AsyncLogger::Instance().Log(LOG_ERROR, "cannot serve metrics on port {}", std::string(getenv("UKF_METRICS_PORT")));
+	Histogram& frameSeconds = MetricsRegistry::Instance().GetHistogram("render_frame_seconds", "Duration of one simulated and rendered frame", MetricsRegistry::LatencyBounds());
 
 	//initHighway(viewer);
 
@@ -29,12 +41,14 @@ int main(int argc, char** argv)
 
 	while (frame_count < (frame_per_sec*sec_interval))
 	{
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
 		viewer->removeAllPointClouds();
 		viewer->removeAllShapes();
 
 		//stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
 		highway.stepHighway(egoVelocity,time_us, frame_per_sec, viewer);
 		viewer->spinOnce(1000/frame_per_sec);
+		frameSeconds.Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
 		frame_count++;
 		time_us = 1000000*frame_count/frame_per_sec;
 		
@@ -14,6 +14,10 @@ public:
 
   Eigen::VectorXd raw_measurements_;
 
+  // number of measurements averaged into this one, which has 1/samples_ of
+  // their noise variance
+  int samples_ = 1;
+
 };
 
 #endif /* MEASUREMENT_PACKAGE_H_ */
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "measurement_scheduler.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "metrics.h"
+
+namespace {
+
+Counter &SchedulerCounter(const char *reason) {
+  return MetricsRegistry::Instance().GetCounter(
+      "scheduler_measurements_total", "Measurements through the scheduler by outcome",
+      std::string("outcome=\"") + reason + "\"");
+}
+
+}  // namespace
+
+MeasurementScheduler::MeasurementScheduler() {
+  // a measurement older than 100 ms is not worth filtering any more
+  max_age_us_ = 100000;
+
+  // unlimited budget, the scheduler never sheds load
+  budget_ = 0;
+
+  // a 30 Hz sensor produces at most two measurements in this window
+  coalesce_window_us_ = 50000;
+}
+
+MeasurementScheduler::~MeasurementScheduler() {}
+
+void MeasurementScheduler::Enqueue(int track_id, const MeasurementPackage &meas_package) {
+  Enqueue(track_id, meas_package, meas_package.timestamp_ + max_age_us_);
+}
+
+void MeasurementScheduler::Enqueue(int track_id, const MeasurementPackage &meas_package,
+                                   long long deadline_us) {
+  std::vector<Entry> &queue = queues_[track_id];
+  Entry pending = {meas_package, deadline_us, meas_package.timestamp_,
+                   meas_package.timestamp_ * meas_package.samples_};
+
+  // keep every queue in timestamp order, the filter cannot go back in time
+  std::vector<Entry>::iterator it = queue.end();
+  while (it != queue.begin() && (it-1)->meas.timestamp_ > meas_package.timestamp_) {
+    --it;
+  }
+  queue.insert(it, pending);
+  ++stats_.enqueued;
+  static Counter &enqueued = SchedulerCounter("enqueued");
+  enqueued.Increment();
+}
+
+int MeasurementScheduler::Pending() const {
+  int count = 0;
+  for (const auto &entry : queues_) {
+    count += entry.second.size();
+  }
+  return count;
+}
+
+void MeasurementScheduler::Coalesce(std::vector<Entry> &queue) {
+  std::vector<Entry> merged;
+  for (const Entry &pending : queue) {
+    // newest already merged measurement of the same sensor
+    int last = merged.size() - 1;
+    while (last >= 0 && merged[last].meas.sensor_type_ != pending.meas.sensor_type_) {
+      --last;
+    }
+    if (last < 0 || pending.meas.timestamp_ - merged[last].first_us > coalesce_window_us_) {
+      merged.push_back(pending);
+      continue;
+    }
+
+    // average into one measurement at the mean timestamp; within the
+    // window the target moves far less than the sensor noise
+    Entry &target = merged[last];
+    int samples = target.meas.samples_ + pending.meas.samples_;
+    Eigen::VectorXd diff = pending.meas.raw_measurements_ - target.meas.raw_measurements_;
+    if (pending.meas.sensor_type_ == MeasurementPackage::RADAR) {
+      // angle normalization
+      while (diff(1) > M_PI) diff(1) -= 2.*M_PI;
+      while (diff(1) < -M_PI) diff(1) += 2.*M_PI;
+    }
+    target.meas.raw_measurements_ += diff * pending.meas.samples_ / samples;
+    if (pending.meas.sensor_type_ == MeasurementPackage::RADAR) {
+      double &phi = target.meas.raw_measurements_(1);
+      while (phi > M_PI) phi -= 2.*M_PI;
+      while (phi < -M_PI) phi += 2.*M_PI;
+    }
+    target.meas.samples_ = samples;
+    target.sum_us += pending.sum_us;
+    target.meas.timestamp_ = target.sum_us / samples;
+    target.deadline_us = std::max(target.deadline_us, pending.deadline_us);
+    ++stats_.coalesced;
+    static Counter &coalesced = SchedulerCounter("coalesced");
+    coalesced.Increment();
+  }
+
+  // merged measurements moved to their mean time
+  std::stable_sort(merged.begin(), merged.end(), [](const Entry &a, const Entry &b) {
+    return a.meas.timestamp_ < b.meas.timestamp_;
+  });
+  queue.swap(merged);
+}
+
+int MeasurementScheduler::Dispatch(long long now_us, const std::function<double(int)> &distance,
+                                   const std::function<void(int, const MeasurementPackage &)> &process) {
+  bool overloaded = budget_ > 0 && Pending() > budget_;
+  static Counter &overloaded_dispatches = MetricsRegistry::Instance().GetCounter(
+      "scheduler_overloaded_dispatches_total", "Dispatches that found more pending work than the budget");
+  if (overloaded) {
+    ++stats_.overloaded;
+    overloaded_dispatches.Increment();
+  }
+
+  static Counter &shed_stale = SchedulerCounter("shed_stale");
+  static Counter &shed_out_of_order = SchedulerCounter("shed_out_of_order");
+  // tracks with pending work as (last update, distance, id)
+  std::vector<std::pair<std::pair<long long, double>, int> > order;
+  for (auto &entry : queues_) {
+    std::vector<Entry> &queue = entry.second;
+
+    // 1. fold pending measurements of a track into fewer updates
+    if (overloaded) {
+      Coalesce(queue);
+    }
+
+    // 2. drop measurements past their deadline or older than the track
+    std::map<int, long long>::iterator last = last_timestamp_.find(entry.first);
+    std::vector<Entry> live;
+    for (const Entry &pending : queue) {
+      if (pending.deadline_us < now_us) {
+        ++stats_.shed_stale;
+        shed_stale.Increment();
+      } else if (last != last_timestamp_.end() && pending.meas.timestamp_ < last->second) {
+        ++stats_.shed_out_of_order;
+        shed_out_of_order.Increment();
+      } else {
+        live.push_back(pending);
+      }
+    }
+    queue.swap(live);
+
+    if (!queue.empty()) {
+      long long updated_us = last == last_timestamp_.end() ? LLONG_MIN : last->second;
+      order.push_back(std::make_pair(
+          std::make_pair(updated_us, overloaded ? distance(entry.first) : 0.0), entry.first));
+    }
+  }
+
+  // 3. serve the tracks that waited longest since their last update first,
+  // the closest to the ego vehicle among equals, one measurement per track
+  // and round, so every track gets its share of the budget
+  std::stable_sort(order.begin(), order.end());
+
+  int processed = 0;
+  std::vector<size_t> done(order.size(), 0);
+  bool served = true;
+  while (served && (budget_ <= 0 || processed < budget_)) {
+    served = false;
+    for (size_t t = 0; t < order.size() && (budget_ <= 0 || processed < budget_); ++t) {
+      int track_id = order[t].second;
+      std::vector<Entry> &queue = queues_[track_id];
+      if (done[t] == queue.size()) {
+        continue;
+      }
+      process(track_id, queue[done[t]].meas);
+      last_timestamp_[track_id] = queue[done[t]].meas.timestamp_;
+      ++done[t];
+      ++processed;
+      served = true;
+    }
+  }
+  for (size_t t = 0; t < order.size(); ++t) {
+    std::vector<Entry> &queue = queues_[order[t].second];
+    queue.erase(queue.begin(), queue.begin() + done[t]);
+  }
+
+  stats_.processed += processed;
+  static Counter &processed_total = SchedulerCounter("processed");
+  static Gauge &pending = MetricsRegistry::Instance().GetGauge(
+      "scheduler_pending_measurements", "Measurements left queued after the last dispatch");
+  processed_total.Increment(processed);
+  pending.Set(Pending());
+  return processed;
+}
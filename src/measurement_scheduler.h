@@ -0,0 +1,97 @@
+#ifndef MEASUREMENT_SCHEDULER_H_
+#define MEASUREMENT_SCHEDULER_H_
+
+#include <functional>
+#include <map>
+#include <vector>
+#include "measurement_package.h"
+
+// counters describing the work the scheduler did and the work it shed
+struct SchedulerStats {
+  long long enqueued = 0;
+  long long processed = 0;
+  // measurements folded into another measurement of the same track
+  long long coalesced = 0;
+  // measurements dropped because their deadline passed
+  long long shed_stale = 0;
+  // measurements dropped because they are older than the track state
+  long long shed_out_of_order = 0;
+  // dispatch calls that found more work than the budget allows
+  long long overloaded = 0;
+};
+
+/**
+ * MeasurementScheduler queues measurements per track and hands them to the
+ * filters with bounded latency. Every measurement carries a deadline after
+ * which it is no longer worth processing. When more work is pending than the
+ * per-dispatch budget allows the scheduler, in this order, coalesces pending
+ * measurements of a track into one update, drops measurements past their
+ * deadline and serves the tracks round robin, one measurement each per
+ * round, starting with the track whose last update is oldest and, among
+ * equals, the one closest to the ego vehicle; the rest waits for the next
+ * dispatch or expires. No track starves while others are updated.
+ */
+class MeasurementScheduler {
+ public:
+  MeasurementScheduler();
+
+  virtual ~MeasurementScheduler();
+
+  /**
+   * Enqueue queues a measurement with the default deadline
+   * @param track_id Track the measurement belongs to
+   * @param meas_package The measurement
+   */
+  void Enqueue(int track_id, const MeasurementPackage &meas_package);
+
+  /**
+   * Enqueue queues a measurement with an explicit deadline
+   * @param track_id Track the measurement belongs to
+   * @param meas_package The measurement
+   * @param deadline_us Time in us after which the measurement is dropped
+   */
+  void Enqueue(int track_id, const MeasurementPackage &meas_package, long long deadline_us);
+
+  /**
+   * Dispatch hands pending measurements to process
+   * @param now_us Current time in us
+   * @param distance Distance of a track to the ego vehicle in m
+   * @param process Filters one measurement for a track
+   * @return Number of measurements processed
+   */
+  int Dispatch(long long now_us, const std::function<double(int)> &distance,
+               const std::function<void(int, const MeasurementPackage &)> &process);
+
+  // number of measurements waiting for a dispatch
+  int Pending() const;
+
+  SchedulerStats stats_;
+
+  // default deadline relative to the measurement timestamp, in us
+  long long max_age_us_;
+
+  // maximum number of updates per dispatch, 0 means unlimited
+  int budget_;
+
+  // measurements of one track and sensor closer than this in time are
+  // coalesced when overloaded, in us
+  long long coalesce_window_us_;
+
+ private:
+  struct Entry {
+    MeasurementPackage meas;
+    long long deadline_us;
+    // timestamp of the oldest measurement folded into this entry
+    long long first_us;
+    // sum of the timestamps folded into this entry, each once per sample
+    long long sum_us;
+  };
+
+  // averages runs of same-sensor measurements that are close in time
+  void Coalesce(std::vector<Entry> &queue);
+
+  std::map<int, std::vector<Entry> > queues_;
+  std::map<int, long long> last_timestamp_;
+};
+
+#endif  // MEASUREMENT_SCHEDULER_H_
@@ -0,0 +1,447 @@
+#include "metrics.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<int> next_slot(0);
+
+// shard of the calling thread
+int ThreadSlot() {
+  thread_local int slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+  return slot;
+}
+
+double FromBits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint64_t ToBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+#ifdef UKF_COUNT_ALLOCATIONS
+// heap allocation counters, plain cells so operator new can use them
+// before any static constructor has run
+MetricCell allocations[kMetricShards];
+MetricCell frees[kMetricShards];
+#endif
+
+// memory for count objects aligned to the cache lines of their cells; plain
+// new only guarantees 16 bytes before C++17
+template <typename T>
+T *AlignedNew(size_t count = 1) {
+  void *memory = nullptr;
+  if (posix_memalign(&memory, alignof(T), count * sizeof(T)) != 0) {
+    throw std::bad_alloc();
+  }
+  T *objects = static_cast<T *>(memory);
+  for (size_t i = 0; i < count; ++i) {
+    new (objects + i) T();
+  }
+  return objects;
+}
+
+double Sum(const MetricCell *cells) {
+  double sum = 0;
+  for (int i = 0; i < kMetricShards; ++i) {
+    sum += cells[i].Value();
+  }
+  return sum;
+}
+
+void FormatValue(std::ostringstream &out, double value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.17g", value);
+  out << buffer;
+}
+
+// name{labels} with an extra label appended
+std::string Series(const std::string &name, const std::string &labels, const std::string &extra = "") {
+  std::string all = labels;
+  if (!extra.empty()) {
+    all += (all.empty() ? "" : ",") + extra;
+  }
+  return all.empty() ? name : name + "{" + all + "}";
+}
+
+}  // namespace
+
+#ifdef UKF_COUNT_ALLOCATIONS
+void *operator new(std::size_t size) {
+  allocations[ThreadSlot()].Add(1);
+  void *pointer = malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  allocations[ThreadSlot()].Add(1);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *pointer) noexcept {
+  if (pointer != nullptr) {
+    frees[ThreadSlot()].Add(1);
+    free(pointer);
+  }
+}
+
+void operator delete[](void *pointer) noexcept {
+  operator delete(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+  operator delete(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+  operator delete(pointer);
+}
+#endif
+
+void MetricCell::Add(double amount) {
+  uint64_t expected = bits.load(std::memory_order_relaxed);
+  while (!bits.compare_exchange_weak(expected, ToBits(FromBits(expected) + amount),
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+double MetricCell::Value() const {
+  return FromBits(bits.load(std::memory_order_relaxed));
+}
+
+void Counter::Increment(double amount) {
+  cells_[ThreadSlot()].Add(amount);
+}
+
+double Counter::Value() const {
+  return Sum(cells_);
+}
+
+void Gauge::Set(double value) {
+  cell_.bits.store(ToBits(value), std::memory_order_relaxed);
+}
+
+void Gauge::Add(double amount) {
+  cell_.Add(amount);
+}
+
+double Gauge::Value() const {
+  return cell_.Value();
+}
+
+Histogram::Histogram(const std::vector<double> &bounds)
+    : bounds_(bounds), cells_(AlignedNew<MetricCell>(kMetricShards * (bounds.size() + 2))) {}
+
+void Histogram::Observe(double value) {
+  size_t bucket = 0;
+  while (bucket < bounds_.size() && value > bounds_[bucket]) {
+    ++bucket;
+  }
+  MetricCell *shard = &cells_[ThreadSlot() * (bounds_.size() + 2)];
+  shard[bucket].Add(1);
+  shard[bounds_.size() + 1].Add(value);
+}
+
+std::vector<double> Histogram::Cumulative() const {
+  size_t stride = bounds_.size() + 2;
+  std::vector<double> counts(bounds_.size() + 1, 0.0);
+  for (int s = 0; s < kMetricShards; ++s) {
+    for (size_t b = 0; b <= bounds_.size(); ++b) {
+      counts[b] += cells_[s * stride + b].Value();
+    }
+  }
+  for (size_t b = 1; b < counts.size(); ++b) {
+    counts[b] += counts[b - 1];
+  }
+  return counts;
+}
+
+double Histogram::Sum() const {
+  size_t stride = bounds_.size() + 2;
+  double sum = 0;
+  for (int s = 0; s < kMetricShards; ++s) {
+    sum += cells_[s * stride + bounds_.size() + 1].Value();
+  }
+  return sum;
+}
+
+MetricsRegistry &MetricsRegistry::Instance() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::Family &MetricsRegistry::GetFamily(const std::string &name, const std::string &help,
+                                                    Type type) {
+  Family &family = families_[name];
+  if (family.help.empty()) {
+    family.help = help;
+    family.type = type;
+  }
+  return family;
+}
+
+Counter &MetricsRegistry::GetCounter(const std::string &name, const std::string &help,
+                                     const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Counter, AlignedDelete> &counter = GetFamily(name, help, COUNTER).counters[labels];
+  if (!counter) {
+    counter.reset(AlignedNew<Counter>());
+  }
+  return *counter;
+}
+
+Gauge &MetricsRegistry::GetGauge(const std::string &name, const std::string &help,
+                                 const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Gauge, AlignedDelete> &gauge = GetFamily(name, help, GAUGE).gauges[labels];
+  if (!gauge) {
+    gauge.reset(AlignedNew<Gauge>());
+  }
+  return *gauge;
+}
+
+Histogram &MetricsRegistry::GetHistogram(const std::string &name, const std::string &help,
+                                         const std::vector<double> &bounds, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Histogram> &histogram = GetFamily(name, help, HISTOGRAM).histograms[labels];
+  if (!histogram) {
+    histogram.reset(new Histogram(bounds));
+  }
+  return *histogram;
+}
+
+std::string MetricsRegistry::Render() const {
+  std::ostringstream out;
+  if (CountsAllocations()) {
+    out << "# HELP process_heap_allocations_total Calls of operator new\n"
+        << "# TYPE process_heap_allocations_total counter\n"
+        << "process_heap_allocations_total ";
+    FormatValue(out, Allocations());
+    out << "\n# HELP process_heap_frees_total Calls of operator delete\n"
+        << "# TYPE process_heap_frees_total counter\n"
+        << "process_heap_frees_total ";
+    FormatValue(out, Frees());
+    out << "\n";
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &entry : families_) {
+    const std::string &name = entry.first;
+    const Family &family = entry.second;
+    const char *type = family.type == COUNTER ? "counter" : family.type == GAUGE ? "gauge" : "histogram";
+    out << "# HELP " << name << " " << family.help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+    for (const auto &counter : family.counters) {
+      out << Series(name, counter.first) << " ";
+      FormatValue(out, counter.second->Value());
+      out << "\n";
+    }
+    for (const auto &gauge : family.gauges) {
+      out << Series(name, gauge.first) << " ";
+      FormatValue(out, gauge.second->Value());
+      out << "\n";
+    }
+    for (const auto &histogram : family.histograms) {
+      const std::vector<double> &bounds = histogram.second->bounds();
+      std::vector<double> counts = histogram.second->Cumulative();
+      for (size_t b = 0; b < counts.size(); ++b) {
+        std::ostringstream le;
+        if (b < bounds.size()) {
+          FormatValue(le, bounds[b]);
+        } else {
+          le << "+Inf";
+        }
+        out << Series(name + "_bucket", histogram.first, "le=\"" + le.str() + "\"") << " ";
+        FormatValue(out, counts[b]);
+        out << "\n";
+      }
+      out << Series(name + "_sum", histogram.first) << " ";
+      FormatValue(out, histogram.second->Sum());
+      out << "\n" << Series(name + "_count", histogram.first) << " ";
+      FormatValue(out, counts.back());
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+
+bool MetricsRegistry::CountsAllocations() {
+#ifdef UKF_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+double MetricsRegistry::Allocations() {
+#ifdef UKF_COUNT_ALLOCATIONS
+  return Sum(allocations);
+#else
+  return 0;
+#endif
+}
+
+double MetricsRegistry::Frees() {
+#ifdef UKF_COUNT_ALLOCATIONS
+  return Sum(frees);
+#else
+  return 0;
+#endif
+}
+
+std::vector<double> MetricsRegistry::LatencyBounds() {
+  return {1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+          1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1};
+}
+
+MetricsServer::MetricsServer() : scrapes_(0), fd_(-1), port_(0), stop_(false) {}
+
+MetricsServer::~MetricsServer() {
+  Stop();
+}
+
+bool MetricsServer::Start(int port) {
+  Stop();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return false;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+  port_ = ntohs(address.sin_port);
+  return Listen(fd);
+}
+
+bool MetricsServer::StartUnix(const std::string &path) {
+  Stop();
+  sockaddr_un address;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return false;
+  }
+  unix_path_ = path;
+  return Listen(fd);
+}
+
+bool MetricsServer::Listen(int fd) {
+  if (listen(fd, 16) != 0) {
+    close(fd);
+    return false;
+  }
+  fd_ = fd;
+  stop_ = false;
+  server_ = std::thread(&MetricsServer::ServeLoop, this);
+  return true;
+}
+
+void MetricsServer::Stop() {
+  if (fd_ < 0) {
+    return;
+  }
+  stop_ = true;
+  server_.join();
+  close(fd_);
+  fd_ = -1;
+  if (!unix_path_.empty()) {
+    unlink(unix_path_.c_str());
+    unix_path_.clear();
+  }
+}
+
+void MetricsServer::ServeLoop() {
+  while (!stop_) {
+    pollfd listener;
+    listener.fd = fd_;
+    listener.events = POLLIN;
+    if (poll(&listener, 1, 100) <= 0) {
+      continue;
+    }
+    int client = accept(fd_, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+
+    // read the request head, its content does not matter
+    char request[4096];
+    size_t received = 0;
+    while (received < sizeof(request)) {
+      pollfd input;
+      input.fd = client;
+      input.events = POLLIN;
+      if (poll(&input, 1, 1000) <= 0) {
+        break;
+      }
+      ssize_t n = read(client, request + received, sizeof(request) - received);
+      if (n <= 0) {
+        break;
+      }
+      received += n;
+      if (memmem(request, received, "\r\n\r\n", 4) != nullptr) {
+        break;
+      }
+    }
+
+    std::string body = MetricsRegistry::Instance().Render();
+    std::string response = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+      ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      sent += n;
+    }
+    close(client);
+    ++scrapes_;
+  }
+}
@@ -0,0 +1,194 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// value cells are spread over this many cache lines, one per thread slot,
+// so that threads recording the same metric do not contend
+const int kMetricShards = 16;
+
+// one cache line holding a double as its bit pattern
+struct alignas(64) MetricCell {
+  std::atomic<uint64_t> bits;
+
+  constexpr MetricCell() : bits(0) {}
+
+  void Add(double amount);
+  double Value() const;
+};
+
+// frees the metrics made by AlignedNew; metrics are trivially destructible
+struct AlignedDelete {
+  void operator()(void *pointer) const { free(pointer); }
+};
+
+/**
+ * Counter is a monotonically increasing value
+ */
+class Counter {
+ public:
+  void Increment(double amount = 1);
+  double Value() const;
+
+ private:
+  MetricCell cells_[kMetricShards];
+};
+
+/**
+ * Gauge is a value that goes up and down
+ */
+class Gauge {
+ public:
+  void Set(double value);
+  void Add(double amount);
+  double Value() const;
+
+ private:
+  MetricCell cell_;
+};
+
+/**
+ * Histogram counts observations into buckets with fixed upper bounds
+ */
+class Histogram {
+ public:
+  /**
+   * Constructor
+   * @param bounds Ascending upper bounds, +Inf is added
+   */
+  explicit Histogram(const std::vector<double> &bounds);
+
+  void Observe(double value);
+
+  const std::vector<double> &bounds() const { return bounds_; }
+
+  // cumulative count of observations up to bound i, the last is the total
+  std::vector<double> Cumulative() const;
+
+  double Sum() const;
+
+ private:
+  std::vector<double> bounds_;
+  // per shard: one cell per bucket including +Inf, then the sum
+  std::unique_ptr<MetricCell[], AlignedDelete> cells_;
+};
+
+/**
+ * MetricsRegistry owns the metrics of the process and renders them in the
+ * Prometheus text exposition format.
+ *
+ * Metrics are registered once, usually into a function-local static
+ * reference, and recorded with relaxed atomic operations on per-thread
+ * cache lines; rendering only reads them, so a scrape never blocks the
+ * threads that record. Configured with UKF_COUNT_ALLOCATIONS, the registry
+ * also counts heap allocations through a replaced global operator new.
+ */
+class MetricsRegistry {
+ public:
+  static MetricsRegistry &Instance();
+
+  /**
+   * GetCounter returns the counter of a name and label set, creating it on
+   * first use
+   * @param name Metric name, counters end in _total
+   * @param help One line description
+   * @param labels Label set in exposition syntax, e.g. sensor="lidar"
+   */
+  Counter &GetCounter(const std::string &name, const std::string &help,
+                      const std::string &labels = "");
+
+  Gauge &GetGauge(const std::string &name, const std::string &help,
+                  const std::string &labels = "");
+
+  Histogram &GetHistogram(const std::string &name, const std::string &help,
+                          const std::vector<double> &bounds, const std::string &labels = "");
+
+  /**
+   * Render formats every metric in the text exposition format
+   */
+  std::string Render() const;
+
+  // true if the build counts heap allocations, see UKF_COUNT_ALLOCATIONS
+  static bool CountsAllocations();
+
+  // heap allocations and frees of the process so far, 0 if not counted
+  static double Allocations();
+  static double Frees();
+
+  // bucket bounds for latencies from 1 us to 1 s
+  static std::vector<double> LatencyBounds();
+
+ private:
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Family {
+    std::string help;
+    Type type;
+    // label set to metric, the maps keep their addresses stable
+    std::map<std::string, std::unique_ptr<Counter, AlignedDelete> > counters;
+    std::map<std::string, std::unique_ptr<Gauge, AlignedDelete> > gauges;
+    std::map<std::string, std::unique_ptr<Histogram> > histograms;
+  };
+
+  MetricsRegistry() {}
+
+  Family &GetFamily(const std::string &name, const std::string &help, Type type);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
+/**
+ * MetricsServer answers every connection on a local port or Unix socket
+ * with the rendered registry as an HTTP response, from its own thread
+ */
+class MetricsServer {
+ public:
+  MetricsServer();
+
+  /**
+   * Destructor stops the server
+   */
+  virtual ~MetricsServer();
+
+  /**
+   * Start listens on 127.0.0.1
+   * @param port TCP port, 0 picks a free one, see port()
+   * @return false if the socket cannot be bound
+   */
+  bool Start(int port);
+
+  /**
+   * StartUnix listens on a Unix domain socket
+   * @param path Socket path, replaced if it exists
+   */
+  bool StartUnix(const std::string &path);
+
+  void Stop();
+
+  // bound TCP port
+  int port() const { return port_; }
+
+  // scrapes answered
+  std::atomic<long long> scrapes_;
+
+ private:
+  bool Listen(int fd);
+  void ServeLoop();
+
+  int fd_;
+  int port_;
+  std::string unix_path_;
+  std::atomic<bool> stop_;
+  std::thread server_;
+};
+
+#endif  // METRICS_H_
@@ -0,0 +1,294 @@
+#include "mot_evaluator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+double Distance(const ObjectState &a, const ObjectState &b) {
+  return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+}
+
+// minimum cost assignment of a square matrix, Hungarian algorithm with
+// potentials; returns the column of every row
+std::vector<int> Hungarian(const std::vector<double> &cost, int n) {
+  const double inf = std::numeric_limits<double>::infinity();
+  // 1-based, row 0 and column 0 are the virtual start
+  std::vector<double> u(n + 1, 0.0), v(n + 1, 0.0), min_v(n + 1);
+  std::vector<int> row_of(n + 1, 0), way(n + 1, 0);
+  std::vector<bool> used(n + 1);
+  for (int i = 1; i <= n; ++i) {
+    row_of[0] = i;
+    int j0 = 0;
+    std::fill(min_v.begin(), min_v.end(), inf);
+    std::fill(used.begin(), used.end(), false);
+    do {
+      used[j0] = true;
+      int i0 = row_of[j0];
+      int j1 = 0;
+      double delta = inf;
+      for (int j = 1; j <= n; ++j) {
+        if (used[j]) {
+          continue;
+        }
+        double reduced = cost[(i0 - 1) * n + (j - 1)] - u[i0] - v[j];
+        if (reduced < min_v[j]) {
+          min_v[j] = reduced;
+          way[j] = j0;
+        }
+        if (min_v[j] < delta) {
+          delta = min_v[j];
+          j1 = j;
+        }
+      }
+      for (int j = 0; j <= n; ++j) {
+        if (used[j]) {
+          u[row_of[j]] += delta;
+          v[j] -= delta;
+        } else {
+          min_v[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (row_of[j0] != 0);
+    do {
+      int j1 = way[j0];
+      row_of[j0] = row_of[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+
+  std::vector<int> column_of(n, -1);
+  for (int j = 1; j <= n; ++j) {
+    if (row_of[j] > 0) {
+      column_of[row_of[j] - 1] = j - 1;
+    }
+  }
+  return column_of;
+}
+
+// solves the rows and columns of one component; pairs without an edge cost
+// 0, the same as leaving both unmatched
+void SolveComponent(const std::vector<int> &rows, const std::vector<int> &cols,
+                    const std::vector<ObjectState> &a, const std::vector<ObjectState> &b,
+                    double gate, double power, std::vector<std::pair<int, int> > &matches) {
+  int n = std::max(rows.size(), cols.size());
+  std::vector<double> cost(n * n, 0.0);
+  double gate_cost = std::pow(gate, power);
+  for (size_t r = 0; r < rows.size(); ++r) {
+    for (size_t c = 0; c < cols.size(); ++c) {
+      double d = Distance(a[rows[r]], b[cols[c]]);
+      if (d < gate) {
+        cost[r * n + c] = std::pow(d, power) - gate_cost;
+      }
+    }
+  }
+  std::vector<int> column_of = Hungarian(cost, n);
+  for (size_t r = 0; r < rows.size(); ++r) {
+    int c = column_of[r];
+    if (c >= 0 && c < (int)cols.size() && cost[r * n + c] < 0) {
+      matches.push_back(std::make_pair(rows[r], cols[c]));
+    }
+  }
+}
+
+int Find(std::vector<int> &parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+}  // namespace
+
+MotMetrics::MotMetrics()
+    : frames(0), truth_count(0), matches(0), misses(0), false_positives(0), id_switches(0),
+      distance_sum(0), gospa_sum(0), gospa_localization(0), gospa_missed(0), gospa_false(0) {}
+
+double MotMetrics::Mota() const {
+  if (truth_count == 0) {
+    return 1.0;
+  }
+  return 1.0 - (double)(misses + false_positives + id_switches) / truth_count;
+}
+
+double MotMetrics::Motp() const {
+  return matches > 0 ? distance_sum / matches : 0.0;
+}
+
+double MotMetrics::Gospa() const {
+  return frames > 0 ? gospa_sum / frames : 0.0;
+}
+
+void MotMetrics::Merge(const MotMetrics &other) {
+  frames += other.frames;
+  truth_count += other.truth_count;
+  matches += other.matches;
+  misses += other.misses;
+  false_positives += other.false_positives;
+  id_switches += other.id_switches;
+  distance_sum += other.distance_sum;
+  gospa_sum += other.gospa_sum;
+  gospa_localization += other.gospa_localization;
+  gospa_missed += other.gospa_missed;
+  gospa_false += other.gospa_false;
+}
+
+MotEvaluator::MotEvaluator(double gate, double gospa_c, double gospa_p)
+    : gate_(gate), gospa_c_(gospa_c), gospa_p_(gospa_p) {}
+
+MotEvaluator::~MotEvaluator() {}
+
+std::vector<std::pair<int, int> > MotEvaluator::Assign(const std::vector<ObjectState> &a,
+                                                       const std::vector<ObjectState> &b,
+                                                       double gate, double power, bool sparse) {
+  std::vector<std::pair<int, int> > matches;
+  if (a.empty() || b.empty()) {
+    return matches;
+  }
+  if (!sparse) {
+    std::vector<int> rows(a.size()), cols(b.size());
+    std::iota(rows.begin(), rows.end(), 0);
+    std::iota(cols.begin(), cols.end(), 0);
+    SolveComponent(rows, cols, a, b, gate, power, matches);
+    std::sort(matches.begin(), matches.end());
+    return matches;
+  }
+
+  // candidate pairs within the gate, b sorted along x
+  std::vector<int> order(b.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int i, int j) { return b[i].x < b[j].x; });
+  std::vector<double> b_x(order.size());
+  for (size_t k = 0; k < order.size(); ++k) {
+    b_x[k] = b[order[k]].x;
+  }
+
+  // union-find over a (0..na-1) and b (na..na+nb-1)
+  const int na = a.size();
+  std::vector<int> parent(na + b.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  std::vector<bool> connected(parent.size(), false);
+  for (int i = 0; i < na; ++i) {
+    size_t k = std::lower_bound(b_x.begin(), b_x.end(), a[i].x - gate) - b_x.begin();
+    for (; k < b_x.size() && b_x[k] < a[i].x + gate; ++k) {
+      int j = order[k];
+      if (Distance(a[i], b[j]) < gate) {
+        parent[Find(parent, i)] = Find(parent, na + j);
+        connected[i] = connected[na + j] = true;
+      }
+    }
+  }
+
+  std::map<int, std::pair<std::vector<int>, std::vector<int> > > components;
+  for (size_t i = 0; i < parent.size(); ++i) {
+    if (!connected[i]) {
+      continue;
+    }
+    std::pair<std::vector<int>, std::vector<int> > &component = components[Find(parent, i)];
+    if ((int)i < na) {
+      component.first.push_back(i);
+    } else {
+      component.second.push_back(i - na);
+    }
+  }
+  for (const auto &component : components) {
+    SolveComponent(component.second.first, component.second.second, a, b, gate, power, matches);
+  }
+  std::sort(matches.begin(), matches.end());
+  return matches;
+}
+
+void MotEvaluator::AddFrame(const MotFrame &frame) {
+  const std::vector<ObjectState> &truth = frame.truth;
+  const std::vector<ObjectState> &tracks = frame.tracks;
+  ++metrics_.frames;
+  metrics_.truth_count += truth.size();
+
+  // CLEAR: pairs matched in the last frame stay matched while in the gate
+  std::map<int, int> track_index;
+  for (size_t j = 0; j < tracks.size(); ++j) {
+    track_index[tracks[j].id] = j;
+  }
+  std::vector<bool> truth_matched(truth.size(), false), track_matched(tracks.size(), false);
+  std::vector<std::pair<int, int> > matches;
+  for (size_t i = 0; i < truth.size(); ++i) {
+    std::map<int, int>::const_iterator last = last_match_.find(truth[i].id);
+    if (last == last_match_.end()) {
+      continue;
+    }
+    std::map<int, int>::const_iterator j = track_index.find(last->second);
+    if (j != track_index.end() && !track_matched[j->second]
+        && Distance(truth[i], tracks[j->second]) < gate_) {
+      matches.push_back(std::make_pair(i, j->second));
+      truth_matched[i] = track_matched[j->second] = true;
+    }
+  }
+
+  std::vector<ObjectState> open_truth, open_tracks;
+  std::vector<int> open_truth_index, open_track_index;
+  for (size_t i = 0; i < truth.size(); ++i) {
+    if (!truth_matched[i]) {
+      open_truth.push_back(truth[i]);
+      open_truth_index.push_back(i);
+    }
+  }
+  for (size_t j = 0; j < tracks.size(); ++j) {
+    if (!track_matched[j]) {
+      open_tracks.push_back(tracks[j]);
+      open_track_index.push_back(j);
+    }
+  }
+  for (const std::pair<int, int> &match : Assign(open_truth, open_tracks, gate_, 1.0)) {
+    int i = open_truth_index[match.first];
+    int j = open_track_index[match.second];
+    matches.push_back(std::make_pair(i, j));
+    std::map<int, int>::iterator last = last_match_.find(truth[i].id);
+    if (last != last_match_.end() && last->second != tracks[j].id) {
+      ++metrics_.id_switches;
+    }
+  }
+
+  for (const std::pair<int, int> &match : matches) {
+    metrics_.distance_sum += Distance(truth[match.first], tracks[match.second]);
+    last_match_[truth[match.first].id] = tracks[match.second].id;
+  }
+  metrics_.matches += matches.size();
+  metrics_.misses += truth.size() - matches.size();
+  metrics_.false_positives += tracks.size() - matches.size();
+
+  // GOSPA with alpha 2: matched pairs cost min(d, c)^p, every unmatched
+  // object c^p / 2, so only pairs closer than c are worth matching
+  std::vector<std::pair<int, int> > gospa_matches = Assign(truth, tracks, gospa_c_, gospa_p_);
+  double localization = 0;
+  for (const std::pair<int, int> &match : gospa_matches) {
+    localization += std::pow(Distance(truth[match.first], tracks[match.second]), gospa_p_);
+  }
+  double unmatched = 0.5 * std::pow(gospa_c_, gospa_p_);
+  double missed = unmatched * (truth.size() - gospa_matches.size());
+  double false_tracks = unmatched * (tracks.size() - gospa_matches.size());
+  metrics_.gospa_localization += localization;
+  metrics_.gospa_missed += missed;
+  metrics_.gospa_false += false_tracks;
+  metrics_.gospa_sum += std::pow(localization + missed + false_tracks, 1.0 / gospa_p_);
+}
+
+MotMetrics MotEvaluator::EvaluateRuns(const std::vector<std::vector<MotFrame> > &runs,
+                                      WorkerPool &pool) const {
+  std::vector<MotMetrics> results(runs.size());
+  pool.ParallelFor(runs.size(), [&](int r) {
+    MotEvaluator evaluator(gate_, gospa_c_, gospa_p_);
+    for (const MotFrame &frame : runs[r]) {
+      evaluator.AddFrame(frame);
+    }
+    results[r] = evaluator.metrics();
+  });
+
+  MotMetrics merged;
+  for (const MotMetrics &result : results) {
+    merged.Merge(result);
+  }
+  return merged;
+}
@@ -0,0 +1,120 @@
+#ifndef MOT_EVALUATOR_H_
+#define MOT_EVALUATOR_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "worker_pool.h"
+
+// position of a truth object or a track in one frame
+struct ObjectState {
+  int id;
+  double x;
+  double y;
+};
+
+// truth objects and track estimates of one frame
+struct MotFrame {
+  std::vector<ObjectState> truth;
+  std::vector<ObjectState> tracks;
+};
+
+// accumulated multi-object tracking metrics
+struct MotMetrics {
+  long long frames;
+  long long truth_count;
+  long long matches;
+  long long misses;
+  long long false_positives;
+  long long id_switches;
+  // summed distance of the CLEAR matches
+  double distance_sum;
+  // summed per-frame GOSPA and its localization, missed and false parts,
+  // which add up to GOSPA^p per frame
+  double gospa_sum;
+  double gospa_localization;
+  double gospa_missed;
+  double gospa_false;
+
+  MotMetrics();
+
+  // 1 - (misses + false positives + ID switches) / truth objects
+  double Mota() const;
+
+  // mean distance of the matched pairs
+  double Motp() const;
+
+  // mean GOSPA per frame
+  double Gospa() const;
+
+  // adds the counts of another run
+  void Merge(const MotMetrics &other);
+};
+
+/**
+ * MotEvaluator scores tracks against truth objects without assuming that
+ * they are index aligned, as CalculateRMSE does.
+ *
+ * Frames are added in time order and accumulate CLEAR MOT metrics (MOTA,
+ * MOTP, ID switches) and GOSPA. Each frame needs two optimal assignments,
+ * one with the CLEAR gate and one with the GOSPA cutoff. Only pairs closer
+ * than the gate can be matched, so the candidate pairs are found by sorting
+ * along x, the bipartite graph splits into connected components, and each
+ * component is solved with the Hungarian algorithm on its own. With many
+ * objects the components stay small and the cost is close to linear.
+ */
+class MotEvaluator {
+ public:
+  /**
+   * Constructor
+   * @param gate Largest distance of a CLEAR match in m
+   * @param gospa_c GOSPA cutoff distance in m
+   * @param gospa_p GOSPA order
+   */
+  MotEvaluator(double gate = 2.0, double gospa_c = 2.0, double gospa_p = 2.0);
+
+  virtual ~MotEvaluator();
+
+  /**
+   * AddFrame scores the next frame of the run
+   */
+  void AddFrame(const MotFrame &frame);
+
+  // metrics of the frames added so far
+  const MotMetrics &metrics() const { return metrics_; }
+
+  /**
+   * EvaluateRuns scores independent runs in parallel, frames of one run are
+   * scored in order because ID switches depend on the previous frame
+   * @param runs Frames of every run
+   * @param pool Worker pool, one run per task
+   * @return Metrics of all runs merged
+   */
+  MotMetrics EvaluateRuns(const std::vector<std::vector<MotFrame> > &runs, WorkerPool &pool) const;
+
+  /**
+   * Assign finds the assignment minimizing the sum over matched pairs of
+   * d^power - gate^power, for pairs closer than gate, so it prefers more
+   * matches and then smaller distances
+   * @param a First set of objects
+   * @param b Second set of objects
+   * @param gate Distance at and beyond which pairs are not matched
+   * @param power Exponent of the distance
+   * @param sparse If false, solve the full matrix at once, for comparison
+   * @return Matched index pairs into a and b
+   */
+  static std::vector<std::pair<int, int> > Assign(const std::vector<ObjectState> &a,
+                                                  const std::vector<ObjectState> &b,
+                                                  double gate, double power, bool sparse = true);
+
+  double gate_;
+  double gospa_c_;
+  double gospa_p_;
+
+ private:
+  MotMetrics metrics_;
+  // track id each truth object was matched to last
+  std::map<int, int> last_match_;
+};
+
+#endif  // MOT_EVALUATOR_H_
@@ -0,0 +1,378 @@
+#include "particle_filter.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "fast_math.h"
+#include "simd_kernels.h"
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+namespace {
+
+// integer hash with good avalanche, the base of the counter-based streams
+inline unsigned int Hash(unsigned int x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// uniform in [0, 1)
+inline float UniformAt(unsigned int key, unsigned int index) {
+  return (Hash(index ^ key) >> 8) * (1.0f / 16777216.0f);
+}
+
+// sum of four uniforms scaled to unit variance, tails cut at 3.46 sigma,
+// which is plenty for process noise and needs no log or sqrt per sample
+inline float GaussianAt(unsigned int key, unsigned int index) {
+  unsigned int h1 = Hash(index ^ key);
+  unsigned int h2 = Hash(h1 + 0x9e3779b9u);
+  float sum = (float)(h1 & 0xffffu) + (float)(h1 >> 16) + (float)(h2 & 0xffffu) + (float)(h2 >> 16);
+  return (sum * (1.0f / 65536.0f) - 2.0f) * 1.7320508f;
+}
+
+}  // namespace
+
+ParticleFilter::ParticleFilter(int num_particles, WorkerPool *pool, unsigned int seed)
+    : num_particles_(std::max(1, num_particles)), pool_(pool), seed_(seed), step_(0) {
+  is_initialized_ = false;
+  time_us_ = 0;
+  x_ = VectorXd::Zero(5);
+  P_ = MatrixXd::Identity(5, 5);
+
+  std_a_ = 2.0;
+  std_yawdd_ = 2.0;
+  std_laspx_ = 0.15;
+  std_laspy_ = 0.15;
+  std_radr_ = 0.3;
+  std_radphi_ = 0.03;
+  std_radrd_ = 0.3;
+
+  init_std_v_ = 5.0;
+  init_std_yawd_ = 0.5;
+  resample_threshold_ = 0.5;
+  roughening_ = 2.0;
+  resamples_ = 0;
+
+  // a few chunks per thread even out the load
+  num_chunks_ = pool_ != nullptr ? std::min(num_particles_, pool_->Size() * 4) : 1;
+
+  px_.resize(num_particles_);
+  py_.resize(num_particles_);
+  v_.resize(num_particles_);
+  yaw_.resize(num_particles_);
+  yawd_.resize(num_particles_);
+  w_.resize(num_particles_);
+  ll_.resize(num_particles_);
+  noise_a_.resize(num_particles_);
+  noise_yawdd_.resize(num_particles_);
+  px_next_.resize(num_particles_);
+  py_next_.resize(num_particles_);
+  v_next_.resize(num_particles_);
+  yaw_next_.resize(num_particles_);
+  yawd_next_.resize(num_particles_);
+}
+
+ParticleFilter::~ParticleFilter() {}
+
+void ParticleFilter::ForChunks(const std::function<void(int, int, int)> &fn) const {
+  int n = num_particles_;
+  int chunks = num_chunks_;
+  auto run = [&](int c) {
+    fn(c, (int)((long long)c * n / chunks), (int)((long long)(c + 1) * n / chunks));
+  };
+  if (pool_ != nullptr) {
+    pool_->ParallelFor(chunks, run);
+  } else {
+    for (int c = 0; c < chunks; ++c) {
+      run(c);
+    }
+  }
+}
+
+unsigned int ParticleFilter::StreamKey(unsigned int k) const {
+  return Hash(Hash(seed_) + Hash(step_ * 16u + k));
+}
+
+void ParticleFilter::ProcessMeasurement(MeasurementPackage meas_package) {
+  if (!is_initialized_) {
+    Initialize(meas_package);
+    Estimate();
+    return;
+  }
+
+  // measurements of the same time stamp share one prediction
+  double delta_t = (meas_package.timestamp_ - time_us_) / 1000000.0;
+  if (delta_t > 0) {
+    Predict(delta_t);
+  }
+  time_us_ = meas_package.timestamp_;
+
+  Update(meas_package);
+  if (EffectiveSampleSize() < resample_threshold_ * num_particles_) {
+    Resample();
+  }
+  Estimate();
+}
+
+void ParticleFilter::Initialize(const MeasurementPackage &meas_package) {
+  ++step_;
+  const unsigned int key_x = StreamKey(0);
+  const unsigned int key_y = StreamKey(1);
+  const unsigned int key_v = StreamKey(2);
+  const unsigned int key_yaw = StreamKey(3);
+  const unsigned int key_yawd = StreamKey(4);
+  const bool lidar = meas_package.sensor_type_ == MeasurementPackage::LASER;
+  const double z0 = meas_package.raw_measurements_(0);
+  const double z1 = meas_package.raw_measurements_(1);
+  const float weight = 1.0f / num_particles_;
+
+  ForChunks([&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      float g0 = GaussianAt(key_x, i);
+      float g1 = GaussianAt(key_y, i);
+      if (lidar) {
+        px_[i] = z0 + std_laspx_ * g0;
+        py_[i] = z1 + std_laspy_ * g1;
+      } else {
+        double s, c;
+        double rho = z0 + std_radr_ * g0;
+        PolySinCos(z1 + std_radphi_ * g1, &s, &c);
+        px_[i] = rho * c;
+        py_[i] = rho * s;
+      }
+      v_[i] = std::fabs(init_std_v_ * GaussianAt(key_v, i));
+      yaw_[i] = -M_PI + 2 * M_PI * UniformAt(key_yaw, i);
+      yawd_[i] = init_std_yawd_ * GaussianAt(key_yawd, i);
+      w_[i] = weight;
+    }
+  });
+
+  time_us_ = meas_package.timestamp_;
+  is_initialized_ = true;
+}
+
+void ParticleFilter::Predict(double delta_t) {
+  ++step_;
+  const unsigned int key_a = StreamKey(0);
+  const unsigned int key_yawdd = StreamKey(1);
+  const SimdKernels &kernels = Kernels();
+
+  ForChunks([&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      noise_a_[i] = GaussianAt(key_a, i);
+      noise_yawdd_[i] = GaussianAt(key_yawdd, i);
+    }
+    kernels.predict_particles(px_.data() + begin, py_.data() + begin, v_.data() + begin,
+                              yaw_.data() + begin, yawd_.data() + begin, noise_a_.data() + begin,
+                              noise_yawdd_.data() + begin, end - begin, std_a_, std_yawdd_,
+                              delta_t);
+  });
+}
+
+void ParticleFilter::Update(const MeasurementPackage &meas_package) {
+  const VectorXd &z = meas_package.raw_measurements_;
+  std::vector<float> chunk_max(num_chunks_, -std::numeric_limits<float>::max());
+
+  const SimdKernels &kernels = Kernels();
+  if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
+    const double zl[2] = {z(0), z(1)};
+    const double inv_var[2] = {1.0 / (std_laspx_ * std_laspx_), 1.0 / (std_laspy_ * std_laspy_)};
+    ForChunks([&](int c, int begin, int end) {
+      chunk_max[c] = kernels.lidar_log_likelihood(px_.data() + begin, py_.data() + begin,
+                                                  end - begin, zl, inv_var, ll_.data() + begin);
+    });
+  } else {
+    const double zr[3] = {z(0), z(1), z(2)};
+    const double inv_var[3] = {1.0 / (std_radr_ * std_radr_), 1.0 / (std_radphi_ * std_radphi_),
+                               1.0 / (std_radrd_ * std_radrd_)};
+    ForChunks([&](int c, int begin, int end) {
+      chunk_max[c] = kernels.radar_log_likelihood(px_.data() + begin, py_.data() + begin,
+                                                  v_.data() + begin, yaw_.data() + begin,
+                                                  end - begin, zr, inv_var, ll_.data() + begin);
+    });
+  }
+
+  // scale the likelihoods by the best one so they cannot all underflow
+  float max_ll = *std::max_element(chunk_max.begin(), chunk_max.end());
+  std::vector<double> chunk_sum(num_chunks_, 0.0);
+  ForChunks([&](int c, int begin, int end) {
+    double sum = 0;
+    for (int i = begin; i < end; ++i) {
+      w_[i] *= std::exp(ll_[i] - max_ll);
+      sum += w_[i];
+    }
+    chunk_sum[c] = sum;
+  });
+
+  double total = 0;
+  for (double sum : chunk_sum) {
+    total += sum;
+  }
+  // every particle lost the target, start over from uniform weights
+  const float scale = total > 0 && std::isfinite(total) ? 1.0 / total : 0.0f;
+  const float uniform = 1.0f / num_particles_;
+  ForChunks([&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      w_[i] = scale > 0 ? w_[i] * scale : uniform;
+    }
+  });
+}
+
+double ParticleFilter::EffectiveSampleSize() const {
+  std::vector<double> chunk_sum(num_chunks_, 0.0);
+  ForChunks([&](int c, int begin, int end) {
+    double sum = 0;
+    for (int i = begin; i < end; ++i) {
+      sum += (double)w_[i] * w_[i];
+    }
+    chunk_sum[c] = sum;
+  });
+  double total = 0;
+  for (double sum : chunk_sum) {
+    total += sum;
+  }
+  return total > 0 ? 1.0 / total : 0.0;
+}
+
+void ParticleFilter::Resample() {
+  ++step_;
+  ++resamples_;
+  const int n = num_particles_;
+
+  // chunk totals, then their exclusive scan gives every chunk its start on
+  // the cumulative weight axis
+  std::vector<double> chunk_sum(num_chunks_, 0.0);
+  ForChunks([&](int c, int begin, int end) {
+    double sum = 0;
+    for (int i = begin; i < end; ++i) {
+      sum += w_[i];
+    }
+    chunk_sum[c] = sum;
+  });
+  std::vector<double> chunk_start(num_chunks_, 0.0);
+  double total = 0;
+  for (int c = 0; c < num_chunks_; ++c) {
+    chunk_start[c] = total;
+    total += chunk_sum[c];
+  }
+
+  // one offset u0 for all positions (k + u0) / n; particle i is copied to
+  // every position inside its slice of the cumulative weight. Each chunk
+  // adds its weights in the same order as above, so slice ends match up
+  // exactly across chunk boundaries and every position is written once
+  const double u0 = UniformAt(StreamKey(0), 0);
+  const double positions = n / total;
+  ForChunks([&](int c, int begin, int end) {
+    double running = 0;
+    int k = (int)std::ceil(chunk_start[c] * positions - u0);
+    k = std::max(0, std::min(n, k));
+    for (int i = begin; i < end; ++i) {
+      running += w_[i];
+      int k_end = (int)std::ceil((chunk_start[c] + running) * positions - u0);
+      k_end = std::max(k, std::min(n, k_end));
+      for (; k < k_end; ++k) {
+        px_next_[k] = px_[i];
+        py_next_[k] = py_[i];
+        v_next_[k] = v_[i];
+        yaw_next_[k] = yaw_[i];
+        yawd_next_[k] = yawd_[i];
+      }
+    }
+  });
+
+  px_.swap(px_next_);
+  py_.swap(py_next_);
+  v_.swap(v_next_);
+  yaw_.swap(yaw_next_);
+  yawd_.swap(yawd_next_);
+
+  // roughening: jitter the copies by a fraction of the spread of the last
+  // estimate, so duplicated particles can separate again
+  double scale = roughening_ * std::pow((double)n, -1.0 / 5);
+  double jitter[5];
+  for (int j = 0; j < 5; ++j) {
+    jitter[j] = scale * std::sqrt(std::max(P_(j, j), 0.0));
+  }
+  unsigned int key[5];
+  for (int j = 0; j < 5; ++j) {
+    key[j] = StreamKey(1 + j);
+  }
+  const float weight = 1.0f / n;
+  ForChunks([&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      px_[i] += jitter[0] * GaussianAt(key[0], i);
+      py_[i] += jitter[1] * GaussianAt(key[1], i);
+      v_[i] += jitter[2] * GaussianAt(key[2], i);
+      yaw_[i] += jitter[3] * GaussianAt(key[3], i);
+      yawd_[i] += jitter[4] * GaussianAt(key[4], i);
+      w_[i] = weight;
+    }
+  });
+}
+
+void ParticleFilter::Estimate() {
+  // weighted sums of px, py, yawd and the velocity vector; a target that
+  // stops and reverses has particles with opposite yaw, which only the
+  // velocity vector averages correctly
+  std::vector<double> chunk_mean(num_chunks_ * 6, 0.0);
+  ForChunks([&](int c, int begin, int end) {
+    double sum[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = begin; i < end; ++i) {
+      double s, co;
+      PolySinCos(yaw_[i], &s, &co);
+      sum[0] += w_[i] * px_[i];
+      sum[1] += w_[i] * py_[i];
+      sum[3] += w_[i] * yawd_[i];
+      sum[4] += w_[i] * v_[i] * s;
+      sum[5] += w_[i] * v_[i] * co;
+    }
+    std::copy(sum, sum + 6, chunk_mean.begin() + 6 * c);
+  });
+  double mean[6] = {0, 0, 0, 0, 0, 0};
+  for (int c = 0; c < num_chunks_; ++c) {
+    for (int j = 0; j < 6; ++j) {
+      mean[j] += chunk_mean[6 * c + j];
+    }
+  }
+  x_ << mean[0], mean[1], std::sqrt(mean[4] * mean[4] + mean[5] * mean[5]),
+        std::atan2(mean[4], mean[5]), mean[3];
+
+  // upper triangle of the weighted covariance
+  const VectorXd x = x_;
+  std::vector<double> chunk_cov(num_chunks_ * 15, 0.0);
+  ForChunks([&](int c, int begin, int end) {
+    double sum[15] = {0};
+    for (int i = begin; i < end; ++i) {
+      double d[5];
+      d[0] = px_[i] - x(0);
+      d[1] = py_[i] - x(1);
+      d[2] = v_[i] - x(2);
+      d[3] = yaw_[i] - x(3);
+      d[3] -= 2 * M_PI * std::nearbyint(d[3] / (2 * M_PI));
+      d[4] = yawd_[i] - x(4);
+      int k = 0;
+      for (int r = 0; r < 5; ++r) {
+        for (int col = r; col < 5; ++col) {
+          sum[k++] += w_[i] * d[r] * d[col];
+        }
+      }
+    }
+    std::copy(sum, sum + 15, chunk_cov.begin() + 15 * c);
+  });
+  int k = 0;
+  for (int r = 0; r < 5; ++r) {
+    for (int col = r; col < 5; ++col) {
+      double sum = 0;
+      for (int c = 0; c < num_chunks_; ++c) {
+        sum += chunk_cov[15 * c + k];
+      }
+      P_(r, col) = sum;
+      P_(col, r) = sum;
+      ++k;
+    }
+  }
+}
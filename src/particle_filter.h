@@ -0,0 +1,126 @@
+#ifndef PARTICLE_FILTER_H_
+#define PARTICLE_FILTER_H_
+
+#include <functional>
+#include <vector>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+#include "tracker.h"
+#include "worker_pool.h"
+
+/**
+ * ParticleFilter tracks one target with the CTRV model and the lidar and
+ * radar models of the UKF, but represents the state by weighted particles,
+ * so it copes with multimodal posteriors such as an ambiguous lane change
+ * or a radar target next to the sensor.
+ *
+ * Particles are stored as structure of arrays in float. Propagation and
+ * the likelihoods run in the kernels of simd_kernels.h, on the widest
+ * vectors of the machine, with process noise drawn from counter-based
+ * random numbers into arrays first. The particle loops are split into
+ * chunks that run on the worker pool. Resampling is systematic and parallel
+ * over the same chunks.
+ */
+class ParticleFilter : public Tracker {
+ public:
+  /**
+   * Constructor
+   * @param num_particles Number of particles
+   * @param pool Worker pool for the particle loops, null runs them serially
+   * @param seed Seed of the random number streams
+   */
+  ParticleFilter(int num_particles = 10000, WorkerPool *pool = nullptr, unsigned int seed = 1);
+
+  virtual ~ParticleFilter();
+
+  virtual void ProcessMeasurement(MeasurementPackage meas_package);
+
+  virtual Eigen::VectorXd State() const { return x_; }
+
+  virtual Eigen::MatrixXd Covariance() const { return P_; }
+
+  /**
+   * Predict propagates every particle through the CTRV model with sampled
+   * process noise
+   * @param delta_t Time between k and k+1 in s
+   */
+  void Predict(double delta_t);
+
+  /**
+   * Update weights the particles by the likelihood of a measurement
+   * @param meas_package The measurement at k+1
+   */
+  void Update(const MeasurementPackage &meas_package);
+
+  /**
+   * Resample draws a new equally weighted particle set, systematic scheme
+   */
+  void Resample();
+
+  /**
+   * EffectiveSampleSize 1 / sum of the squared normalized weights
+   */
+  double EffectiveSampleSize() const;
+
+  // initially set to false, set to true in first call of ProcessMeasurement
+  bool is_initialized_;
+
+  // time when the state is true, in us
+  long long time_us_;
+
+  // weighted mean and covariance of the particles after the last measurement
+  Eigen::VectorXd x_;
+  Eigen::MatrixXd P_;
+
+  // process and measurement noise, same meaning and defaults as in UKF
+  double std_a_;
+  double std_yawdd_;
+  double std_laspx_;
+  double std_laspy_;
+  double std_radr_;
+  double std_radphi_;
+  double std_radrd_;
+
+  // spread of the initial particles in the unmeasured speed and yaw rate;
+  // the initial yaw is uniform
+  double init_std_v_;
+  double init_std_yawd_;
+
+  // resample when the effective sample size drops below this fraction
+  double resample_threshold_;
+
+  // roughening constant K, resampled particles are jittered by
+  // K * N^(-1/5) times the standard deviation of the estimate
+  double roughening_;
+
+  // number of resampling steps so far
+  long long resamples_;
+
+ private:
+  // runs fn(chunk, begin, end) for every chunk of the particle arrays
+  void ForChunks(const std::function<void(int, int, int)> &fn) const;
+
+  void Initialize(const MeasurementPackage &meas_package);
+
+  void Estimate();
+
+  // key of random stream k of the current step, particles index into it
+  unsigned int StreamKey(unsigned int k) const;
+
+  int num_particles_;
+  int num_chunks_;
+  WorkerPool *pool_;
+  unsigned int seed_;
+  unsigned int step_;
+
+  // particle state, normalized weights and per-particle log-likelihoods
+  std::vector<float> px_, py_, v_, yaw_, yawd_, w_, ll_;
+
+  // unit normal process noise of the current prediction
+  std::vector<float> noise_a_, noise_yawdd_;
+
+  // buffers resampling writes into before they are swapped in
+  std::vector<float> px_next_, py_next_, v_next_, yaw_next_, yawd_next_;
+};
+
+#endif  // PARTICLE_FILTER_H_
@@ -10,6 +10,7 @@
 #include <vector>
 #include <string>
 #include "../ukf.h"
+#include "../fast_math.h"
 
 struct Color
 {
@@ -160,14 +161,15 @@ struct Car
 			}
 		}
 
-		position.x += velocity * cos(angle) * dt;
-		position.y += velocity * sin(angle) * dt;
+		double sinAngle, cosAngle;
+		FastSinCos(angle, &sinAngle, &cosAngle);
+		position.x += velocity * cosAngle * dt;
+		position.y += velocity * sinAngle * dt;
 		angle += velocity*steering*dt/Lf;
 		orientation = getQuaternion(angle);
 		velocity += acceleration*dt;
 
-		sinNegTheta = sin(-angle);
-		cosNegTheta = cos(-angle);
+		FastSinCos(-angle, &sinNegTheta, &cosNegTheta);
 	}
 
 	// collision helper function
@@ -0,0 +1,90 @@
+#include "sensor_rig.h"
+#include <cmath>
+#include "fast_math.h"
+
+namespace {
+
+SensorMount Mount(const std::string &name, MeasurementPackage::SensorType type, double x, double y,
+                  double yaw, double rate, double range, double fov) {
+  SensorMount mount;
+  mount.name = name;
+  mount.type = type;
+  mount.x = x;
+  mount.y = y;
+  mount.yaw = yaw;
+  mount.rate = rate;
+  // the noise of the sensors UKF is tuned for
+  if (type == MeasurementPackage::LASER) {
+    mount.noise[0] = 0.15;
+    mount.noise[1] = 0.15;
+    mount.noise[2] = 0;
+  } else {
+    mount.noise[0] = 0.3;
+    mount.noise[1] = 0.03;
+    mount.noise[2] = 0.3;
+  }
+  mount.range = range;
+  mount.fov = fov;
+  return mount;
+}
+
+}  // namespace
+
+bool SensorMount::Sees(double px, double py) const {
+  double dx = px - x;
+  double dy = py - y;
+  if (dx * dx + dy * dy > range * range) {
+    return false;
+  }
+  double bearing = FastAtan2(dy, dx) - yaw;
+  double sin_bearing, cos_bearing;
+  FastSinCos(bearing, &sin_bearing, &cos_bearing);
+  bearing = FastAtan2(sin_bearing, cos_bearing);
+  return fabs(bearing) <= fov / 2;
+}
+
+bool SensorMount::Fires(long long timestamp_us, long long frame_us) const {
+  // a measurement is due whenever the frame crosses a multiple of 1 / rate
+  return timestamp_us == 0
+      || floor(timestamp_us * rate / 1e6) != floor((timestamp_us - frame_us) * rate / 1e6);
+}
+
+std::vector<SensorMount> StockRig() {
+  std::vector<SensorMount> rig;
+  rig.push_back(Mount("lidar", MeasurementPackage::LASER, 0, 0, 0, 1e6, 1e9, 2 * M_PI));
+  rig.push_back(Mount("radar", MeasurementPackage::RADAR, 0, 0, 0, 1e6, 1e9, 2 * M_PI));
+  return rig;
+}
+
+std::vector<SensorMount> CornerRadarRig() {
+  std::vector<SensorMount> rig;
+  rig.push_back(Mount("roof_lidar", MeasurementPackage::LASER, 0, 0, 0, 20, 100, 2 * M_PI));
+  rig.push_back(Mount("front_radar", MeasurementPackage::RADAR, 2.0, 0, 0, 20, 150, M_PI / 2));
+  rig.push_back(Mount("rear_radar", MeasurementPackage::RADAR, -2.0, 0, M_PI, 20, 150, M_PI / 2));
+  rig.push_back(Mount("front_left_radar", MeasurementPackage::RADAR, 1.8, 0.9, M_PI / 4, 20, 80, 170 * M_PI / 180));
+  rig.push_back(Mount("front_right_radar", MeasurementPackage::RADAR, 1.8, -0.9, -M_PI / 4, 20, 80, 170 * M_PI / 180));
+  rig.push_back(Mount("rear_left_radar", MeasurementPackage::RADAR, -1.8, 0.9, 3 * M_PI / 4, 20, 80, 170 * M_PI / 180));
+  rig.push_back(Mount("rear_right_radar", MeasurementPackage::RADAR, -1.8, -0.9, -3 * M_PI / 4, 20, 80, 170 * M_PI / 180));
+  return rig;
+}
+
+MeasurementPackage ToEgoFrame(const MountedMeasurement &measurement) {
+  MeasurementPackage meas = measurement.meas;
+  const Eigen::VectorXd &z = measurement.meas.raw_measurements_;
+  double c, s;
+  FastSinCos(measurement.yaw, &s, &c);
+  if (meas.sensor_type_ == MeasurementPackage::LASER) {
+    meas.raw_measurements_(0) = measurement.x + c * z(0) - s * z(1);
+    meas.raw_measurements_(1) = measurement.y + s * z(0) + c * z(1);
+  } else {
+    double sin_phi, cos_phi;
+    FastSinCos(z(1), &sin_phi, &cos_phi);
+    double local_x = z(0) * cos_phi;
+    double local_y = z(0) * sin_phi;
+    double px = measurement.x + c * local_x - s * local_y;
+    double py = measurement.y + s * local_x + c * local_y;
+    meas.raw_measurements_(0) = sqrt(px * px + py * py);
+    meas.raw_measurements_(1) = FastAtan2(py, px);
+  }
+  return meas;
+}
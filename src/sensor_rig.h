@@ -0,0 +1,67 @@
+#ifndef SENSOR_RIG_H_
+#define SENSOR_RIG_H_
+
+#include <string>
+#include <vector>
+#include "measurement_package.h"
+
+/**
+ * SensorMount is one sensor of the ego vehicle: where it sits, how often it
+ * measures, how noisy it is and what it can see. Lidars measure the target
+ * position and radars range, bearing and range rate, both in the frame of
+ * the sensor.
+ */
+struct SensorMount {
+  std::string name;
+  MeasurementPackage::SensorType type;
+  // pose in the ego frame, x ahead and yaw counterclockwise from x
+  double x;
+  double y;
+  double yaw;
+  // measurements per second
+  double rate;
+  // noise standard deviations, px and py for lidars, rho, phi and rho_dot
+  // for radars
+  double noise[3];
+  // range in m and full horizontal field of view in rad
+  double range;
+  double fov;
+
+  // true if a target at (px, py) in the ego frame is in range and in view
+  bool Sees(double px, double py) const;
+
+  // true if the sensor measures during the frame that ends at timestamp_us
+  bool Fires(long long timestamp_us, long long frame_us) const;
+};
+
+// a measurement in the frame of the sensor that took it
+struct MountedMeasurement {
+  MeasurementPackage meas;
+  // index of the sensor in its rig
+  int sensor;
+  // pose and noise of the sensor, see SensorMount
+  double x;
+  double y;
+  double yaw;
+  double noise[3];
+};
+
+/**
+ * StockRig the lidar and the radar at the ego origin the highway has always
+ * sensed with, every frame
+ */
+std::vector<SensorMount> StockRig();
+
+/**
+ * CornerRadarRig a roof lidar with a front, a rear and four corner
+ * radars, all at 20 Hz, so targets are seen 3 to 5 times per cycle
+ */
+std::vector<SensorMount> CornerRadarRig();
+
+/**
+ * ToEgoFrame the measurement a sensor of the same kind at the ego origin
+ * would have made of the same position; the range rate is kept as is
+ */
+MeasurementPackage ToEgoFrame(const MountedMeasurement &measurement);
+
+#endif  // SENSOR_RIG_H_
@@ -1,6 +1,8 @@
 #ifndef LIDAR_H
 #define LIDAR_H
 #include "../render/render.h"
+#include "../async_logger.h"
+#include "../simd_kernels.h"
 #include <ctime>
 #include <chrono>
 
@@ -73,6 +75,10 @@ struct Lidar
 {
 
 	std::vector<Ray> rays;
+	// ray steps one array per axis, and where each ray stopped, for the
+	// dispatched ray casting kernel
+	std::vector<double> rayDirX, rayDirY, rayDirZ;
+	std::vector<double> hitX, hitY, hitZ, hitDistance;
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
 	std::vector<Car> cars;
 	Vect3 position;
@@ -110,6 +116,9 @@ struct Lidar
 			{
 				Ray ray(position,angle,angleVertical,resoultion);
 				rays.push_back(ray);
+				rayDirX.push_back(ray.direction.x);
+				rayDirY.push_back(ray.direction.y);
+				rayDirZ.push_back(ray.direction.z);
 			}
 		}
 	}
@@ -129,11 +138,31 @@ struct Lidar
  
 		cloud->points.clear();
 		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+		std::vector<RayTarget> targets;
+		for(const Car& car : cars)
+			targets.push_back({car.position.x, car.position.y, car.position.z, car.cosNegTheta, car.sinNegTheta, car.dimensions.x, car.dimensions.y, car.dimensions.z});
+		RayScan rayScan = {position.x, position.y, position.z, resoultion, maxDistance, tan(groundSlope), targets.data(), (int)targets.size()};
+		size_t numRays = rays.size();
+		hitX.resize(numRays);
+		hitY.resize(numRays);
+		hitZ.resize(numRays);
+		hitDistance.resize(numRays);
+		Kernels().cast_rays(rayScan, rayDirX.data(), rayDirY.data(), rayDirZ.data(), numRays, hitX.data(), hitY.data(), hitZ.data(), hitDistance.data());
+
+		// in ray order, so the noise draws match Ray::rayCast
+		for(size_t i = 0; i < numRays; i++)
+		{
+			if((hitDistance[i] >= minDistance)&&(hitDistance[i]<=maxDistance)&& (hitY[i] <= 6 && hitY[i] >= -6 && hitX[i] <= 50 && hitX[i] >= -15))
+			{
+				double rx = ((double) rand() / (RAND_MAX));
+				double ry = ((double) rand() / (RAND_MAX));
+				double rz = ((double) rand() / (RAND_MAX));
+				cloud->points.push_back(pcl::PointXYZ(hitX[i]+rx*sderr, hitY[i]+ry*sderr, hitZ[i]+rz*sderr));
+			}
+		}
 		auto endTime = std::chrono::steady_clock::now();
-		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
+		auto elapsedTime = std::chrono::duration<double, std::milli>(endTime - startTime);
+		AsyncLogger::Instance().Log(LOG_DEBUG, "ray casting took {} milliseconds", elapsedTime.count());
 		cloud->width = cloud->points.size();
 		cloud->height = 1; // one dimensional unorganized point cloud dataset
 		return cloud;
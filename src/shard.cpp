@@ -0,0 +1,183 @@
+#include "shard.h"
+#include <algorithm>
+
+std::vector<Car> GenerateTraffic(int num_cars, double road_min, double road_max, unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> position(road_min, road_max);
+  std::uniform_real_distribution<double> speed(2.0, 8.0);
+  std::uniform_real_distribution<double> acceleration(-1.0, 1.0);
+  std::uniform_int_distribution<int> lane(-1, 1);
+
+  std::vector<Car> traffic;
+  for (int i = 0; i < num_cars; ++i) {
+    // relative to the ego frame traffic drifts forward or backward
+    double velocity = (gen() % 2 ? 1.0 : -1.0) * speed(gen);
+    Car car(Vect3(position(gen), 4.0*lane(gen), 0), Vect3(4, 2, 2), Color(0, 0, 1),
+            velocity, 0, 2, "car" + std::to_string(i));
+
+    std::vector<accuation> instructions;
+    instructions.push_back(accuation(1.0*1e6, acceleration(gen), 0.0));
+    instructions.push_back(accuation(3.0*1e6, 0.0, 0.0));
+    car.setInstructions(instructions);
+
+    UKF ukf;
+    car.setUKF(ukf);
+    traffic.push_back(car);
+  }
+  return traffic;
+}
+
+void SegmentBounds(int i, double road_min, double road_max, int num_segments,
+                   double &x_min, double &x_max) {
+  double length = (road_max - road_min) / num_segments;
+  x_min = road_min + i*length;
+  x_max = (i == num_segments-1) ? road_max : road_min + (i+1)*length;
+}
+
+int SegmentIndex(double x, double road_min, double road_max, int num_segments) {
+  if (x < road_min || x >= road_max) {
+    return -1;
+  }
+  int index = static_cast<int>((x - road_min) / (road_max - road_min) * num_segments);
+  index = std::min(index, num_segments-1);
+  // guard against rounding at the segment edges
+  double x_min, x_max;
+  SegmentBounds(index, road_min, road_max, num_segments, x_min, x_max);
+  while (index > 0 && x < x_min) {
+    SegmentBounds(--index, road_min, road_max, num_segments, x_min, x_max);
+  }
+  while (index < num_segments-1 && x >= x_max) {
+    SegmentBounds(++index, road_min, road_max, num_segments, x_min, x_max);
+  }
+  return index;
+}
+
+HighwayShard::HighwayShard(int id, double x_min, double x_max)
+    : id_(id), x_min_(x_min), x_max_(x_max), handoffs_in_(0), handoffs_out_(0) {}
+
+HighwayShard::~HighwayShard() {}
+
+void HighwayShard::Step(const Car &ego, double dt, long long timestamp) {
+  handoff_out_.clear();
+
+  size_t kept = 0;
+  for (size_t i = 0; i < traffic_.size(); ++i) {
+    Car &car = traffic_[i];
+    car.move(dt, timestamp);
+
+    VectorXd gt(4);
+    gt << car.position.x, car.position.y, car.velocity*cos(car.angle), car.velocity*sin(car.angle);
+    tools_.ground_truth.push_back(gt);
+    tools_.lidarSense(car, viewer_, timestamp, false);
+    tools_.radarSense(car, ego, viewer_, timestamp, false);
+
+    double v = car.ukf.x_(2);
+    double yaw = car.ukf.x_(3);
+    VectorXd estimate(4);
+    estimate << car.ukf.x_(0), car.ukf.x_(1), cos(yaw)*v, sin(yaw)*v;
+    tools_.estimations.push_back(estimate);
+
+    // cars that crossed a boundary leave together with their filter state
+    if (Owns(car.position.x)) {
+      if (kept != i) {
+        traffic_[kept] = car;
+      }
+      ++kept;
+    } else {
+      handoff_out_.push_back(car);
+    }
+  }
+  traffic_.erase(traffic_.begin() + kept, traffic_.end());
+  handoffs_out_ += handoff_out_.size();
+}
+
+void HighwayShard::Absorb() {
+  std::lock_guard<std::mutex> lock(handoff_mutex_);
+  handoffs_in_ += handoff_in_.size();
+  traffic_.insert(traffic_.end(), handoff_in_.begin(), handoff_in_.end());
+  handoff_in_.clear();
+}
+
+ShardedHighway::ShardedHighway(double road_min, double road_max, int num_shards, int num_threads)
+    : road_min_(road_min), road_max_(road_max), exits_(0), pool_(num_threads) {
+  egoCar = Car(Vect3(0, 0, 0), Vect3(4, 2, 2), Color(0, 1, 0), 0, 0, 2, "egoCar");
+
+  for (int i = 0; i < num_shards; ++i) {
+    double x_min, x_max;
+    SegmentBounds(i, road_min, road_max, num_shards, x_min, x_max);
+    shards_.push_back(new HighwayShard(i, x_min, x_max));
+  }
+}
+
+ShardedHighway::~ShardedHighway() {
+  for (HighwayShard *shard : shards_) {
+    delete shard;
+  }
+}
+
+void ShardedHighway::Populate(int num_cars, unsigned int seed) {
+  for (const Car &car : GenerateTraffic(num_cars, road_min_, road_max_, seed)) {
+    AddCar(car);
+  }
+}
+
+void ShardedHighway::AddCar(const Car &car) {
+  int index = ShardIndex(car.position.x);
+  if (index < 0) {
+    return;
+  }
+  shards_[index]->traffic_.push_back(car);
+}
+
+int ShardedHighway::ShardIndex(double x) const {
+  return SegmentIndex(x, road_min_, road_max_, shards_.size());
+}
+
+int ShardedHighway::NumCars() const {
+  int count = 0;
+  for (const HighwayShard *shard : shards_) {
+    count += shard->traffic_.size();
+  }
+  return count;
+}
+
+void ShardedHighway::Route(std::vector<Car> &cars) {
+  for (const Car &car : cars) {
+    int index = ShardIndex(car.position.x);
+    if (index < 0) {
+      std::lock_guard<std::mutex> lock(exit_mutex_);
+      ++exits_;
+      continue;
+    }
+    HighwayShard *target = shards_[index];
+    std::lock_guard<std::mutex> lock(target->handoff_mutex_);
+    target->handoff_in_.push_back(car);
+  }
+  cars.clear();
+}
+
+void ShardedHighway::Step(double dt, long long timestamp) {
+  int num_shards = shards_.size();
+
+  // phase 1: simulate, sense and track, then queue cars for their new owner
+  pool_.ParallelFor(num_shards, [&](int i) {
+    shards_[i]->Step(egoCar, dt, timestamp);
+    Route(shards_[i]->handoff_out_);
+  });
+
+  // phase 2: take over the cars queued by the neighbours
+  pool_.ParallelFor(num_shards, [&](int i) {
+    shards_[i]->Absorb();
+  });
+}
+
+VectorXd ShardedHighway::CalculateRMSE() {
+  Tools tools;
+  for (const HighwayShard *shard : shards_) {
+    tools.estimations.insert(tools.estimations.end(),
+                             shard->tools_.estimations.begin(), shard->tools_.estimations.end());
+    tools.ground_truth.insert(tools.ground_truth.end(),
+                              shard->tools_.ground_truth.begin(), shard->tools_.ground_truth.end());
+  }
+  return tools.CalculateRMSE(tools.estimations, tools.ground_truth);
+}
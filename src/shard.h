@@ -0,0 +1,147 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include <mutex>
+#include <vector>
+#include "render/render.h"
+#include "tools.h"
+#include "worker_pool.h"
+
+/**
+ * GenerateTraffic places num_cars tracked cars on the three lanes
+ * @param num_cars Number of traffic cars
+ * @param road_min Rear end of the road in m
+ * @param road_max Front end of the road in m
+ * @param seed Seed for positions, speeds and manoeuvres
+ */
+std::vector<Car> GenerateTraffic(int num_cars, double road_min, double road_max, unsigned int seed);
+
+/**
+ * SegmentBounds bounds of segment i when [road_min, road_max) is split into
+ * num_segments equally long segments; the last one ends exactly at road_max
+ */
+void SegmentBounds(int i, double road_min, double road_max, int num_segments,
+                   double &x_min, double &x_max);
+
+/**
+ * SegmentIndex index of the segment of SegmentBounds that contains x
+ * @return -1 if x is off the road
+ */
+int SegmentIndex(double x, double road_min, double road_max, int num_segments);
+
+/**
+ * HighwayShard owns one longitudinal segment [x_min, x_max) of the road.
+ * Cars inside the segment are moved, sensed and tracked by the shard; a car
+ * that drives out of the segment is handed to the owning shard together with
+ * its UKF state. The sensors measure every car directly from the ego
+ * vehicle, so a shard needs nothing of its neighbours while it steps.
+ */
+class HighwayShard {
+ public:
+  HighwayShard(int id, double x_min, double x_max);
+
+  virtual ~HighwayShard();
+
+  /**
+   * Step moves every local car, senses it with lidar and radar and records
+   * the estimate against ground truth
+   * @param ego Ego vehicle the radar is mounted on
+   * @param dt Time step in s
+   * @param timestamp Simulation time in us
+   */
+  void Step(const Car &ego, double dt, long long timestamp);
+
+  /**
+   * Absorb moves the cars queued for this shard into the local traffic
+   */
+  void Absorb();
+
+  // true if x lies inside the segment owned by this shard
+  bool Owns(double x) const { return x >= x_min_ && x < x_max_; }
+
+  // shard index and segment bounds in m
+  int id_;
+  double x_min_;
+  double x_max_;
+
+  // cars owned by this shard
+  std::vector<Car> traffic_;
+
+  // cars handed over by other shards, consumed by Absorb
+  std::vector<Car> handoff_in_;
+  std::mutex handoff_mutex_;
+
+  // cars that left this shard during the last Step, routed by the owner
+  std::vector<Car> handoff_out_;
+
+  // per-shard estimates and ground truth for RMSE
+  Tools tools_;
+
+  // cumulative counters
+  long long handoffs_in_;
+  long long handoffs_out_;
+
+ private:
+  pcl::visualization::PCLVisualizer::Ptr viewer_;
+};
+
+/**
+ * ShardedHighway splits the road into equally long segments and steps them
+ * on a worker pool. Each tick runs two parallel phases separated by a
+ * barrier: step and emit handoffs, then absorb handoffs.
+ */
+class ShardedHighway {
+ public:
+  /**
+   * Constructor
+   * @param road_min Rear end of the simulated road in m
+   * @param road_max Front end of the simulated road in m
+   * @param num_shards Number of longitudinal segments
+   * @param num_threads Worker threads, 0 picks the hardware concurrency
+   */
+  ShardedHighway(double road_min, double road_max, int num_shards, int num_threads = 0);
+
+  virtual ~ShardedHighway();
+
+  /**
+   * Populate places num_cars tracked cars on the road, see GenerateTraffic
+   */
+  void Populate(int num_cars, unsigned int seed);
+
+  /**
+   * AddCar hands a car to the shard owning its position
+   */
+  void AddCar(const Car &car);
+
+  /**
+   * Step advances every shard by one frame
+   * @param dt Time step in s
+   * @param timestamp Simulation time in us
+   */
+  void Step(double dt, long long timestamp);
+
+  // index of the shard owning x, -1 if x is off the simulated road
+  int ShardIndex(double x) const;
+
+  // number of cars currently on the road
+  int NumCars() const;
+
+  // RMSE over every estimate recorded by all shards
+  VectorXd CalculateRMSE();
+
+  std::vector<HighwayShard *> shards_;
+  Car egoCar;
+  double road_min_;
+  double road_max_;
+
+  // cars that drove off either end of the simulated road
+  long long exits_;
+
+ private:
+  void Route(std::vector<Car> &cars);
+
+  WorkerPool pool_;
+  std::mutex exit_mutex_;
+};
+
+#endif  // SHARD_H_
@@ -0,0 +1,295 @@
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "async_logger.h"
+#include "fast_math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UKF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+namespace scalar {
+
+typedef double Vec;
+typedef bool Mask;
+const int kWidth = 1;
+
+inline Vec Load(const double *p) { return *p; }
+inline void Store(double *p, Vec v) { *p = v; }
+inline Vec LoadFloat(const float *p) { return *p; }
+inline void StoreFloat(float *p, Vec v) { *p = (float)v; }
+inline Vec Set(double x) { return x; }
+inline Vec Add(Vec a, Vec b) { return a + b; }
+inline Vec Sub(Vec a, Vec b) { return a - b; }
+inline Vec Mul(Vec a, Vec b) { return a * b; }
+inline Vec Div(Vec a, Vec b) { return a / b; }
+inline Vec Neg(Vec a) { return -a; }
+inline Vec Sqrt(Vec a) { return std::sqrt(a); }
+inline Vec Abs(Vec a) { return std::fabs(a); }
+// a when it is larger, else b, the operand order of maxpd
+inline Vec Max(Vec a, Vec b) { return a > b ? a : b; }
+inline Vec Round(Vec a) { return std::nearbyint(a); }
+inline Vec CopySign(Vec a, Vec s) { return std::signbit(s) ? -a : a; }
+inline Mask Gt(Vec a, Vec b) { return a > b; }
+inline Mask Ge(Vec a, Vec b) { return a >= b; }
+inline Mask Lt(Vec a, Vec b) { return a < b; }
+inline Mask Le(Vec a, Vec b) { return a <= b; }
+inline Mask Eq(Vec a, Vec b) { return a == b; }
+inline Mask And(Mask a, Mask b) { return a && b; }
+inline Mask Or(Mask a, Mask b) { return a || b; }
+inline Mask Not(Mask a) { return !a; }
+inline Vec Select(Mask m, Vec a, Vec b) { return m ? a : b; }
+inline bool Any(Mask m) { return m; }
+inline double Sum(Vec a) { return a; }
+
+#define UKF_SIMD_SCALAR
+#include "simd_kernels_impl.h"
+#undef UKF_SIMD_SCALAR
+
+}  // namespace scalar
+
+#ifdef UKF_SIMD_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace sse2 {
+
+typedef __m128d Vec;
+typedef __m128d Mask;
+const int kWidth = 2;
+
+inline Vec Load(const double *p) { return _mm_loadu_pd(p); }
+inline void Store(double *p, Vec v) { _mm_storeu_pd(p, v); }
+// two floats are 64 bits, moved as one integer lane
+inline Vec LoadFloat(const float *p) {
+  return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+}
+inline void StoreFloat(float *p, Vec v) {
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_castps_si128(_mm_cvtpd_ps(v)));
+}
+inline Vec Set(double x) { return _mm_set1_pd(x); }
+inline Vec Add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+inline Vec Sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+inline Vec Mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+inline Vec Div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+inline Vec Neg(Vec a) { return _mm_xor_pd(a, _mm_set1_pd(-0.0)); }
+inline Vec Sqrt(Vec a) { return _mm_sqrt_pd(a); }
+inline Vec Abs(Vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+inline Vec Max(Vec a, Vec b) { return _mm_max_pd(a, b); }
+// SSE2 has no rounding instruction; adding and subtracting 1.5 * 2^52
+// rounds to the nearest integer for |a| < 2^51
+inline Vec Round(Vec a) {
+  const Vec magic = _mm_set1_pd(6755399441055744.0);
+  return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+}
+inline Vec CopySign(Vec a, Vec s) {
+  const Vec sign = _mm_set1_pd(-0.0);
+  return _mm_or_pd(_mm_andnot_pd(sign, a), _mm_and_pd(sign, s));
+}
+inline Mask Gt(Vec a, Vec b) { return _mm_cmpgt_pd(a, b); }
+inline Mask Ge(Vec a, Vec b) { return _mm_cmpge_pd(a, b); }
+inline Mask Lt(Vec a, Vec b) { return _mm_cmplt_pd(a, b); }
+inline Mask Le(Vec a, Vec b) { return _mm_cmple_pd(a, b); }
+inline Mask Eq(Vec a, Vec b) { return _mm_cmpeq_pd(a, b); }
+inline Mask And(Mask a, Mask b) { return _mm_and_pd(a, b); }
+inline Mask Or(Mask a, Mask b) { return _mm_or_pd(a, b); }
+inline Mask Not(Mask a) { return _mm_xor_pd(a, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+inline Vec Select(Mask m, Vec a, Vec b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+inline bool Any(Mask m) { return _mm_movemask_pd(m) != 0; }
+inline double Sum(Vec a) {
+  double lanes[kWidth];
+  _mm_storeu_pd(lanes, a);
+  return lanes[0] + lanes[1];
+}
+
+#include "simd_kernels_impl.h"
+
+}  // namespace sse2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+
+typedef __m256d Vec;
+typedef __m256d Mask;
+const int kWidth = 4;
+
+inline Vec Load(const double *p) { return _mm256_loadu_pd(p); }
+inline void Store(double *p, Vec v) { _mm256_storeu_pd(p, v); }
+inline Vec LoadFloat(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+inline void StoreFloat(float *p, Vec v) { _mm_storeu_ps(p, _mm256_cvtpd_ps(v)); }
+inline Vec Set(double x) { return _mm256_set1_pd(x); }
+inline Vec Add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+inline Vec Sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+inline Vec Mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+inline Vec Div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+inline Vec Neg(Vec a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+inline Vec Sqrt(Vec a) { return _mm256_sqrt_pd(a); }
+inline Vec Abs(Vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+inline Vec Max(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+inline Vec Round(Vec a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline Vec CopySign(Vec a, Vec s) {
+  const Vec sign = _mm256_set1_pd(-0.0);
+  return _mm256_or_pd(_mm256_andnot_pd(sign, a), _mm256_and_pd(sign, s));
+}
+inline Mask Gt(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+inline Mask Ge(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+inline Mask Lt(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+inline Mask Le(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+inline Mask Eq(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+inline Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+inline Mask Or(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+inline Mask Not(Mask a) { return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi32(-1))); }
+inline Vec Select(Mask m, Vec a, Vec b) { return _mm256_blendv_pd(b, a, m); }
+inline bool Any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+inline double Sum(Vec a) {
+  double lanes[kWidth];
+  _mm256_storeu_pd(lanes, a);
+  return ((lanes[0] + lanes[1]) + lanes[2]) + lanes[3];
+}
+
+#include "simd_kernels_impl.h"
+
+}  // namespace avx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512 {
+
+typedef __m512d Vec;
+typedef __mmask8 Mask;
+const int kWidth = 8;
+
+inline Vec Load(const double *p) { return _mm512_loadu_pd(p); }
+inline void Store(double *p, Vec v) { _mm512_storeu_pd(p, v); }
+inline Vec LoadFloat(const float *p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+inline void StoreFloat(float *p, Vec v) { _mm256_storeu_ps(p, _mm512_cvtpd_ps(v)); }
+inline Vec Set(double x) { return _mm512_set1_pd(x); }
+inline Vec Add(Vec a, Vec b) { return _mm512_add_pd(a, b); }
+inline Vec Sub(Vec a, Vec b) { return _mm512_sub_pd(a, b); }
+inline Vec Mul(Vec a, Vec b) { return _mm512_mul_pd(a, b); }
+inline Vec Div(Vec a, Vec b) { return _mm512_div_pd(a, b); }
+inline Vec Sqrt(Vec a) { return _mm512_mask_sqrt_pd(a, 0xFF, a); }
+inline Vec Abs(Vec a) { return _mm512_abs_pd(a); }
+inline Vec Max(Vec a, Vec b) { return _mm512_max_pd(a, b); }
+inline Vec Round(Vec a) {
+  return _mm512_mask_roundscale_pd(a, 0xFF, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+// AVX-512F has no floating point logic, the sign bit is flipped as integers
+inline Vec Neg(Vec a) {
+  return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a),
+                                              _mm512_set1_epi64(0x8000000000000000LL)));
+}
+inline Vec CopySign(Vec a, Vec s) {
+  const __m512i magnitude = _mm512_set1_epi64(0x7FFFFFFFFFFFFFFFLL);
+  const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+  return _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(magnitude, _mm512_castpd_si512(a)),
+                                             _mm512_and_si512(sign, _mm512_castpd_si512(s))));
+}
+inline Mask Gt(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+inline Mask Ge(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+inline Mask Lt(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+inline Mask Le(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+inline Mask Eq(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+inline Mask And(Mask a, Mask b) { return a & b; }
+inline Mask Or(Mask a, Mask b) { return a | b; }
+inline Mask Not(Mask a) { return static_cast<Mask>(~a); }
+inline Vec Select(Mask m, Vec a, Vec b) { return _mm512_mask_blend_pd(m, b, a); }
+inline bool Any(Mask m) { return m != 0; }
+inline double Sum(Vec a) {
+  double lanes[kWidth];
+  _mm512_storeu_pd(lanes, a);
+  double sum = lanes[0];
+  for (int i = 1; i < kWidth; ++i) {
+    sum += lanes[i];
+  }
+  return sum;
+}
+
+#include "simd_kernels_impl.h"
+
+}  // namespace avx512
+#pragma GCC pop_options
+
+#endif  // UKF_SIMD_X86
+
+#define UKF_KERNELS(isa, ns)                                                          \
+  {isa, #ns, &ns::PredictSigmaPoints, &ns::RadarTransform, &ns::UtMean, &ns::UtCovariance, \
+   &ns::CastRays, &ns::PredictParticles, &ns::LidarLogLikelihood, &ns::RadarLogLikelihood}
+
+const SimdKernels kScalarKernels = UKF_KERNELS(ISA_SCALAR, scalar);
+#ifdef UKF_SIMD_X86
+const SimdKernels kSse2Kernels = UKF_KERNELS(ISA_SSE2, sse2);
+const SimdKernels kAvx2Kernels = UKF_KERNELS(ISA_AVX2, avx2);
+const SimdKernels kAvx512Kernels = UKF_KERNELS(ISA_AVX512, avx512);
+#endif
+
+#undef UKF_KERNELS
+
+const SimdKernels &SelectKernels() {
+  const SimdKernels *selected = nullptr;
+  const char *forced = getenv("UKF_FORCE_ISA");
+  if (forced != nullptr) {
+    for (int isa = ISA_SCALAR; isa <= ISA_AVX512; ++isa) {
+      if (IsaName(static_cast<SimdIsa>(isa)) == forced) {
+        selected = KernelsFor(static_cast<SimdIsa>(isa));
+      }
+    }
+    if (selected == nullptr) {
+      AsyncLogger::Instance().Log(LOG_WARNING, "UKF_FORCE_ISA={} is unknown or unsupported here",
+                                  std::string(forced));
+    }
+  }
+  for (int isa = ISA_AVX512; selected == nullptr; --isa) {
+    selected = KernelsFor(static_cast<SimdIsa>(isa));
+  }
+  AsyncLogger::Instance().Log(LOG_DEBUG, "filter kernels use {}", selected->name);
+  return *selected;
+}
+
+}  // namespace
+
+const SimdKernels &Kernels() {
+  static const SimdKernels &kernels = SelectKernels();
+  return kernels;
+}
+
+const SimdKernels *KernelsFor(SimdIsa isa) {
+  switch (isa) {
+    case ISA_SCALAR:
+      return &kScalarKernels;
+#ifdef UKF_SIMD_X86
+    case ISA_SSE2:
+      return __builtin_cpu_supports("sse2") ? &kSse2Kernels : nullptr;
+    case ISA_AVX2:
+      return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : nullptr;
+    case ISA_AVX512:
+      return __builtin_cpu_supports("avx512f") ? &kAvx512Kernels : nullptr;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+std::string IsaName(SimdIsa isa) {
+  switch (isa) {
+    case ISA_SCALAR:
+      return "scalar";
+    case ISA_SSE2:
+      return "sse2";
+    case ISA_AVX2:
+      return "avx2";
+    case ISA_AVX512:
+      return "avx512";
+  }
+  return "";
+}
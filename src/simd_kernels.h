@@ -0,0 +1,152 @@
+#ifndef SIMD_KERNELS_H_
+#define SIMD_KERNELS_H_
+
+#include <string>
+
+// sigma point arrays are row-major, one row per state component, with rows
+// padded to this many points so every vector width divides them
+const int kSigmaStride = 16;
+
+enum SimdIsa {
+  ISA_SCALAR,
+  ISA_SSE2,
+  ISA_AVX2,
+  ISA_AVX512
+};
+
+// an oriented car box of Car::checkCollision
+struct RayTarget {
+  double x;
+  double y;
+  double z;
+  double cos_neg_theta;
+  double sin_neg_theta;
+  double length;
+  double width;
+  double height;
+};
+
+// parameters shared by all rays of one scan, see Ray::rayCast
+struct RayScan {
+  double origin_x;
+  double origin_y;
+  double origin_z;
+  double resolution;
+  double max_distance;
+  // tangent of the ground slope
+  double ground_tan;
+  const RayTarget *targets;
+  int num_targets;
+};
+
+/**
+ * SimdKernels is one build of the filter and sensor hot loops for one
+ * instruction set.
+ *
+ * Every kernel is compiled for SSE2, AVX2 and AVX-512 with GCC target
+ * attributes and selected by CPUID at startup, so one binary uses the
+ * widest vectors of the machine it runs on. The environment variable
+ * UKF_FORCE_ISA=scalar|sse2|avx2|avx512 overrides the choice.
+ *
+ * The scalar build calls the Fast* functions of fast_math.h like the plain
+ * loops did. The vector builds call libm lane by lane, or with
+ * UKF_FAST_MATH evaluate sin, cos and atan2 with the polynomials of
+ * fast_math.h on whole vectors, and sum sigma points lane by lane. They
+ * differ from the scalar build by rounding, plus with UKF_FAST_MATH the
+ * polynomial error, which the CTRV model scales by v / yawd; with yaw rates
+ * just above the 0.001 cutoff that is 1e-8 at most. Ray hits are identical
+ * in every build, the march only adds and compares.
+ *
+ * The particle kernels work on the float arrays of ParticleFilter. They
+ * widen every lane to double, always use the polynomials, in every build,
+ * and round the results back to float once.
+ */
+struct SimdKernels {
+  SimdIsa isa;
+  const char *name;
+
+  /**
+   * PredictSigmaPoints propagates augmented sigma points through the CTRV
+   * model, as UKF::SigmaPointsPrediction
+   * @param aug 7 rows of augmented sigma points
+   * @param pred 5 rows of predicted sigma points
+   * @param n Number of sigma points, at most kSigmaStride
+   * @param delta_t Time step in s
+   */
+  void (*predict_sigma_points)(const double *aug, double *pred, int n, double delta_t);
+
+  /**
+   * RadarTransform maps 5 rows of sigma points to range, bearing and range
+   * rate, 3 rows
+   */
+  void (*radar_transform)(const double *x, double *z, int n);
+
+  /**
+   * UtMean the weighted mean of each of rows rows of n sigma points
+   */
+  void (*ut_mean)(const double *x, int rows, int n, const double *weights, double *mean);
+
+  /**
+   * UtCovariance the weighted covariance of the sigma point residuals of a
+   * and b, out is a_rows x b_rows row-major; a and b may be the same
+   * @param a_angle Row of a normalized to [-pi, pi], -1 for none
+   */
+  void (*ut_covariance)(const double *a, const double *a_mean, int a_rows, int a_angle,
+                        const double *b, const double *b_mean, int b_rows, int b_angle,
+                        int n, const double *weights, double *out);
+
+  /**
+   * CastRays marches rays from the scan origin until they hit the ground,
+   * a target, the road bounds or the maximum distance
+   * @param dir_x, dir_y, dir_z Step of every ray, resolution long
+   * @param hit_x, hit_y, hit_z, hit_distance Where every ray stopped
+   */
+  void (*cast_rays)(const RayScan &scan, const double *dir_x, const double *dir_y,
+                    const double *dir_z, int n, double *hit_x, double *hit_y, double *hit_z,
+                    double *hit_distance);
+
+  /**
+   * PredictParticles propagates n particles through the CTRV model, as
+   * ParticleFilter::Predict, and keeps their speed non-negative
+   * @param noise_a, noise_yawdd Unit normal process noise of every particle,
+   * scaled by std_a and std_yawdd
+   */
+  void (*predict_particles)(float *px, float *py, float *v, float *yaw, float *yawd,
+                            const float *noise_a, const float *noise_yawdd, int n, double std_a,
+                            double std_yawdd, double delta_t);
+
+  /**
+   * LidarLogLikelihood the log-likelihood of lidar measurement z for n
+   * particles, up to a constant
+   * @param inv_var Inverse variances of px and py
+   * @return The largest log-likelihood
+   */
+  float (*lidar_log_likelihood)(const float *px, const float *py, int n, const double *z,
+                                const double *inv_var, float *ll);
+
+  /**
+   * RadarLogLikelihood the log-likelihood of radar measurement z for n
+   * particles, up to a constant
+   * @param inv_var Inverse variances of range, bearing and range rate
+   * @return The largest log-likelihood
+   */
+  float (*radar_log_likelihood)(const float *px, const float *py, const float *v,
+                                const float *yaw, int n, const double *z, const double *inv_var,
+                                float *ll);
+};
+
+/**
+ * Kernels the build selected for this process
+ */
+const SimdKernels &Kernels();
+
+/**
+ * KernelsFor the build of one instruction set
+ * @return nullptr if the compiler or the CPU does not support it
+ */
+const SimdKernels *KernelsFor(SimdIsa isa);
+
+// name of an instruction set as UKF_FORCE_ISA spells it
+std::string IsaName(SimdIsa isa);
+
+#endif  // SIMD_KERNELS_H_
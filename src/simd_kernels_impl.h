@@ -0,0 +1,477 @@
+// Kernel bodies of simd_kernels.h, included once per instruction set by
+// simd_kernels.cpp inside a namespace that defines the vector type Vec, its
+// mask type Mask, the lane count kWidth and the operations used below. The
+// file has no include guard on purpose.
+
+// lanes i..i+kWidth-1 that are below n
+inline Mask LaneMask(int i, int n) {
+  static const double kIota[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  return Lt(Add(Set(i), Load(kIota)), Set(n));
+}
+
+#if defined(UKF_SIMD_SCALAR)
+
+inline void PolySinCosLanes(Vec x, Vec *s, Vec *c) {
+  PolySinCos(x, s, c);
+}
+
+inline Vec PolyAtan2Lanes(Vec y, Vec x) {
+  return PolyAtan2(y, x);
+}
+
+#else
+
+// PolySinCos of fast_math.h on every lane
+inline void PolySinCosLanes(Vec x, Vec *s, Vec *c) {
+  const Vec k = Round(Mul(x, Set(6.36619772367581382433e-01)));
+  const Vec r = Sub(Sub(x, Mul(k, Set(1.57079632673412561417e+00))),
+                    Mul(k, Set(6.07710050650619224932e-11)));
+  const Vec r2 = Mul(r, r);
+
+  Vec sp = Add(Set(1.0/362880), Mul(r2, Set(-1.0/39916800)));
+  sp = Add(Set(-1.0/5040), Mul(r2, sp));
+  sp = Add(Set(1.0/120), Mul(r2, sp));
+  sp = Add(Set(-1.0/6), Mul(r2, sp));
+  const Vec sr = Add(r, Mul(Mul(r, r2), sp));
+  Vec cp = Add(Set(-1.0/3628800), Mul(r2, Set(1.0/479001600)));
+  cp = Add(Set(1.0/40320), Mul(r2, cp));
+  cp = Add(Set(-1.0/720), Mul(r2, cp));
+  cp = Add(Set(1.0/24), Mul(r2, cp));
+  cp = Add(Set(-0.5), Mul(r2, cp));
+  const Vec cr = Add(Set(1.0), Mul(r2, cp));
+
+  // quadrant k mod 4 from the fraction of k / 4: 0, 0.25, +-0.5 or -0.25
+  const Vec q = Sub(Mul(k, Set(0.25)), Round(Mul(k, Set(0.25))));
+  const Mask odd = Eq(Abs(q), Set(0.25));
+  const Mask negate_sin = Or(Lt(q, Set(0.0)), Eq(q, Set(0.5)));
+  const Mask negate_cos = Or(Gt(q, Set(0.0)), Eq(q, Set(-0.5)));
+  const Vec sq = Select(odd, cr, sr);
+  const Vec cq = Select(odd, sr, cr);
+  *s = Select(negate_sin, Neg(sq), sq);
+  *c = Select(negate_cos, Neg(cq), cq);
+}
+
+// PolyAtan2 of fast_math.h on every lane
+inline Vec PolyAtan2Lanes(Vec y, Vec x) {
+  const Vec ax = Abs(x);
+  const Vec ay = Abs(y);
+  const Mask swap = Gt(ay, ax);
+  const Vec num = Select(swap, ax, ay);
+  const Vec den = Select(swap, ay, ax);
+  const Vec t = Select(Gt(den, Set(0.0)), Div(num, den), Set(0.0));
+  const Mask shift = Gt(t, Set(4.14213562373095048802e-01));
+  const Vec u = Select(shift, Div(Sub(t, Set(1.0)), Add(t, Set(1.0))), t);
+  const Vec u2 = Mul(u, u);
+
+  static const double kCoefficients[10] = {-1.0/21, 1.0/19, -1.0/17, 1.0/15, -1.0/13, 1.0/11,
+                                           -1.0/9, 1.0/7, -1.0/5, 1.0/3};
+  Vec p = Set(1.0/23);
+  for (int i = 0; i < 10; ++i) {
+    p = Add(Set(kCoefficients[i]), Mul(u2, p));
+  }
+  Vec a = Sub(u, Mul(Mul(u, u2), p));
+  a = Select(shift, Add(a, Set(M_PI / 4)), a);
+  a = Select(swap, Sub(Set(M_PI / 2), a), a);
+  a = Select(Lt(x, Set(0.0)), Sub(Set(M_PI), a), a);
+  return CopySign(a, y);
+}
+
+#endif  // UKF_SIMD_SCALAR
+
+// the trigonometry of the filter kernels follows the Fast* functions
+#if defined(UKF_SIMD_SCALAR)
+
+inline void SinCos(Vec x, Vec *s, Vec *c) {
+  FastSinCos(x, s, c);
+}
+
+inline Vec Atan2(Vec y, Vec x) {
+  return FastAtan2(y, x);
+}
+
+#elif !defined(UKF_FAST_MATH)
+
+// libm on every lane, so that the vector builds match the scalar one unless
+// the polynomials are asked for
+inline void SinCos(Vec x, Vec *s, Vec *c) {
+  double lanes[kWidth], sines[kWidth], cosines[kWidth];
+  Store(lanes, x);
+  for (int i = 0; i < kWidth; ++i) {
+    sines[i] = std::sin(lanes[i]);
+    cosines[i] = std::cos(lanes[i]);
+  }
+  *s = Load(sines);
+  *c = Load(cosines);
+}
+
+inline Vec Atan2(Vec y, Vec x) {
+  double ys[kWidth], xs[kWidth];
+  Store(ys, y);
+  Store(xs, x);
+  for (int i = 0; i < kWidth; ++i) {
+    ys[i] = std::atan2(ys[i], xs[i]);
+  }
+  return Load(ys);
+}
+
+#else
+
+inline void SinCos(Vec x, Vec *s, Vec *c) {
+  PolySinCosLanes(x, s, c);
+}
+
+inline Vec Atan2(Vec y, Vec x) {
+  return PolyAtan2Lanes(y, x);
+}
+
+#endif  // UKF_SIMD_SCALAR
+
+// d - 2 pi round(d / 2 pi), the same as the while loops of the filter
+inline Vec NormalizeAngle(Vec d) {
+  return Sub(d, Mul(Set(2.*M_PI), Round(Mul(d, Set(0.5 / M_PI)))));
+}
+
+void PredictSigmaPoints(const double *aug, double *pred, int n, double delta_t) {
+  const Vec dt = Set(delta_t);
+  const Vec half_dt2 = Set(0.5 * delta_t * delta_t);
+  for (int i = 0; i < n; i += kWidth) {
+    const Vec px = Load(aug + 0 * kSigmaStride + i);
+    const Vec py = Load(aug + 1 * kSigmaStride + i);
+    const Vec v = Load(aug + 2 * kSigmaStride + i);
+    const Vec yaw = Load(aug + 3 * kSigmaStride + i);
+    const Vec yawd = Load(aug + 4 * kSigmaStride + i);
+    const Vec nu_a = Load(aug + 5 * kSigmaStride + i);
+    const Vec nu_yawdd = Load(aug + 6 * kSigmaStride + i);
+
+    Vec sin_yaw, cos_yaw, sin_yaw_pred, cos_yaw_pred;
+    SinCos(yaw, &sin_yaw, &cos_yaw);
+    const Vec yaw_pred = Add(yaw, Mul(yawd, dt));
+    SinCos(yaw_pred, &sin_yaw_pred, &cos_yaw_pred);
+
+    // both branches, the straight one where yawd is near zero
+    const Mask turning = Gt(Abs(yawd), Set(0.001));
+    const Vec radius = Div(v, yawd);
+    Vec px_pred = Select(turning, Add(px, Mul(radius, Sub(sin_yaw_pred, sin_yaw))),
+                         Add(px, Mul(Mul(v, cos_yaw), dt)));
+    Vec py_pred = Select(turning, Add(py, Mul(radius, Add(Neg(cos_yaw_pred), cos_yaw))),
+                         Add(py, Mul(Mul(v, sin_yaw), dt)));
+
+    // add noise
+    px_pred = Add(px_pred, Mul(Mul(half_dt2, cos_yaw), nu_a));
+    py_pred = Add(py_pred, Mul(Mul(half_dt2, sin_yaw), nu_a));
+    Store(pred + 0 * kSigmaStride + i, px_pred);
+    Store(pred + 1 * kSigmaStride + i, py_pred);
+    Store(pred + 2 * kSigmaStride + i, Add(v, Mul(dt, nu_a)));
+    Store(pred + 3 * kSigmaStride + i, Add(yaw_pred, Mul(half_dt2, nu_yawdd)));
+    Store(pred + 4 * kSigmaStride + i, Add(yawd, Mul(dt, nu_yawdd)));
+  }
+}
+
+void RadarTransform(const double *x, double *z, int n) {
+  for (int i = 0; i < n; i += kWidth) {
+    const Vec p_x = Load(x + 0 * kSigmaStride + i);
+    const Vec p_y = Load(x + 1 * kSigmaStride + i);
+    const Vec v = Load(x + 2 * kSigmaStride + i);
+    const Vec yaw = Load(x + 3 * kSigmaStride + i);
+
+    Vec sin_yaw, cos_yaw;
+    SinCos(yaw, &sin_yaw, &cos_yaw);
+    const Vec v1 = Mul(cos_yaw, v);
+    const Vec v2 = Mul(sin_yaw, v);
+
+    const Vec rho = Sqrt(Add(Mul(p_x, p_x), Mul(p_y, p_y)));
+    Store(z + 0 * kSigmaStride + i, rho);
+    Store(z + 1 * kSigmaStride + i, Atan2(p_y, p_x));
+    Store(z + 2 * kSigmaStride + i, Div(Add(Mul(p_x, v1), Mul(p_y, v2)), rho));
+  }
+}
+
+void UtMean(const double *x, int rows, int n, const double *weights, double *mean) {
+  double w[kSigmaStride] = {0};
+  std::copy(weights, weights + n, w);
+  for (int r = 0; r < rows; ++r) {
+    Vec sum = Set(0.0);
+    for (int i = 0; i < n; i += kWidth) {
+      // lanes past n may hold anything, also NaN
+      Vec value = Select(LaneMask(i, n), Load(x + r * kSigmaStride + i), Set(0.0));
+      sum = Add(sum, Mul(Load(w + i), value));
+    }
+    mean[r] = Sum(sum);
+  }
+}
+
+// residuals of rows rows of sigma points, zero past n
+inline void Residuals(const double *x, const double *mean, int rows, int angle, int n, double *d) {
+  for (int r = 0; r < rows; ++r) {
+    for (int i = 0; i < kSigmaStride; i += kWidth) {
+      Vec diff = Sub(Load(x + r * kSigmaStride + i), Set(mean[r]));
+      if (r == angle) {
+        diff = NormalizeAngle(diff);
+      }
+      Store(d + r * kSigmaStride + i, Select(LaneMask(i, n), diff, Set(0.0)));
+    }
+  }
+}
+
+void UtCovariance(const double *a, const double *a_mean, int a_rows, int a_angle,
+                  const double *b, const double *b_mean, int b_rows, int b_angle,
+                  int n, const double *weights, double *out) {
+  double w[kSigmaStride] = {0};
+  std::copy(weights, weights + n, w);
+  alignas(64) double da[7 * kSigmaStride];
+  alignas(64) double db[7 * kSigmaStride];
+  Residuals(a, a_mean, a_rows, a_angle, n, da);
+  const bool same = a == b && a_mean == b_mean && a_angle == b_angle;
+  if (!same) {
+    Residuals(b, b_mean, b_rows, b_angle, n, db);
+  }
+  const double *d2 = same ? da : db;
+
+  for (int r = 0; r < a_rows; ++r) {
+    // a symmetric result only needs its upper triangle
+    for (int c = same ? r : 0; c < b_rows; ++c) {
+      Vec sum = Set(0.0);
+      for (int i = 0; i < n; i += kWidth) {
+        sum = Add(sum, Mul(Mul(Load(w + i), Load(da + r * kSigmaStride + i)),
+                           Load(d2 + c * kSigmaStride + i)));
+      }
+      out[r * b_rows + c] = Sum(sum);
+      if (same) {
+        out[c * b_rows + r] = out[r * b_rows + c];
+      }
+    }
+  }
+}
+
+// rays of one chunk of kWidth, lanes past count start finished
+inline void CastChunk(const RayScan &scan, const double *dir_x, const double *dir_y,
+                      const double *dir_z, int count, const std::vector<double> &bounds,
+                      double *hit_x, double *hit_y, double *hit_z, double *hit_distance) {
+  const Vec dx = Load(dir_x), dy = Load(dir_y), dz = Load(dir_z);
+  const Vec resolution = Set(scan.resolution);
+  const Vec max_distance = Set(scan.max_distance);
+  const Vec ground_tan = Set(scan.ground_tan);
+  Vec x = Set(scan.origin_x), y = Set(scan.origin_y), z = Set(scan.origin_z);
+  Vec distance = Set(0.0);
+  Mask live = LaneMask(0, count);
+  Mask collision = Not(live);
+
+  while (true) {
+    // the road bounds of Ray::rayCast
+    const Mask inside = And(And(Le(y, Set(6.0)), Ge(y, Set(-6.0))),
+                            And(Le(x, Set(50.0)), Ge(x, Set(-15.0))));
+    const Mask active = And(And(Not(collision), Lt(distance, max_distance)), inside);
+    if (!Any(active)) {
+      break;
+    }
+    x = Select(active, Add(x, dx), x);
+    y = Select(active, Add(y, dy), y);
+    z = Select(active, Add(z, dz), z);
+    distance = Select(active, Add(distance, resolution), distance);
+
+    const Mask ground = Le(z, Mul(x, ground_tan));
+    Mask car = LaneMask(0, 0);
+    for (int t = 0; t < scan.num_targets; ++t) {
+      const RayTarget &target = scan.targets[t];
+      const double *bound = &bounds[t * 10];
+      const Vec xr = Sub(x, Set(target.x));
+      const Vec yr = Sub(y, Set(target.y));
+      const Vec cos_t = Set(target.cos_neg_theta);
+      const Vec sin_t = Set(target.sin_neg_theta);
+      const Vec x_prime = Add(Sub(Mul(xr, cos_t), Mul(yr, sin_t)), Set(target.x));
+      const Vec y_prime = Add(Add(Mul(yr, cos_t), Mul(xr, sin_t)), Set(target.y));
+      const Mask in_y = And(Le(Set(bound[2]), y_prime), Ge(Set(bound[3]), y_prime));
+      const Mask body = And(And(Le(Set(bound[0]), x_prime), Ge(Set(bound[1]), x_prime)),
+                            And(Le(Set(bound[4]), z), Ge(Set(bound[5]), z)));
+      const Mask cabin = And(And(Le(Set(bound[6]), x_prime), Ge(Set(bound[7]), x_prime)),
+                             And(Le(Set(bound[8]), z), Ge(Set(bound[9]), z)));
+      car = Or(car, And(in_y, Or(body, cabin)));
+    }
+    const Mask checked = And(Not(ground), Lt(distance, max_distance));
+    collision = Or(collision, And(active, Or(ground, And(checked, car))));
+  }
+
+  Store(hit_x, x);
+  Store(hit_y, y);
+  Store(hit_z, z);
+  Store(hit_distance, distance);
+}
+
+void CastRays(const RayScan &scan, const double *dir_x, const double *dir_y, const double *dir_z,
+              int n, double *hit_x, double *hit_y, double *hit_z, double *hit_distance) {
+  // the interval ends of Car::inbetween for every target: x, y and z of the
+  // body, then x and z of the cabin
+  std::vector<double> bounds(scan.num_targets * 10);
+  for (int t = 0; t < scan.num_targets; ++t) {
+    const RayTarget &target = scan.targets[t];
+    double *bound = &bounds[t * 10];
+    bound[0] = target.x - target.length / 2;
+    bound[1] = target.x + target.length / 2;
+    bound[2] = target.y - target.width / 2;
+    bound[3] = target.y + target.width / 2;
+    bound[4] = (target.z + target.height / 3) - target.height / 3;
+    bound[5] = (target.z + target.height / 3) + target.height / 3;
+    bound[6] = target.x - target.length / 4;
+    bound[7] = target.x + target.length / 4;
+    bound[8] = (target.z + target.height * 5 / 6) - target.height / 6;
+    bound[9] = (target.z + target.height * 5 / 6) + target.height / 6;
+  }
+
+  for (int i = 0; i < n; i += kWidth) {
+    int count = std::min(kWidth, n - i);
+    double chunk[7][kWidth] = {{0}};
+    std::copy(dir_x + i, dir_x + i + count, chunk[0]);
+    std::copy(dir_y + i, dir_y + i + count, chunk[1]);
+    std::copy(dir_z + i, dir_z + i + count, chunk[2]);
+    CastChunk(scan, chunk[0], chunk[1], chunk[2], count, bounds, chunk[3], chunk[4], chunk[5],
+              chunk[6]);
+    std::copy(chunk[3], chunk[3] + count, hit_x + i);
+    std::copy(chunk[4], chunk[4] + count, hit_y + i);
+    std::copy(chunk[5], chunk[5] + count, hit_z + i);
+    std::copy(chunk[6], chunk[6] + count, hit_distance + i);
+  }
+}
+
+// the largest lane
+inline double MaxLane(Vec a) {
+  double lanes[kWidth];
+  Store(lanes, a);
+  double best = lanes[0];
+  for (int i = 1; i < kWidth; ++i) {
+    best = lanes[i] > best ? lanes[i] : best;
+  }
+  return best;
+}
+
+// kWidth particles through the CTRV model; the float state is widened to
+// double for the arithmetic and rounded back once
+inline void PredictParticleLanes(float *px, float *py, float *v, float *yaw, float *yawd,
+                                 const float *noise_a, const float *noise_yawdd, Vec std_a,
+                                 Vec std_yawdd, Vec dt, Vec half_dt2) {
+  const Vec vel = LoadFloat(v);
+  const Vec heading = LoadFloat(yaw);
+  const Vec rate = LoadFloat(yawd);
+  const Vec nu_a = Mul(std_a, LoadFloat(noise_a));
+  const Vec nu_yawdd = Mul(std_yawdd, LoadFloat(noise_yawdd));
+
+  Vec s0, c0, s1, c1;
+  const Vec heading_pred = Add(heading, Mul(rate, dt));
+  PolySinCosLanes(heading, &s0, &c0);
+  PolySinCosLanes(heading_pred, &s1, &c1);
+
+  // both branches, the straight one where yawd is near zero
+  const Mask turning = Gt(Abs(rate), Set(0.001));
+  const Vec radius = Div(vel, Select(turning, rate, Set(1.0)));
+  const Vec dx = Select(turning, Mul(radius, Sub(s1, s0)), Mul(Mul(vel, c0), dt));
+  const Vec dy = Select(turning, Mul(radius, Sub(c0, c1)), Mul(Mul(vel, s0), dt));
+  StoreFloat(px, Add(LoadFloat(px), Add(dx, Mul(Mul(half_dt2, c0), nu_a))));
+  StoreFloat(py, Add(LoadFloat(py), Add(dy, Mul(Mul(half_dt2, s0), nu_a))));
+  StoreFloat(yawd, Add(rate, Mul(dt, nu_yawdd)));
+
+  // (-v, yaw + pi) moves like (v, yaw), v stays >= 0
+  const Vec vel_pred = Add(vel, Mul(dt, nu_a));
+  const Vec yaw_pred = Add(heading_pred, Mul(half_dt2, nu_yawdd));
+  const Mask reverse = Lt(vel_pred, Set(0.0));
+  StoreFloat(v, Select(reverse, Neg(vel_pred), vel_pred));
+  StoreFloat(yaw, Select(reverse, Add(yaw_pred, Set(M_PI)), yaw_pred));
+}
+
+void PredictParticles(float *px, float *py, float *v, float *yaw, float *yawd,
+                      const float *noise_a, const float *noise_yawdd, int n, double std_a,
+                      double std_yawdd, double delta_t) {
+  const Vec a = Set(std_a);
+  const Vec yawdd = Set(std_yawdd);
+  const Vec dt = Set(delta_t);
+  const Vec half_dt2 = Set(0.5 * delta_t * delta_t);
+  int i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    PredictParticleLanes(px + i, py + i, v + i, yaw + i, yawd + i, noise_a + i, noise_yawdd + i,
+                         a, yawdd, dt, half_dt2);
+  }
+  if (i < n) {
+    // the last particles in zero padded lanes
+    float *state[5] = {px + i, py + i, v + i, yaw + i, yawd + i};
+    float lanes[7][kWidth] = {{0}};
+    for (int r = 0; r < 5; ++r) {
+      std::copy(state[r], state[r] + n - i, lanes[r]);
+    }
+    std::copy(noise_a + i, noise_a + n, lanes[5]);
+    std::copy(noise_yawdd + i, noise_yawdd + n, lanes[6]);
+    PredictParticleLanes(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6],
+                         a, yawdd, dt, half_dt2);
+    for (int r = 0; r < 5; ++r) {
+      std::copy(lanes[r], lanes[r] + n - i, state[r]);
+    }
+  }
+}
+
+inline Vec LidarLogLikelihoodLanes(const float *px, const float *py, const double *z,
+                                   const double *inv_var, float *ll) {
+  const Vec dx = Sub(LoadFloat(px), Set(z[0]));
+  const Vec dy = Sub(LoadFloat(py), Set(z[1]));
+  const Vec l = Mul(Set(-0.5), Add(Mul(Mul(dx, dx), Set(inv_var[0])),
+                                   Mul(Mul(dy, dy), Set(inv_var[1]))));
+  StoreFloat(ll, l);
+  return l;
+}
+
+float LidarLogLikelihood(const float *px, const float *py, int n, const double *z,
+                         const double *inv_var, float *ll) {
+  Vec best = Set(-std::numeric_limits<float>::max());
+  int i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    best = Max(LidarLogLikelihoodLanes(px + i, py + i, z, inv_var, ll + i), best);
+  }
+  if (i < n) {
+    float lanes[3][kWidth] = {{0}};
+    std::copy(px + i, px + n, lanes[0]);
+    std::copy(py + i, py + n, lanes[1]);
+    Vec l = LidarLogLikelihoodLanes(lanes[0], lanes[1], z, inv_var, lanes[2]);
+    best = Max(Select(LaneMask(0, n - i), l, best), best);
+    std::copy(lanes[2], lanes[2] + n - i, ll + i);
+  }
+  // rounding to float keeps the order, so this is the largest float of ll
+  return (float)MaxLane(best);
+}
+
+inline Vec RadarLogLikelihoodLanes(const float *px, const float *py, const float *v,
+                                   const float *yaw, const double *z, const double *inv_var,
+                                   float *ll) {
+  const Vec x = LoadFloat(px);
+  const Vec y = LoadFloat(py);
+  Vec sin_yaw, cos_yaw;
+  PolySinCosLanes(LoadFloat(yaw), &sin_yaw, &cos_yaw);
+  const Vec rho = Sqrt(Add(Mul(x, x), Mul(y, y)));
+  const Vec phi = PolyAtan2Lanes(y, x);
+  const Vec rho_dot = Div(Mul(Add(Mul(x, cos_yaw), Mul(y, sin_yaw)), LoadFloat(v)),
+                          Max(rho, Set(1e-3)));
+
+  const Vec dr = Sub(rho, Set(z[0]));
+  const Vec dphi = NormalizeAngle(Sub(phi, Set(z[1])));
+  const Vec drd = Sub(rho_dot, Set(z[2]));
+  const Vec l = Mul(Set(-0.5), Add(Add(Mul(Mul(dr, dr), Set(inv_var[0])),
+                                       Mul(Mul(dphi, dphi), Set(inv_var[1]))),
+                                   Mul(Mul(drd, drd), Set(inv_var[2]))));
+  StoreFloat(ll, l);
+  return l;
+}
+
+float RadarLogLikelihood(const float *px, const float *py, const float *v, const float *yaw,
+                         int n, const double *z, const double *inv_var, float *ll) {
+  Vec best = Set(-std::numeric_limits<float>::max());
+  int i = 0;
+  for (; i + kWidth <= n; i += kWidth) {
+    best = Max(RadarLogLikelihoodLanes(px + i, py + i, v + i, yaw + i, z, inv_var, ll + i), best);
+  }
+  if (i < n) {
+    float lanes[5][kWidth] = {{0}};
+    std::copy(px + i, px + n, lanes[0]);
+    std::copy(py + i, py + n, lanes[1]);
+    std::copy(v + i, v + n, lanes[2]);
+    std::copy(yaw + i, yaw + n, lanes[3]);
+    Vec l = RadarLogLikelihoodLanes(lanes[0], lanes[1], lanes[2], lanes[3], z, inv_var, lanes[4]);
+    best = Max(Select(LaneMask(0, n - i), l, best), best);
+    std::copy(lanes[4], lanes[4] + n - i, ll + i);
+  }
+  return (float)MaxLane(best);
+}
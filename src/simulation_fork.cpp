@@ -0,0 +1,118 @@
+#include "simulation_fork.h"
+#include "fast_math.h"
+
+namespace {
+
+CarPose PoseOf(const Car &car) {
+  CarPose pose;
+  pose.position = car.position;
+  pose.velocity = car.velocity;
+  pose.angle = car.angle;
+  pose.acceleration = car.acceleration;
+  pose.steering = car.steering;
+  pose.accuateIndex = car.accuateIndex;
+  return pose;
+}
+
+// Car::move on a pose, with the instructions and geometry of car
+void MovePose(const Car &car, float dt, long long time_us, CarPose &pose) {
+  const std::vector<accuation> &instructions = car.instructions;
+  if (instructions.size() > 0 && pose.accuateIndex < (int)instructions.size() - 1) {
+    if (time_us >= instructions[pose.accuateIndex + 1].time_us) {
+      pose.acceleration = instructions[pose.accuateIndex + 1].acceleration;
+      pose.steering = instructions[pose.accuateIndex + 1].steering;
+      pose.accuateIndex++;
+    }
+  }
+
+  double sin_angle, cos_angle;
+  FastSinCos(pose.angle, &sin_angle, &cos_angle);
+  pose.position.x += pose.velocity * cos_angle * dt;
+  pose.position.y += pose.velocity * sin_angle * dt;
+  pose.angle += pose.velocity * pose.steering * dt / car.Lf;
+  pose.velocity += pose.acceleration * dt;
+}
+
+}  // namespace
+
+SimulationFork SimulationFork::Snapshot(const std::vector<Car> &traffic, const Car &ego,
+                                        long long timestamp) {
+  SimulationFork fork;
+  fork.timestamp_ = timestamp;
+  fork.cars_ = std::make_shared<const std::vector<Car> >(traffic);
+  fork.ego_car_ = std::make_shared<const Car>(ego);
+  fork.poses_ = std::make_shared<std::vector<CarPose> >();
+  for (const Car &car : traffic) {
+    fork.poses_->push_back(PoseOf(car));
+  }
+  fork.ego_ = PoseOf(ego);
+  return fork;
+}
+
+SimulationFork SimulationFork::Fork() const {
+  // the copy shares cars, poses and overrides; each side copies on write
+  return *this;
+}
+
+const Car &SimulationFork::car(int i) const {
+  std::map<int, std::shared_ptr<Car> >::const_iterator it = overrides_.find(i);
+  return it != overrides_.end() ? *it->second : (*cars_)[i];
+}
+
+Car &SimulationFork::MutableCar(int i) {
+  std::shared_ptr<Car> &entry = overrides_[i];
+  if (!entry || entry.use_count() > 1) {
+    entry = std::make_shared<Car>(entry ? *entry : (*cars_)[i]);
+  }
+  return *entry;
+}
+
+CarPose &SimulationFork::MutablePose(int i) {
+  OwnPoses();
+  return (*poses_)[i];
+}
+
+void SimulationFork::OwnPoses() {
+  if (poses_.use_count() > 1) {
+    poses_ = std::make_shared<std::vector<CarPose> >(*poses_);
+  }
+}
+
+void SimulationFork::Step(double dt) {
+  OwnPoses();
+  std::vector<CarPose> &poses = *poses_;
+  for (size_t i = 0; i < poses.size(); ++i) {
+    MovePose(car(i), dt, timestamp_, poses[i]);
+  }
+  MovePose(*ego_car_, dt, timestamp_, ego_);
+  timestamp_ += static_cast<long long>(dt * 1e6);
+}
+
+size_t SimulationFork::OwnedBytes() const {
+  size_t bytes = sizeof(*this);
+  if (poses_.use_count() == 1) {
+    bytes += poses_->capacity() * sizeof(CarPose);
+  }
+  for (const auto &entry : overrides_) {
+    bytes += sizeof(entry);
+    if (entry.second.use_count() == 1) {
+      const Car &car = *entry.second;
+      // the filter matrices dominate, count their coefficients
+      bytes += sizeof(Car) + car.instructions.capacity() * sizeof(accuation)
+             + sizeof(double) * (car.ukf.x_.size() + car.ukf.P_.size()
+                                 + car.ukf.Xsig_pred_.size() + car.ukf.weights_.size());
+    }
+  }
+  return bytes;
+}
+
+std::vector<double> RunRollouts(const SimulationFork &root, int count,
+                                const std::function<double(int, SimulationFork&)> &rollout,
+                                WorkerPool &pool) {
+  std::vector<double> scores(count);
+  pool.ParallelFor(count, [&](int i) {
+    SimulationFork fork = root.Fork();
+    scores[i] = rollout(i, fork);
+  });
+  return scores;
+}
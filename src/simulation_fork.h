@@ -0,0 +1,120 @@
+#ifndef SIMULATION_FORK_H_
+#define SIMULATION_FORK_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include "render/render.h"
+#include "worker_pool.h"
+
+// the part of a car that changes while it drives
+struct CarPose {
+  Vect3 position;
+  float velocity;
+  float angle;
+  float acceleration;
+  float steering;
+  int accuateIndex;
+
+  CarPose() : position(0, 0, 0), velocity(0), angle(0), acceleration(0), steering(0), accuateIndex(-1) {}
+};
+
+/**
+ * SimulationFork is a branch of the highway state for what-if rollouts.
+ *
+ * A snapshot copies the traffic once into an immutable base that every fork
+ * taken from it shares. The base holds the heavy part of each car, its UKF,
+ * instructions and name. Driving only changes the pose of a car, so a fork
+ * keeps its own array of poses, shared with its parent until the first
+ * Step. Any other change goes through MutableCar, which copies that one car
+ * on the first write. Forking therefore costs a few pointer copies, and a
+ * fork grows only by its poses and the cars it actually modifies.
+ */
+class SimulationFork {
+ public:
+  /**
+   * Snapshot takes the root of a family of forks
+   * @param traffic Traffic cars
+   * @param ego Ego car
+   * @param timestamp Simulation time of the snapshot in us
+   */
+  static SimulationFork Snapshot(const std::vector<Car> &traffic, const Car &ego, long long timestamp);
+
+  /**
+   * Fork branches off a child that shares all state with this fork
+   */
+  SimulationFork Fork() const;
+
+  // number of traffic cars
+  int size() const { return cars_->size(); }
+
+  /**
+   * car returns traffic car i. Its pose fields are those of the snapshot,
+   * the current pose is pose(i)
+   */
+  const Car &car(int i) const;
+
+  /**
+   * MutableCar returns traffic car i for changing its filter, instructions
+   * or geometry, copied on the first write of this fork
+   */
+  Car &MutableCar(int i);
+
+  // current pose of traffic car i
+  const CarPose &pose(int i) const { return (*poses_)[i]; }
+
+  /**
+   * MutablePose returns the pose of traffic car i for writing, the poses are
+   * copied on the first write of this fork
+   */
+  CarPose &MutablePose(int i);
+
+  // ego car pose, set its acceleration and steering to steer the rollout
+  CarPose &ego() { return ego_; }
+  const CarPose &ego() const { return ego_; }
+
+  /**
+   * Step advances the ego car and all traffic by dt like Car::move
+   * @param dt Time step in s
+   */
+  void Step(double dt);
+
+  /**
+   * OwnedBytes estimates the memory this fork does not share
+   */
+  size_t OwnedBytes() const;
+
+  // simulation time in us
+  long long timestamp_;
+
+ private:
+  SimulationFork() {}
+
+  // copies the poses if they are still shared
+  void OwnPoses();
+
+  std::shared_ptr<const std::vector<Car> > cars_;
+  std::shared_ptr<const Car> ego_car_;
+  std::shared_ptr<std::vector<CarPose> > poses_;
+  // modified cars; shared with the parent until either side writes
+  std::map<int, std::shared_ptr<Car> > overrides_;
+  CarPose ego_;
+};
+
+/**
+ * RunRollouts runs one rollout per fork of root across the worker pool.
+ * Forks share copied-on-write state through reference counts; root must
+ * stay alive until all forks are done so that no fork mistakes a car it
+ * shares with a sibling for its own.
+ * @param root State every fork branches from
+ * @param count Number of forks
+ * @param rollout Runs fork index on its fork and returns its score
+ * @param pool Worker pool, each fork runs on one thread
+ * @return Scores indexed like the forks
+ */
+std::vector<double> RunRollouts(const SimulationFork &root, int count,
+                                const std::function<double(int, SimulationFork&)> &rollout,
+                                WorkerPool &pool);
+
+#endif  // SIMULATION_FORK_H_
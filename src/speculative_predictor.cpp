@@ -0,0 +1,78 @@
+#include "speculative_predictor.h"
+#include <chrono>
+#include <cstdlib>
+
+SpeculativePredictor::SpeculativePredictor(int num_threads)
+    : window_us_(100), hits_(0), misses_(0), path_seconds_(0), measurements_(0),
+      pool_(num_threads) {}
+
+SpeculativePredictor::~SpeculativePredictor() {}
+
+void SpeculativePredictor::Speculate(const std::vector<const UKF*> &filters) {
+  if (speculations_.size() < filters.size()) {
+    Speculation empty;
+    empty.valid = false;
+    empty.period_us = 0;
+    speculations_.resize(filters.size(), empty);
+  }
+
+  pool_.ParallelFor(filters.size(), [&](int i) {
+    const UKF *filter = filters[i];
+    Speculation &speculation = speculations_[i];
+    speculation.valid = false;
+    if (filter == nullptr || !filter->is_initialized_ || speculation.period_us <= 0) {
+      return;
+    }
+
+    UKF ukf = *filter;
+    speculation.base_us = ukf.time_us_;
+    speculation.base_x = ukf.x_;
+    speculation.target_us = ukf.time_us_ + speculation.period_us;
+    ukf.Prediction(speculation.period_us / 1000000.0);
+    speculation.x = ukf.x_;
+    speculation.P = ukf.P_;
+    speculation.Xsig_pred = ukf.Xsig_pred_;
+    speculation.valid = true;
+  });
+}
+
+bool SpeculativePredictor::ProcessMeasurement(int track_id, UKF &ukf,
+                                              const MeasurementPackage &meas_package) {
+  auto start = std::chrono::steady_clock::now();
+  if (track_id >= (int)speculations_.size()) {
+    Speculation empty;
+    empty.valid = false;
+    empty.period_us = 0;
+    speculations_.resize(track_id + 1, empty);
+  }
+  Speculation &speculation = speculations_[track_id];
+
+  // the speculation only applies to the filter state it started from
+  bool hit = speculation.valid && ukf.is_initialized_
+          && ukf.time_us_ == speculation.base_us && ukf.x_ == speculation.base_x
+          && std::llabs(meas_package.timestamp_ - speculation.target_us) <= window_us_;
+
+  if (ukf.is_initialized_ && meas_package.timestamp_ > ukf.time_us_) {
+    speculation.period_us = meas_package.timestamp_ - ukf.time_us_;
+  }
+
+  if (hit) {
+    ukf.x_ = speculation.x;
+    ukf.P_ = speculation.P;
+    ukf.Xsig_pred_ = speculation.Xsig_pred;
+    ukf.time_us_ = meas_package.timestamp_;
+    ukf.Update(meas_package);
+    ++hits_;
+  } else {
+    ukf.ProcessMeasurement(meas_package);
+    if (speculation.valid) {
+      ++misses_;
+    }
+  }
+  speculation.valid = false;
+
+  auto end = std::chrono::steady_clock::now();
+  path_seconds_ += std::chrono::duration<double>(end - start).count();
+  ++measurements_;
+  return hit;
+}
@@ -0,0 +1,76 @@
+#ifndef SPECULATIVE_PREDICTOR_H_
+#define SPECULATIVE_PREDICTOR_H_
+
+#include <vector>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+#include "ukf.h"
+#include "worker_pool.h"
+
+/**
+ * SpeculativePredictor moves the UKF prediction off the measurement path.
+ * Sensor periods are regular, so between frames the worker pool predicts
+ * every track to the time its next measurement is expected. When that
+ * measurement arrives within window_us_ of the expected time only the
+ * update runs; otherwise the speculation is discarded and the regular
+ * ProcessMeasurement predicts as usual.
+ */
+class SpeculativePredictor {
+ public:
+  /**
+   * Constructor
+   * @param num_threads Worker threads, 0 picks the hardware concurrency
+   */
+  explicit SpeculativePredictor(int num_threads = 0);
+
+  virtual ~SpeculativePredictor();
+
+  /**
+   * Speculate predicts every filter to its expected next measurement time
+   * @param filters Filters indexed by track id, null entries are skipped
+   */
+  void Speculate(const std::vector<const UKF*> &filters);
+
+  /**
+   * ProcessMeasurement filters a measurement, using the speculation of the
+   * track when it matches
+   * @param track_id Track the measurement belongs to
+   * @param ukf Filter of the track
+   * @param meas_package The measurement
+   * @return true if the speculation was used
+   */
+  bool ProcessMeasurement(int track_id, UKF &ukf, const MeasurementPackage &meas_package);
+
+  // largest difference in us between the expected and the actual timestamp
+  // for which the speculation is used. The prediction is then off by at
+  // most this much time, 100 us move a car at highway speed by 3 mm
+  long long window_us_;
+
+  // speculations used, speculations discarded
+  long long hits_;
+  long long misses_;
+
+  // time spent in ProcessMeasurement, the measurement to estimate latency
+  double path_seconds_;
+  long long measurements_;
+
+ private:
+  struct Speculation {
+    // filter time and mean the speculation started from
+    long long base_us;
+    Eigen::VectorXd base_x;
+    // expected measurement time and the prediction to it
+    long long target_us;
+    Eigen::VectorXd x;
+    Eigen::MatrixXd P;
+    Eigen::MatrixXd Xsig_pred;
+    bool valid;
+    // last interval between measurements with different timestamps
+    long long period_us;
+  };
+
+  std::vector<Speculation> speculations_;
+  WorkerPool pool_;
+};
+
+#endif  // SPECULATIVE_PREDICTOR_H_
@@ -0,0 +1,180 @@
+#include "time_synchronizer.h"
+#include <algorithm>
+#include <climits>
+#include "metrics.h"
+
+namespace {
+
+// heap order: the earliest head on top, ties by stream
+bool Later(long long a_us, int a_stream, long long b_us, int b_stream) {
+  return a_us > b_us || (a_us == b_us && a_stream > b_stream);
+}
+
+Counter &Measurements(const char *outcome) {
+  return MetricsRegistry::Instance().GetCounter(
+      "sync_measurements_total", "Measurements through the time synchronizer by outcome",
+      std::string("outcome=\"") + outcome + "\"");
+}
+
+Gauge &PendingGauge() {
+  static Gauge &gauge = MetricsRegistry::Instance().GetGauge(
+      "sync_pending", "Measurements waiting in the time synchronizer");
+  return gauge;
+}
+
+}  // namespace
+
+TimeSynchronizer::TimeSynchronizer() : released_us_(LLONG_MIN), now_us_(LLONG_MIN), pending_(0) {}
+
+TimeSynchronizer::~TimeSynchronizer() {}
+
+int TimeSynchronizer::AddStream(const std::string &name, long long max_latency_us) {
+  Stream stream;
+  stream.name = name;
+  stream.max_latency_us = max_latency_us;
+  stream.last_timestamp_us = LLONG_MIN;
+  stream.closed = false;
+  stream.head_us = LLONG_MIN;
+  std::vector<double> bounds = MetricsRegistry::LatencyBounds();
+  stream.wait = &MetricsRegistry::Instance().GetHistogram(
+      "sync_wait_seconds", "Time measurements wait for their order to be settled", bounds,
+      "stream=\"" + name + "\"");
+  streams_.push_back(stream);
+  return streams_.size() - 1;
+}
+
+void TimeSynchronizer::PushHead(int stream) {
+  Stream &s = streams_[stream];
+  s.head_us = s.queue.front().meas.timestamp_;
+  Head head = {s.head_us, stream};
+  heap_.push_back(head);
+  std::push_heap(heap_.begin(), heap_.end(), [](const Head &a, const Head &b) {
+    return Later(a.timestamp_us, a.stream, b.timestamp_us, b.stream);
+  });
+}
+
+void TimeSynchronizer::Push(int stream, int track_id, const MeasurementPackage &meas_package,
+                            long long now_us) {
+  static Counter &late = Measurements("late");
+  static Counter &reordered = Measurements("reordered");
+  long long timestamp = meas_package.timestamp_;
+  if (timestamp < released_us_) {
+    now_us_ = std::max(now_us_, now_us);
+    ++stats_.late;
+    late.Increment();
+    return;
+  }
+
+  now_us_ = std::max(now_us_, now_us);
+  Stream &s = streams_[stream];
+  SyncedMeasurement entry = {stream, track_id, meas_package, now_us};
+  bool was_empty = s.queue.empty();
+  if (was_empty || timestamp >= s.queue.back().meas.timestamp_) {
+    s.queue.push_back(entry);
+  } else {
+    // the stream broke its own order, keep its queue sorted
+    ++stats_.reordered;
+    reordered.Increment();
+    std::deque<SyncedMeasurement>::iterator at = std::upper_bound(
+        s.queue.begin(), s.queue.end(), timestamp,
+        [](long long t, const SyncedMeasurement &m) { return t < m.meas.timestamp_; });
+    s.queue.insert(at, entry);
+  }
+  // a new head gets a heap entry, the one it replaced goes stale
+  if (was_empty || s.queue.front().meas.timestamp_ < s.head_us) {
+    PushHead(stream);
+  }
+  s.last_timestamp_us = std::max(s.last_timestamp_us, timestamp);
+  ++pending_;
+  PendingGauge().Set(pending_);
+}
+
+void TimeSynchronizer::Heartbeat(int stream, long long timestamp_us) {
+  Stream &s = streams_[stream];
+  s.last_timestamp_us = std::max(s.last_timestamp_us, timestamp_us);
+}
+
+void TimeSynchronizer::Close(int stream) {
+  streams_[stream].closed = true;
+}
+
+long long TimeSynchronizer::Watermark(long long now_us) const {
+  long long watermark = LLONG_MAX;
+  for (const Stream &s : streams_) {
+    if (!s.closed) {
+      watermark = std::min(watermark, std::max(s.last_timestamp_us, now_us - s.max_latency_us));
+    }
+  }
+  return watermark;
+}
+
+long long TimeSynchronizer::NextReleaseTime() const {
+  long long head_us = LLONG_MAX;
+  for (const Stream &s : streams_) {
+    if (!s.queue.empty()) {
+      head_us = std::min(head_us, static_cast<long long>(s.queue.front().meas.timestamp_));
+    }
+  }
+  if (head_us == LLONG_MAX) {
+    return LLONG_MAX;
+  }
+  // the streams that have not reported past the head hold it
+  long long due_us = now_us_;
+  for (const Stream &s : streams_) {
+    if (!s.closed && s.last_timestamp_us < head_us) {
+      due_us = std::max(due_us, head_us + s.max_latency_us);
+    }
+  }
+  return due_us;
+}
+
+int TimeSynchronizer::Release(long long now_us, const Sink &sink) {
+  now_us_ = std::max(now_us_, now_us);
+  return ReleaseUpTo(Watermark(now_us), now_us, sink);
+}
+
+int TimeSynchronizer::Drain(const Sink &sink) {
+  long long now_us = LLONG_MIN;
+  for (const Stream &s : streams_) {
+    if (!s.queue.empty()) {
+      now_us = std::max(now_us, s.queue.back().arrival_us);
+    }
+  }
+  return ReleaseUpTo(LLONG_MAX, now_us, sink);
+}
+
+int TimeSynchronizer::ReleaseUpTo(long long watermark_us, long long now_us, const Sink &sink) {
+  static Counter &released = Measurements("released");
+  int count = 0;
+  while (!heap_.empty() && heap_.front().timestamp_us <= watermark_us) {
+    Head head = heap_.front();
+    std::pop_heap(heap_.begin(), heap_.end(), [](const Head &a, const Head &b) {
+      return Later(a.timestamp_us, a.stream, b.timestamp_us, b.stream);
+    });
+    heap_.pop_back();
+    Stream &s = streams_[head.stream];
+    if (s.queue.empty() || head.timestamp_us != s.head_us) {
+      continue;
+    }
+
+    SyncedMeasurement entry = s.queue.front();
+    s.queue.pop_front();
+    if (!s.queue.empty()) {
+      PushHead(head.stream);
+    } else {
+      s.head_us = LLONG_MIN;
+    }
+    released_us_ = entry.meas.timestamp_;
+    long long wait_us = std::max(0LL, now_us - entry.arrival_us);
+    s.wait->Observe(wait_us * 1e-6);
+    stats_.total_wait_us += wait_us;
+    stats_.max_wait_us = std::max(stats_.max_wait_us, wait_us);
+    ++stats_.released;
+    released.Increment();
+    --pending_;
+    ++count;
+    sink(entry);
+  }
+  PendingGauge().Set(pending_);
+  return count;
+}
@@ -0,0 +1,137 @@
+#ifndef TIME_SYNCHRONIZER_H_
+#define TIME_SYNCHRONIZER_H_
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "measurement_package.h"
+
+class Histogram;
+
+// a measurement on its way through the synchronizer
+struct SyncedMeasurement {
+  int stream;
+  int track_id;
+  MeasurementPackage meas;
+  // time the measurement reached the synchronizer, in us
+  long long arrival_us;
+};
+
+struct SynchronizerStats {
+  long long released = 0;
+  // measurements older than one already released, dropped
+  long long late = 0;
+  // measurements that overtook an earlier one of their stream
+  long long reordered = 0;
+  // time measurements waited for the ordering guarantee, in us
+  long long total_wait_us = 0;
+  long long max_wait_us = 0;
+};
+
+/**
+ * TimeSynchronizer merges measurement streams of independent sensors into
+ * one stream in timestamp order.
+ *
+ * Every stream has a known maximum latency: a measurement taken at t
+ * arrives by t + max_latency. Its watermark is the later of its newest
+ * timestamp and now - max_latency, since nothing older can still come; the
+ * minimum over all streams bounds every future timestamp. The heads of the
+ * per-stream queues sit in a heap, a k-way merge releases them while they
+ * are not newer than that bound. So a measurement waits only until every
+ * other stream has reported past it or could no longer do so, which is the
+ * least waiting that still guarantees order.
+ *
+ * The wait each stream adds goes to the sync_wait_seconds histogram of the
+ * metrics registry.
+ */
+class TimeSynchronizer {
+ public:
+  typedef std::function<void(const SyncedMeasurement &)> Sink;
+
+  TimeSynchronizer();
+
+  virtual ~TimeSynchronizer();
+
+  /**
+   * AddStream adds a sensor stream
+   * @param name Label of the stream in the metrics
+   * @param max_latency_us Longest time from a measurement to its arrival
+   * @return Index of the stream
+   */
+  int AddStream(const std::string &name, long long max_latency_us);
+
+  /**
+   * Push queues an arriving measurement
+   * @param stream Stream it arrived on
+   * @param track_id Track it belongs to
+   * @param meas_package The measurement
+   * @param now_us Arrival time
+   */
+  void Push(int stream, int track_id, const MeasurementPackage &meas_package, long long now_us);
+
+  /**
+   * Heartbeat tells that a stream will send nothing older than timestamp_us,
+   * so idle streams do not hold the others for their whole latency
+   */
+  void Heartbeat(int stream, long long timestamp_us);
+
+  // a closed stream no longer holds the others back
+  void Close(int stream);
+
+  /**
+   * Release hands every measurement whose order is settled to the sink, in
+   * timestamp order; the sink must not push to this synchronizer
+   * @param now_us Current time
+   * @return Number of measurements released
+   */
+  int Release(long long now_us, const Sink &sink);
+
+  // releases everything still queued, at the end of a run
+  int Drain(const Sink &sink);
+
+  // bound on the timestamps that can still arrive
+  long long Watermark(long long now_us) const;
+
+  /**
+   * NextReleaseTime when the earliest queued measurement is due if nothing
+   * else arrives, never before the latest time seen; event loops release
+   * then so no wait exceeds the latency
+   * @return LLONG_MAX if nothing is queued
+   */
+  long long NextReleaseTime() const;
+
+  int Pending() const { return pending_; }
+
+  SynchronizerStats stats_;
+
+ private:
+  struct Stream {
+    std::string name;
+    long long max_latency_us;
+    long long last_timestamp_us;
+    bool closed;
+    std::deque<SyncedMeasurement> queue;
+    // timestamp of the queue head in the heap, valid while queued
+    long long head_us;
+    Histogram *wait;
+  };
+
+  struct Head {
+    long long timestamp_us;
+    int stream;
+  };
+
+  void PushHead(int stream);
+  int ReleaseUpTo(long long watermark_us, long long now_us, const Sink &sink);
+
+  std::vector<Stream> streams_;
+  // min-heap of queue heads by timestamp, then stream
+  std::vector<Head> heap_;
+  long long released_us_;
+  // latest time seen by Push or Release
+  long long now_us_;
+  int pending_;
+};
+
+#endif  // TIME_SYNCHRONIZER_H_
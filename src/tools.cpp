@@ -1,17 +1,20 @@
 #include <iostream>
 #include "tools.h"
+#include "fast_math.h"
+#include "async_logger.h"
 
 using namespace std;
 using std::vector;
 
-Tools::Tools() {}
+Tools::Tools() : seed(0) {}
 
 Tools::~Tools() {}
 
 double Tools::noise(double stddev, long long seedNum)
 {
-	mt19937::result_type seed = seedNum;
-	auto dist = std::bind(std::normal_distribution<double>{0, stddev}, std::mt19937(seed));
+	// timestamps stay far below the offset, so runs never share a noise sample
+	mt19937::result_type seedValue = seedNum + seed*1000000007LL;
+	auto dist = std::bind(std::normal_distribution<double>{0, stddev}, std::mt19937(seedValue));
 	return dist();
 }
 
@@ -29,7 +32,10 @@ lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& view
     meas_package.raw_measurements_ << marker.x, marker.y;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
+    if(measurementSink)
+    	measurementSink(car, meas_package);
+    else
+    	car.ukf.ProcessMeasurement(meas_package);
 
     return marker;
 }
@@ -38,8 +44,11 @@ lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& view
 rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize)
 {
 	double rho = sqrt((car.position.x-ego.position.x)*(car.position.x-ego.position.x)+(car.position.y-ego.position.y)*(car.position.y-ego.position.y));
-	double phi = atan2(car.position.y-ego.position.y,car.position.x-ego.position.x);
-	double rho_dot = (car.velocity*cos(car.angle)*rho*cos(phi) + car.velocity*sin(car.angle)*rho*sin(phi))/rho;
+	double phi = FastAtan2(car.position.y-ego.position.y,car.position.x-ego.position.x);
+	double sinAngle, cosAngle, sinPhi, cosPhi;
+	FastSinCos(car.angle, &sinAngle, &cosAngle);
+	FastSinCos(phi, &sinPhi, &cosPhi);
+	double rho_dot = (car.velocity*cosAngle*rho*cosPhi + car.velocity*sinAngle*rho*sinPhi)/rho;
 
 	rmarker marker = rmarker(rho+noise(0.3,timestamp+2), phi+noise(0.03,timestamp+3), rho_dot+noise(0.3,timestamp+4));
 	if(visualize)
@@ -54,11 +63,67 @@ rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::
     meas_package.raw_measurements_ << marker.rho, marker.phi, marker.rho_dot;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
+    if(measurementSink)
+    	measurementSink(car, meas_package);
+    else
+    	car.ukf.ProcessMeasurement(meas_package);
 
     return marker;
 }
 
+// sense a car with every sensor of a rig mounted on the ego car at the origin
+std::vector<MountedMeasurement> Tools::rigSense(Car& car, const std::vector<SensorMount>& rig, long long timestamp, int frame_per_sec)
+{
+	std::vector<MountedMeasurement> measurements;
+	double sinAngle, cosAngle;
+	FastSinCos(car.angle, &sinAngle, &cosAngle);
+	// noise samples follow the sensors, so the stock rig draws what lidarSense and radarSense do
+	long long seedNum = timestamp;
+	for (size_t s = 0; s < rig.size(); s++)
+	{
+		const SensorMount& mount = rig[s];
+		int dim = mount.type == MeasurementPackage::LASER ? 2 : 3;
+		seedNum += dim;
+		if(!mount.Fires(timestamp, 1000000/frame_per_sec) || !mount.Sees(car.position.x, car.position.y))
+			continue;
+
+		MountedMeasurement measurement;
+		measurement.sensor = s;
+		measurement.x = mount.x;
+		measurement.y = mount.y;
+		measurement.yaw = mount.yaw;
+		std::copy(mount.noise, mount.noise+3, measurement.noise);
+		measurement.meas.sensor_type_ = mount.type;
+		measurement.meas.timestamp_ = timestamp;
+		measurement.meas.raw_measurements_ = VectorXd(dim);
+
+		double sinMount, cosMount;
+		FastSinCos(mount.yaw, &sinMount, &cosMount);
+		double dx = car.position.x-mount.x;
+		double dy = car.position.y-mount.y;
+		long long first = seedNum-dim;
+		if(mount.type == MeasurementPackage::LASER)
+		{
+			measurement.meas.raw_measurements_ << cosMount*dx + sinMount*dy + noise(mount.noise[0],first),
+				-sinMount*dx + cosMount*dy + noise(mount.noise[1],first+1);
+		}
+		else
+		{
+			double rho = sqrt(dx*dx+dy*dy);
+			double phi = FastAtan2(dy,dx) - mount.yaw;
+			double sinPhi, cosPhi;
+			FastSinCos(phi, &sinPhi, &cosPhi);
+			phi = FastAtan2(sinPhi, cosPhi);
+			double rho_dot = car.velocity*(cosAngle*dx + sinAngle*dy)/rho;
+			measurement.meas.raw_measurements_ << rho + noise(mount.noise[0],first),
+				phi + noise(mount.noise[1],first+1),
+				rho_dot + noise(mount.noise[2],first+2);
+		}
+		measurements.push_back(measurement);
+	}
+	return measurements;
+}
+
 // Show UKF tracking and also allow showing predicted future path
 // double time:: time ahead in the future to predict
 // int steps:: how many steps to show between present and time and future time
@@ -95,7 +160,8 @@ VectorXd Tools::CalculateRMSE(const vector<VectorXd> &estimations,
 	//  * the estimation vector size should equal ground truth vector size
 	if(estimations.size() != ground_truth.size()
 			|| estimations.size() == 0){
-		cout << "Invalid estimation or ground_truth data" << endl;
+		AsyncLogger::Instance().Log(LOG_WARNING, "Invalid estimation or ground_truth data: {} estimations, {} ground truth",
+		                            estimations.size(), ground_truth.size());
 		return rmse;
 	}
 
@@ -122,7 +188,7 @@ VectorXd Tools::CalculateRMSE(const vector<VectorXd> &estimations,
 void Tools::savePcd(typename pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, std::string file)
 {
   pcl::io::savePCDFileASCII (file, *cloud);
-  std::cerr << "Saved " << cloud->points.size () << " data points to "+file << std::endl;
+  AsyncLogger::Instance().Log(LOG_INFO, "Saved {} data points to {}", cloud->points.size (), file);
 }
 
 pcl::PointCloud<pcl::PointXYZ>::Ptr Tools::loadPcd(std::string file)
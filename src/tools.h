@@ -3,6 +3,7 @@
 #include <vector>
 #include "Eigen/Dense"
 #include "render/render.h"
+#include "sensor_rig.h"
 #include <pcl/io/pcd_io.h>
 #include<bits/stdc++.h>
 
@@ -43,10 +44,16 @@ class Tools {
 	// Members
 	std::vector<VectorXd> estimations;
 	std::vector<VectorXd> ground_truth;
+	// when set, sensed measurements are handed here instead of to car.ukf
+	std::function<void(Car&, const MeasurementPackage&)> measurementSink;
+	// selects an independent noise sequence for Monte Carlo runs, 0 is the default scenario
+	long long seed;
 	
 	double noise(double stddev, long long seedNum);
 	lmarker lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
 	rmarker radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
+	// measurements of car by the sensors of rig that fire this frame and see it, in the frames of the sensors
+	std::vector<MountedMeasurement> rigSense(Car& car, const std::vector<SensorMount>& rig, long long timestamp, int frame_per_sec);
 	void ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
 	/**
 	* A helper method to calculate RMSE.
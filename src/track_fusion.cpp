@@ -0,0 +1,173 @@
+#include "track_fusion.h"
+#include <cmath>
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+namespace {
+
+bool PositiveDefinite(const MatrixXd &P) {
+  Eigen::LLT<MatrixXd> llt(P);
+  return llt.info() == Eigen::Success;
+}
+
+}  // namespace
+
+SensorPipeline::SensorPipeline(const UKF &prototype)
+    : prototype_(prototype), busy_(false), stop_(false), processed_(0) {
+  thread_ = std::thread(&SensorPipeline::Loop, this);
+}
+
+SensorPipeline::~SensorPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  thread_.join();
+}
+
+void SensorPipeline::Submit(int track_id, const MeasurementPackage &meas_package) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    queue_.push_back(std::make_pair(track_id, meas_package));
+  }
+  work_cv_.notify_one();
+}
+
+void SensorPipeline::Drain() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  idle_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+long long SensorPipeline::processed() const {
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return processed_;
+}
+
+bool SensorPipeline::Estimate(int track_id, long long timestamp, VectorXd &x, MatrixXd &P) const {
+  UKF ukf;
+  {
+    std::lock_guard<std::mutex> lock(filters_mutex_);
+    std::map<int, UKF>::const_iterator it = filters_.find(track_id);
+    if (it == filters_.end() || !it->second.is_initialized_) {
+      return false;
+    }
+    ukf = it->second;
+  }
+
+  // predict the copy outside the lock so the pipeline keeps filtering
+  if (timestamp > ukf.time_us_) {
+    ukf.Prediction((timestamp - ukf.time_us_) / 1000000.0);
+  }
+  x = ukf.x_;
+  P = ukf.P_;
+  return true;
+}
+
+void SensorPipeline::Loop() {
+  while (true) {
+    std::pair<int, MeasurementPackage> item;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      work_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      item = queue_.front();
+      queue_.pop_front();
+      busy_ = true;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(filters_mutex_);
+      std::map<int, UKF>::iterator it = filters_.find(item.first);
+      if (it == filters_.end()) {
+        it = filters_.insert(std::make_pair(item.first, prototype_)).first;
+      }
+      it->second.ProcessMeasurement(item.second);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      busy_ = false;
+      ++processed_;
+      if (queue_.empty()) {
+        idle_cv_.notify_all();
+      }
+    }
+  }
+}
+
+TrackFusion::TrackFusion(const UKF &prototype)
+    : lidar_(prototype), radar_(prototype) {}
+
+TrackFusion::~TrackFusion() {}
+
+void TrackFusion::Submit(int track_id, const MeasurementPackage &meas_package) {
+  if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
+    lidar_.Submit(track_id, meas_package);
+  } else {
+    radar_.Submit(track_id, meas_package);
+  }
+}
+
+void TrackFusion::Sync() {
+  lidar_.Drain();
+  radar_.Drain();
+}
+
+bool TrackFusion::Fuse(int track_id, long long timestamp, VectorXd &x, MatrixXd &P) const {
+  VectorXd x_lidar, x_radar;
+  MatrixXd P_lidar, P_radar;
+  bool has_lidar = lidar_.Estimate(track_id, timestamp, x_lidar, P_lidar);
+  bool has_radar = radar_.Estimate(track_id, timestamp, x_radar, P_radar);
+
+  // a local filter whose covariance lost positive definiteness is left out
+  // until it recovers, its information matrix would be meaningless
+  if (has_lidar && has_radar) {
+    has_lidar = PositiveDefinite(P_lidar);
+    has_radar = PositiveDefinite(P_radar);
+  }
+
+  if (has_lidar && has_radar) {
+    CovarianceIntersection(x_lidar, P_lidar, x_radar, P_radar, 0.5, x, P);
+  } else if (has_lidar) {
+    x = x_lidar;
+    P = P_lidar;
+  } else if (has_radar) {
+    x = x_radar;
+    P = P_radar;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void TrackFusion::CovarianceIntersection(const VectorXd &xa, const MatrixXd &Pa,
+                                         const VectorXd &xb, const MatrixXd &Pb, double w,
+                                         VectorXd &x, MatrixXd &P) {
+  // fuse the yaw of b on the branch closest to the yaw of a. A CTRV state
+  // (v, yaw) moves the same as (-v, yaw + pi), and a local filter may settle
+  // on either, so b is flipped to the representation whose yaw is within
+  // pi / 2 of a, with its covariance transformed by diag(1, 1, -1, 1, 1)
+  VectorXd xb_near = xb;
+  MatrixXd Pb_near = Pb;
+  double yaw_diff = xb(3) - xa(3);
+  while (yaw_diff > M_PI) yaw_diff -= 2.*M_PI;
+  while (yaw_diff < -M_PI) yaw_diff += 2.*M_PI;
+  if (fabs(yaw_diff) > 0.5 * M_PI) {
+    yaw_diff -= yaw_diff > 0 ? M_PI : -M_PI;
+    xb_near(2) = -xb(2);
+    Pb_near.row(2) *= -1;
+    Pb_near.col(2) *= -1;
+  }
+  xb_near(3) = xa(3) + yaw_diff;
+
+  MatrixXd Ya = Pa.inverse();
+  MatrixXd Yb = Pb_near.inverse();
+
+  MatrixXd Y = w * Ya + (1 - w) * Yb;
+  P = Y.inverse();
+  x = P * (w * Ya * xa + (1 - w) * Yb * xb_near);
+}
@@ -0,0 +1,124 @@
+#ifndef TRACK_FUSION_H_
+#define TRACK_FUSION_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+#include "ukf.h"
+
+/**
+ * SensorPipeline filters the measurements of one sensor stream on its own
+ * thread, with one sensor-local UKF per track. Submit only queues, so a slow
+ * stream never blocks the producer or the other pipelines.
+ */
+class SensorPipeline {
+ public:
+  /**
+   * Constructor starts the pipeline thread
+   * @param prototype Filter copied for every new track
+   */
+  explicit SensorPipeline(const UKF &prototype);
+
+  /**
+   * Destructor stops the thread once the queue is drained
+   */
+  virtual ~SensorPipeline();
+
+  /**
+   * Submit queues a measurement for a track
+   */
+  void Submit(int track_id, const MeasurementPackage &meas_package);
+
+  /**
+   * Drain blocks until every queued measurement has been filtered
+   */
+  void Drain();
+
+  /**
+   * Estimate returns the local estimate of a track predicted to timestamp
+   * @return false if the track has no local estimate yet
+   */
+  bool Estimate(int track_id, long long timestamp, Eigen::VectorXd &x, Eigen::MatrixXd &P) const;
+
+  // measurements filtered so far
+  long long processed() const;
+
+ private:
+  void Loop();
+
+  UKF prototype_;
+
+  // queue_, busy_, stop_ and processed_
+  mutable std::mutex queue_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  std::deque<std::pair<int, MeasurementPackage> > queue_;
+  bool busy_;
+  bool stop_;
+  long long processed_;
+
+  // filters_
+  mutable std::mutex filters_mutex_;
+  std::map<int, UKF> filters_;
+
+  std::thread thread_;
+};
+
+/**
+ * TrackFusion runs a lidar-only and a radar-only filter per track, each
+ * sensor in its own SensorPipeline, and fuses the local estimates on demand.
+ * Both local filters share the process model and its noise, so their errors
+ * are correlated by an unknown amount. Covariance intersection stays
+ * consistent for any correlation: it fuses in information form,
+ *   P^-1 = w Pa^-1 + (1 - w) Pb^-1,  P^-1 x = w Pa^-1 xa + (1 - w) Pb^-1 xb,
+ * with equal weights w = 1/2. The fused mean is then the mean of independent
+ * fusion, with twice its covariance. A weight that minimizes the size of P
+ * instead trusts the tighter local filter wholesale, and the radar-only
+ * filter is tight but lags a car that accelerates, so the fused track would
+ * inherit the lag and drop the lidar positions.
+ */
+class TrackFusion {
+ public:
+  /**
+   * Constructor
+   * @param prototype Filter settings used by both sensor-local filters
+   */
+  explicit TrackFusion(const UKF &prototype = UKF());
+
+  virtual ~TrackFusion();
+
+  /**
+   * Submit routes a measurement to the pipeline of its sensor
+   */
+  void Submit(int track_id, const MeasurementPackage &meas_package);
+
+  /**
+   * Sync waits for both pipelines to drain, for reproducible runs
+   */
+  void Sync();
+
+  /**
+   * Fuse combines the local estimates of a track at timestamp. Uses a single
+   * local estimate as is when the other sensor has none yet.
+   * @return false if no sensor has an estimate of the track
+   */
+  bool Fuse(int track_id, long long timestamp, Eigen::VectorXd &x, Eigen::MatrixXd &P) const;
+
+  /**
+   * CovarianceIntersection fuses two estimates of unknown correlation
+   * @param w The weight of estimate a, in [0, 1]
+   */
+  static void CovarianceIntersection(const Eigen::VectorXd &xa, const Eigen::MatrixXd &Pa,
+                                     const Eigen::VectorXd &xb, const Eigen::MatrixXd &Pb, double w,
+                                     Eigen::VectorXd &x, Eigen::MatrixXd &P);
+
+  SensorPipeline lidar_;
+  SensorPipeline radar_;
+};
+
+#endif  // TRACK_FUSION_H_
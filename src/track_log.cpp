@@ -0,0 +1,245 @@
+#include "track_log.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "metrics.h"
+
+namespace {
+
+const char kMagic[4] = {'U', 'K', 'F', 'C'};
+const uint32_t kVersion = 1;
+const int kDoubleColumns = 10;
+
+Gauge &PendingChunks() {
+  static Gauge &gauge = MetricsRegistry::Instance().GetGauge(
+      "track_log_pending_chunks", "Full chunks queued for the track log writer");
+  return gauge;
+}
+
+struct ChunkHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t rows;
+};
+
+// bytes of a column of rows values of size bytes, padded to 8
+size_t ColumnBytes(size_t rows, size_t size) {
+  return (rows * size + 7) / 8 * 8;
+}
+
+size_t ChunkBytes(size_t rows) {
+  return sizeof(ChunkHeader) + ColumnBytes(rows, sizeof(int64_t))
+       + ColumnBytes(rows, sizeof(int32_t)) + kDoubleColumns * ColumnBytes(rows, sizeof(double));
+}
+
+}  // namespace
+
+void TrackLogWriter::Chunk::Reserve(size_t rows) {
+  timestamp.reserve(rows);
+  track_id.reserve(rows);
+  for (std::vector<double> &column : columns) {
+    column.reserve(rows);
+  }
+}
+
+TrackLogWriter::TrackLogWriter(size_t chunk_rows)
+    : rows_(0), max_pending_(4), chunk_rows_(chunk_rows), file_(nullptr),
+      failed_(false), stop_(false) {}
+
+TrackLogWriter::~TrackLogWriter() {
+  Close();
+}
+
+bool TrackLogWriter::Open(const std::string &path) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    return false;
+  }
+  failed_ = false;
+  stop_ = false;
+  rows_ = 0;
+  current_.Reserve(chunk_rows_);
+  writer_ = std::thread(&TrackLogWriter::WriterLoop, this);
+  return true;
+}
+
+void TrackLogWriter::Append(const TrackSample &sample) {
+  if (file_ == nullptr) {
+    return;
+  }
+  current_.timestamp.push_back(sample.timestamp);
+  current_.track_id.push_back(sample.track_id);
+  current_.columns[0].push_back(sample.px);
+  current_.columns[1].push_back(sample.py);
+  current_.columns[2].push_back(sample.vx);
+  current_.columns[3].push_back(sample.vy);
+  for (int i = 0; i < 5; ++i) {
+    current_.columns[4 + i].push_back(sample.p_diag[i]);
+  }
+  current_.columns[9].push_back(sample.nis);
+  ++rows_;
+  if (current_.size() >= chunk_rows_) {
+    Submit();
+  }
+}
+
+void TrackLogWriter::Submit() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return pending_.size() < max_pending_; });
+  pending_.push_back(Chunk());
+  pending_.back().timestamp.swap(current_.timestamp);
+  pending_.back().track_id.swap(current_.track_id);
+  for (int i = 0; i < kDoubleColumns; ++i) {
+    pending_.back().columns[i].swap(current_.columns[i]);
+  }
+  PendingChunks().Set(pending_.size());
+  lock.unlock();
+  cv_.notify_all();
+  current_.Reserve(chunk_rows_);
+}
+
+bool TrackLogWriter::Close() {
+  if (file_ == nullptr) {
+    return !failed_;
+  }
+  if (current_.size() > 0) {
+    Submit();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+  if (fclose(file_) != 0) {
+    failed_ = true;
+  }
+  file_ = nullptr;
+  return !failed_;
+}
+
+void TrackLogWriter::WriterLoop() {
+  while (true) {
+    Chunk chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+      chunk = std::move(pending_.front());
+      pending_.pop_front();
+      PendingChunks().Set(pending_.size());
+    }
+    cv_.notify_all();
+    if (!WriteChunk(chunk)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ = true;
+    }
+  }
+}
+
+bool TrackLogWriter::WriteChunk(const Chunk &chunk) {
+  size_t rows = chunk.size();
+  ChunkHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.rows = rows;
+  static const char padding[8] = {0};
+
+  bool ok = fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = ok && fwrite(chunk.timestamp.data(), sizeof(int64_t), rows, file_) == rows;
+  ok = ok && fwrite(chunk.track_id.data(), sizeof(int32_t), rows, file_) == rows;
+  size_t pad = ColumnBytes(rows, sizeof(int32_t)) - rows * sizeof(int32_t);
+  ok = ok && fwrite(padding, 1, pad, file_) == pad;
+  for (int i = 0; i < kDoubleColumns; ++i) {
+    ok = ok && fwrite(chunk.columns[i].data(), sizeof(double), rows, file_) == rows;
+  }
+  return ok;
+}
+
+TrackLogReader::TrackLogReader() : data_(nullptr), size_(0), rows_(0) {}
+
+TrackLogReader::~TrackLogReader() {
+  Close();
+}
+
+void TrackLogReader::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  rows_ = 0;
+  chunks_.clear();
+}
+
+bool TrackLogReader::Open(const std::string &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = info.st_size;
+  if (size_ > 0) {
+    void *mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    data_ = static_cast<const char*>(mapped);
+  }
+  close(fd);
+
+  size_t offset = 0;
+  while (offset < size_) {
+    if (size_ - offset < sizeof(ChunkHeader)) {
+      Close();
+      return false;
+    }
+    const ChunkHeader *header = reinterpret_cast<const ChunkHeader*>(data_ + offset);
+    // every row takes at least 8 bytes, so the row count of a corrupt header
+    // is rejected before ChunkBytes could overflow
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion
+        || header->rows > size_ / 8 || ChunkBytes(header->rows) > size_ - offset) {
+      Close();
+      return false;
+    }
+
+    size_t rows = header->rows;
+    const char *column = data_ + offset + sizeof(ChunkHeader);
+    TrackLogChunk chunk;
+    chunk.rows = rows;
+    chunk.timestamp = reinterpret_cast<const int64_t*>(column);
+    column += ColumnBytes(rows, sizeof(int64_t));
+    chunk.track_id = reinterpret_cast<const int32_t*>(column);
+    column += ColumnBytes(rows, sizeof(int32_t));
+    const double *columns[kDoubleColumns];
+    for (int i = 0; i < kDoubleColumns; ++i) {
+      columns[i] = reinterpret_cast<const double*>(column);
+      column += ColumnBytes(rows, sizeof(double));
+    }
+    chunk.px = columns[0];
+    chunk.py = columns[1];
+    chunk.vx = columns[2];
+    chunk.vy = columns[3];
+    for (int i = 0; i < 5; ++i) {
+      chunk.p_diag[i] = columns[4 + i];
+    }
+    chunk.nis = columns[9];
+    chunks_.push_back(chunk);
+
+    rows_ += rows;
+    offset += ChunkBytes(rows);
+  }
+  return true;
+}
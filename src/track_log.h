@@ -0,0 +1,150 @@
+#ifndef TRACK_LOG_H_
+#define TRACK_LOG_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one estimate of one track
+struct TrackSample {
+  int64_t timestamp;
+  int32_t track_id;
+  double px;
+  double py;
+  double vx;
+  double vy;
+  // diagonal of the state covariance P
+  double p_diag[5];
+  // normalized innovation squared of the last update
+  double nis;
+};
+
+// zero-copy view of one chunk of a mapped track log, one array per field
+struct TrackLogChunk {
+  size_t rows;
+  const int64_t *timestamp;
+  const int32_t *track_id;
+  const double *px;
+  const double *py;
+  const double *vx;
+  const double *vy;
+  const double *p_diag[5];
+  const double *nis;
+};
+
+/**
+ * TrackLogWriter stores track samples in a columnar binary file.
+ *
+ * The file is a sequence of chunks. A chunk is a 16 byte header, the magic
+ * "UKFC", the format version and the row count, followed by one contiguous
+ * array per field in the order of TrackSample, each padded to 8 bytes.
+ * Samples are appended to an in-memory chunk; full chunks are handed to a
+ * background thread that writes them, so the simulation never waits on the
+ * disk unless max_pending_ chunks are already queued.
+ */
+class TrackLogWriter {
+ public:
+  /**
+   * Constructor
+   * @param chunk_rows Samples per chunk
+   */
+  explicit TrackLogWriter(size_t chunk_rows = 65536);
+
+  /**
+   * Destructor closes the file
+   */
+  virtual ~TrackLogWriter();
+
+  /**
+   * Open creates the file and starts the writer thread
+   * @param path File to write
+   * @return false if the file cannot be created
+   */
+  bool Open(const std::string &path);
+
+  /**
+   * Append adds a sample to the current chunk, ignored unless open
+   */
+  void Append(const TrackSample &sample);
+
+  /**
+   * Close writes the last chunk and waits for the writer thread
+   * @return false if any write failed
+   */
+  bool Close();
+
+  // samples appended so far
+  long long rows_;
+
+  // full chunks that may wait for the writer before Append blocks
+  size_t max_pending_;
+
+ private:
+  struct Chunk {
+    std::vector<int64_t> timestamp;
+    std::vector<int32_t> track_id;
+    // px, py, vx, vy, the P diagonal and NIS, one vector per column
+    std::vector<double> columns[10];
+
+    void Reserve(size_t rows);
+    size_t size() const { return timestamp.size(); }
+  };
+
+  void Submit();
+  void WriterLoop();
+  bool WriteChunk(const Chunk &chunk);
+
+  size_t chunk_rows_;
+  Chunk current_;
+  FILE *file_;
+  bool failed_;
+  bool stop_;
+  std::deque<Chunk> pending_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread writer_;
+};
+
+/**
+ * TrackLogReader maps a track log read-only and exposes its chunks as
+ * arrays pointing into the mapping, without copying or parsing
+ */
+class TrackLogReader {
+ public:
+  TrackLogReader();
+
+  /**
+   * Destructor unmaps the file
+   */
+  virtual ~TrackLogReader();
+
+  /**
+   * Open maps a file and indexes its chunks
+   * @param path File written by TrackLogWriter
+   * @return false if the file cannot be mapped or is malformed
+   */
+  bool Open(const std::string &path);
+
+  // number of chunks and of rows in all chunks
+  int chunks() const { return chunks_.size(); }
+  long long rows() const { return rows_; }
+
+  // chunk i, valid while the reader is open
+  const TrackLogChunk &chunk(int i) const { return chunks_[i]; }
+
+ private:
+  void Close();
+
+  const char *data_;
+  size_t size_;
+  long long rows_;
+  std::vector<TrackLogChunk> chunks_;
+};
+
+#endif  // TRACK_LOG_H_
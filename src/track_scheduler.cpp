@@ -0,0 +1,88 @@
+#include "track_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include "fast_math.h"
+
+TrackScheduler::TrackScheduler() {
+  // the distance term halves roughly every 20 m
+  distance_scale_ = 30.0;
+
+  // closing in at 10 m/s is as relevant as being next to the ego
+  closing_speed_scale_ = 10.0;
+
+  // a 2 m position uncertainty is as relevant as being next to the ego
+  uncertainty_scale_ = 2.0;
+
+  full_threshold_ = 0.5;
+  reduced_threshold_ = 0.2;
+
+  reduced_interval_us_ = 100000;
+  coast_interval_us_ = 500000;
+
+  tier_count_[FULL] = 0;
+  tier_count_[REDUCED] = 0;
+  tier_count_[COAST] = 0;
+  skipped_ = 0;
+}
+
+TrackScheduler::~TrackScheduler() {}
+
+double TrackScheduler::Relevance(const UKF &ukf, const Car &ego) const {
+  double dx = ukf.x_(0) - ego.position.x;
+  double dy = ukf.x_(1) - ego.position.y;
+  double distance = sqrt(dx*dx + dy*dy);
+
+  // positive when the track moves towards the ego vehicle
+  double closing_speed = 0.0;
+  if (distance > 0.001) {
+    double sin_yaw, cos_yaw, sin_ego, cos_ego;
+    FastSinCos(ukf.x_(3), &sin_yaw, &cos_yaw);
+    FastSinCos(ego.angle, &sin_ego, &cos_ego);
+    double vx = ukf.x_(2) * cos_yaw - ego.velocity * cos_ego;
+    double vy = ukf.x_(2) * sin_yaw - ego.velocity * sin_ego;
+    closing_speed = -(dx*vx + dy*vy) / distance;
+  }
+
+  double uncertainty = sqrt(ukf.P_(0, 0) + ukf.P_(1, 1));
+
+  return exp(-distance / distance_scale_)
+       + std::max(0.0, closing_speed) / closing_speed_scale_
+       + uncertainty / uncertainty_scale_;
+}
+
+TrackScheduler::Tier TrackScheduler::Classify(double relevance) const {
+  if (relevance >= full_threshold_) {
+    return FULL;
+  }
+  if (relevance >= reduced_threshold_) {
+    return REDUCED;
+  }
+  return COAST;
+}
+
+bool TrackScheduler::ShouldUpdate(int track_id, const UKF &ukf, const Car &ego, long long timestamp) {
+  // a track without an estimate needs its first measurement
+  if (!ukf.is_initialized_) {
+    last_update_us_[track_id] = timestamp;
+    ++tier_count_[FULL];
+    return true;
+  }
+
+  Tier tier = Classify(Relevance(ukf, ego));
+  ++tier_count_[tier];
+
+  long long interval = 0;
+  if (tier == REDUCED) {
+    interval = reduced_interval_us_;
+  } else if (tier == COAST) {
+    interval = coast_interval_us_;
+  }
+
+  std::map<int, long long>::iterator last = last_update_us_.find(track_id);
+  if (last != last_update_us_.end() && timestamp - last->second < interval) {
+    ++skipped_;
+    return false;
+  }
+  last_update_us_[track_id] = timestamp;
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef TRACK_SCHEDULER_H_
+#define TRACK_SCHEDULER_H_
+
+#include <map>
+#include "render/render.h"
+#include "ukf.h"
+
+/**
+ * TrackScheduler decides how much filter work each track gets per frame.
+ * A relevance score combines the distance to the ego vehicle, the closing
+ * speed and the position uncertainty. Relevant tracks are updated every
+ * frame, less relevant tracks at a reduced rate, and the rest coast on a
+ * mean-only prediction between sparse updates.
+ */
+class TrackScheduler {
+ public:
+  enum Tier {
+    FULL,
+    REDUCED,
+    COAST
+  };
+
+  TrackScheduler();
+
+  virtual ~TrackScheduler();
+
+  /**
+   * Relevance scores a track, higher means more safety relevant
+   * @param ukf Filter of the track
+   * @param ego Ego vehicle
+   */
+  double Relevance(const UKF &ukf, const Car &ego) const;
+
+  /**
+   * Classify maps a relevance score to an update tier
+   */
+  Tier Classify(double relevance) const;
+
+  /**
+   * ShouldUpdate decides whether a track gets a measurement update in this
+   * frame and remembers the decision
+   * @param track_id Track index
+   * @param ukf Filter of the track
+   * @param ego Ego vehicle
+   * @param timestamp Current time in us
+   */
+  bool ShouldUpdate(int track_id, const UKF &ukf, const Car &ego, long long timestamp);
+
+  // distance in m at which the distance term has decayed to 1/e
+  double distance_scale_;
+
+  // closing speed in m/s that counts as much as a track at the ego
+  double closing_speed_scale_;
+
+  // position standard deviation in m that counts as much as a track at the ego
+  double uncertainty_scale_;
+
+  // minimum relevance for the FULL and REDUCED tiers
+  double full_threshold_;
+  double reduced_threshold_;
+
+  // time between updates in the REDUCED and COAST tiers, in us
+  long long reduced_interval_us_;
+  long long coast_interval_us_;
+
+  // number of update decisions per tier
+  long long tier_count_[3];
+
+  // number of frames a track was not updated
+  long long skipped_;
+
+ private:
+  std::map<int, long long> last_update_us_;
+};
+
+#endif  // TRACK_SCHEDULER_H_
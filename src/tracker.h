@@ -0,0 +1,32 @@
+#ifndef TRACKER_H_
+#define TRACKER_H_
+
+#include "Eigen/Dense"
+#include "measurement_package.h"
+
+/**
+ * Tracker is the measurement interface shared by the filters of the CTRV
+ * model, so a UKF and a ParticleFilter can be swapped behind it
+ */
+class Tracker {
+ public:
+  virtual ~Tracker() {}
+
+  /**
+   * ProcessMeasurement
+   * @param meas_package The latest measurement data of either radar or laser
+   */
+  virtual void ProcessMeasurement(MeasurementPackage meas_package) = 0;
+
+  /**
+   * State estimate [pos1 pos2 vel_abs yaw_angle yaw_rate]
+   */
+  virtual Eigen::VectorXd State() const = 0;
+
+  /**
+   * Covariance of the state estimate
+   */
+  virtual Eigen::MatrixXd Covariance() const = 0;
+};
+
+#endif  // TRACKER_H_
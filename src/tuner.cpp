@@ -0,0 +1,300 @@
+#include "tuner.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include "highway.h"
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+RunResult RunHighway(const NoiseConfig &config, long long seed,
+                     const std::atomic<bool> *abort, bool stop_on_fail) {
+  // a null viewer runs the scenario headless
+  pcl::visualization::PCLVisualizer::Ptr viewer;
+  Highway highway(viewer);
+  highway.tools.seed = seed;
+  for (Car &car : highway.traffic) {
+    car.ukf.std_a_ = config.std_a;
+    car.ukf.std_yawdd_ = config.std_yawdd;
+  }
+
+  // same timing as main.cpp
+  int frame_per_sec = 30;
+  int sec_interval = 10;
+  double egoVelocity = 25;
+
+  RunResult result;
+  result.aborted = false;
+  result.frames = 0;
+  while (result.frames < frame_per_sec * sec_interval) {
+    long long time_us = 1000000LL * result.frames / frame_per_sec;
+    highway.stepHighway(egoVelocity, time_us, frame_per_sec, viewer);
+    ++result.frames;
+
+    if (stop_on_fail && !highway.pass) {
+      break;
+    }
+    if (abort != nullptr && abort->load()) {
+      result.aborted = true;
+      break;
+    }
+  }
+
+  result.rmse = highway.tools.CalculateRMSE(highway.tools.estimations, highway.tools.ground_truth);
+  result.pass = highway.pass;
+  result.worst_ratio = 0;
+  for (int k = 0; k < 4; ++k) {
+    double worst = std::max(result.rmse(k), highway.rmseFailLog[k]);
+    result.worst_ratio = std::max(result.worst_ratio, worst / highway.rmseThreshold[k]);
+  }
+  return result;
+}
+
+NoiseTuner::NoiseTuner(const std::vector<long long> &seeds, int num_threads)
+    : seeds_(seeds), pool_(num_threads) {
+  std_a_min_ = 0.2;
+  std_a_max_ = 6.0;
+  std_yawdd_min_ = 0.2;
+  std_yawdd_max_ = 6.0;
+}
+
+NoiseTuner::~NoiseTuner() {}
+
+std::vector<TunerResult> NoiseTuner::Evaluate(const std::vector<NoiseConfig> &configs) {
+  int num_configs = configs.size();
+  int num_seeds = seeds_.size();
+  std::vector<RunResult> runs(num_configs * num_seeds);
+  std::unique_ptr<std::atomic<bool>[]> failed(new std::atomic<bool>[num_configs]);
+  for (int c = 0; c < num_configs; ++c) {
+    failed[c] = false;
+  }
+
+  pool_.ParallelFor(num_configs * num_seeds, [&](int k) {
+    int c = k / num_seeds;
+    RunResult &run = runs[k];
+    if (failed[c].load()) {
+      // another seed already failed this configuration
+      run.aborted = true;
+      run.frames = 0;
+      return;
+    }
+    run = RunHighway(configs[c], seeds_[k % num_seeds], &failed[c]);
+    if (!run.aborted && !run.pass) {
+      failed[c] = true;
+    }
+  });
+
+  std::vector<TunerResult> results;
+  for (int c = 0; c < num_configs; ++c) {
+    TunerResult result;
+    result.config = configs[c];
+    result.rmse = VectorXd::Zero(4);
+    result.score = 0;
+    result.pass = !failed[c].load();
+    result.runs = 0;
+    result.frames = 0;
+    for (int s = 0; s < num_seeds; ++s) {
+      const RunResult &run = runs[c * num_seeds + s];
+      result.frames += run.frames;
+      if (run.aborted) {
+        continue;
+      }
+      result.rmse += run.rmse;
+      result.score += run.worst_ratio;
+      ++result.runs;
+    }
+    if (result.runs > 0) {
+      result.rmse /= result.runs;
+      result.score /= result.runs;
+    }
+    results.push_back(result);
+  }
+  return results;
+}
+
+std::vector<TunerResult> NoiseTuner::GridSearch(int n) {
+  std::vector<NoiseConfig> configs;
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      double u = n > 1 ? (double)i / (n - 1) : 0.5;
+      double w = n > 1 ? (double)j / (n - 1) : 0.5;
+      NoiseConfig config = {std_a_min_ + u * (std_a_max_ - std_a_min_),
+                            std_yawdd_min_ + w * (std_yawdd_max_ - std_yawdd_min_)};
+      configs.push_back(config);
+    }
+  }
+  return Evaluate(configs);
+}
+
+std::vector<TunerResult> NoiseTuner::RandomSearch(int n, unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> std_a(std_a_min_, std_a_max_);
+  std::uniform_real_distribution<double> std_yawdd(std_yawdd_min_, std_yawdd_max_);
+  std::vector<NoiseConfig> configs;
+  for (int i = 0; i < n; ++i) {
+    NoiseConfig config;
+    config.std_a = std_a(gen);
+    config.std_yawdd = std_yawdd(gen);
+    configs.push_back(config);
+  }
+  return Evaluate(configs);
+}
+
+namespace {
+
+typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > PointList;
+
+// squared exponential kernel on the unit square
+double Kernel(const Eigen::Vector2d &a, const Eigen::Vector2d &b) {
+  const double length = 0.2;
+  return exp(-(a - b).squaredNorm() / (2 * length * length));
+}
+
+// Gaussian process over normalized configurations
+class GaussianProcess {
+ public:
+  GaussianProcess(const PointList &inputs, const std::vector<double> &outputs)
+      : inputs_(inputs) {
+    int n = inputs.size();
+    MatrixXd K(n, n);
+    for (int i = 0; i < n; ++i) {
+      for (int j = 0; j < n; ++j) {
+        K(i, j) = Kernel(inputs[i], inputs[j]);
+      }
+    }
+    K += 1e-4 * MatrixXd::Identity(n, n);
+    llt_ = K.llt();
+    VectorXd y(n);
+    for (int i = 0; i < n; ++i) {
+      y(i) = outputs[i];
+    }
+    alpha_ = llt_.solve(y);
+  }
+
+  void Predict(const Eigen::Vector2d &x, double &mean, double &stddev) const {
+    int n = inputs_.size();
+    VectorXd k(n);
+    for (int i = 0; i < n; ++i) {
+      k(i) = Kernel(x, inputs_[i]);
+    }
+    mean = k.dot(alpha_);
+    double var = 1.0 - k.dot(llt_.solve(k));
+    stddev = sqrt(std::max(var, 1e-12));
+  }
+
+ private:
+  PointList inputs_;
+  Eigen::LLT<MatrixXd> llt_;
+  VectorXd alpha_;
+};
+
+// expected improvement below best for a Gaussian prediction
+double ExpectedImprovement(double mean, double stddev, double best) {
+  double z = (best - mean) / stddev;
+  double cdf = 0.5 * erfc(-z / sqrt(2.0));
+  double pdf = exp(-0.5 * z * z) / sqrt(2.0 * M_PI);
+  return (best - mean) * cdf + stddev * pdf;
+}
+
+}  // namespace
+
+std::vector<TunerResult> NoiseTuner::BayesianSearch(int n, unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  PointList inputs;
+  std::vector<TunerResult> results;
+  int batch = std::max(1, pool_.Size());
+
+  // initial design, then batches picked by expected improvement
+  int initial = std::min(n, std::max(4, batch));
+  PointList proposals;
+  for (int i = 0; i < initial; ++i) {
+    proposals.push_back(Eigen::Vector2d(unit(gen), unit(gen)));
+  }
+
+  while (!proposals.empty()) {
+    std::vector<NoiseConfig> configs;
+    for (const Eigen::Vector2d &u : proposals) {
+      NoiseConfig config = {std_a_min_ + u(0) * (std_a_max_ - std_a_min_),
+                            std_yawdd_min_ + u(1) * (std_yawdd_max_ - std_yawdd_min_)};
+      configs.push_back(config);
+    }
+    std::vector<TunerResult> evaluated = Evaluate(configs);
+    inputs.insert(inputs.end(), proposals.begin(), proposals.end());
+    results.insert(results.end(), evaluated.begin(), evaluated.end());
+    proposals.clear();
+
+    int remaining = n - (int)results.size();
+    if (remaining <= 0) {
+      break;
+    }
+
+    // model the log score, standardized, so failing outliers do not dominate
+    std::vector<double> outputs;
+    double mean = 0, var = 0;
+    for (const TunerResult &result : results) {
+      outputs.push_back(log(std::max(result.score, 1e-6)));
+      mean += outputs.back();
+    }
+    mean /= outputs.size();
+    for (double y : outputs) {
+      var += (y - mean) * (y - mean);
+    }
+    double scale = sqrt(var / outputs.size()) + 1e-9;
+    for (double &y : outputs) {
+      y = (y - mean) / scale;
+    }
+
+    // pick a batch with the kriging believer heuristic: each pick is added
+    // to the model at its predicted mean before choosing the next one
+    PointList believed_inputs = inputs;
+    std::vector<double> believed_outputs = outputs;
+    for (int b = 0; b < std::min(batch, remaining); ++b) {
+      GaussianProcess gp(believed_inputs, believed_outputs);
+      double best = *std::min_element(believed_outputs.begin(), believed_outputs.end());
+
+      Eigen::Vector2d best_candidate;
+      double best_ei = -1, best_mean = 0;
+      for (int c = 0; c < 500; ++c) {
+        Eigen::Vector2d candidate(unit(gen), unit(gen));
+        double mu, sigma;
+        gp.Predict(candidate, mu, sigma);
+        double ei = ExpectedImprovement(mu, sigma, best);
+        if (ei > best_ei) {
+          best_ei = ei;
+          best_mean = mu;
+          best_candidate = candidate;
+        }
+      }
+      proposals.push_back(best_candidate);
+      believed_inputs.push_back(best_candidate);
+      believed_outputs.push_back(best_mean);
+    }
+  }
+  return results;
+}
+
+void NoiseTuner::Report(std::vector<TunerResult> results, std::ostream &out, int top) {
+  std::stable_sort(results.begin(), results.end(), [](const TunerResult &a, const TunerResult &b) {
+    if (a.pass != b.pass) {
+      return a.pass;
+    }
+    return a.score < b.score;
+  });
+
+  out << "rank  std_a  std_yawdd  score  pass  runs  frames  rmse(x y vx vy)" << std::endl;
+  for (int i = 0; i < (int)results.size() && i < top; ++i) {
+    const TunerResult &result = results[i];
+    out << std::setw(4) << i + 1 << std::fixed << std::setprecision(3)
+        << std::setw(7) << result.config.std_a
+        << std::setw(11) << result.config.std_yawdd
+        << std::setw(7) << result.score
+        << std::setw(6) << (result.pass ? "yes" : "no")
+        << std::setw(6) << result.runs
+        << std::setw(8) << result.frames
+        << "  " << result.rmse.transpose() << std::endl;
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef TUNER_H_
+#define TUNER_H_
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+#include "Eigen/Dense"
+#include "worker_pool.h"
+
+// process noise parameters of the UKF that are searched
+struct NoiseConfig {
+  double std_a;
+  double std_yawdd;
+};
+
+// outcome of one headless highway run
+struct RunResult {
+  Eigen::VectorXd rmse;
+  // worst ratio of RMSE to rmseThreshold seen after the check starts
+  double worst_ratio;
+  bool pass;
+  // true if the run was cut short through the abort flag
+  bool aborted;
+  // frames simulated before the run finished or was stopped
+  int frames;
+};
+
+// aggregate over all Monte Carlo seeds of one configuration
+struct TunerResult {
+  NoiseConfig config;
+  // mean RMSE over the seeds that ran
+  Eigen::VectorXd rmse;
+  // mean over seeds of the worst RMSE to threshold ratio, lower is better
+  double score;
+  bool pass;
+  int runs;
+  int frames;
+};
+
+/**
+ * RunHighway simulates the highway scenario without a viewer
+ * @param config Process noise for every tracked car
+ * @param seed Selects the measurement noise sequence
+ * @param abort Stops the run early when it becomes true, may be null
+ * @param stop_on_fail Stop as soon as the RMSE threshold is violated
+ */
+RunResult RunHighway(const NoiseConfig &config, long long seed,
+                     const std::atomic<bool> *abort = nullptr, bool stop_on_fail = true);
+
+/**
+ * NoiseTuner searches std_a_ and std_yawdd_ over seeded headless runs of
+ * the highway scenario. All runs of a batch execute in parallel; as soon as
+ * one seed of a configuration violates rmseThreshold the remaining seeds of
+ * that configuration are stopped.
+ */
+class NoiseTuner {
+ public:
+  /**
+   * Constructor
+   * @param seeds Monte Carlo seeds every configuration is evaluated on
+   * @param num_threads Worker threads, 0 picks the hardware concurrency
+   */
+  NoiseTuner(const std::vector<long long> &seeds, int num_threads = 0);
+
+  virtual ~NoiseTuner();
+
+  /**
+   * Evaluate runs every configuration on every seed
+   */
+  std::vector<TunerResult> Evaluate(const std::vector<NoiseConfig> &configs);
+
+  /**
+   * GridSearch evaluates an n by n grid over the search box
+   */
+  std::vector<TunerResult> GridSearch(int n);
+
+  /**
+   * RandomSearch evaluates n configurations drawn uniformly from the box
+   */
+  std::vector<TunerResult> RandomSearch(int n, unsigned int seed);
+
+  /**
+   * BayesianSearch fits a Gaussian process to the scores seen so far and
+   * evaluates batches of configurations that maximize expected improvement
+   * @param n Total number of configurations to evaluate
+   * @param seed Seed for the initial design and candidate sampling
+   */
+  std::vector<TunerResult> BayesianSearch(int n, unsigned int seed);
+
+  /**
+   * Report prints the results ranked best first
+   */
+  static void Report(std::vector<TunerResult> results, std::ostream &out, int top = 10);
+
+  // search box for std_a_ in m/s^2 and std_yawdd_ in rad/s^2
+  double std_a_min_, std_a_max_;
+  double std_yawdd_min_, std_yawdd_max_;
+
+ private:
+  std::vector<long long> seeds_;
+  WorkerPool pool_;
+};
+
+#endif  // TUNER_H_
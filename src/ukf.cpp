@@ -1,9 +1,52 @@
 #include "ukf.h"
+#include "fast_math.h"
+#include "metrics.h"
+#include "simd_kernels.h"
 #include "Eigen/Dense"
+#include <chrono>
 #include <iostream>
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
+namespace {
+
+// seconds since t0
+double SecondsSince(const std::chrono::steady_clock::time_point &t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+Counter &UpdatesCounter(MeasurementPackage::SensorType sensor) {
+  static Counter &lidar = MetricsRegistry::Instance().GetCounter(
+      "ukf_updates_total", "Measurements processed by the filters", "sensor=\"lidar\"");
+  static Counter &radar = MetricsRegistry::Instance().GetCounter(
+      "ukf_updates_total", "Measurements processed by the filters", "sensor=\"radar\"");
+  return sensor == MeasurementPackage::LASER ? lidar : radar;
+}
+
+// Initial yaw and yaw rate variances. Traffic heads along the lanes, so the
+// initial yaw of 0 is close for every car, forward or oncoming (negative v).
+// A loose yaw lets the first noisy positions swing it and v sin(yaw) spikes
+// for the first second.
+const double kInitialYawVariance = 0.05;
+const double kInitialYawRateVariance = 0.1;
+
+}  // namespace
+
+const char *UKF::UpdateMethodName(UpdateMethod method) {
+  static const char *names[] = {"unscented", "ekf", "converted", "adaptive"};
+  return names[method];
+}
+
+bool UKF::ParseUpdateMethod(const std::string &name, UpdateMethod &method) {
+  for (int m = UNSCENTED; m <= ADAPTIVE; ++m) {
+    if (name == UpdateMethodName(static_cast<UpdateMethod>(m))) {
+      method = static_cast<UpdateMethod>(m);
+      return true;
+    }
+  }
+  return false;
+}
+
 /**
  * Initializes Unscented Kalman filter
  */
@@ -90,22 +133,51 @@ UKF::UKF() {
   Radar_R_ << std_radr_*std_radr_, 0, 0,
               0, std_radphi_*std_radphi_, 0,
               0, 0,std_radrd_*std_radrd_;
+
+  // Radar update method
+  radar_update_ = UNSCENTED;
+
+  // At 1% spread the bearing nonlinearity is well below the sensor noise
+  adaptive_spread_ = 0.01;
+  adaptive_min_range_ = 5.0;
+
+  radar_update_count_[UNSCENTED] = 0;
+  radar_update_count_[EKF] = 0;
+  radar_update_count_[CONVERTED] = 0;
+
+  // Event-triggered updates
+  event_trigger_ = false;
+  trigger_nis_ = 0.5;
+  trigger_gain_ = 0.25;
+  nis_ = 0;
+  updates_run_ = 0;
+  updates_skipped_ = 0;
+  skipped_nis_sum_ = 0;
+
+  // Multi-measurement initialization
+  init_window_us_ = 0;
 }
 
 UKF::~UKF() {}
 
 void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
+  static Histogram &predict_seconds = MetricsRegistry::Instance().GetHistogram(
+      "ukf_predict_seconds", "Duration of the prediction step", MetricsRegistry::LatencyBounds());
+  static Histogram &update_seconds = MetricsRegistry::Instance().GetHistogram(
+      "ukf_update_seconds", "Duration of the update step", MetricsRegistry::LatencyBounds());
+  UpdatesCounter(meas_package.sensor_type_).Increment();
+
   if(is_initialized_){
     double delta_t = (meas_package.timestamp_ - time_us_) / 1000000.0;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
     Prediction(delta_t);
+    predict_seconds.Observe(SecondsSince(t0));
 
     time_us_ = meas_package.timestamp_;
 
-    if(meas_package.sensor_type_ == MeasurementPackage::LASER && use_laser_){
-      UpdateLidar(meas_package);
-    } else if(meas_package.sensor_type_ == MeasurementPackage::RADAR && use_radar_){
-      UpdateRadar(meas_package);
-    }
+    t0 = std::chrono::steady_clock::now();
+    Update(meas_package);
+    update_seconds.Observe(SecondsSince(t0));
   }else{
     is_initialized_ = true;
 
@@ -119,24 +191,100 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
       P_ << std_laspx_*std_laspx_, 0, 0, 0, 0,
             0, std_laspy_*std_laspy_, 0, 0, 0,
             0, 0, 1, 0, 0,
-            0, 0, 0, 1, 0,
-            0, 0, 0, 0, 1;
+            0, 0, 0, kInitialYawVariance, 0,
+            0, 0, 0, 0, kInitialYawRateVariance;
 
     } else {
       double rho = meas_package.raw_measurements_(0);
       double phi = meas_package.raw_measurements_(1);
-      x_(0) = rho*cos(phi); //Px
-      x_(1) = rho*sin(phi); //Py
+      double sin_phi, cos_phi;
+      FastSinCos(phi, &sin_phi, &cos_phi);
+      x_(0) = rho*cos_phi; //Px
+      x_(1) = rho*sin_phi; //Py
 
       P_ << (std_radr_+std_radphi_)*(std_radr_+std_radphi_), 0, 0, 0, 0,
             0, (std_radr_+std_radphi_)*(std_radr_+std_radphi_), 0, 0, 0,
             0, 0, 1, 0, 0,
-            0, 0, 0, 1, 0,
-            0, 0, 0, 0, 1;
+            0, 0, 0, kInitialYawVariance, 0,
+            0, 0, 0, 0, kInitialYawRateVariance;
+    }
+
+    if(init_window_us_ > 0){
+      init_window_.assign(1, meas_package);
     }
   }
 }
 
+void UKF::ProcessStacked(const std::vector<MountedMeasurement> &measurements) {
+  static Histogram &predict_seconds = MetricsRegistry::Instance().GetHistogram(
+      "ukf_predict_seconds", "Duration of the prediction step", MetricsRegistry::LatencyBounds());
+  static Histogram &update_seconds = MetricsRegistry::Instance().GetHistogram(
+      "ukf_update_seconds", "Duration of the update step", MetricsRegistry::LatencyBounds());
+  if(measurements.empty()){
+    return;
+  }
+
+  size_t first = 0;
+  if(!is_initialized_){
+    // the first measurement seeds the filter, the others update it
+    long long window_us = init_window_us_;
+    init_window_us_ = 0;
+    ProcessMeasurement(ToEgoFrame(measurements[0]));
+    init_window_us_ = window_us;
+    first = 1;
+    if(measurements.size() == 1){
+      return;
+    }
+  }
+  for(size_t i = first; i < measurements.size(); ++i){
+    UpdatesCounter(measurements[i].meas.sensor_type_).Increment();
+  }
+
+  // also at the filter time, the sigma points must be drawn from P_ as updated
+  long long timestamp = measurements[0].meas.timestamp_;
+  double delta_t = (timestamp - time_us_) / 1000000.0;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  Prediction(delta_t);
+  predict_seconds.Observe(SecondsSince(t0));
+  time_us_ = timestamp;
+
+  t0 = std::chrono::steady_clock::now();
+  UpdateStacked(measurements, first);
+  update_seconds.Observe(SecondsSince(t0));
+}
+
+void UKF::Update(const MeasurementPackage &meas_package) {
+  // an average of n measurements has 1/n of their noise variance
+  double noise_scale = 1.0 / std::max(meas_package.samples_, 1);
+
+  if(!init_window_.empty()){
+    init_window_.push_back(meas_package);
+    if(meas_package.timestamp_ - init_window_.front().timestamp_ >= init_window_us_){
+      bool seeded = InitializeFromWindow();
+      init_window_.clear();
+      // the window ends with this measurement, it is part of the fit
+      if(seeded){
+        return;
+      }
+    }
+  }
+
+  if(event_trigger_){
+    if(!UpdateTriggered(meas_package, noise_scale)){
+      ++updates_skipped_;
+      skipped_nis_sum_ += nis_;
+      return;
+    }
+    ++updates_run_;
+  }
+
+  if(meas_package.sensor_type_ == MeasurementPackage::LASER && use_laser_){
+    UpdateLidar(meas_package, noise_scale);
+  } else if(meas_package.sensor_type_ == MeasurementPackage::RADAR && use_radar_){
+    UpdateRadar(meas_package, noise_scale);
+  }
+}
+
 void UKF::Prediction(double delta_t) {
   // create sigma point matrix
   MatrixXd Xsig_aug(n_aug_, 2 * n_aug_ + 1);
@@ -174,79 +322,206 @@ void UKF::GenerateSigmaPoints(MatrixXd &Xsig_aug) {
 }
 
 void UKF::SigmaPointsPrediction(MatrixXd &Xsig_aug, double &delta_t){
-  // predict sigma points
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {
-    // extract state vector elements
-    double px = Xsig_aug(0, i);
-    double py = Xsig_aug(1, i);
-    double v = Xsig_aug(2, i);
-    double yaw = Xsig_aug(3, i);
-    double yawd = Xsig_aug(4, i);
-    double nu_a = Xsig_aug(5, i);
-    double nu_yawdd = Xsig_aug(6, i);
-
-    // predict the states
-    double px_pred, py_pred;
-
-    // avoid division by zero
-    if (fabs(yawd) > 0.001) {
-      px_pred = px + v / yawd * (sin(yaw + yawd * delta_t) - sin(yaw));
-      py_pred = py + v / yawd * (-1 * cos(yaw + yawd * delta_t) + cos(yaw));
-    }
-    else {
-      px_pred = px + v * cos(yaw) * delta_t;
-      py_pred = py + v * sin(yaw) * delta_t;
+  // sigma points row by row, the layout of the dispatched kernels
+  int n_sig = 2 * n_aug_ + 1;
+  alignas(64) double aug[7 * kSigmaStride] = {0};
+  alignas(64) double pred[5 * kSigmaStride];
+  for (int r = 0; r < n_aug_; ++r) {
+    for (int i = 0; i < n_sig; ++i) {
+      aug[r * kSigmaStride + i] = Xsig_aug(r, i);
     }
+  }
 
-    double v_pred = v;
-    double yaw_pred = yaw + yawd * delta_t;
-    double yawd_pred = yawd;
-
-    // add noise
-    px_pred += 0.5 * delta_t * delta_t * cos(yaw) * nu_a;
-    py_pred += 0.5 * delta_t * delta_t * sin(yaw) * nu_a;
-    v_pred += delta_t * nu_a;
-    yaw_pred += 0.5 * delta_t * delta_t * nu_yawdd;
-    yawd_pred += delta_t * nu_yawdd;
-
-  // write predicted sigma points into right column
-    Xsig_pred_(0, i) = px_pred;
-    Xsig_pred_(1, i) = py_pred;
-    Xsig_pred_(2, i) = v_pred;
-    Xsig_pred_(3, i) = yaw_pred;
-    Xsig_pred_(4, i) = yawd_pred;
+  // predict sigma points
+  Kernels().predict_sigma_points(aug, pred, n_sig, delta_t);
+
+  for (int r = 0; r < n_x_; ++r) {
+    for (int i = 0; i < n_sig; ++i) {
+      Xsig_pred_(r, i) = pred[r * kSigmaStride + i];
+    }
   }
 }
 
 void UKF::PredictMeanAndCovariance(void) {
+  int n_sig = 2 * n_aug_ + 1;
+  alignas(64) double sigma[5 * kSigmaStride] = {0};
+  for (int r = 0; r < n_x_; ++r) {
+    for (int i = 0; i < n_sig; ++i) {
+      sigma[r * kSigmaStride + i] = Xsig_pred_(r, i);
+    }
+  }
+
   // predicted state mean
-  x_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  // iterate over sigma points
-    x_ = x_ + weights_(i) * Xsig_pred_.col(i);
+  const SimdKernels &kernels = Kernels();
+  kernels.ut_mean(sigma, n_x_, n_sig, weights_.data(), x_.data());
+
+  // predicted state covariance matrix, yaw is the angle
+  Eigen::Matrix<double, 5, 5, Eigen::RowMajor> P;
+  kernels.ut_covariance(sigma, x_.data(), n_x_, 3, sigma, x_.data(), n_x_, 3, n_sig,
+                        weights_.data(), P.data());
+  P_ = P;
+}
+
+VectorXd UKF::PredictMean(double delta_t) const {
+  double px = x_(0);
+  double py = x_(1);
+  double v = x_(2);
+  double yaw = x_(3);
+  double yawd = x_(4);
+
+  VectorXd x_pred = x_;
+  double sin_yaw, cos_yaw;
+  FastSinCos(yaw, &sin_yaw, &cos_yaw);
+
+  // avoid division by zero
+  if (fabs(yawd) > 0.001) {
+    double sin_yaw_pred, cos_yaw_pred;
+    FastSinCos(yaw + yawd * delta_t, &sin_yaw_pred, &cos_yaw_pred);
+    x_pred(0) = px + v / yawd * (sin_yaw_pred - sin_yaw);
+    x_pred(1) = py + v / yawd * (-1 * cos_yaw_pred + cos_yaw);
+  }
+  else {
+    x_pred(0) = px + v * cos_yaw * delta_t;
+    x_pred(1) = py + v * sin_yaw * delta_t;
   }
+  x_pred(3) = yaw + yawd * delta_t;
 
-  // predicted state covariance matrix
-  P_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  // iterate over sigma points
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    
-    // angle normalization
-    while (x_diff(3)> M_PI) x_diff(3)-=2.*M_PI;
-    while (x_diff(3)<-M_PI) x_diff(3)+=2.*M_PI;
-
-    P_ = P_ + weights_(i) * x_diff * x_diff.transpose();
+  return x_pred;
+}
+
+bool UKF::UpdateTriggered(const MeasurementPackage &meas_package, double noise_scale) {
+  VectorXd z_diff;
+  MatrixXd S;
+  MatrixXd R;
+  if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
+    z_diff = meas_package.raw_measurements_ - Lidar_H_ * x_;
+    R = noise_scale * Lidar_R_;
+    S = Lidar_H_ * P_ * Lidar_H_.transpose() + R;
+  } else {
+    double p_x = x_(0);
+    double p_y = x_(1);
+    double rho = sqrt(p_x*p_x + p_y*p_y);
+    // too close to the sensor to linearize, always update
+    if (rho < 1e-3) {
+      nis_ = 0;
+      return true;
+    }
+    double sin_yaw, cos_yaw;
+    FastSinCos(x_(3), &sin_yaw, &cos_yaw);
+    VectorXd z_pred(n_z_);
+    z_pred << rho,
+              FastAtan2(p_y, p_x),
+              (p_x*cos_yaw*x_(2) + p_y*sin_yaw*x_(2)) / rho;
+    z_diff = meas_package.raw_measurements_ - z_pred;
+    while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
+    while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
+
+    MatrixXd H = RadarJacobian(x_);
+    R = noise_scale * Radar_R_;
+    S = H * P_ * H.transpose() + R;
+  }
+
+  Eigen::LDLT<MatrixXd> ldlt(S);
+  nis_ = z_diff.dot(ldlt.solve(z_diff));
+  double gain = 0.5 * log(S.determinant() / R.determinant());
+  return nis_ >= trigger_nis_ * z_diff.size() || gain >= trigger_gain_;
+}
+
+bool UKF::InitializeFromWindow() {
+  // normal equations of the fit for [px py vx vy] at the last measurement
+  Eigen::Matrix4d A = Eigen::Matrix4d::Zero();
+  Eigen::Vector4d b = Eigen::Vector4d::Zero();
+  long long last_us = init_window_.back().timestamp_;
+  for (const MeasurementPackage &meas_package : init_window_) {
+    double dt = (meas_package.timestamp_ - last_us) / 1000000.0;
+    Eigen::Matrix<double, 2, 4> H;
+    H << 1, 0, dt, 0,
+         0, 1, 0, dt;
+    Eigen::Vector2d z;
+    Eigen::Matrix2d R;
+    if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
+      z = meas_package.raw_measurements_.head(2);
+      R = Lidar_R_;
+    } else {
+      double rho = meas_package.raw_measurements_(0);
+      double phi = meas_package.raw_measurements_(1);
+      double rho_dot = meas_package.raw_measurements_(2);
+      double sin_phi, cos_phi;
+      FastSinCos(phi, &sin_phi, &cos_phi);
+      z << rho * cos_phi, rho * sin_phi;
+      // range and cross-range noise rotated into the Cartesian frame
+      Eigen::Matrix2d rotation;
+      rotation << cos_phi, -sin_phi,
+                  sin_phi, cos_phi;
+      Eigen::Matrix2d polar = Eigen::Matrix2d::Zero();
+      polar(0, 0) = std_radr_ * std_radr_;
+      polar(1, 1) = std::max(rho * rho, 0.01) * std_radphi_ * std_radphi_;
+      R = rotation * polar * rotation.transpose();
+
+      // the range rate is the velocity along the measured bearing
+      Eigen::Vector4d h(0, 0, cos_phi, sin_phi);
+      double r_inv = meas_package.samples_ / (std_radrd_ * std_radrd_);
+      A += r_inv * h * h.transpose();
+      b += r_inv * rho_dot * h;
+    }
+    // averaged measurements count as often as they were sampled
+    Eigen::Matrix2d R_inv = meas_package.samples_ * R.inverse();
+    A += H.transpose() * R_inv * H;
+    b += H.transpose() * R_inv * z;
+  }
+
+  Eigen::LDLT<Eigen::Matrix4d> ldlt(A);
+  if (ldlt.info() != Eigen::Success || !ldlt.isPositive() || A.determinant() <= 0) {
+    return false;
+  }
+  Eigen::Vector4d fit = ldlt.solve(b);
+  Eigen::Matrix4d fit_cov = ldlt.solve(Eigen::Matrix4d::Identity());
+
+  // from Cartesian velocity to speed and heading
+  double vx = fit(2);
+  double vy = fit(3);
+  double v = sqrt(vx*vx + vy*vy);
+  Eigen::Matrix4d J = Eigen::Matrix4d::Identity();
+  double v_std = sqrt(fit_cov(2, 2) + fit_cov(3, 3));
+  Eigen::Matrix4d cov;
+  double yaw = 0;
+  if (v > v_std) {
+    yaw = FastAtan2(vy, vx);
+    J.block<2, 2>(2, 2) << vx / v, vy / v,
+                           -vy / (v*v), vx / (v*v);
+    cov = J * fit_cov * J.transpose();
+  } else {
+    // too slow for a heading, leave it as uncertain as a fresh track
+    cov = Eigen::Matrix4d::Zero();
+    cov.block<2, 2>(0, 0) = fit_cov.block<2, 2>(0, 0);
+    cov(2, 2) = v_std * v_std;
+    cov(3, 3) = 1;
   }
+
+  // the fit assumes a constant velocity, allow for the acceleration the
+  // process model expects over the window
+  double window_s = (last_us - init_window_.front().timestamp_) / 1000000.0;
+  cov(2, 2) += std_a_*std_a_ * window_s*window_s;
+
+  double yawd = x_(4);
+  double yawd_var = P_(4, 4);
+  x_ << fit(0), fit(1), v, yaw, yawd;
+  P_.fill(0.0);
+  P_.topLeftCorner(4, 4) = cov;
+  P_(4, 4) = yawd_var;
+  time_us_ = last_us;
+  return true;
 }
 
-void UKF::UpdateLidar(MeasurementPackage meas_package) {
+void UKF::UpdateLidar(MeasurementPackage meas_package, double noise_scale) {
   VectorXd z_pred = Lidar_H_ * x_;
   VectorXd y = meas_package.raw_measurements_ - z_pred;
   MatrixXd Ht = Lidar_H_.transpose();
-  MatrixXd S = Lidar_H_ * P_ * Ht + Lidar_R_;
+  MatrixXd S = Lidar_H_ * P_ * Ht + noise_scale * Lidar_R_;
   MatrixXd Si = S.inverse();
   MatrixXd PHt = P_ * Ht;
   MatrixXd K = PHt * Si;
+  nis_ = y.dot(Si * y);
 
   //new estimate
   x_ = x_ + (K * y);
@@ -254,10 +529,131 @@ void UKF::UpdateLidar(MeasurementPackage meas_package) {
   P_ = (I - K * Lidar_H_) * P_;
 }
 
-void UKF::UpdateRadar(MeasurementPackage meas_package) {
-  // create matrix for sigma points in measurement space
-  MatrixXd Zsig(n_z_, 2 * n_aug_ + 1);
+void UKF::UpdateRadar(MeasurementPackage meas_package, double noise_scale) {
+  UpdateMethod method = radar_update_;
+  if (method == ADAPTIVE) {
+    double rho = sqrt(x_(0)*x_(0) + x_(1)*x_(1));
+    double spread = sqrt(P_(0,0) + P_(1,1));
+    bool linear = rho > adaptive_min_range_ && spread < adaptive_spread_ * rho;
+    method = linear ? EKF : UNSCENTED;
+  }
+
+  // the linearized models break down next to the sensor
+  if (method != UNSCENTED && x_(0)*x_(0) + x_(1)*x_(1) < 1e-4) {
+    method = UNSCENTED;
+  }
+
+  ++radar_update_count_[method];
+  if (method == EKF) {
+    UpdateRadarEKF(meas_package, noise_scale);
+  } else if (method == CONVERTED) {
+    UpdateRadarConverted(meas_package, noise_scale);
+  } else {
+    UpdateRadarUnscented(meas_package, noise_scale);
+  }
+}
+
+MatrixXd UKF::RadarJacobian(const VectorXd &x) {
+  double p_x = x(0);
+  double p_y = x(1);
+  double sin_yaw, cos_yaw;
+  FastSinCos(x(3), &sin_yaw, &cos_yaw);
+  double v1 = cos_yaw*x(2);
+  double v2 = sin_yaw*x(2);
+
+  double rho2 = p_x*p_x + p_y*p_y;
+  double rho = sqrt(rho2);
+  double rho3 = rho2*rho;
+  double cross = p_y*v1 - p_x*v2;
+
+  MatrixXd H(3, 5);
+  H << p_x/rho, p_y/rho, 0, 0, 0,
+       -p_y/rho2, p_x/rho2, 0, 0, 0,
+       p_y*cross/rho3, -p_x*cross/rho3, (p_x*cos_yaw + p_y*sin_yaw)/rho, cross/rho, 0;
+  return H;
+}
+
+void UKF::UpdateRadarEKF(const MeasurementPackage &meas_package, double noise_scale) {
+  double p_x = x_(0);
+  double p_y = x_(1);
+  double rho = sqrt(p_x*p_x + p_y*p_y);
+  double sin_yaw, cos_yaw;
+  FastSinCos(x_(3), &sin_yaw, &cos_yaw);
+
+  // predicted measurement at the mean
+  VectorXd z_pred(n_z_);
+  z_pred << rho,
+            FastAtan2(p_y, p_x),
+            (p_x*cos_yaw*x_(2) + p_y*sin_yaw*x_(2)) / rho;
+
+  MatrixXd H = RadarJacobian(x_);
+  MatrixXd PHt = P_ * H.transpose();
+  MatrixXd S = H * PHt + noise_scale * Radar_R_;
+  MatrixXd K = PHt * S.inverse();
+
+  // residual
+  VectorXd z_diff = meas_package.raw_measurements_ - z_pred;
+
+  // angle normalization
+  while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
+  while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
+  nis_ = z_diff.dot(S.ldlt().solve(z_diff));
+
+  x_ = x_ + K * z_diff;
+  MatrixXd I = MatrixXd::Identity(n_x_, n_x_);
+  P_ = (I - K * H) * P_;
+}
+
+void UKF::UpdateRadarConverted(const MeasurementPackage &meas_package, double noise_scale) {
+  double rho = meas_package.raw_measurements_(0);
+  double phi = meas_package.raw_measurements_(1);
+  double rho_dot = meas_package.raw_measurements_(2);
+
+  // E[cos(phi noise)] shrinks the naive conversion towards the sensor
+  double var_phi = noise_scale*std_radphi_*std_radphi_;
+  double lambda = exp(-var_phi/2);
+  double lambda4 = exp(-2*var_phi);
+  double sin_phi, cos_phi, sin_2phi, cos_2phi;
+  FastSinCos(phi, &sin_phi, &cos_phi);
+  FastSinCos(2*phi, &sin_2phi, &cos_2phi);
+
+  VectorXd z(2);
+  z << rho*cos_phi/lambda, rho*sin_phi/lambda;
+
+  // covariance of the debiased conversion, evaluated at the measurement
+  double a = (1/(lambda*lambda) - 2)*rho*rho;
+  double b = 0.5*(rho*rho + noise_scale*std_radr_*std_radr_);
+  MatrixXd R(2, 2);
+  R << a*cos_phi*cos_phi + b*(1 + lambda4*cos_2phi), a*cos_phi*sin_phi + b*lambda4*sin_2phi,
+       a*cos_phi*sin_phi + b*lambda4*sin_2phi, a*sin_phi*sin_phi + b*(1 - lambda4*cos_2phi);
+
+  // linear position update, same model as the lidar
+  VectorXd y = z - Lidar_H_ * x_;
+  MatrixXd PHt = P_ * Lidar_H_.transpose();
+  MatrixXd S = Lidar_H_ * PHt + R;
+  MatrixXd K = PHt * S.inverse();
+  nis_ = y.dot(S.ldlt().solve(y));
+  x_ = x_ + K * y;
+  MatrixXd I = MatrixXd::Identity(n_x_, n_x_);
+  P_ = (I - K * Lidar_H_) * P_;
+
+  // range rate as a scalar update linearized at the new estimate
+  double p_x = x_(0);
+  double p_y = x_(1);
+  double range = sqrt(p_x*p_x + p_y*p_y);
+  double sin_yaw, cos_yaw;
+  FastSinCos(x_(3), &sin_yaw, &cos_yaw);
+  VectorXd h = RadarJacobian(x_).row(2).transpose();
+  double rho_dot_pred = (p_x*cos_yaw*x_(2) + p_y*sin_yaw*x_(2)) / range;
+  VectorXd Ph = P_ * h;
+  double s = h.dot(Ph) + noise_scale*std_radrd_*std_radrd_;
+  VectorXd k = Ph / s;
+  nis_ += (rho_dot - rho_dot_pred) * (rho_dot - rho_dot_pred) / s;
+  x_ = x_ + k * (rho_dot - rho_dot_pred);
+  P_ = P_ - k * Ph.transpose();
+}
 
+void UKF::UpdateRadarUnscented(const MeasurementPackage &meas_package, double noise_scale) {
   // mean predicted measurement
   VectorXd z_pred(n_z_);
   
@@ -265,62 +661,32 @@ void UKF::UpdateRadar(MeasurementPackage meas_package) {
   MatrixXd S(n_z_, n_z_);
 
   // transform sigma points into measurement space
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {  // 2n+1 simga points
-    // extract values for better readability
-    double p_x = Xsig_pred_(0,i);
-    double p_y = Xsig_pred_(1,i);
-    double v  = Xsig_pred_(2,i);
-    double yaw = Xsig_pred_(3,i);
-
-    double v1 = cos(yaw)*v;
-    double v2 = sin(yaw)*v;
-
-    // measurement model
-    Zsig(0,i) = sqrt(p_x*p_x + p_y*p_y);                       // r
-    Zsig(1,i) = atan2(p_y,p_x);                                // phi
-    Zsig(2,i) = (p_x*v1 + p_y*v2) / sqrt(p_x*p_x + p_y*p_y);   // r_dot
+  int n_sig = 2 * n_aug_ + 1;
+  alignas(64) double sigma[5 * kSigmaStride] = {0};
+  alignas(64) double zsig[3 * kSigmaStride];
+  for (int r = 0; r < n_x_; ++r) {
+    for (int i = 0; i < n_sig; ++i) {
+      sigma[r * kSigmaStride + i] = Xsig_pred_(r, i);
+    }
   }
+  const SimdKernels &kernels = Kernels();
+  kernels.radar_transform(sigma, zsig, n_sig);
 
   // mean predicted measurement
-  z_pred.fill(0.0);
-  for (int i=0; i < 2*n_aug_+1; ++i) {
-    z_pred = z_pred + weights_(i) * Zsig.col(i);
-  }
+  kernels.ut_mean(zsig, n_z_, n_sig, weights_.data(), z_pred.data());
 
-  // innovation covariance matrix S
-  S.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {  // 2n+1 simga points
-    // residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-
-    // angle normalization
-    while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-    while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
-
-    S = S + weights_(i) * z_diff * z_diff.transpose();
-  }
+  // innovation covariance matrix S, the bearing is the angle
+  Eigen::Matrix<double, 3, 3, Eigen::RowMajor> S_sigma;
+  kernels.ut_covariance(zsig, z_pred.data(), n_z_, 1, zsig, z_pred.data(), n_z_, 1, n_sig,
+                        weights_.data(), S_sigma.data());
 
   // add measurement noise covariance matrix
-  S = S + Radar_R_;
+  S = S_sigma + noise_scale * Radar_R_;
 
   // calculate cross correlation matrix
-  MatrixXd Tc = MatrixXd(n_x_, n_z_);
-  Tc.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; ++i) {  // 2n+1 simga points
-    // residual
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-    // angle normalization
-    while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
-    while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
-
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    // angle normalization
-    while (x_diff(3)> M_PI) x_diff(3)-=2.*M_PI;
-    while (x_diff(3)<-M_PI) x_diff(3)+=2.*M_PI;
-
-    Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
-  }
+  Eigen::Matrix<double, 5, 3, Eigen::RowMajor> Tc;
+  kernels.ut_covariance(sigma, x_.data(), n_x_, 3, zsig, z_pred.data(), n_z_, 1, n_sig,
+                        weights_.data(), Tc.data());
 
   // Kalman gain K;
   MatrixXd K = Tc * S.inverse();
@@ -331,8 +697,108 @@ void UKF::UpdateRadar(MeasurementPackage meas_package) {
   // angle normalization
   while (z_diff(1)> M_PI) z_diff(1)-=2.*M_PI;
   while (z_diff(1)<-M_PI) z_diff(1)+=2.*M_PI;
+  nis_ = z_diff.dot(S.ldlt().solve(z_diff));
 
   // update state mean and covariance matrix
   x_ = x_ + K * z_diff;
   P_ = P_ - K*S*K.transpose();
 }
+
+void UKF::UpdateStacked(const std::vector<MountedMeasurement> &measurements, size_t first) {
+  // rows of each applied measurement in the stack
+  int n_z = 0;
+  std::vector<int> row(measurements.size(), -1);
+  for (size_t m = first; m < measurements.size(); ++m) {
+    MeasurementPackage::SensorType type = measurements[m].meas.sensor_type_;
+    if ((type == MeasurementPackage::LASER && use_laser_) ||
+        (type == MeasurementPackage::RADAR && use_radar_)) {
+      row[m] = n_z;
+      n_z += type == MeasurementPackage::LASER ? 2 : 3;
+    }
+  }
+  if (n_z == 0) {
+    return;
+  }
+
+  // predicted sigma points seen from every sensor, and the stacked
+  // measurement and noise
+  int n_sig = 2 * n_aug_ + 1;
+  MatrixXd Zsig(n_z, n_sig);
+  VectorXd z(n_z);
+  VectorXd R(n_z);
+  std::vector<int> angle_rows;
+  for (size_t m = first; m < measurements.size(); ++m) {
+    if (row[m] < 0) {
+      continue;
+    }
+    const MountedMeasurement &mounted = measurements[m];
+    int r = row[m];
+    double sin_mount, cos_mount;
+    FastSinCos(mounted.yaw, &sin_mount, &cos_mount);
+    if (mounted.meas.sensor_type_ == MeasurementPackage::LASER) {
+      for (int i = 0; i < n_sig; ++i) {
+        double dx = Xsig_pred_(0, i) - mounted.x;
+        double dy = Xsig_pred_(1, i) - mounted.y;
+        Zsig(r, i) = cos_mount * dx + sin_mount * dy;
+        Zsig(r + 1, i) = -sin_mount * dx + cos_mount * dy;
+      }
+    } else {
+      for (int i = 0; i < n_sig; ++i) {
+        double dx = Xsig_pred_(0, i) - mounted.x;
+        double dy = Xsig_pred_(1, i) - mounted.y;
+        double sin_yaw, cos_yaw;
+        FastSinCos(Xsig_pred_(3, i), &sin_yaw, &cos_yaw);
+        double rho = sqrt(dx * dx + dy * dy);
+        double phi = FastAtan2(dy, dx) - mounted.yaw;
+        while (phi > M_PI) phi -= 2. * M_PI;
+        while (phi < -M_PI) phi += 2. * M_PI;
+        Zsig(r, i) = rho;
+        Zsig(r + 1, i) = phi;
+        Zsig(r + 2, i) = rho > 1e-4 ? Xsig_pred_(2, i) * (dx * cos_yaw + dy * sin_yaw) / rho : 0;
+      }
+      angle_rows.push_back(r + 1);
+    }
+    int dim = mounted.meas.sensor_type_ == MeasurementPackage::LASER ? 2 : 3;
+    for (int k = 0; k < dim; ++k) {
+      z(r + k) = mounted.meas.raw_measurements_(k);
+      R(r + k) = mounted.noise[k] * mounted.noise[k];
+    }
+  }
+
+  // mean predicted measurement
+  VectorXd z_pred = Zsig * weights_;
+
+  // deviations of the sigma points, angles normalized
+  MatrixXd Zdiff = Zsig.colwise() - z_pred;
+  MatrixXd Xdiff = Xsig_pred_.colwise() - x_;
+  for (int i = 0; i < n_sig; ++i) {
+    for (int a : angle_rows) {
+      while (Zdiff(a, i) > M_PI) Zdiff(a, i) -= 2. * M_PI;
+      while (Zdiff(a, i) < -M_PI) Zdiff(a, i) += 2. * M_PI;
+    }
+    while (Xdiff(3, i) > M_PI) Xdiff(3, i) -= 2. * M_PI;
+    while (Xdiff(3, i) < -M_PI) Xdiff(3, i) += 2. * M_PI;
+  }
+
+  // innovation covariance and cross correlation
+  MatrixXd ZdiffW = Zdiff * weights_.asDiagonal();
+  MatrixXd S = ZdiffW * Zdiff.transpose();
+  S.diagonal() += R;
+  MatrixXd Tc = Xdiff * ZdiffW.transpose();
+
+  // residual
+  VectorXd z_diff = z - z_pred;
+  for (int a : angle_rows) {
+    while (z_diff(a) > M_PI) z_diff(a) -= 2. * M_PI;
+    while (z_diff(a) < -M_PI) z_diff(a) += 2. * M_PI;
+  }
+
+  // one factorization for the gain and the NIS, K = Tc S^-1
+  Eigen::LDLT<MatrixXd> ldlt = S.ldlt();
+  MatrixXd Kt = ldlt.solve(Tc.transpose());
+  nis_ = z_diff.dot(ldlt.solve(z_diff));
+
+  // update state mean and covariance matrix
+  x_ = x_ + Kt.transpose() * z_diff;
+  P_ = P_ - Tc * Kt;
+}
@@ -1,11 +1,37 @@
 #ifndef UKF_H
 #define UKF_H
 
+#include <string>
+#include <vector>
 #include "Eigen/Dense"
 #include "measurement_package.h"
+#include "sensor_rig.h"
+#include "tracker.h"
 
-class UKF {
+class UKF : public Tracker {
  public:
+  /**
+   * Measurement update methods selectable per sensor
+   */
+  enum UpdateMethod {
+    UNSCENTED,  // sigma points through the measurement model
+    EKF,        // linearize the model with its analytic Jacobian
+    CONVERTED,  // debiased conversion to a linear position measurement
+    ADAPTIVE    // EKF when the model is close to linear, UNSCENTED otherwise
+  };
+
+  /**
+   * UpdateMethodName lower case name of a method, as ParseUpdateMethod
+   * reads it
+   */
+  static const char *UpdateMethodName(UpdateMethod method);
+
+  /**
+   * ParseUpdateMethod reads unscented, ekf, converted or adaptive
+   * @return false if name is none of them
+   */
+  static bool ParseUpdateMethod(const std::string &name, UpdateMethod &method);
+
   /**
    * Constructor
    */
@@ -20,7 +46,34 @@ class UKF {
    * ProcessMeasurement
    * @param meas_package The latest measurement data of either radar or laser
    */
-  void ProcessMeasurement(MeasurementPackage meas_package);
+  virtual void ProcessMeasurement(MeasurementPackage meas_package);
+
+  /**
+   * ProcessStacked predicts once to the time of the measurements and applies
+   * them all in one update. The measurements share a timestamp and may come
+   * from any number of mounted lidars and radars; an uninitialized filter
+   * starts from the first. The event trigger and the initialization window
+   * apply to single measurements only and are bypassed.
+   * @param measurements Measurements of this track at k+1
+   */
+  void ProcessStacked(const std::vector<MountedMeasurement> &measurements);
+
+  /**
+   * State returns x_
+   */
+  virtual Eigen::VectorXd State() const { return x_; }
+
+  /**
+   * Covariance returns P_
+   */
+  virtual Eigen::MatrixXd Covariance() const { return P_; }
+
+  /**
+   * Update applies a measurement taken at the current filter time with the
+   * update matching its sensor
+   * @param meas_package The measurement at k+1
+   */
+  void Update(const MeasurementPackage &meas_package);
 
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
@@ -48,18 +101,89 @@ class UKF {
    */
   void PredictMeanAndCovariance(void);
 
+  /**
+   * PredictMean propagates only the state mean through the process model,
+   * leaving the filter untouched. Cheap stand-in for Prediction when a track
+   * is coasting and only its estimate is needed.
+   * @param delta_t Time between the filter state and the estimate in s
+   * @return Predicted state vector
+   */
+  Eigen::VectorXd PredictMean(double delta_t) const;
+
   /**
    * Updates the state and the state covariance matrix using a laser measurement
    * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances, 1/n for an
+   *   average of n measurements
    */
-  void UpdateLidar(MeasurementPackage meas_package);
+  void UpdateLidar(MeasurementPackage meas_package, double noise_scale = 1);
 
   /**
    * Updates the state and the state covariance matrix using a radar measurement
    * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances, see
+   *   UpdateLidar
+   */
+  void UpdateRadar(MeasurementPackage meas_package, double noise_scale = 1);
+
+  /**
+   * UpdateStacked stacks the measurements from first on into one vector,
+   * transforms the predicted sigma points into it once, each through the
+   * model and the mount of its sensor, and solves the innovation covariance
+   * once for the gain. Sets nis_ over the whole stack.
+   * @param measurements Measurements at k+1
+   * @param first Index of the first measurement to apply
    */
-  void UpdateRadar(MeasurementPackage meas_package);
+  void UpdateStacked(const std::vector<MountedMeasurement> &measurements, size_t first);
 
+  /**
+   * UpdateRadarUnscented radar update through the predicted sigma points
+   * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances
+   */
+  void UpdateRadarUnscented(const MeasurementPackage &meas_package, double noise_scale);
+
+  /**
+   * UpdateRadarEKF radar update linearized at the predicted mean
+   * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances
+   */
+  void UpdateRadarEKF(const MeasurementPackage &meas_package, double noise_scale);
+
+  /**
+   * UpdateRadarConverted converts range and bearing to a debiased Cartesian
+   * position for a linear update, followed by a scalar range rate update
+   * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances
+   */
+  void UpdateRadarConverted(const MeasurementPackage &meas_package, double noise_scale);
+
+  /**
+   * RadarJacobian Jacobian of (rho, phi, rho_dot) with respect to the state
+   * @param x State the model is linearized at
+   * @return 3x5 Jacobian
+   */
+  static Eigen::MatrixXd RadarJacobian(const Eigen::VectorXd &x);
+
+  /**
+   * UpdateTriggered cheap pre-check of a measurement against the predicted
+   * state, using the linearized innovation covariance S. Sets nis_.
+   * @param meas_package The measurement at k+1
+   * @param noise_scale Factor on the configured noise variances
+   * @return false if the innovation is consistent with the prediction and
+   * the update would add little information
+   */
+  bool UpdateTriggered(const MeasurementPackage &meas_package, double noise_scale);
+
+  /**
+   * InitializeFromWindow fits position and velocity to the measurements in
+   * init_window_ by weighted least squares, with a constant velocity over
+   * the window, lidar positions, radar positions and radar range rates. It
+   * seeds the position, speed and heading of x_ and P_ at the last
+   * measurement and keeps the yaw rate the filter has estimated so far.
+   * @return false if the fit is underdetermined
+   */
+  bool InitializeFromWindow();
 
   // initially set to false, set to true in first call of ProcessMeasurement
   bool is_initialized_;
@@ -115,6 +239,51 @@ class UKF {
   // Radar measurement noise covariance matrix
   Eigen::MatrixXd Radar_R_;
 
+  // Update method used for radar measurements. The lidar model is linear,
+  // so its Kalman update is exact and has no alternatives
+  UpdateMethod radar_update_;
+
+  // ADAPTIVE uses the EKF when the position spread seen from the sensor,
+  // sqrt(P_xx + P_yy) / rho, is below this ratio
+  double adaptive_spread_;
+
+  // ADAPTIVE never linearizes targets closer than this, in m
+  double adaptive_min_range_;
+
+  // number of radar updates run with each method
+  long long radar_update_count_[3];
+
+  // if true, Update skips measurements UpdateTriggered rejects
+  bool event_trigger_;
+
+  // skip only if the NIS per measurement dimension is below this
+  double trigger_nis_;
+
+  // and the information gain 0.5 * log(det(S) / det(R)) is below this, in
+  // nats. The gain grows with P, so a coasting track is updated again
+  double trigger_gain_;
+
+  // normalized innovation squared of the last update, or of the last
+  // measurement the event trigger checked
+  double nis_;
+
+  // updates run and skipped by the event trigger
+  long long updates_run_;
+  long long updates_skipped_;
+
+  // skipped measurements are folded into this sum of their NIS, which
+  // should stay well below the skipped count times the dimension
+  double skipped_nis_sum_;
+
+  // the measurements of a new track within this many us of the first are
+  // fitted together once the window is full, so speed and heading are known
+  // long before the filter converges from zero on its own. The filter runs
+  // as usual meanwhile. 0 initializes from the first measurement only
+  long long init_window_us_;
+
+  // measurements of the initialization window so far
+  std::vector<MeasurementPackage> init_window_;
+
   // Weights of sigma points
   Eigen::VectorXd weights_;
 
@@ -0,0 +1,196 @@
+#include "ukf_smoother.h"
+#include <algorithm>
+#include <cmath>
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+namespace {
+
+// angle normalization
+double NormalizeAngle(double angle) {
+  while (angle > M_PI) angle -= 2.*M_PI;
+  while (angle < -M_PI) angle += 2.*M_PI;
+  return angle;
+}
+
+void PackVector(const VectorXd &v, double *out) {
+  for (int i = 0; i < 5; ++i) {
+    out[i] = v(i);
+  }
+}
+
+VectorXd UnpackVector(const double *in) {
+  VectorXd v(5);
+  for (int i = 0; i < 5; ++i) {
+    v(i) = in[i];
+  }
+  return v;
+}
+
+// covariances are symmetric, only the upper triangle is stored
+void PackSymmetric(const MatrixXd &m, double *out) {
+  int k = 0;
+  for (int i = 0; i < 5; ++i) {
+    for (int j = i; j < 5; ++j) {
+      out[k++] = m(i, j);
+    }
+  }
+}
+
+MatrixXd UnpackSymmetric(const double *in) {
+  MatrixXd m(5, 5);
+  int k = 0;
+  for (int i = 0; i < 5; ++i) {
+    for (int j = i; j < 5; ++j) {
+      m(i, j) = in[k];
+      m(j, i) = in[k];
+      ++k;
+    }
+  }
+  return m;
+}
+
+}  // namespace
+
+UKFSmoother::UKFSmoother() {}
+
+UKFSmoother::~UKFSmoother() {}
+
+void UKFSmoother::Forward(const std::vector<MeasurementPackage> &log, size_t begin, size_t end,
+                          std::vector<Step> &steps) const {
+  steps.resize(end - begin);
+  if (begin >= end) {
+    return;
+  }
+
+  UKF ukf = prototype_;
+  ukf.is_initialized_ = false;
+  ukf.ProcessMeasurement(log[begin]);
+  steps[0].timestamp = log[begin].timestamp_;
+  PackVector(ukf.x_, steps[0].x);
+  PackSymmetric(ukf.P_, steps[0].P);
+
+  MatrixXd Xsig_aug(ukf.n_aug_, 2 * ukf.n_aug_ + 1);
+  for (size_t k = 1; k < steps.size(); ++k) {
+    const MeasurementPackage &meas_package = log[begin + k];
+    double delta_t = (meas_package.timestamp_ - ukf.time_us_) / 1000000.0;
+    VectorXd x_prev = ukf.x_;
+
+    // the UKF prediction, keeping the sigma points of the previous step
+    ukf.GenerateSigmaPoints(Xsig_aug);
+    ukf.SigmaPointsPrediction(Xsig_aug, delta_t);
+    ukf.PredictMeanAndCovariance();
+
+    // cross-covariance between the state at k-1 and the prediction to k
+    MatrixXd D = MatrixXd::Zero(5, 5);
+    for (int i = 0; i < 2 * ukf.n_aug_ + 1; ++i) {
+      VectorXd x_diff = Xsig_aug.col(i).head(5) - x_prev;
+      x_diff(3) = NormalizeAngle(x_diff(3));
+      VectorXd x_pred_diff = ukf.Xsig_pred_.col(i) - ukf.x_;
+      x_pred_diff(3) = NormalizeAngle(x_pred_diff(3));
+      D += ukf.weights_(i) * x_diff * x_pred_diff.transpose();
+    }
+
+    Step &previous = steps[k - 1];
+    PackVector(ukf.x_, previous.x_pred);
+    PackSymmetric(ukf.P_, previous.P_pred);
+    for (int i = 0; i < 25; ++i) {
+      previous.D[i] = D(i % 5, i / 5);
+    }
+
+    ukf.time_us_ = meas_package.timestamp_;
+    ukf.Update(meas_package);
+
+    steps[k].timestamp = meas_package.timestamp_;
+    PackVector(ukf.x_, steps[k].x);
+    PackSymmetric(ukf.P_, steps[k].P);
+  }
+}
+
+void UKFSmoother::Backward(const std::vector<Step> &steps,
+                           std::vector<SmoothedState> &smoothed) const {
+  smoothed.resize(steps.size());
+  if (steps.empty()) {
+    return;
+  }
+
+  SmoothedState &last = smoothed.back();
+  last.timestamp = steps.back().timestamp;
+  last.x = UnpackVector(steps.back().x);
+  last.P = UnpackSymmetric(steps.back().P);
+
+  for (int k = (int)steps.size() - 2; k >= 0; --k) {
+    const Step &step = steps[k];
+    VectorXd x = UnpackVector(step.x);
+    MatrixXd P = UnpackSymmetric(step.P);
+    VectorXd x_pred = UnpackVector(step.x_pred);
+    MatrixXd P_pred = UnpackSymmetric(step.P_pred);
+    MatrixXd D(5, 5);
+    for (int i = 0; i < 25; ++i) {
+      D(i % 5, i / 5) = step.D[i];
+    }
+
+    // smoother gain G = D * P_pred^-1, solved through the symmetric P_pred
+    MatrixXd G = P_pred.ldlt().solve(D.transpose()).transpose();
+
+    const SmoothedState &next = smoothed[k + 1];
+    VectorXd x_diff = next.x - x_pred;
+    x_diff(3) = NormalizeAngle(x_diff(3));
+
+    SmoothedState &current = smoothed[k];
+    current.timestamp = step.timestamp;
+    current.x = x + G * x_diff;
+    current.P = P + G * (next.P - P_pred) * G.transpose();
+  }
+}
+
+std::vector<SmoothedState> UKFSmoother::Smooth(const std::vector<MeasurementPackage> &log,
+                                               std::vector<SmoothedState> *filtered) const {
+  std::vector<Step> steps;
+  Forward(log, 0, log.size(), steps);
+
+  if (filtered != nullptr) {
+    filtered->resize(steps.size());
+    for (size_t k = 0; k < steps.size(); ++k) {
+      (*filtered)[k].timestamp = steps[k].timestamp;
+      (*filtered)[k].x = UnpackVector(steps[k].x);
+      (*filtered)[k].P = UnpackSymmetric(steps[k].P);
+    }
+  }
+
+  std::vector<SmoothedState> smoothed;
+  Backward(steps, smoothed);
+  return smoothed;
+}
+
+std::vector<SmoothedState> UKFSmoother::SmoothParallel(const std::vector<MeasurementPackage> &log,
+                                                       int num_segments, int overlap,
+                                                       WorkerPool &pool) const {
+  std::vector<SmoothedState> smoothed(log.size());
+  if (log.empty()) {
+    return smoothed;
+  }
+  num_segments = std::max(1, std::min(num_segments, (int)log.size()));
+  size_t length = (log.size() + num_segments - 1) / num_segments;
+
+  pool.ParallelFor(num_segments, [&](int j) {
+    size_t core_begin = j * length;
+    size_t core_end = std::min(log.size(), core_begin + length);
+    if (core_begin >= core_end) {
+      return;
+    }
+    size_t begin = core_begin > (size_t)overlap ? core_begin - overlap : 0;
+    size_t end = std::min(log.size(), core_end + overlap);
+
+    std::vector<Step> steps;
+    Forward(log, begin, end, steps);
+    std::vector<SmoothedState> segment;
+    Backward(steps, segment);
+
+    // segments write disjoint ranges of the result
+    std::copy(segment.begin() + (core_begin - begin), segment.begin() + (core_end - begin),
+              smoothed.begin() + core_begin);
+  });
+  return smoothed;
+}
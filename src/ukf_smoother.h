@@ -0,0 +1,76 @@
+#ifndef UKF_SMOOTHER_H_
+#define UKF_SMOOTHER_H_
+
+#include <vector>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+#include "ukf.h"
+#include "worker_pool.h"
+
+// smoothed (or filtered) estimate at the time of one measurement
+struct SmoothedState {
+  long long timestamp;
+  Eigen::VectorXd x;
+  Eigen::MatrixXd P;
+};
+
+/**
+ * UKFSmoother runs an unscented Rauch-Tung-Striebel smoother over a recorded
+ * measurement log of one track. The forward pass is the regular UKF; for
+ * every step it keeps the filtered moments, the predicted moments of the
+ * next step and their cross-covariance in fixed-size storage, so a long log
+ * costs a few hundred bytes per measurement and no heap allocations.
+ */
+class UKFSmoother {
+ public:
+  UKFSmoother();
+
+  virtual ~UKFSmoother();
+
+  /**
+   * Smooth runs the forward filter and the backward pass over the whole log
+   * @param log Measurements of one track in timestamp order
+   * @param filtered If not null, receives the forward filter estimates
+   * @return Smoothed estimate at every measurement
+   */
+  std::vector<SmoothedState> Smooth(const std::vector<MeasurementPackage> &log,
+                                    std::vector<SmoothedState> *filtered = nullptr) const;
+
+  /**
+   * SmoothParallel splits the log into segments that are smoothed on the
+   * worker pool and stitched together. Every segment is extended by overlap
+   * measurements on both sides: the leading overlap lets the filter that
+   * starts cold converge, the trailing overlap carries information from the
+   * future into the segment end. Only the core of each segment is kept.
+   * @param log Measurements of one track in timestamp order
+   * @param num_segments Number of segments, usually the pool size
+   * @param overlap Measurements added on each side of a segment
+   * @param pool Worker pool the segments run on
+   */
+  std::vector<SmoothedState> SmoothParallel(const std::vector<MeasurementPackage> &log,
+                                            int num_segments, int overlap,
+                                            WorkerPool &pool) const;
+
+  // filter whose noise settings are used for every pass
+  UKF prototype_;
+
+ private:
+  // forward pass record of one measurement
+  struct Step {
+    long long timestamp;
+    // filtered mean and packed upper triangle of the filtered covariance
+    double x[5];
+    double P[15];
+    // mean, covariance and cross-covariance of the prediction to the next step
+    double x_pred[5];
+    double P_pred[15];
+    double D[25];
+  };
+
+  void Forward(const std::vector<MeasurementPackage> &log, size_t begin, size_t end,
+               std::vector<Step> &steps) const;
+
+  void Backward(const std::vector<Step> &steps, std::vector<SmoothedState> &smoothed) const;
+};
+
+#endif  // UKF_SMOOTHER_H_
@@ -0,0 +1,132 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * WorkerPool keeps a fixed set of threads alive between calls so that
+ * per-frame parallel work does not pay for thread creation every tick.
+ * ParallelFor blocks until every index has been processed; the calling
+ * thread takes part in the work as well.
+ */
+class WorkerPool {
+ public:
+  /**
+   * Constructor
+   * @param num_threads Total threads including the caller, 0 picks the
+   * hardware concurrency
+   */
+  explicit WorkerPool(int num_threads = 0)
+      : generation_(0), pending_workers_(0), count_(0), next_(0), stop_(false) {
+    if (num_threads <= 0) {
+      num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads <= 0) {
+      num_threads = 1;
+    }
+    for (int i = 1; i < num_threads; ++i) {
+      workers_.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+    }
+  }
+
+  /**
+   * Destructor joins all worker threads
+   */
+  virtual ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // number of threads taking part in ParallelFor, including the caller
+  int Size() const { return static_cast<int>(workers_.size()) + 1; }
+
+  /**
+   * ParallelFor runs fn(i) for every i in [0, count) across the pool
+   * @param count Number of work items
+   * @param fn Work item callback, must be safe to call concurrently
+   */
+  void ParallelFor(int count, const std::function<void(int)> &fn) {
+    if (count <= 0) {
+      return;
+    }
+    if (workers_.empty() || count == 1) {
+      for (int i = 0; i < count; ++i) {
+        fn(i);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &fn;
+      count_ = count;
+      next_.store(0);
+      pending_workers_ = static_cast<int>(workers_.size());
+      ++generation_;
+    }
+    start_cv_.notify_all();
+
+    RunItems(fn, count);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_workers_ == 0; });
+    task_ = nullptr;
+  }
+
+ private:
+  void RunItems(const std::function<void(int)> &fn, int count) {
+    int i;
+    while ((i = next_.fetch_add(1)) < count) {
+      fn(i);
+    }
+  }
+
+  void WorkerLoop() {
+    unsigned long long seen = 0;
+    while (true) {
+      const std::function<void(int)> *task;
+      int count;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+        task = task_;
+        count = count_;
+      }
+
+      RunItems(*task, count);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_workers_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)> *task_ = nullptr;
+  unsigned long long generation_;
+  int pending_workers_;
+  int count_;
+  std::atomic<int> next_;
+  bool stop_;
+};
+
+#endif  // WORKER_POOL_H_